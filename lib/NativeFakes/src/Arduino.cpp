@@ -0,0 +1,292 @@
+#include <Arduino.h>
+#include <lwip/tcp.h>
+#include <stdarg.h>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+static const std::chrono::steady_clock::time_point s_boot = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - s_boot).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - s_boot).count();
+}
+
+/*
+ * Either lets lwIP run its callbacks, as on the device
+ */
+void delay(unsigned long t_ms)
+{
+    fake_tcp_poll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(t_ms));
+}
+
+void yield()
+{
+    fake_tcp_poll();
+    std::this_thread::yield();
+}
+
+size_t Print::write(const uint8_t* t_buffer, size_t t_length)
+{
+    size_t written = 0;
+
+    while (t_length-- && write(*t_buffer++)) written++;
+
+    return written;
+}
+
+size_t Print::print(const __FlashStringHelper* t_text)
+{
+    return write((const char*)t_text);
+}
+
+size_t Print::print(const char* t_text)
+{
+    return write(t_text);
+}
+
+size_t Print::print(char t_char)
+{
+    return write((uint8_t)t_char);
+}
+
+size_t Print::print(unsigned char t_value, int t_base)
+{
+    return print((unsigned long long)t_value, t_base);
+}
+
+size_t Print::print(int t_value, int t_base)
+{
+    return print((long long)t_value, t_base);
+}
+
+size_t Print::print(unsigned int t_value, int t_base)
+{
+    return print((unsigned long long)t_value, t_base);
+}
+
+size_t Print::print(long t_value, int t_base)
+{
+    return print((long long)t_value, t_base);
+}
+
+size_t Print::print(unsigned long t_value, int t_base)
+{
+    return print((unsigned long long)t_value, t_base);
+}
+
+size_t Print::print(long long t_value, int t_base)
+{
+    if ((t_value < 0) && (t_base == DEC)) return print('-') + print((unsigned long long)-t_value, t_base);
+
+    return print((unsigned long long)t_value, t_base);
+}
+
+size_t Print::print(unsigned long long t_value, int t_base)
+{
+    char buffer[24];
+
+    snprintf(buffer, sizeof(buffer), (t_base == HEX) ? "%llX" : "%llu", t_value);
+
+    return write(buffer);
+}
+
+size_t Print::print(double t_value, int t_digits)
+{
+    char buffer[48];
+
+    snprintf(buffer, sizeof(buffer), "%.*f", t_digits, t_value);
+
+    return write(buffer);
+}
+
+size_t Print::print(const Printable& t_value)
+{
+    return t_value.printTo(*this);
+}
+
+size_t Print::println()
+{
+    return write("\r\n");
+}
+
+size_t Print::printf(const char* t_format, ...)
+{
+    char buffer[256];
+    va_list args;
+
+    va_start(args, t_format);
+    int length = vsnprintf(buffer, sizeof(buffer), t_format, args);
+    va_end(args);
+
+    if (length < 0) return 0;
+
+    return write((const uint8_t*)buffer, ((size_t)length < sizeof(buffer)) ? length : sizeof(buffer) - 1);
+}
+
+int Stream::read(uint8_t* t_buffer, size_t t_length)
+{
+    size_t count = 0;
+    int c;
+
+    while ((count < t_length) && ((c = read()) >= 0)) t_buffer[count++] = c;
+
+    return count;
+}
+
+int Stream::timedRead()
+{
+    unsigned long start = millis();
+
+    do
+    {
+        int c = read();
+
+        if (c >= 0) return c;
+
+        yield();
+    } while ((millis() - start) < m_timeout);
+
+    return -1;
+}
+
+size_t Stream::readBytes(uint8_t* t_buffer, size_t t_length)
+{
+    size_t count = 0;
+    int c;
+
+    while ((count < t_length) && ((c = timedRead()) >= 0)) t_buffer[count++] = c;
+
+    return count;
+}
+
+bool Stream::find(const char* t_target)
+{
+    size_t length = strlen(t_target);
+    size_t matched = 0;
+    int c;
+
+    if (!length) return true;
+
+    while ((c = timedRead()) >= 0)
+    {
+        if (c == t_target[matched])
+        {
+            if (++matched == length) return true;
+        }
+        else
+        {
+            matched = (c == t_target[0]) ? 1 : 0;
+        }
+    }
+
+    return false;
+}
+
+size_t HardwareSerial::write(uint8_t t_char)
+{
+    return fwrite(&t_char, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* t_buffer, size_t t_length)
+{
+    return fwrite(t_buffer, 1, t_length, stdout);
+}
+
+HardwareSerial Serial;
+
+static std::map<uint32_t, std::vector<uint8_t>> s_flash;
+
+static std::vector<uint8_t>& flashSector(const uint32_t t_sector)
+{
+    std::vector<uint8_t>& sector = s_flash[t_sector];
+
+    if (sector.empty()) sector.assign(SPI_FLASH_SEC_SIZE, 0xFF);
+
+    return sector;
+}
+
+void EspClass::getHeapStats(uint32_t* t_free, uint16_t* t_max_block, uint8_t* t_fragmentation)
+{
+    if (t_free) *t_free = getFreeHeap();
+    if (t_max_block) *t_max_block = 30000;
+    if (t_fragmentation) *t_fragmentation = 10;
+}
+
+bool EspClass::flashEraseSector(uint32_t t_sector)
+{
+    flashSector(t_sector).assign(SPI_FLASH_SEC_SIZE, 0xFF);
+    return true;
+}
+
+// Like NOR flash, a write can only clear bits
+bool EspClass::flashWrite(uint32_t t_address, const uint32_t* t_buffer, size_t t_length)
+{
+    const uint8_t* data = (const uint8_t*)t_buffer;
+
+    for (size_t i = 0; i < t_length; i++)
+    {
+        flashSector((t_address + i) / SPI_FLASH_SEC_SIZE)[(t_address + i) % SPI_FLASH_SEC_SIZE] &= data[i];
+    }
+
+    return true;
+}
+
+bool EspClass::flashRead(uint32_t t_address, uint32_t* t_buffer, size_t t_length)
+{
+    uint8_t* data = (uint8_t*)t_buffer;
+
+    for (size_t i = 0; i < t_length; i++)
+    {
+        data[i] = flashSector((t_address + i) / SPI_FLASH_SEC_SIZE)[(t_address + i) % SPI_FLASH_SEC_SIZE];
+    }
+
+    return true;
+}
+
+EspClass ESP;
+
+/*
+ * Allocations from new go through malloc, as they do
+ * on the device, so the counts in Heap.h include them
+ */
+void* operator new(size_t t_size)
+{
+    void* pointer = malloc(t_size ? t_size : 1);
+
+    if (!pointer) abort();
+
+    return pointer;
+}
+
+void* operator new[](size_t t_size)
+{
+    return operator new(t_size);
+}
+
+void operator delete(void* t_pointer) noexcept
+{
+    free(t_pointer);
+}
+
+void operator delete[](void* t_pointer) noexcept
+{
+    free(t_pointer);
+}
+
+void operator delete(void* t_pointer, size_t) noexcept
+{
+    free(t_pointer);
+}
+
+void operator delete[](void* t_pointer, size_t) noexcept
+{
+    free(t_pointer);
+}
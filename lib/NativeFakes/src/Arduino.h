@@ -0,0 +1,163 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+/*
+ * Host stand-in for the ESP8266 Arduino core
+ *
+ * Only what the modules built by the native
+ * environment use, behaving as the core does where
+ * it matters (e.g. Stream timeouts). Flash strings
+ * are plain strings, and the clock is the host's.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+
+// The core's Arduino.h brings these in for the
+// libraries, and the code leans on that
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <WString.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(p)        (*(const uint8_t*)(p))
+#define pgm_read_dword(p)       (*(const uint32_t*)(p))
+
+// The NodeMCU pin names, as numbered by the core
+#define D3                      0
+#define D4                      2
+
+#define DEC                     10
+#define HEX                     16
+
+typedef uint8_t byte;
+
+class __FlashStringHelper;
+#define F(s)                    (reinterpret_cast<const __FlashStringHelper*>(s))
+#define FPSTR(s)                (reinterpret_cast<const __FlashStringHelper*>(s))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void yield();
+
+class Print;
+
+class Printable
+{
+public:
+    virtual ~Printable() {};
+    virtual size_t printTo(Print&) const = 0;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {};
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t*, size_t);
+    size_t write(const char* t_text) { return t_text ? write((const uint8_t*)t_text, strlen(t_text)) : 0; }
+    size_t write(const char* t_buffer, size_t t_length) { return write((const uint8_t*)t_buffer, t_length); }
+    virtual int availableForWrite() { return 0; }
+
+    size_t print(const __FlashStringHelper*);
+    size_t print(const char*);
+    size_t print(const String& t_text) { return write(t_text.c_str(), t_text.length()); }
+    size_t print(char);
+    size_t print(unsigned char, int = DEC);
+    size_t print(int, int = DEC);
+    size_t print(unsigned int, int = DEC);
+    size_t print(long, int = DEC);
+    size_t print(unsigned long, int = DEC);
+    size_t print(long long, int = DEC);
+    size_t print(unsigned long long, int = DEC);
+    size_t print(double, int = 2);
+    size_t print(const Printable&);
+
+    template<typename T>
+    size_t println(const T& t_value) { size_t length = print(t_value); return length + println(); }
+
+    template<typename T>
+    size_t println(const T& t_value, int t_format) { size_t length = print(t_value, t_format); return length + println(); }
+
+    size_t println();
+    size_t printf(const char*, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual int read(uint8_t*, size_t);
+
+    // Bytes left before the end of the stream, -1 if that isn't known
+    virtual ssize_t streamRemaining() { return -1; }
+
+    void setTimeout(unsigned long t_timeout) { m_timeout = t_timeout; }
+    unsigned long getTimeout() const { return m_timeout; }
+
+    size_t readBytes(uint8_t*, size_t);
+    size_t readBytes(char* t_buffer, size_t t_length) { return readBytes((uint8_t*)t_buffer, t_length); }
+    bool find(const char*);
+
+protected:
+    unsigned long m_timeout = 1000;
+
+    int timedRead();
+};
+
+/*
+ * Writes go to stdout, and are never held up
+ */
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {};
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t) override;
+    size_t write(const uint8_t*, size_t) override;
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+    void flush() {};
+};
+
+extern HardwareSerial Serial;
+
+#define SPI_FLASH_SEC_SIZE      4096
+
+/*
+ * Heap figures are fixed, and flash is held in
+ * memory, one sector at a time as it's used
+ */
+class EspClass
+{
+public:
+    void reset() { abort(); }
+    void restart() { abort(); }
+    uint32_t getFreeHeap() { return 40000; }
+    void getHeapStats(uint32_t* = nullptr, uint16_t* = nullptr, uint8_t* = nullptr);
+    uint32_t getCycleCount() { return (uint32_t)micros() * 80; }
+    bool flashEraseSector(uint32_t);
+    bool flashWrite(uint32_t, const uint32_t*, size_t);
+    bool flashRead(uint32_t, uint32_t*, size_t);
+};
+
+extern EspClass ESP;
+
+#endif
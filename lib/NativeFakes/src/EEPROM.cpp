@@ -0,0 +1,3 @@
+#include <ESP_EEPROM.h>
+
+EEPROMClass EEPROM;
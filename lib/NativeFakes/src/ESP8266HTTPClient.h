@@ -0,0 +1,63 @@
+#ifndef ESP8266HTTPClient_h
+#define ESP8266HTTPClient_h
+
+#include <ESP8266WiFi.h>
+
+#define HTTP_CODE_OK                        200
+
+#define HTTPC_ERROR_CONNECTION_FAILED       (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED      (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED     (-3)
+#define HTTPC_ERROR_NOT_CONNECTED           (-4)
+#define HTTPC_ERROR_CONNECTION_LOST         (-5)
+#define HTTPC_ERROR_NO_STREAM               (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER          (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM            (-8)
+#define HTTPC_ERROR_ENCODING                (-9)
+#define HTTPC_ERROR_STREAM_WRITE            (-10)
+#define HTTPC_ERROR_READ_TIMEOUT            (-11)
+
+/*
+ * The core's HTTPClient, for plain HTTP to an IP
+ * address over the fake WiFiClient. Like the core,
+ * the request headers are built up in Strings, and
+ * a reused connection is only kept if the response
+ * allows it.
+ */
+class HTTPClient
+{
+public:
+    HTTPClient() {};
+    bool begin(WiFiClient&, const String&, uint16_t, const String& = "/", bool = false);
+    void end();
+    void setUserAgent(const String& t_user_agent) { m_user_agent = t_user_agent; }
+    void setReuse(bool t_reuse) { m_reuse = t_reuse; }
+    void setTimeout(uint16_t t_timeout) { m_timeout = t_timeout; }
+    void addHeader(const String&, const String&, bool = false, bool = true);
+    int GET();
+    int POST(const char*);
+    int POST(const String& t_payload) { return POST(t_payload.c_str()); }
+    WiFiClient& getStream() { return *m_client; }
+    int getSize() { return m_size; }
+    bool connected() { return m_client && m_client->connected(); }
+
+    static String errorToString(int);
+
+private:
+    WiFiClient* m_client = nullptr;
+    IPAddress m_ip;
+    String m_host;
+    uint16_t m_port = 80;
+    String m_uri;
+    String m_user_agent = "ESP8266HTTPClient";
+    String m_headers;
+    bool m_reuse = true;
+    bool m_can_reuse = false;
+    uint16_t m_timeout = 5000;
+    int m_size = -1;
+
+    int sendRequest(const char*, const char*, const size_t);
+    int handleHeaderResponse();
+};
+
+#endif
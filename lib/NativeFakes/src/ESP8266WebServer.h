@@ -0,0 +1,362 @@
+#ifndef ESP8266WebServer_h
+#define ESP8266WebServer_h
+
+#include <ESP8266WiFi.h>
+#include <FS.h>
+#include <string>
+#include <vector>
+
+enum HTTPMethod
+{
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+};
+
+namespace esp8266webserver
+{
+
+template<typename ServerType>
+class ESP8266WebServerTemplate;
+
+template<typename ServerType>
+class RequestHandler
+{
+public:
+    virtual ~RequestHandler() {};
+    virtual bool canHandle(HTTPMethod, const String&) { return false; }
+    virtual bool canUpload(const String&) { return false; }
+    virtual bool handle(ESP8266WebServerTemplate<ServerType>&, HTTPMethod, const String&) { return false; }
+
+    RequestHandler<ServerType>* next() { return m_next; }
+    void next(RequestHandler<ServerType>* t_next) { m_next = t_next; }
+
+private:
+    RequestHandler<ServerType>* m_next = nullptr;
+};
+
+/*
+ * The core's web server, without the socket
+ *
+ * A request handed to fakeRequest is taken by the
+ * next handleClient, of whichever server, and run
+ * through the handlers as the core would: the first
+ * that can handle the uri gets it, in the order they
+ * were added. Arguments come from the query string,
+ * decoded, and are kept in Strings like the core's.
+ * The response is kept for the test to look at,
+ * whether it was sent in one go or in chunks.
+ */
+template<typename ServerType>
+class ESP8266WebServerTemplate
+{
+public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    ~ESP8266WebServerTemplate()
+    {
+        for (RequestHandler<ServerType>* handler : m_owned) delete handler;
+        delete[] m_args;
+    }
+
+    void begin(uint16_t) {};
+
+    void on(const String& t_uri, HTTPMethod t_method, THandlerFunction t_function)
+    {
+        FunctionHandler* handler = new FunctionHandler(t_uri, t_method, t_function);
+
+        m_owned.push_back(handler);
+        addHandler(handler);
+    }
+
+    void addHandler(RequestHandler<ServerType>* t_handler)
+    {
+        if (!m_last_handler)
+        {
+            m_first_handler = t_handler;
+        }
+        else
+        {
+            m_last_handler->next(t_handler);
+        }
+
+        m_last_handler = t_handler;
+    }
+
+    void onNotFound(THandlerFunction t_function) { m_not_found = t_function; }
+
+    void handleClient()
+    {
+        if (!s_pending) return;
+
+        s_pending = false;
+        s_status = 0;
+        s_response.clear();
+        s_headers.clear();
+
+        m_method = s_method;
+        parseUri(s_uri.c_str());
+
+        RequestHandler<ServerType>* handler = m_first_handler;
+
+        while (handler && !handler->canHandle(m_method, m_uri)) handler = handler->next();
+
+        if (!handler || !handler->handle(*this, m_method, m_uri))
+        {
+            if (m_not_found)
+            {
+                m_not_found();
+            }
+            else
+            {
+                send(404, "text/plain", String("Not found: ") + m_uri.c_str());
+            }
+        }
+    }
+
+    const String& arg(const String& t_name) const
+    {
+        for (int i = 0; i < m_arg_count; i++)
+        {
+            if (m_args[i].name == t_name) return m_args[i].value;
+        }
+
+        return m_empty;
+    }
+
+    const String& arg(int t_index) const { return (t_index < m_arg_count) ? m_args[t_index].value : m_empty; }
+    const String& argName(int t_index) const { return (t_index < m_arg_count) ? m_args[t_index].name : m_empty; }
+    int args() const { return m_arg_count; }
+
+    bool hasArg(const String& t_name) const
+    {
+        for (int i = 0; i < m_arg_count; i++)
+        {
+            if (m_args[i].name == t_name) return true;
+        }
+
+        return false;
+    }
+
+    const String& uri() const { return m_uri; }
+    HTTPMethod method() const { return m_method; }
+
+    void sendHeader(const String& t_name, const String& t_value, bool = false)
+    {
+        s_headers += std::string(t_name.c_str()) + ": " + t_value.c_str() + "\r\n";
+    }
+
+    void send(int t_code, const char* t_type = nullptr, const String& t_content = String())
+    {
+        send(t_code, t_type, t_content.c_str(), t_content.length());
+    }
+
+    void send(int t_code, const __FlashStringHelper* t_type, const String& t_content = String())
+    {
+        send(t_code, reinterpret_cast<const char*>(t_type), t_content);
+    }
+
+    void send(int t_code, const char* t_type, const char* t_content)
+    {
+        send(t_code, t_type, t_content, strlen(t_content));
+    }
+
+    void send(int t_code, const __FlashStringHelper* t_type, const char* t_content)
+    {
+        send(t_code, reinterpret_cast<const char*>(t_type), t_content);
+    }
+
+    void send(int t_code, const char* t_type, const char* t_content, size_t t_length)
+    {
+        s_status = t_code;
+        s_response.assign(t_content, t_length);
+    }
+
+    void send_P(int t_code, const char* t_type, const char* t_content) { send(t_code, t_type, t_content); }
+    void send_P(int t_code, const char* t_type, const char* t_content, size_t t_length) { send(t_code, t_type, t_content, t_length); }
+
+    void setContentLength(size_t) {};
+
+    bool chunkedResponseModeStart(int t_code, const char*)
+    {
+        s_status = t_code;
+        s_response.clear();
+        return true;
+    }
+
+    bool chunkedResponseModeStart(int t_code, const __FlashStringHelper* t_type)
+    {
+        return chunkedResponseModeStart(t_code, reinterpret_cast<const char*>(t_type));
+    }
+
+    void chunkedResponseFinalize() {};
+
+    void sendContent(const String& t_content) { s_response.append(t_content.c_str(), t_content.length()); }
+    void sendContent(const char* t_content) { s_response.append(t_content); }
+    void sendContent(const char* t_content, size_t t_length) { s_response.append(t_content, t_length); }
+    void sendContent(const __FlashStringHelper* t_content) { sendContent(reinterpret_cast<const char*>(t_content)); }
+    void sendContent_P(const char* t_content) { sendContent(t_content); }
+    void sendContent_P(const char* t_content, size_t t_length) { sendContent(t_content, t_length); }
+
+    WiFiClient& client() { return m_client; }
+
+    template<typename T>
+    size_t streamFile(T& t_file, const String&, HTTPMethod = HTTP_GET)
+    {
+        char buffer[256];
+        int length;
+        size_t sent = 0;
+
+        s_status = 200;
+        s_response.clear();
+
+        while ((length = t_file.read((uint8_t*)buffer, sizeof(buffer))) > 0)
+        {
+            s_response.append(buffer, length);
+            sent += length;
+        }
+
+        return sent;
+    }
+
+    // Host only
+    static void fakeRequest(const HTTPMethod t_method, const char* t_uri)
+    {
+        s_method = t_method;
+        s_uri = t_uri;
+        s_pending = true;
+    }
+
+    static int fakeStatus() { return s_status; }
+    static const std::string& fakeResponse() { return s_response; }
+    static const std::string& fakeHeaders() { return s_headers; }
+
+private:
+    struct Argument
+    {
+        String name;
+        String value;
+    };
+
+    class FunctionHandler : public RequestHandler<ServerType>
+    {
+    public:
+        FunctionHandler(const String& t_uri, HTTPMethod t_method, THandlerFunction t_function) :
+            m_uri(t_uri),
+            m_method(t_method),
+            m_function(t_function)
+            {};
+
+        bool canHandle(HTTPMethod t_method, const String& t_uri) override
+        {
+            return ((m_method == HTTP_ANY) || (m_method == t_method)) && (t_uri == m_uri);
+        }
+
+        bool handle(ESP8266WebServerTemplate<ServerType>&, HTTPMethod t_method, const String& t_uri) override
+        {
+            if (!canHandle(t_method, t_uri)) return false;
+
+            m_function();
+            return true;
+        }
+
+    private:
+        String m_uri;
+        HTTPMethod m_method;
+        THandlerFunction m_function;
+    };
+
+    RequestHandler<ServerType>* m_first_handler = nullptr;
+    RequestHandler<ServerType>* m_last_handler = nullptr;
+    std::vector<RequestHandler<ServerType>*> m_owned;
+    THandlerFunction m_not_found;
+    WiFiClient m_client;
+    HTTPMethod m_method = HTTP_ANY;
+    String m_uri;
+    Argument* m_args = nullptr;
+    int m_arg_count = 0;
+    const String m_empty;
+
+    static inline HTTPMethod s_method = HTTP_GET;
+    static inline std::string s_uri;
+    static inline bool s_pending = false;
+    static inline int s_status = 0;
+    static inline std::string s_response;
+    static inline std::string s_headers;
+
+    /*
+     * Splits off and decodes the query, in to a new array
+     * of arguments for each request as the core does
+     */
+    void parseUri(const char* t_uri)
+    {
+        const char* query = strchr(t_uri, '?');
+
+        m_uri = query ? String(t_uri, query - t_uri) : String(t_uri);
+
+        delete[] m_args;
+        m_args = nullptr;
+        m_arg_count = 0;
+
+        if (!query || !query[1]) return;
+
+        m_arg_count = 1;
+
+        for (const char* c = query + 1; *c; c++)
+        {
+            if (*c == '&') m_arg_count++;
+        }
+
+        m_args = new Argument[m_arg_count];
+
+        const char* start = query + 1;
+
+        for (int i = 0; i < m_arg_count; i++)
+        {
+            const char* end = strchr(start, '&');
+            const char* equals = strchr(start, '=');
+
+            if (!end) end = start + strlen(start);
+            if (!equals || (equals > end)) equals = end;
+
+            m_args[i].name = urlDecode(start, equals - start);
+            m_args[i].value = (equals < end) ? urlDecode(equals + 1, end - equals - 1) : String();
+
+            start = end + 1;
+        }
+    }
+
+    static String urlDecode(const char* t_text, const size_t t_length)
+    {
+        String decoded;
+
+        for (size_t i = 0; i < t_length; i++)
+        {
+            if ((t_text[i] == '%') && ((i + 2) < t_length) && isxdigit(t_text[i + 1]) && isxdigit(t_text[i + 2]))
+            {
+                char hex[3] = { t_text[i + 1], t_text[i + 2], '\0' };
+
+                decoded += (char)strtol(hex, nullptr, 16);
+                i += 2;
+            }
+            else
+            {
+                decoded += (t_text[i] == '+') ? ' ' : t_text[i];
+            }
+        }
+
+        return decoded;
+    }
+};
+
+}
+
+using ESP8266WebServer = esp8266webserver::ESP8266WebServerTemplate<WiFiServer>;
+using RequestHandler = esp8266webserver::RequestHandler<WiFiServer>;
+
+#endif
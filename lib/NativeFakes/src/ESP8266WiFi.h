@@ -0,0 +1,92 @@
+#ifndef ESP8266WiFi_h
+#define ESP8266WiFi_h
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <string>
+
+#define FAKE_REQUEST_SIZE       4096    // Longest request a pretend speaker takes in
+
+/*
+ * Answers a request (headers and body) sent to a
+ * pretend speaker at an address and port, with the
+ * whole response, or nullptr to leave it unanswered.
+ * The response must stay put until it's been read.
+ */
+typedef const char* (*FakeResponder)(const IPAddress&, const uint16_t, const char*, const size_t);
+
+/*
+ * Connection to a pretend speaker
+ *
+ * Every connect succeeds (unless refused). Once a
+ * whole request has been written (the headers, and
+ * as much body as they give a Content-Length for) it's
+ * answered, by the responder if there is one, or
+ * with the canned response. A kept-alive connection
+ * answers the next request too. If either side asked
+ * for the connection to be closed, the speaker hangs
+ * up once its response has been read. What was sent
+ * on the latest connection is kept for checking.
+ * fakeCloseIdle has the speaker close a kept-alive
+ * connection as the next request reaches it, without
+ * answering, as one that timed it out would.
+ *
+ * With fakeUseNetwork, connections are real TCP
+ * sockets instead, e.g. to tools/sonossim.py.
+ */
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() {};
+
+    int connect(IPAddress, uint16_t);
+    uint8_t connected();
+    void stop();
+    void setNoDelay(bool) {};
+
+    int available() override;
+    int read() override;
+    int read(uint8_t*, size_t) override;
+    int peek() override;
+    size_t write(uint8_t t_char) override { return write(&t_char, 1); }
+    size_t write(const uint8_t*, size_t) override;
+    using Print::write;
+
+    // Host only
+    static void fakeRespond(const char*);
+    static void fakeServe(FakeResponder);
+    static void fakeRefuse(const bool);
+    static void fakeCloseIdle();
+    static void fakeReset();
+    static const std::string& fakeSent();
+    static uint32_t fakeConnects();
+    static void fakeUseNetwork(const bool);
+
+private:
+    bool m_open = false;
+    int m_socket = -1;                  // With fakeUseNetwork
+    IPAddress m_ip;
+    uint16_t m_port = 0;
+    char m_request[FAKE_REQUEST_SIZE];
+    size_t m_request_length = 0;
+    const char* m_response = nullptr;   // Being read
+    size_t m_response_length = 0;
+    size_t m_position = 0;
+    bool m_hang_up = false;             // Once the response has been read
+    uint32_t m_answered = 0;            // Requests answered on this connection
+
+    void answer(const size_t);
+};
+
+class WiFiServer;
+
+class WiFiClass
+{
+public:
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+    bool isConnected() { return true; }
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef ESP8266mDNS_h
+#define ESP8266mDNS_h
+
+#include <Arduino.h>
+
+/*
+ * Answers nothing, as there's no network to answer on
+ */
+class MDNSResponder
+{
+public:
+    bool begin(const char*) { return true; }
+    void addService(const char*, const char*, uint16_t) {};
+    void addService(const __FlashStringHelper*, const __FlashStringHelper*, uint16_t) {};
+    void update() {};
+};
+
+extern MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef ESP_EEPROM_h
+#define ESP_EEPROM_h
+
+#include <Arduino.h>
+
+#define EEPROM_FAKE_SIZE    4096
+
+/*
+ * Held in memory, and reads back erased (0xFF)
+ * until something is written
+ */
+class EEPROMClass
+{
+public:
+    EEPROMClass() { memset(m_data, 0xFF, sizeof(m_data)); }
+    void begin(size_t) {};
+    void end() {};
+    bool commit() { return true; }
+    bool commitReset() { return true; }
+    bool wipe() { memset(m_data, 0xFF, sizeof(m_data)); return true; }
+
+    template<typename T>
+    T& get(int t_address, T& t_value)
+    {
+        if ((t_address >= 0) && ((t_address + sizeof(T)) <= sizeof(m_data))) memcpy(&t_value, m_data + t_address, sizeof(T));
+        return t_value;
+    }
+
+    template<typename T>
+    const T& put(int t_address, const T& t_value)
+    {
+        if ((t_address >= 0) && ((t_address + sizeof(T)) <= sizeof(m_data))) memcpy(m_data + t_address, &t_value, sizeof(T));
+        return t_value;
+    }
+
+private:
+    uint8_t m_data[EEPROM_FAKE_SIZE];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,91 @@
+#include <FS.h>
+#include <map>
+
+static std::map<std::string, std::shared_ptr<std::string>> s_files;
+
+int File::read(uint8_t* t_buffer, size_t t_length)
+{
+    size_t length = available();
+
+    if (length > t_length) length = t_length;
+    if (length) memcpy(t_buffer, m_data->data() + m_position, length);
+
+    m_position += length;
+
+    return length;
+}
+
+size_t File::write(const uint8_t* t_buffer, size_t t_length)
+{
+    if (!m_data) return 0;
+
+    if (m_position > m_data->size()) m_data->resize(m_position);
+
+    m_data->replace(m_position, t_length, (const char*)t_buffer, t_length);
+    m_position += t_length;
+
+    return t_length;
+}
+
+bool File::seek(uint32_t t_offset, SeekMode t_mode)
+{
+    size_t base = (t_mode == SeekSet) ? 0 : ((t_mode == SeekCur) ? m_position : size());
+
+    m_position = base + t_offset;
+
+    return (bool)m_data;
+}
+
+bool FS::format()
+{
+    s_files.clear();
+    return true;
+}
+
+/*
+ * "r", "w" and "a", with "+" ignored
+ */
+File FS::open(const char* t_path, const char* t_mode)
+{
+    auto found = s_files.find(t_path);
+
+    if (t_mode[0] == 'r')
+    {
+        return (found == s_files.end()) ? File() : File(found->second);
+    }
+
+    if ((found == s_files.end()) || (t_mode[0] == 'w'))
+    {
+        s_files[t_path] = std::make_shared<std::string>();
+    }
+
+    File file(s_files[t_path]);
+
+    if (t_mode[0] == 'a') file.seek(0, SeekEnd);
+
+    return file;
+}
+
+bool FS::exists(const char* t_path)
+{
+    return s_files.count(t_path) > 0;
+}
+
+bool FS::remove(const char* t_path)
+{
+    return s_files.erase(t_path) > 0;
+}
+
+bool FS::rename(const char* t_from, const char* t_to)
+{
+    auto found = s_files.find(t_from);
+
+    if (found == s_files.end()) return false;
+
+    s_files[t_to] = found->second;
+    s_files.erase(found);
+
+    return true;
+}
+
+FS LittleFS;
@@ -0,0 +1,57 @@
+#ifndef FS_h
+#define FS_h
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+enum SeekMode
+{
+    SeekSet,
+    SeekCur,
+    SeekEnd
+};
+
+/*
+ * A file held in memory by the FS below
+ */
+class File : public Stream
+{
+public:
+    File() {};
+    File(std::shared_ptr<std::string> t_data) : m_data(t_data) {};
+
+    int available() override { return m_data ? (int)(m_data->size() - m_position) : 0; }
+    int read() override { return available() ? (uint8_t)(*m_data)[m_position++] : -1; }
+    int peek() override { return available() ? (uint8_t)(*m_data)[m_position] : -1; }
+    int read(uint8_t*, size_t) override;
+    size_t write(uint8_t t_char) override { return write(&t_char, 1); }
+    size_t write(const uint8_t*, size_t) override;
+    using Print::write;
+
+    bool seek(uint32_t, SeekMode = SeekSet);
+    size_t position() const { return m_position; }
+    size_t size() const { return m_data ? m_data->size() : 0; }
+    bool truncate(uint32_t t_size) { if (m_data) m_data->resize(t_size); return (bool)m_data; }
+    void flush() {};
+    void close() { m_data.reset(); m_position = 0; }
+    operator bool() const { return (bool)m_data; }
+
+private:
+    std::shared_ptr<std::string> m_data;
+    size_t m_position = 0;
+};
+
+class FS
+{
+public:
+    bool begin() { return true; }
+    void end() {};
+    bool format();
+    File open(const char*, const char*);
+    bool exists(const char*);
+    bool remove(const char*);
+    bool rename(const char*, const char*);
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include <ESP8266HTTPClient.h>
+
+bool HTTPClient::begin(WiFiClient& t_client, const String& t_host, uint16_t t_port, const String& t_uri, bool t_https)
+{
+    unsigned int a, b, c, d;
+
+    if (t_https || (sscanf(t_host.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4)) return false;
+
+    m_client = &t_client;
+    m_ip = IPAddress(a, b, c, d);
+    m_host = t_host;
+    m_port = t_port;
+    m_uri = t_uri;
+    m_headers = String();
+
+    return true;
+}
+
+void HTTPClient::end()
+{
+    if (m_client && !(m_reuse && m_can_reuse && m_client->connected())) m_client->stop();
+
+    m_headers = String();
+    m_size = -1;
+}
+
+void HTTPClient::addHeader(const String& t_name, const String& t_value, bool, bool)
+{
+    m_headers += t_name;
+    m_headers += ": ";
+    m_headers += t_value;
+    m_headers += "\r\n";
+}
+
+int HTTPClient::GET()
+{
+    return sendRequest("GET", nullptr, 0);
+}
+
+int HTTPClient::POST(const char* t_payload)
+{
+    return sendRequest("POST", t_payload, strlen(t_payload));
+}
+
+int HTTPClient::sendRequest(const char* t_type, const char* t_payload, const size_t t_payload_length)
+{
+    if (!m_client) return HTTPC_ERROR_NOT_CONNECTED;
+
+    if (!(m_can_reuse && m_client->connected()))
+    {
+        m_client->stop();
+
+        if (!m_client->connect(m_ip, m_port)) return HTTPC_ERROR_CONNECTION_FAILED;
+    }
+
+    m_client->setTimeout(m_timeout);
+
+    String header(t_type);
+
+    header += " ";
+    header += m_uri;
+    header += " HTTP/1.1\r\nHost: ";
+    header += m_host;
+    header += ":";
+    header += String((unsigned int)m_port);
+    header += "\r\nUser-Agent: ";
+    header += m_user_agent;
+    header += m_reuse ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n";
+    header += m_headers;
+
+    if (t_payload)
+    {
+        header += "Content-Length: ";
+        header += String((unsigned int)t_payload_length);
+        header += "\r\n";
+    }
+
+    header += "\r\n";
+
+    if (m_client->write((const uint8_t*)header.c_str(), header.length()) != header.length()) return HTTPC_ERROR_SEND_HEADER_FAILED;
+    if (t_payload_length && (m_client->write((const uint8_t*)t_payload, t_payload_length) != t_payload_length)) return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+
+    return handleHeaderResponse();
+}
+
+/*
+ * Reads the status line and headers, a line at a time
+ * in to a String, as the core does
+ */
+int HTTPClient::handleHeaderResponse()
+{
+    unsigned long start = millis();
+    int code = 0;
+    String line;
+
+    m_size = -1;
+    m_can_reuse = m_reuse;
+
+    while (m_client->connected() || m_client->available())
+    {
+        int c = m_client->read();
+
+        if (c < 0)
+        {
+            if ((millis() - start) >= m_timeout) return HTTPC_ERROR_READ_TIMEOUT;
+
+            yield();
+            continue;
+        }
+
+        if (c != '\n')
+        {
+            if (c != '\r') line += (char)c;
+            continue;
+        }
+
+        if (line.startsWith("HTTP/1."))
+        {
+            code = line.substring(9, 12).toInt();
+            m_can_reuse = m_reuse && (line[7] != '0');
+        }
+        else if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0)
+        {
+            m_size = atol(line.c_str() + 15);
+        }
+        else if (strncasecmp(line.c_str(), "Connection:", 11) == 0)
+        {
+            m_can_reuse = m_can_reuse && !strstr(line.c_str(), "close");
+        }
+        else if (line.isEmpty())
+        {
+            return code ? code : HTTPC_ERROR_NO_HTTP_SERVER;
+        }
+
+        line = String();
+    }
+
+    return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+String HTTPClient::errorToString(int t_error)
+{
+    switch (t_error)
+    {
+        case HTTPC_ERROR_CONNECTION_FAILED:     return F("connection failed");
+        case HTTPC_ERROR_SEND_HEADER_FAILED:    return F("send header failed");
+        case HTTPC_ERROR_SEND_PAYLOAD_FAILED:   return F("send payload failed");
+        case HTTPC_ERROR_NOT_CONNECTED:         return F("not connected");
+        case HTTPC_ERROR_CONNECTION_LOST:       return F("connection lost");
+        case HTTPC_ERROR_NO_STREAM:             return F("no stream");
+        case HTTPC_ERROR_NO_HTTP_SERVER:        return F("no HTTP server");
+        case HTTPC_ERROR_TOO_LESS_RAM:          return F("not enough ram");
+        case HTTPC_ERROR_ENCODING:              return F("Transfer-Encoding not supported");
+        case HTTPC_ERROR_STREAM_WRITE:          return F("Stream write error");
+        case HTTPC_ERROR_READ_TIMEOUT:          return F("read Timeout");
+        default:                                return String();
+    }
+}
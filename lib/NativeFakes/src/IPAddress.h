@@ -0,0 +1,33 @@
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <Arduino.h>
+
+/*
+ * IPv4 only, held in network order like the core's
+ */
+class IPAddress : public Printable
+{
+public:
+    IPAddress() {};
+    IPAddress(uint8_t t_a, uint8_t t_b, uint8_t t_c, uint8_t t_d) : m_address(t_a | (t_b << 8) | (t_c << 16) | ((uint32_t)t_d << 24)) {};
+    IPAddress(uint32_t t_address) : m_address(t_address) {};
+
+    operator uint32_t() const { return m_address; }
+    bool operator==(const IPAddress& t_other) const { return m_address == t_other.m_address; }
+    bool operator!=(const IPAddress& t_other) const { return m_address != t_other.m_address; }
+    uint8_t operator[](int t_index) const { return (m_address >> (t_index * 8)) & 0xFF; }
+    bool isSet() const { return m_address != 0; }
+    uint32_t v4() const { return m_address; }
+    String toString() const { char text[16]; snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]); return String(text); }
+
+    size_t printTo(Print& t_out) const override
+    {
+        return t_out.printf("%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    }
+
+private:
+    uint32_t m_address = 0;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include <MFRC522.h>
+#include <SPI.h>
+
+SPIClass SPI;
+
+static bool s_present = false;
+static bool s_halted = false;
+static MFRC522::Uid s_uid;
+static byte s_blocks[FAKE_CARD_BLOCKS][FAKE_CARD_BLOCK_SIZE];
+static uint32_t s_reads = 0;
+
+bool MFRC522::PICC_IsNewCardPresent()
+{
+    return s_present && !s_halted;
+}
+
+bool MFRC522::PICC_ReadCardSerial()
+{
+    if (!PICC_IsNewCardPresent()) return false;
+
+    uid = s_uid;
+
+    return true;
+}
+
+/*
+ * As the library works it out, from the SAK
+ */
+MFRC522::PICC_Type MFRC522::PICC_GetType(byte t_sak)
+{
+    switch (t_sak & 0x7F)
+    {
+        case 0x04:  return PICC_TYPE_NOT_COMPLETE;
+        case 0x09:  return PICC_TYPE_MIFARE_MINI;
+        case 0x08:  return PICC_TYPE_MIFARE_1K;
+        case 0x18:  return PICC_TYPE_MIFARE_4K;
+        case 0x00:  return PICC_TYPE_MIFARE_UL;
+        case 0x10:
+        case 0x11:  return PICC_TYPE_MIFARE_PLUS;
+        case 0x01:  return PICC_TYPE_TNP3XXX;
+        case 0x20:  return PICC_TYPE_ISO_14443_4;
+        case 0x40:  return PICC_TYPE_ISO_18092;
+        default:    return PICC_TYPE_UNKNOWN;
+    }
+}
+
+const __FlashStringHelper* MFRC522::PICC_GetTypeName(PICC_Type t_type)
+{
+    switch (t_type)
+    {
+        case PICC_TYPE_MIFARE_MINI: return F("MIFARE Mini, 320 bytes");
+        case PICC_TYPE_MIFARE_1K:   return F("MIFARE 1KB");
+        case PICC_TYPE_MIFARE_4K:   return F("MIFARE 4KB");
+        case PICC_TYPE_MIFARE_UL:   return F("MIFARE Ultralight or Ultralight C");
+        default:                    return F("Unknown type");
+    }
+}
+
+const __FlashStringHelper* MFRC522::GetStatusCodeName(StatusCode t_code)
+{
+    switch (t_code)
+    {
+        case STATUS_OK:         return F("Success.");
+        case STATUS_TIMEOUT:    return F("Timeout in communication.");
+        case STATUS_NO_ROOM:    return F("A buffer is not big enough.");
+        default:                return F("Error in communication.");
+    }
+}
+
+MFRC522::StatusCode MFRC522::PCD_Authenticate(byte, byte, MIFARE_Key*, Uid*)
+{
+    return (s_present && !s_halted) ? STATUS_OK : STATUS_TIMEOUT;
+}
+
+/*
+ * A block, and the two bytes of CRC after it
+ */
+MFRC522::StatusCode MFRC522::MIFARE_Read(byte t_block, byte* t_buffer, byte* t_size)
+{
+    if (!s_present || s_halted) return STATUS_TIMEOUT;
+    if (*t_size < (FAKE_CARD_BLOCK_SIZE + 2)) return STATUS_NO_ROOM;
+
+    memcpy(t_buffer, s_blocks[t_block], FAKE_CARD_BLOCK_SIZE);
+    t_buffer[FAKE_CARD_BLOCK_SIZE] = 0;
+    t_buffer[FAKE_CARD_BLOCK_SIZE + 1] = 0;
+    *t_size = FAKE_CARD_BLOCK_SIZE + 2;
+
+    s_reads++;
+
+    return STATUS_OK;
+}
+
+MFRC522::StatusCode MFRC522::MIFARE_Write(byte t_block, byte* t_buffer, byte t_size)
+{
+    if (!s_present || s_halted) return STATUS_TIMEOUT;
+    if (!t_buffer || (t_size > FAKE_CARD_BLOCK_SIZE)) return STATUS_INVALID;
+
+    memcpy(s_blocks[t_block], t_buffer, t_size);
+
+    return STATUS_OK;
+}
+
+MFRC522::StatusCode MFRC522::PICC_HaltA()
+{
+    s_halted = true;
+
+    return STATUS_OK;
+}
+
+/*
+ * Puts a card down on the reader (or the same one
+ * back down), new to it until it's next halted
+ */
+void MFRC522::fakePresent(const byte* t_uid, const byte t_uid_size, const byte t_sak)
+{
+    memset(&s_uid, 0, sizeof(s_uid));
+    memcpy(s_uid.uidByte, t_uid, (t_uid_size < sizeof(s_uid.uidByte)) ? t_uid_size : sizeof(s_uid.uidByte));
+    s_uid.size = t_uid_size;
+    s_uid.sak = t_sak;
+
+    s_present = true;
+    s_halted = false;
+}
+
+void MFRC522::fakeRemove()
+{
+    s_present = false;
+}
+
+/*
+ * Writes the card's memory as Rfid lays it out, in
+ * the three data blocks of each sector from
+ * t_sector on, and clears the rest of the card
+ */
+void MFRC522::fakeFill(const byte t_sector, const char* t_data, const size_t t_length)
+{
+    memset(s_blocks, 0, sizeof(s_blocks));
+
+    for (size_t i = 0; (i * FAKE_CARD_BLOCK_SIZE) < t_length; i++)
+    {
+        size_t block = ((t_sector + (i / 3)) * 4) + (i % 3);
+        size_t length = std::min<size_t>(FAKE_CARD_BLOCK_SIZE, t_length - (i * FAKE_CARD_BLOCK_SIZE));
+
+        if (block >= FAKE_CARD_BLOCKS) break;
+
+        memcpy(s_blocks[block], t_data + (i * FAKE_CARD_BLOCK_SIZE), length);
+    }
+}
+
+const byte* MFRC522::fakeBlock(const byte t_block)
+{
+    return s_blocks[t_block];
+}
+
+uint32_t MFRC522::fakeReads()
+{
+    return s_reads;
+}
@@ -0,0 +1,93 @@
+#ifndef MFRC522_h
+#define MFRC522_h
+
+#include <Arduino.h>
+
+#define FAKE_CARD_BLOCKS        256     // A MIFARE Classic 4K, and all a block number can reach
+#define FAKE_CARD_BLOCK_SIZE    16
+
+/*
+ * Reader with one pretend card in front of it
+ *
+ * The card is put down with fakePresent, and is then
+ * new to the reader until it's halted, as a real card
+ * left on the reader would be. Its memory is shared
+ * by every reader, so a test needn't get at the one
+ * inside the code under test. Any key authenticates.
+ */
+class MFRC522
+{
+public:
+    enum StatusCode : byte
+    {
+        STATUS_OK,
+        STATUS_ERROR,
+        STATUS_COLLISION,
+        STATUS_TIMEOUT,
+        STATUS_NO_ROOM,
+        STATUS_INTERNAL_ERROR,
+        STATUS_INVALID,
+        STATUS_CRC_WRONG,
+        STATUS_MIFARE_NACK = 0xff
+    };
+
+    enum PICC_Type : byte
+    {
+        PICC_TYPE_UNKNOWN,
+        PICC_TYPE_ISO_14443_4,
+        PICC_TYPE_ISO_18092,
+        PICC_TYPE_MIFARE_MINI,
+        PICC_TYPE_MIFARE_1K,
+        PICC_TYPE_MIFARE_4K,
+        PICC_TYPE_MIFARE_UL,
+        PICC_TYPE_MIFARE_PLUS,
+        PICC_TYPE_MIFARE_DESFIRE,
+        PICC_TYPE_TNP3XXX,
+        PICC_TYPE_NOT_COMPLETE = 0xff
+    };
+
+    enum PICC_Command : byte
+    {
+        PICC_CMD_MF_AUTH_KEY_A = 0x60,
+        PICC_CMD_MF_AUTH_KEY_B = 0x61
+    };
+
+    static constexpr byte MF_KEY_SIZE = 6;
+
+    typedef struct
+    {
+        byte size;
+        byte uidByte[10];
+        byte sak;
+    } Uid;
+
+    typedef struct
+    {
+        byte keyByte[MF_KEY_SIZE];
+    } MIFARE_Key;
+
+    Uid uid;
+
+    MFRC522(byte, byte) {};
+    void PCD_Init() {};
+    void PCD_DumpVersionToSerial() {};
+    bool PICC_IsNewCardPresent();
+    bool PICC_ReadCardSerial();
+    static PICC_Type PICC_GetType(byte);
+    static const __FlashStringHelper* PICC_GetTypeName(PICC_Type);
+    static const __FlashStringHelper* GetStatusCodeName(StatusCode);
+    StatusCode PCD_Authenticate(byte, byte, MIFARE_Key*, Uid*);
+    StatusCode MIFARE_Read(byte, byte*, byte*);
+    StatusCode MIFARE_Write(byte, byte*, byte);
+    StatusCode PICC_HaltA();
+    void PCD_StopCrypto1() {};
+
+    // Host only
+    static void fakePresent(const byte*, const byte, const byte);
+    static void fakeRemove();
+    static void fakeFill(const byte, const char*, const size_t);
+    static const byte* fakeBlock(const byte);
+    static uint32_t fakeReads();
+};
+
+#endif
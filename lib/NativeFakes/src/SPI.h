@@ -0,0 +1,15 @@
+#ifndef SPI_h
+#define SPI_h
+
+/*
+ * Nothing on the bus, the reader is faked above it
+ */
+class SPIClass
+{
+public:
+    void begin() {};
+};
+
+extern SPIClass SPI;
+
+#endif
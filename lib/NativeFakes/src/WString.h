@@ -0,0 +1,58 @@
+#ifndef WString_h
+#define WString_h
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+class __FlashStringHelper;
+
+/*
+ * The core's String, over a std::string. Only what
+ * the code built for the host (and its fakes) use.
+ */
+class String
+{
+public:
+    String() {};
+    String(const char* t_text) : m_text(t_text ? t_text : "") {};
+    String(const char* t_text, size_t t_length) : m_text(t_text, t_length) {};
+    String(const __FlashStringHelper* t_text) : String(reinterpret_cast<const char*>(t_text)) {};
+    explicit String(char t_char) : m_text(1, t_char) {};
+    explicit String(int t_value) : m_text(std::to_string(t_value)) {};
+    explicit String(unsigned int t_value) : m_text(std::to_string(t_value)) {};
+    explicit String(long t_value) : m_text(std::to_string(t_value)) {};
+    explicit String(unsigned long t_value) : m_text(std::to_string(t_value)) {};
+
+    const char* c_str() const { return m_text.c_str(); }
+    unsigned int length() const { return m_text.length(); }
+    bool isEmpty() const { return m_text.empty(); }
+    bool reserve(unsigned int t_size) { m_text.reserve(t_size); return true; }
+    char operator[](unsigned int t_index) const { return (t_index < m_text.length()) ? m_text[t_index] : '\0'; }
+
+    String& operator=(const char* t_text) { m_text = t_text ? t_text : ""; return *this; }
+    bool concat(const char* t_text, unsigned int t_length) { m_text.append(t_text, t_length); return true; }
+    String& operator+=(const String& t_text) { m_text += t_text.m_text; return *this; }
+    String& operator+=(const char* t_text) { if (t_text) m_text += t_text; return *this; }
+    String& operator+=(char t_char) { m_text += t_char; return *this; }
+
+    bool equals(const char* t_text) const { return m_text == (t_text ? t_text : ""); }
+    bool operator==(const String& t_text) const { return m_text == t_text.m_text; }
+    bool operator==(const char* t_text) const { return equals(t_text); }
+    bool operator!=(const String& t_text) const { return m_text != t_text.m_text; }
+    bool operator!=(const char* t_text) const { return !equals(t_text); }
+    bool startsWith(const char* t_text) const { return m_text.compare(0, strlen(t_text), t_text) == 0; }
+    int indexOf(char t_char, unsigned int t_from = 0) const { size_t found = m_text.find(t_char, t_from); return (found == std::string::npos) ? -1 : (int)found; }
+    String substring(unsigned int t_from) const { return (t_from < m_text.length()) ? String(m_text.c_str() + t_from) : String(); }
+    String substring(unsigned int t_from, unsigned int t_to) const { return (t_from < t_to) && (t_from < m_text.length()) ? String(m_text.c_str() + t_from, std::min<size_t>(t_to, m_text.length()) - t_from) : String(); }
+    long toInt() const { return atol(m_text.c_str()); }
+
+private:
+    std::string m_text;
+};
+
+inline String operator+(String t_left, const char* t_right) { t_left += t_right; return t_left; }
+inline String operator+(String t_left, const String& t_right) { t_left += t_right; return t_left; }
+
+#endif
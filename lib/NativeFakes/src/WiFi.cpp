@@ -0,0 +1,269 @@
+#include <ESP8266WiFi.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::string s_response;
+static FakeResponder s_responder = nullptr;
+static std::string s_sent;
+static bool s_refuse = false;
+static bool s_close_idle = false;
+static uint32_t s_connects = 0;
+static bool s_network = false;
+
+/*
+ * Case-insensitive search of the first t_length
+ * bytes, which needn't be NUL terminated
+ */
+static const char* findHeader(const char* t_text, const size_t t_length, const char* t_name)
+{
+    size_t name_length = strlen(t_name);
+
+    for (size_t i = 0; (i + name_length) <= t_length; i++)
+    {
+        if (strncasecmp(t_text + i, t_name, name_length) == 0) return t_text + i + name_length;
+    }
+
+    return nullptr;
+}
+
+/*
+ * Blocking, as the core's connect is, reads and
+ * peeks are made without waiting
+ */
+static int connectSocket(const IPAddress& t_ip, const uint16_t t_port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    struct sockaddr_in address = {};
+
+    if (fd < 0) return -1;
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(t_port);
+    address.sin_addr.s_addr = (uint32_t)t_ip;
+
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    return fd;
+}
+
+int WiFiClient::connect(IPAddress t_ip, uint16_t t_port)
+{
+    if (s_refuse) return 0;
+
+    if (s_network)
+    {
+        stop();
+
+        if ((m_socket = connectSocket(t_ip, t_port)) < 0) return 0;
+    }
+
+    s_connects++;
+    s_sent.clear();
+    m_open = true;
+    m_ip = t_ip;
+    m_port = t_port;
+    m_request_length = 0;
+    m_response = nullptr;
+    m_hang_up = false;
+    m_answered = 0;
+
+    return 1;
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (m_socket >= 0)
+    {
+        char c;
+        ssize_t received = recv(m_socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+        // Closed by the other end once there's nothing left to read
+        return (received > 0) || ((received < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)));
+    }
+
+    // Like the core, still connected while there's something to read
+    return m_open && (!m_hang_up || available());
+}
+
+void WiFiClient::stop()
+{
+    if (m_socket >= 0) close(m_socket);
+
+    m_socket = -1;
+    m_open = false;
+    m_request_length = 0;
+    m_response = nullptr;
+}
+
+int WiFiClient::available()
+{
+    if (m_socket >= 0)
+    {
+        int length = 0;
+
+        return (ioctl(m_socket, FIONREAD, &length) == 0) ? length : 0;
+    }
+
+    return (m_open && m_response) ? (int)(m_response_length - m_position) : 0;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+
+    if (m_socket >= 0) return (recv(m_socket, &c, 1, MSG_DONTWAIT) == 1) ? c : -1;
+
+    if (!available()) return -1;
+
+    return (uint8_t)m_response[m_position++];
+}
+
+int WiFiClient::read(uint8_t* t_buffer, size_t t_length)
+{
+    if (m_socket >= 0)
+    {
+        ssize_t received = recv(m_socket, t_buffer, t_length, MSG_DONTWAIT);
+
+        return (received > 0) ? received : 0;
+    }
+
+    size_t length = available();
+
+    if (length > t_length) length = t_length;
+
+    memcpy(t_buffer, m_response + m_position, length);
+    m_position += length;
+
+    return length;
+}
+
+int WiFiClient::peek()
+{
+    uint8_t c;
+
+    if (m_socket >= 0) return (recv(m_socket, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1) ? c : -1;
+
+    return available() ? (uint8_t)m_response[m_position] : -1;
+}
+
+size_t WiFiClient::write(const uint8_t* t_buffer, size_t t_length)
+{
+    if (!m_open || m_hang_up) return 0;
+
+    s_sent.append((const char*)t_buffer, t_length);
+
+    if (m_socket >= 0)
+    {
+        ssize_t sent = send(m_socket, t_buffer, t_length, MSG_NOSIGNAL);
+
+        return (sent > 0) ? sent : 0;
+    }
+
+    size_t length = std::min(t_length, sizeof(m_request) - m_request_length);
+
+    memcpy(m_request + m_request_length, t_buffer, length);
+    m_request_length += length;
+
+    // Answered once the headers, and any body they promise, are in
+    const char* end = findHeader(m_request, m_request_length, "\r\n\r\n");
+
+    if (!end) return t_length;
+
+    const char* content_length = findHeader(m_request, end - m_request, "\r\nContent-Length:");
+    size_t request_length = (end - m_request) + (content_length ? atol(content_length) : 0);
+
+    if (m_request_length >= request_length) answer(request_length);
+
+    return t_length;
+}
+
+/*
+ * Answers the request at the start of m_request, and
+ * drops it
+ */
+void WiFiClient::answer(const size_t t_request_length)
+{
+    if (s_close_idle && m_answered)
+    {
+        s_close_idle = false;
+        m_response = nullptr;
+        m_response_length = 0;
+        m_request_length = 0;
+        m_hang_up = true;
+        return;
+    }
+
+    m_response = s_responder ? s_responder(m_ip, m_port, m_request, t_request_length) : s_response.c_str();
+    m_response_length = m_response ? strlen(m_response) : 0;
+    m_position = 0;
+    m_answered++;
+
+    const char* request_end = findHeader(m_request, t_request_length, "\r\n\r\n");
+    const char* response_end = m_response ? findHeader(m_response, m_response_length, "\r\n\r\n") : nullptr;
+    const char* request_connection = findHeader(m_request, request_end - m_request, "\r\nConnection: close");
+    const char* response_connection = response_end ? findHeader(m_response, response_end - m_response, "\r\nConnection: close") : nullptr;
+
+    m_hang_up = m_response_length && (request_connection || response_connection);
+
+    m_request_length -= t_request_length;
+    memmove(m_request, m_request + t_request_length, m_request_length);
+}
+
+void WiFiClient::fakeRespond(const char* t_response)
+{
+    s_response = t_response;
+}
+
+void WiFiClient::fakeServe(FakeResponder t_responder)
+{
+    s_responder = t_responder;
+}
+
+void WiFiClient::fakeRefuse(const bool t_refuse)
+{
+    s_refuse = t_refuse;
+}
+
+void WiFiClient::fakeCloseIdle()
+{
+    s_close_idle = true;
+}
+
+void WiFiClient::fakeReset()
+{
+    s_response.clear();
+    s_responder = nullptr;
+    s_sent.clear();
+    s_refuse = false;
+    s_close_idle = false;
+    s_connects = 0;
+}
+
+const std::string& WiFiClient::fakeSent()
+{
+    return s_sent;
+}
+
+uint32_t WiFiClient::fakeConnects()
+{
+    return s_connects;
+}
+
+void WiFiClient::fakeUseNetwork(const bool t_network)
+{
+    s_network = t_network;
+}
+
+WiFiClass WiFi;
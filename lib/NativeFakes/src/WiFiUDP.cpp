@@ -0,0 +1,183 @@
+#include <WiFiUDP.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct FakePacket
+{
+    IPAddress ip;
+    uint16_t port;
+    char data[FAKE_UDP_PACKET_SIZE];
+    size_t length;
+};
+
+// Waiting to be read, oldest first
+static FakePacket s_packets[FAKE_UDP_PACKETS];
+static uint8_t s_packet_head = 0;
+static uint8_t s_packet_count = 0;
+
+static std::string s_sent;
+static IPAddress s_sent_to;
+static uint16_t s_sent_port = 0;
+static bool s_network = false;
+
+uint8_t WiFiUDP::begin(uint16_t)
+{
+    if (!s_network) return 1;
+
+    stop();
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    return m_socket >= 0;
+}
+
+void WiFiUDP::stop()
+{
+    if (m_socket >= 0) close(m_socket);
+
+    m_socket = -1;
+}
+
+int WiFiUDP::beginPacket(IPAddress t_ip, uint16_t t_port)
+{
+    s_sent.clear();
+    s_sent_to = t_ip;
+    s_sent_port = t_port;
+
+    return 1;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress t_ip, uint16_t t_port, IPAddress, int)
+{
+    return beginPacket(t_ip, t_port);
+}
+
+int WiFiUDP::endPacket()
+{
+    if (m_socket < 0) return 1;
+
+    struct sockaddr_in address = {};
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(s_sent_port);
+    address.sin_addr.s_addr = (uint32_t)s_sent_to;
+
+    return sendto(m_socket, s_sent.data(), s_sent.size(), 0, (struct sockaddr*)&address, sizeof(address)) == (ssize_t)s_sent.size();
+}
+
+/*
+ * Moves on to the next packet, returning its size,
+ * or 0 if there isn't one. Whatever is left of the
+ * last packet is dropped, as the core does.
+ */
+int WiFiUDP::parsePacket()
+{
+    m_length = 0;
+    m_position = 0;
+
+    if (m_socket >= 0)
+    {
+        struct sockaddr_in address = {};
+        socklen_t address_length = sizeof(address);
+        ssize_t received = recvfrom(m_socket, m_packet, sizeof(m_packet), MSG_DONTWAIT, (struct sockaddr*)&address, &address_length);
+
+        if (received <= 0) return 0;
+
+        m_length = received;
+        m_remote_ip = IPAddress((uint32_t)address.sin_addr.s_addr);
+        m_remote_port = ntohs(address.sin_port);
+
+        return m_length;
+    }
+
+    if (!s_packet_count) return 0;
+
+    const FakePacket& packet = s_packets[s_packet_head];
+
+    memcpy(m_packet, packet.data, packet.length);
+    m_length = packet.length;
+    m_remote_ip = packet.ip;
+    m_remote_port = packet.port;
+
+    s_packet_head = (s_packet_head + 1) % FAKE_UDP_PACKETS;
+    s_packet_count--;
+
+    return m_length;
+}
+
+int WiFiUDP::available()
+{
+    return m_length - m_position;
+}
+
+int WiFiUDP::read()
+{
+    return available() ? (uint8_t)m_packet[m_position++] : -1;
+}
+
+int WiFiUDP::read(uint8_t* t_buffer, size_t t_length)
+{
+    size_t length = std::min(t_length, (size_t)available());
+
+    memcpy(t_buffer, m_packet + m_position, length);
+    m_position += length;
+
+    return length;
+}
+
+int WiFiUDP::peek()
+{
+    return available() ? (uint8_t)m_packet[m_position] : -1;
+}
+
+size_t WiFiUDP::write(const uint8_t* t_buffer, size_t t_length)
+{
+    s_sent.append((const char*)t_buffer, t_length);
+
+    return t_length;
+}
+
+/*
+ * Queues a packet from t_ip, to be picked up by the
+ * next parsePacket. Returns false (and drops it) if
+ * the queue is full or it's too big for one frame.
+ */
+bool WiFiUDP::fakeReceive(const IPAddress& t_ip, const uint16_t t_port, const char* t_data, const size_t t_length)
+{
+    if ((s_packet_count == FAKE_UDP_PACKETS) || (t_length > FAKE_UDP_PACKET_SIZE)) return false;
+
+    FakePacket& packet = s_packets[(s_packet_head + s_packet_count) % FAKE_UDP_PACKETS];
+
+    packet.ip = t_ip;
+    packet.port = t_port;
+    memcpy(packet.data, t_data, t_length);
+    packet.length = t_length;
+
+    s_packet_count++;
+
+    return true;
+}
+
+const std::string& WiFiUDP::fakeSent()
+{
+    return s_sent;
+}
+
+IPAddress WiFiUDP::fakeSentTo()
+{
+    return s_sent_to;
+}
+
+void WiFiUDP::fakeUseNetwork(const bool t_network)
+{
+    s_network = t_network;
+}
+
+void WiFiUDP::fakeReset()
+{
+    s_packet_head = 0;
+    s_packet_count = 0;
+    s_sent.clear();
+    s_sent_to = IPAddress();
+}
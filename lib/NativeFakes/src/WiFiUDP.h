@@ -0,0 +1,56 @@
+#ifndef WiFiUDP_h
+#define WiFiUDP_h
+
+#include <ESP8266WiFi.h>
+
+#define FAKE_UDP_PACKETS        16      // Held until read, more are dropped
+#define FAKE_UDP_PACKET_SIZE    1472    // Largest payload that fits an Ethernet frame
+
+/*
+ * Receives the packets handed to fakeReceive, in
+ * order, whichever socket reads them. Packets sent
+ * go nowhere, but the latest is kept for checking.
+ *
+ * With fakeUseNetwork, packets go out on a real
+ * socket and replies to it are read back. It takes
+ * any free port, as replies to a search go to
+ * wherever it came from.
+ */
+class WiFiUDP : public Stream
+{
+public:
+    uint8_t begin(uint16_t);
+    void stop();
+    int beginPacket(IPAddress, uint16_t);
+    int beginPacketMulticast(IPAddress, uint16_t, IPAddress, int = 1);
+    int endPacket();
+    int parsePacket();
+    IPAddress remoteIP() { return m_remote_ip; }
+    uint16_t remotePort() { return m_remote_port; }
+
+    int available() override;
+    int read() override;
+    int read(uint8_t*, size_t) override;
+    int read(char* t_buffer, size_t t_length) { return read((uint8_t*)t_buffer, t_length); }
+    int peek() override;
+    size_t write(uint8_t t_char) override { return write(&t_char, 1); }
+    size_t write(const uint8_t*, size_t) override;
+    using Print::write;
+
+    // Host only
+    static bool fakeReceive(const IPAddress&, const uint16_t, const char*, const size_t);
+    static const std::string& fakeSent();
+    static IPAddress fakeSentTo();
+    static void fakeReset();
+    static void fakeUseNetwork(const bool);
+
+private:
+    int m_socket = -1;                  // With fakeUseNetwork
+    IPAddress m_remote_ip;
+    uint16_t m_remote_port = 0;
+    char m_packet[FAKE_UDP_PACKET_SIZE];
+    size_t m_length = 0;
+    size_t m_position = 0;
+};
+
+#endif
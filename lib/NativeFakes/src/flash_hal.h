@@ -0,0 +1,7 @@
+#ifndef flash_hal_h
+#define flash_hal_h
+
+// Where a 4MB board's filesystem starts, the config store sits just below it
+#define FS_PHYS_ADDR        0x200000
+
+#endif
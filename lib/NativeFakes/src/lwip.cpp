@@ -0,0 +1,261 @@
+#include <ESP8266WiFi.h>
+#include <lwip/etharp.h>
+#include <lwip/netif.h>
+#include <lwip/tcp.h>
+
+static struct netif s_netif;
+
+struct netif* netif_default = &s_netif;
+
+static ip4_addr_t s_addresses[FAKE_ARP_ENTRIES];
+static struct eth_addr s_eth_addresses[FAKE_ARP_ENTRIES];
+static uint8_t s_address_count = 0;
+static uint32_t s_requests = 0;
+
+ssize_t etharp_find_addr(struct netif*, const ip4_addr_t* t_address, struct eth_addr** t_eth_address, const ip4_addr_t** t_ip_address)
+{
+    for (uint8_t i = 0; i < s_address_count; i++)
+    {
+        if (s_addresses[i].addr != t_address->addr) continue;
+
+        *t_eth_address = &s_eth_addresses[i];
+        *t_ip_address = &s_addresses[i];
+
+        return i;
+    }
+
+    return -1;
+}
+
+err_t etharp_request(struct netif* t_netif, const ip4_addr_t* t_address)
+{
+    struct eth_addr* eth_address;
+    const ip4_addr_t* ip_address;
+
+    s_requests++;
+
+    if (etharp_find_addr(t_netif, t_address, &eth_address, &ip_address) >= 0) return ERR_OK;
+
+    // The oldest entry makes way, as lwIP's does when full
+    if (s_address_count == FAKE_ARP_ENTRIES)
+    {
+        for (uint8_t i = 1; i < FAKE_ARP_ENTRIES; i++) s_addresses[i - 1] = s_addresses[i];
+
+        s_address_count--;
+    }
+
+    s_addresses[s_address_count++] = *t_address;
+
+    return ERR_OK;
+}
+
+void fake_etharp_clear()
+{
+    s_address_count = 0;
+}
+
+uint32_t fake_etharp_requests()
+{
+    return s_requests;
+}
+
+enum FakeTcpState : uint8_t
+{
+    FAKE_TCP_FREE,
+    FAKE_TCP_NEW,
+    FAKE_TCP_CONNECTING,    // Until the next poll
+    FAKE_TCP_OPEN,
+    FAKE_TCP_CLOSED         // By the other end, until closed here too
+};
+
+struct tcp_pcb
+{
+    FakeTcpState state;
+    WiFiClient client;
+    IPAddress ip;
+    uint16_t port;
+    void* arg;
+    tcp_connected_fn connected;
+    tcp_recv_fn recv;
+    tcp_err_fn err;
+};
+
+static struct tcp_pcb s_pcbs[FAKE_TCP_PCBS];
+static uint8_t s_received[FAKE_TCP_MSS];
+static bool s_polling = false;
+
+/*
+ * Hands the pcb back, and tells its owner why
+ */
+static void release(struct tcp_pcb* t_pcb, const err_t t_err)
+{
+    tcp_err_fn err = t_err ? t_pcb->err : nullptr;
+    void* arg = t_pcb->arg;
+
+    t_pcb->client.stop();
+    t_pcb->state = FAKE_TCP_FREE;
+
+    if (err) err(arg, t_err);
+}
+
+struct tcp_pcb* tcp_new()
+{
+    for (uint8_t i = 0; i < FAKE_TCP_PCBS; i++)
+    {
+        if (s_pcbs[i].state != FAKE_TCP_FREE) continue;
+
+        s_pcbs[i].state = FAKE_TCP_NEW;
+        s_pcbs[i].arg = nullptr;
+        s_pcbs[i].connected = nullptr;
+        s_pcbs[i].recv = nullptr;
+        s_pcbs[i].err = nullptr;
+
+        return &s_pcbs[i];
+    }
+
+    return nullptr;
+}
+
+void tcp_arg(struct tcp_pcb* t_pcb, void* t_arg)
+{
+    t_pcb->arg = t_arg;
+}
+
+void tcp_err(struct tcp_pcb* t_pcb, tcp_err_fn t_err)
+{
+    t_pcb->err = t_err;
+}
+
+void tcp_recv(struct tcp_pcb* t_pcb, tcp_recv_fn t_recv)
+{
+    t_pcb->recv = t_recv;
+}
+
+err_t tcp_connect(struct tcp_pcb* t_pcb, const ip_addr_t* t_address, uint16_t t_port, tcp_connected_fn t_connected)
+{
+    if (t_pcb->state != FAKE_TCP_NEW) return ERR_CLSD;
+
+    t_pcb->ip = IPAddress(t_address->addr);
+    t_pcb->port = t_port;
+    t_pcb->connected = t_connected;
+    t_pcb->state = FAKE_TCP_CONNECTING;
+
+    return ERR_OK;
+}
+
+/*
+ * Always copies, and sends straight away
+ */
+err_t tcp_write(struct tcp_pcb* t_pcb, const void* t_data, uint16_t t_length, uint8_t)
+{
+    if (t_pcb->state != FAKE_TCP_OPEN) return ERR_CLSD;
+
+    return (t_pcb->client.write((const uint8_t*)t_data, t_length) == t_length) ? ERR_OK : ERR_MEM;
+}
+
+err_t tcp_output(struct tcp_pcb*)
+{
+    return ERR_OK;
+}
+
+void tcp_recved(struct tcp_pcb*, uint16_t)
+{
+}
+
+void tcp_nagle_disable(struct tcp_pcb*)
+{
+}
+
+err_t tcp_close(struct tcp_pcb* t_pcb)
+{
+    release(t_pcb, ERR_OK);
+
+    return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb* t_pcb)
+{
+    release(t_pcb, ERR_ABRT);
+}
+
+uint8_t pbuf_free(struct pbuf*)
+{
+    return 1;
+}
+
+uint16_t pbuf_copy_partial(const struct pbuf* t_buffer, void* t_data, uint16_t t_length, uint16_t t_offset)
+{
+    if (t_offset >= t_buffer->len) return 0;
+    if (t_length > (t_buffer->len - t_offset)) t_length = t_buffer->len - t_offset;
+
+    memcpy(t_data, (const uint8_t*)t_buffer->payload + t_offset, t_length);
+
+    return t_length;
+}
+
+/*
+ * What lwIP does between the app's turns: connects
+ * made since the last poll are tried, and whatever
+ * has arrived on the open ones is handed over, or
+ * the other end closing is passed on as a null pbuf
+ */
+void fake_tcp_poll()
+{
+    // The callbacks may well yield
+    if (s_polling) return;
+
+    s_polling = true;
+
+    for (uint8_t i = 0; i < FAKE_TCP_PCBS; i++)
+    {
+        struct tcp_pcb* pcb = &s_pcbs[i];
+
+        if (pcb->state == FAKE_TCP_CONNECTING)
+        {
+            if (!pcb->client.connect(pcb->ip, pcb->port))
+            {
+                release(pcb, ERR_RST);
+                continue;
+            }
+
+            pcb->state = FAKE_TCP_OPEN;
+
+            if (pcb->connected && (pcb->connected(pcb->arg, pcb, ERR_OK) != ERR_OK)) continue;
+        }
+
+        if (pcb->state != FAKE_TCP_OPEN) continue;
+
+        if (pcb->client.available() > 0)
+        {
+            struct pbuf buffer = {};
+            int length = pcb->client.read(s_received, sizeof(s_received));
+
+            if (length <= 0) continue;
+
+            buffer.payload = s_received;
+            buffer.len = buffer.tot_len = length;
+
+            if (pcb->recv) pcb->recv(pcb->arg, pcb, &buffer, ERR_OK);
+        }
+        else if (!pcb->client.connected())
+        {
+            pcb->state = FAKE_TCP_CLOSED;
+
+            if (pcb->recv) pcb->recv(pcb->arg, pcb, nullptr, ERR_OK);
+        }
+    }
+
+    s_polling = false;
+}
+
+uint8_t fake_tcp_in_use()
+{
+    uint8_t in_use = 0;
+
+    for (uint8_t i = 0; i < FAKE_TCP_PCBS; i++)
+    {
+        if (s_pcbs[i].state != FAKE_TCP_FREE) in_use++;
+    }
+
+    return in_use;
+}
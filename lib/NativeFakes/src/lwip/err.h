@@ -0,0 +1,14 @@
+#ifndef LWIP_HDR_ERR_H
+#define LWIP_HDR_ERR_H
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+
+#define ERR_OK                  0
+#define ERR_MEM                 (-1)
+#define ERR_ABRT                (-13)
+#define ERR_RST                 (-14)
+#define ERR_CLSD                (-15)
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef LWIP_HDR_NETIF_ETHARP_H
+#define LWIP_HDR_NETIF_ETHARP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <lwip/err.h>
+#include <lwip/ip_addr.h>
+#include <lwip/netif.h>
+
+#define FAKE_ARP_ENTRIES        10      // As lwIP's ARP_TABLE_SIZE
+
+struct eth_addr
+{
+    uint8_t addr[6];
+};
+
+/*
+ * The ARP table. A request is answered straight away,
+ * so an address is cached from then on, until the
+ * table is cleared (e.g. to stand for the 5 minutes
+ * lwIP keeps entries for).
+ */
+ssize_t etharp_find_addr(struct netif*, const ip4_addr_t*, struct eth_addr**, const ip4_addr_t**);
+err_t etharp_request(struct netif*, const ip4_addr_t*);
+
+// Host only
+void fake_etharp_clear();
+uint32_t fake_etharp_requests();
+
+#endif
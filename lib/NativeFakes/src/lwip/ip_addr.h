@@ -0,0 +1,19 @@
+#ifndef LWIP_HDR_IP_ADDR_H
+#define LWIP_HDR_IP_ADDR_H
+
+#include <stdint.h>
+
+/*
+ * IPv4 only, in network order as lwIP keeps them
+ */
+typedef struct
+{
+    uint32_t addr;
+} ip4_addr_t;
+
+typedef ip4_addr_t ip_addr_t;
+
+#define ip4_addr_set_u32(a, v)      ((a)->addr = (v))
+#define ip_addr_set_ip4_u32(a, v)   ip4_addr_set_u32(a, v)
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef LWIP_HDR_NETIF_H
+#define LWIP_HDR_NETIF_H
+
+/*
+ * The one interface, which carries no packets
+ */
+struct netif
+{
+    int unused;
+};
+
+extern struct netif* netif_default;
+
+#endif
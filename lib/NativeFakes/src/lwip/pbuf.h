@@ -0,0 +1,21 @@
+#ifndef LWIP_HDR_PBUF_H
+#define LWIP_HDR_PBUF_H
+
+#include <stdint.h>
+
+/*
+ * Received data as lwIP hands it over. The fake
+ * only ever delivers a single pbuf, not a chain.
+ */
+struct pbuf
+{
+    struct pbuf* next;
+    void* payload;
+    uint16_t tot_len;
+    uint16_t len;
+};
+
+uint8_t pbuf_free(struct pbuf*);
+uint16_t pbuf_copy_partial(const struct pbuf*, void*, uint16_t, uint16_t);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef LWIP_HDR_TCP_H
+#define LWIP_HDR_TCP_H
+
+#include <lwip/err.h>
+#include <lwip/ip_addr.h>
+#include <lwip/pbuf.h>
+
+#define FAKE_TCP_PCBS           5       // As the core's MEMP_NUM_TCP_PCB
+#define FAKE_TCP_MSS            1460    // Most handed to a recv callback at once
+
+#define TCP_WRITE_FLAG_COPY     0x01
+#define TCP_WRITE_FLAG_MORE     0x02
+
+struct tcp_pcb;
+
+typedef err_t (*tcp_connected_fn)(void*, struct tcp_pcb*, err_t);
+typedef err_t (*tcp_recv_fn)(void*, struct tcp_pcb*, struct pbuf*, err_t);
+typedef void (*tcp_err_fn)(void*, err_t);
+
+/*
+ * lwIP's raw TCP API, over the fake WiFiClient (so
+ * to a pretend speaker, or with fakeUseNetwork a real
+ * one). Nothing happens until the code yields, as on
+ * the device: the connect is made, and the callbacks
+ * run, from yield() and delay().
+ */
+struct tcp_pcb* tcp_new();
+void tcp_arg(struct tcp_pcb*, void*);
+void tcp_err(struct tcp_pcb*, tcp_err_fn);
+void tcp_recv(struct tcp_pcb*, tcp_recv_fn);
+err_t tcp_connect(struct tcp_pcb*, const ip_addr_t*, uint16_t, tcp_connected_fn);
+err_t tcp_write(struct tcp_pcb*, const void*, uint16_t, uint8_t);
+err_t tcp_output(struct tcp_pcb*);
+void tcp_recved(struct tcp_pcb*, uint16_t);
+void tcp_nagle_disable(struct tcp_pcb*);
+err_t tcp_close(struct tcp_pcb*);
+void tcp_abort(struct tcp_pcb*);
+
+// Host only
+void fake_tcp_poll();
+uint8_t fake_tcp_in_use();
+
+#endif
@@ -0,0 +1,195 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "Capture.h"
+#include "Log.h"
+
+static const char* s_request_separator = "\r\n";
+static const char* s_request_action = "SOAPACTION: ";
+static const char* s_request_end = "\r\n\r\n";
+
+/**
+ * Starts a new capture, replacing any previous one
+ */
+bool CaptureClass::start()
+{
+    stop();
+
+    m_file = LittleFS.open(CAPTURE_PATH, "w");
+
+    if (!m_file) return false;
+
+    uint32_t header[2] = { s_file_magic, (uint32_t)millis() };
+
+    m_file.write((const uint8_t*)header, sizeof(header));
+    m_size = sizeof(header);
+    m_body_length = 0;
+    m_active = true;
+
+    LOG(CAPTURE_STARTED);
+
+    return true;
+}
+
+void CaptureClass::stop()
+{
+    if (!m_active) return;
+
+    flushBody();
+    m_active = false;
+    m_file.close();
+
+    LOG(CAPTURE_STOPPED, m_size);
+}
+
+void CaptureClass::record(const CaptureRecordType t_type, const IPAddress& t_ip, const void* t_data, const size_t t_length)
+{
+    if (!m_active) return;
+
+    flushBody();
+
+    const uint8_t* data = (const uint8_t*)t_data;
+    size_t remaining = t_length;
+
+    // Anything over a record's worth carries on in the next
+    do
+    {
+        size_t length = (remaining > 0xFFFF) ? 0xFFFF : remaining;
+
+        if (!reserve(length)) return;
+
+        writeHeader(t_type, t_ip, length);
+        m_file.write(data, length);
+
+        data += length;
+        remaining -= length;
+    } while (remaining);
+}
+
+/*
+ * Records a request as it would go on the wire,
+ * without the headers HTTPClient adds itself
+ */
+void CaptureClass::request(const IPAddress& t_ip, const char* t_method, const char* t_path, const char* t_action, const char* t_payload)
+{
+    if (!m_active) return;
+
+    flushBody();
+
+    size_t payload_length = t_payload ? strlen(t_payload) : 0;
+    size_t length = strlen(t_method) + 1 + strlen(t_path) + strlen(s_request_separator)
+                    + (t_action ? (strlen(s_request_action) + strlen(t_action)) : 0)
+                    + strlen(s_request_end) + payload_length;
+
+    if ((length > 0xFFFF) || !reserve(length)) return;
+
+    writeHeader(CAPTURE_HTTP_REQUEST, t_ip, length);
+
+    m_file.print(t_method);
+    m_file.print(' ');
+    m_file.print(t_path);
+    m_file.print(s_request_separator);
+
+    if (t_action)
+    {
+        m_file.print(s_request_action);
+        m_file.print(t_action);
+    }
+
+    m_file.print(s_request_end);
+    if (payload_length) m_file.write((const uint8_t*)t_payload, payload_length);
+}
+
+void CaptureClass::status(const IPAddress& t_ip, const int16_t t_status)
+{
+    record(CAPTURE_HTTP_STATUS, t_ip, &t_status, sizeof(t_status));
+}
+
+/*
+ * Body bytes are read one at a time, so they're
+ * batched up rather than each becoming a record
+ */
+void CaptureClass::body(const IPAddress& t_ip, const uint8_t t_byte)
+{
+    if (!m_active) return;
+
+    if ((m_body_length == sizeof(m_body)) || (m_body_length && (m_body_ip != t_ip))) flushBody();
+
+    m_body_ip = t_ip;
+    m_body[m_body_length++] = t_byte;
+}
+
+void CaptureClass::end(const IPAddress& t_ip)
+{
+    record(CAPTURE_HTTP_END, t_ip, nullptr, 0);
+}
+
+void CaptureClass::flushBody()
+{
+    if (!m_body_length) return;
+
+    size_t length = m_body_length;
+
+    // Cleared first, as record() flushes too
+    m_body_length = 0;
+
+    if (!reserve(length)) return;
+
+    writeHeader(CAPTURE_HTTP_BODY, m_body_ip, length);
+    m_file.write(m_body, length);
+}
+
+/*
+ * Makes sure a record fits, stopping the capture
+ * if the file is full
+ */
+bool CaptureClass::reserve(const size_t t_length)
+{
+    size_t record_length = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint32_t) + t_length;
+
+    if ((m_size + record_length) > CAPTURE_MAX_SIZE)
+    {
+        LOG(CAPTURE_FULL);
+        m_body_length = 0;
+        stop();
+        return false;
+    }
+
+    m_size += record_length;
+
+    return true;
+}
+
+void CaptureClass::writeHeader(const CaptureRecordType t_type, const IPAddress& t_ip, const size_t t_length)
+{
+    uint8_t header[11];
+    uint16_t length = t_length;
+    uint32_t now = micros();
+    uint32_t ip = (uint32_t)t_ip;
+
+    header[0] = t_type;
+    memcpy(header + 1, &length, sizeof(length));
+    memcpy(header + 3, &now, sizeof(now));
+    memcpy(header + 7, &ip, sizeof(ip));
+
+    m_file.write(header, sizeof(header));
+}
+
+int CaptureStream::read()
+{
+    int c = m_stream->read();
+
+    if (c >= 0) CAPTURE.body(m_ip, c);
+
+    return c;
+}
+
+int CaptureStream::read(uint8_t* t_buffer, size_t t_length)
+{
+    int length = m_stream->read(t_buffer, t_length);
+
+    for (int i = 0; i < length; i++) CAPTURE.body(m_ip, t_buffer[i]);
+
+    return length;
+}
+
+CaptureClass CAPTURE;
@@ -0,0 +1,105 @@
+#ifndef Capture_h
+#define Capture_h
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <FS.h>
+
+#ifdef DEBUG
+    #define DEBUG_CAPTURE(x) x
+#else
+    #define DEBUG_CAPTURE(x) do{}while(0)
+#endif
+
+#define CAPTURE_MAX_SIZE            (256 * 1024UL)  // Capture stops once the file reaches this
+#define CAPTURE_BUFFER_SIZE         256             // Response bytes batched up before going to flash
+
+static constexpr char CAPTURE_PATH[]        = "/capture.bin";
+
+/*
+ * Capture file: a header (magic, millis() at the start)
+ * then records of type, length, micros() and the remote
+ * address, all little endian, followed by the data
+ */
+enum CaptureRecordType : uint8_t
+{
+    CAPTURE_SSDP_SENT,          // Datagram sent
+    CAPTURE_SSDP_RECEIVED,      // Datagram received
+    CAPTURE_HTTP_REQUEST,       // "<method> <path>\r\n<headers>\r\n\r\n<body>"
+    CAPTURE_HTTP_STATUS,        // int16_t status, or HTTPClient error
+    CAPTURE_HTTP_BODY,          // Response bytes, in the order they were read
+    CAPTURE_HTTP_END            // Connection ended, no data
+};
+
+/*
+ * Capture of Sonos traffic
+ *
+ * While started, the Sonos transport records every
+ * SSDP datagram and HTTP exchange, with timings, to a
+ * file on LittleFS. Download it from /capture and use
+ * tools/capture.py to list it, or have the simulator
+ * replay it. Writing to flash slows requests down, so
+ * only capture when you need to.
+ */
+class CaptureClass
+{
+public:
+    CaptureClass() {};
+    bool start();
+    void stop();
+    bool isActive() { return m_active; }
+
+    void record(const CaptureRecordType, const IPAddress&, const void*, const size_t);
+    void request(const IPAddress&, const char*, const char*, const char*, const char*);
+    void status(const IPAddress&, const int16_t);
+    void body(const IPAddress&, const uint8_t);
+    void end(const IPAddress&);
+
+    static const uint32_t s_file_magic = 0x31504143; // "CAP1"
+
+private:
+    File m_file;
+    bool m_active = false;
+    uint32_t m_size = 0;
+    uint8_t m_body[CAPTURE_BUFFER_SIZE];
+    size_t m_body_length = 0;
+    IPAddress m_body_ip;
+
+    void flushBody();
+    bool reserve(const size_t);
+    void writeHeader(const CaptureRecordType, const IPAddress&, const size_t);
+};
+
+/*
+ * Reads through to another stream, capturing what's
+ * read as response body
+ */
+class CaptureStream : public Stream
+{
+public:
+    CaptureStream() {};
+
+    void attach(Stream* t_stream, const IPAddress& t_ip)
+    {
+        m_stream = t_stream;
+        m_ip = t_ip;
+        setTimeout(t_stream->getTimeout());
+    }
+
+    int available() override { return m_stream->available(); }
+    int peek() override { return m_stream->peek(); }
+    ssize_t streamRemaining() override { return m_stream->streamRemaining(); }
+    size_t write(uint8_t t_char) override { return m_stream->write(t_char); }
+    using Print::write;
+
+    int read() override;
+    int read(uint8_t*, size_t) override;
+
+private:
+    Stream* m_stream = nullptr;
+    IPAddress m_ip;
+};
+
+extern CaptureClass CAPTURE;
+
+#endif
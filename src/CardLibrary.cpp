@@ -0,0 +1,384 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "CardLibrary.h"
+#include "Utility.h"
+
+/**
+ * Mounts the filesystem and rebuilds the index
+ *
+ * Replays the append-only log from the start, so
+ * the last record written for any UID wins. Any
+ * partial record at the end of the log (power loss
+ * mid-write) is ignored and truncated away.
+ */
+bool CardLibrary::begin()
+{
+    if (!LittleFS.begin())
+    {
+        Serial.println(F("CardLibrary::begin error mounting filesystem"));
+        return false;
+    }
+
+    // A left over temp file means we lost power mid-compaction,
+    // in which case the original log is still intact
+    if (LittleFS.exists(CARD_LIBRARY_TEMP_PATH)) LittleFS.remove(CARD_LIBRARY_TEMP_PATH);
+
+    m_file = LittleFS.open(CARD_LIBRARY_PATH, LittleFS.exists(CARD_LIBRARY_PATH) ? "r+" : "w+");
+
+    if (!m_file)
+    {
+        Serial.println(F("CardLibrary::begin error opening card library"));
+        return false;
+    }
+
+    m_card_count = 0;
+    m_record_count = 0;
+
+    CardRecord record;
+    uint16_t record_count = m_file.size() / sizeof(CardRecord);
+
+    for (uint16_t i = 0; i < record_count; i++)
+    {
+        if (!readRecord(i, record) || (record.magic != s_record_magic)) break;
+
+        m_record_count = i + 1;
+
+        int32_t existing = findIndex(record.uid, record.uid_size);
+
+        if (existing >= 0)
+        {
+            m_index_record[existing] = i;
+        }
+        else if (m_card_count < CARD_LIBRARY_MAX_CARDS)
+        {
+            uint32_t hash = hashUid(record.uid, record.uid_size);
+            uint16_t position = lowerBound(hash);
+
+            memmove(&m_index_hash[position + 1], &m_index_hash[position], (m_card_count - position) * sizeof(*m_index_hash));
+            memmove(&m_index_record[position + 1], &m_index_record[position], (m_card_count - position) * sizeof(*m_index_record));
+            m_index_hash[position] = hash;
+            m_index_record[position] = i;
+            m_card_count++;
+        }
+    }
+
+    if (m_file.size() != (size_t)m_record_count * sizeof(CardRecord))
+    {
+        Serial.println(F("CardLibrary::begin dropping incomplete record"));
+        m_file.truncate(m_record_count * sizeof(CardRecord));
+    }
+
+    m_started = true;
+
+    Serial.print(F("CardLibrary::begin loaded "));Serial.print(m_card_count);Serial.println(F(" cards"));
+
+    return true;
+}
+
+/**
+ * Adds or replaces the entry for a card
+ *
+ * Appends a new record to the log and points the
+ * index at it. Older records for the same UID are
+ * left in the log until the next compaction.
+ */
+bool CardLibrary::add(const uint8_t* t_uid, const uint8_t t_uid_size, const char* t_label, const char* t_command, const uint32_t t_written, const uint8_t t_flags)
+{
+    if (!m_started || t_uid_size > CARD_LIBRARY_UID_SIZE) return false;
+
+    int32_t existing = findIndex(t_uid, t_uid_size);
+
+    if ((existing < 0) && (m_card_count >= CARD_LIBRARY_MAX_CARDS))
+    {
+        Serial.println(F("CardLibrary::add library is full"));
+        return false;
+    }
+
+    // Keep the log from growing without bound, and make sure
+    // the record number still fits in the index
+    if ((m_record_count >= (2 * CARD_LIBRARY_MAX_CARDS)) && !compact())
+    {
+        return false;
+    }
+
+    CardRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = s_record_magic;
+    record.uid_size = t_uid_size;
+    memcpy(record.uid, t_uid, t_uid_size);
+    record.flags = t_flags;
+    record.written = t_written;
+    strncpy(record.label, t_label, sizeof(record.label) - 1);
+    strncpy(record.command, t_command, sizeof(record.command) - 1);
+
+    m_file.seek(m_record_count * sizeof(CardRecord), SeekSet);
+    if (m_file.write((const uint8_t*)&record, sizeof(record)) != sizeof(record))
+    {
+        Serial.println(F("CardLibrary::add error writing record"));
+        return false;
+    }
+    m_file.flush();
+
+    if (existing >= 0)
+    {
+        m_index_record[existing] = m_record_count;
+    }
+    else
+    {
+        uint32_t hash = hashUid(t_uid, t_uid_size);
+        uint16_t position = lowerBound(hash);
+
+        memmove(&m_index_hash[position + 1], &m_index_hash[position], (m_card_count - position) * sizeof(*m_index_hash));
+        memmove(&m_index_record[position + 1], &m_index_record[position], (m_card_count - position) * sizeof(*m_index_record));
+        m_index_hash[position] = hash;
+        m_index_record[position] = m_record_count;
+        m_card_count++;
+    }
+
+    m_record_count++;
+
+    DEBUG_CARDS(Serial.print(F("CardLibrary::add stored card ["));
+                Serial.print(t_label);
+                Serial.print(F("] ["));
+                Serial.print(t_command);
+                Serial.println(F("]")));
+
+    return true;
+}
+
+bool CardLibrary::find(const uint8_t* t_uid, const uint8_t t_uid_size, CardRecord& t_record)
+{
+    int32_t position = findIndex(t_uid, t_uid_size);
+
+    return (position >= 0) && readRecord(m_index_record[position], t_record);
+}
+
+/**
+ * Resolves the command for a UID mapped card
+ *
+ * Fills the buffer with the command if the UID
+ * has been mapped, so the reader can skip reading
+ * (and authenticating) the card. Returns false for
+ * unknown cards, or cards that should be read.
+ */
+bool CardLibrary::resolve(const uint8_t* t_uid, const uint8_t t_uid_size, uint8_t* t_buffer, const uint16_t t_buffer_size)
+{
+    CardRecord record;
+
+    if (!m_started || !t_buffer_size || !find(t_uid, t_uid_size, record) || !(record.flags & CARD_FLAG_MAPPED))
+    {
+        return false;
+    }
+
+    memset(t_buffer, 0, t_buffer_size);
+    strncpy((char*)t_buffer, record.command, t_buffer_size - 1);
+
+    DEBUG_CARDS(Serial.print(F("CardLibrary::resolve mapped card ["));
+                Serial.print(record.command);
+                Serial.println(F("]")));
+
+    return true;
+}
+
+/*
+ * Gets a card by its position in the index
+ */
+bool CardLibrary::get(const uint16_t t_position, CardRecord& t_record)
+{
+    return m_started && (t_position < m_card_count) && readRecord(m_index_record[t_position], t_record);
+}
+
+/**
+ * Pages through the cards matching a query
+ *
+ * Calls the callback for up to t_limit matches
+ * after skipping t_offset matches, stopping early
+ * if the callback returns false. Matches on label
+ * or command, case insensitive; an empty query
+ * matches everything. Returns the total number of
+ * matches so the caller can page.
+ */
+uint16_t CardLibrary::search(const char* t_query, const uint16_t t_offset, const uint16_t t_limit, bool (*t_callback)(const CardRecord&, void*), void* t_context)
+{
+    if (!m_started) return 0;
+
+    CardRecord record;
+    bool emitting = true;
+
+    // Without a query the total is known, so only read the requested page
+    if (!t_query || !t_query[0])
+    {
+        for (uint16_t i = t_offset; (i < m_card_count) && (i < (uint32_t)t_offset + t_limit) && emitting; i++)
+        {
+            if (readRecord(m_index_record[i], record)) emitting = t_callback(record, t_context);
+        }
+
+        return m_card_count;
+    }
+
+    uint16_t matches = 0;
+    StriSearch query(t_query);
+
+    for (uint16_t i = 0; i < m_card_count; i++)
+    {
+        if (!readRecord(m_index_record[i], record)) continue;
+
+        if (query.find(record.label, strnlen(record.label, sizeof(record.label)))
+            || query.find(record.command, strnlen(record.command, sizeof(record.command))))
+        {
+            if (emitting && (matches >= t_offset) && (matches < (uint32_t)t_offset + t_limit))
+            {
+                emitting = t_callback(record, t_context);
+            }
+
+            matches++;
+        }
+    }
+
+    return matches;
+}
+
+uint16_t CardLibrary::getCardCount()
+{
+    return m_card_count;
+}
+
+/*
+ * Label to attach to the next card written, set
+ * by the web server ahead of the card being presented
+ */
+void CardLibrary::setPendingLabel(const char* t_label, const size_t t_length)
+{
+    size_t length = (t_length < (sizeof(m_pending_label) - 1)) ? t_length : (sizeof(m_pending_label) - 1);
+
+    memset(m_pending_label, 0, sizeof(m_pending_label));
+    memcpy(m_pending_label, t_label, length);
+}
+
+const char* CardLibrary::getPendingLabel()
+{
+    return m_pending_label;
+}
+
+void CardLibrary::clearPendingLabel()
+{
+    memset(m_pending_label, 0, sizeof(m_pending_label));
+}
+
+void CardLibrary::formatUid(const uint8_t* t_uid, const uint8_t t_uid_size, char* t_buffer, const size_t t_buffer_size)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t length = 0;
+
+    for (uint8_t i = 0; (i < t_uid_size) && ((length + 2) < t_buffer_size); i++)
+    {
+        t_buffer[length++] = hex[t_uid[i] >> 4];
+        t_buffer[length++] = hex[t_uid[i] & 0x0F];
+    }
+
+    if (t_buffer_size) t_buffer[length] = '\0';
+}
+
+uint32_t CardLibrary::hashUid(const uint8_t* t_uid, const uint8_t t_uid_size)
+{
+    // FNV-1a, seeded with the size so that a 4 byte UID
+    // can't collide with a zero padded 7 byte one
+    uint32_t hash = 2166136261UL ^ t_uid_size;
+
+    for (uint8_t i = 0; i < t_uid_size; i++)
+    {
+        hash = (hash ^ t_uid[i]) * 16777619UL;
+    }
+
+    return hash;
+}
+
+uint16_t CardLibrary::lowerBound(const uint32_t t_hash)
+{
+    uint16_t low = 0;
+    uint16_t high = m_card_count;
+
+    while (low < high)
+    {
+        uint16_t middle = low + ((high - low) / 2);
+
+        if (m_index_hash[middle] < t_hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+int32_t CardLibrary::findIndex(const uint8_t* t_uid, const uint8_t t_uid_size)
+{
+    uint32_t hash = hashUid(t_uid, t_uid_size);
+    CardRecord record;
+
+    // Walk any entries sharing the hash, confirming against the record
+    for (uint16_t i = lowerBound(hash); (i < m_card_count) && (m_index_hash[i] == hash); i++)
+    {
+        if (readRecord(m_index_record[i], record)
+            && (record.uid_size == t_uid_size)
+            && (memcmp(record.uid, t_uid, t_uid_size) == 0))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool CardLibrary::readRecord(const uint16_t t_record, CardRecord& t_record_out)
+{
+    if (!m_file.seek((uint32_t)t_record * sizeof(CardRecord), SeekSet)) return false;
+
+    return m_file.read((uint8_t*)&t_record_out, sizeof(CardRecord)) == sizeof(CardRecord);
+}
+
+/**
+ * Rewrites the log with only the live records
+ *
+ * Writes to a temp file and renames it over the
+ * log, so a power loss part way through leaves
+ * the original log untouched.
+ */
+bool CardLibrary::compact()
+{
+    Serial.println(F("CardLibrary::compact compacting card library"));
+
+    File temp = LittleFS.open(CARD_LIBRARY_TEMP_PATH, "w+");
+    if (!temp) return false;
+
+    CardRecord record;
+
+    for (uint16_t i = 0; i < m_card_count; i++)
+    {
+        if (!readRecord(m_index_record[i], record) || (temp.write((const uint8_t*)&record, sizeof(record)) != sizeof(record)))
+        {
+            temp.close();
+            LittleFS.remove(CARD_LIBRARY_TEMP_PATH);
+            Serial.println(F("CardLibrary::compact error compacting card library"));
+            return false;
+        }
+    }
+
+    temp.close();
+    m_file.close();
+
+    if (!LittleFS.rename(CARD_LIBRARY_TEMP_PATH, CARD_LIBRARY_PATH))
+    {
+        Serial.println(F("CardLibrary::compact error replacing card library"));
+        m_file = LittleFS.open(CARD_LIBRARY_PATH, "r+");
+        return false;
+    }
+
+    // Records were written out in index order
+    for (uint16_t i = 0; i < m_card_count; i++) m_index_record[i] = i;
+    m_record_count = m_card_count;
+
+    m_file = LittleFS.open(CARD_LIBRARY_PATH, "r+");
+
+    return (bool)m_file;
+}
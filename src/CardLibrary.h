@@ -0,0 +1,75 @@
+#ifndef CardLibrary_h
+#define CardLibrary_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+#ifdef DEBUG
+    #define DEBUG_CARDS(x) x
+#else
+    #define DEBUG_CARDS(x) do{}while(0)
+#endif
+
+#define CARD_LIBRARY_MAX_CARDS      1024    // 6 bytes of RAM per card for the index
+#define CARD_LIBRARY_UID_SIZE       10      // Largest (triple size) ISO 14443 UID
+#define CARD_LIBRARY_LABEL_SIZE     48
+#define CARD_LIBRARY_COMMAND_SIZE   256
+
+#define CARD_FLAG_MAPPED            0x01    // Command is resolved from the UID, the card isn't read
+
+static const char* CARD_LIBRARY_PATH        = "/cards.log";
+static const char* CARD_LIBRARY_TEMP_PATH   = "/cards.tmp";
+
+/*
+ * On-flash record. Records are fixed size so the
+ * index only needs to hold a record number, and a
+ * record can be read back with a single seek.
+ */
+struct CardRecord
+{
+    uint32_t magic;
+    uint8_t uid_size;
+    uint8_t uid[CARD_LIBRARY_UID_SIZE];
+    uint8_t flags;
+    uint32_t written;   // Seconds since epoch, 0 if the clock wasn't set
+    char label[CARD_LIBRARY_LABEL_SIZE];
+    char command[CARD_LIBRARY_COMMAND_SIZE];
+};
+
+class CardLibrary
+{
+public:
+    CardLibrary() {};
+    bool begin();
+    bool add(const uint8_t*, const uint8_t, const char*, const char*, const uint32_t, const uint8_t = 0);
+    bool find(const uint8_t*, const uint8_t, CardRecord&);
+    bool resolve(const uint8_t*, const uint8_t, uint8_t*, const uint16_t);
+    bool get(const uint16_t, CardRecord&);
+    uint16_t search(const char*, const uint16_t, const uint16_t, bool (*)(const CardRecord&, void*), void*);
+    uint16_t getCardCount();
+    void setPendingLabel(const char*, const size_t);
+    const char* getPendingLabel();
+    void clearPendingLabel();
+    static void formatUid(const uint8_t*, const uint8_t, char*, const size_t);
+
+private:
+    static const uint32_t s_record_magic = 0x31445243; // "CRD1"
+
+    // Index sorted by UID hash, kept as parallel arrays
+    // to avoid padding (6 bytes per entry rather than 8)
+    uint32_t m_index_hash[CARD_LIBRARY_MAX_CARDS];
+    uint16_t m_index_record[CARD_LIBRARY_MAX_CARDS];
+    File m_file;
+    uint16_t m_card_count = 0;
+    uint16_t m_record_count = 0;
+    bool m_started = false;
+    char m_pending_label[CARD_LIBRARY_LABEL_SIZE]{};
+
+    static uint32_t hashUid(const uint8_t*, const uint8_t);
+    uint16_t lowerBound(const uint32_t);
+    int32_t findIndex(const uint8_t*, const uint8_t);
+    bool readRecord(const uint16_t, CardRecord&);
+    bool compact();
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include <Arduino.h>
+#include "Command.h"
+#include "Log.h"
+
+#define COMMAND_SLOTS       32      // Power of two, comfortably more than COMMAND_COUNT
+#define COMMAND_HASH_SEED   4       // Change if the static_assert below ever fires
+
+#define COMMAND_SPEC(id, handler, arg, min, max, choices, flags) { COMMAND_##id, #id, sizeof(#id) - 1, arg, min, max, choices, flags, handler },
+
+static constexpr CommandSpec s_commands[] = { COMMANDS(COMMAND_SPEC) };
+
+#undef COMMAND_SPEC
+
+/*
+ * FNV-1a of the opcode, folded down to a slot
+ */
+static constexpr uint8_t commandSlot(const char* t_name, const size_t t_length)
+{
+    uint32_t hash = 2166136261UL ^ COMMAND_HASH_SEED;
+
+    for (size_t i = 0; i < t_length; i++)
+    {
+        hash = (hash ^ (uint8_t)t_name[i]) * 16777619UL;
+    }
+
+    return (hash ^ (hash >> 16)) & (COMMAND_SLOTS - 1);
+}
+
+struct CommandSlots
+{
+    int8_t command[COMMAND_SLOTS];
+    bool perfect;   // No two opcodes share a slot
+};
+
+static constexpr CommandSlots buildCommandSlots()
+{
+    CommandSlots slots = {};
+
+    slots.perfect = true;
+
+    for (uint8_t i = 0; i < COMMAND_SLOTS; i++) slots.command[i] = -1;
+
+    for (uint8_t i = 0; i < COMMAND_COUNT; i++)
+    {
+        uint8_t slot = commandSlot(s_commands[i].name, s_commands[i].name_length);
+
+        if (slots.command[slot] >= 0) slots.perfect = false;
+
+        slots.command[slot] = i;
+    }
+
+    return slots;
+}
+
+// Built by the compiler, so finding a command is one
+// hash, one lookup and one compare
+static constexpr CommandSlots s_slots = buildCommandSlots();
+
+static_assert(COMMAND_COUNT <= COMMAND_SLOTS, "More commands than hash slots");
+static_assert(s_slots.perfect, "Command opcodes collide, change COMMAND_HASH_SEED");
+
+static bool isSeparator(const char t_char)
+{
+    return (t_char == ' ') || (t_char == '\r') || (t_char == '\n') || (t_char == '\t');
+}
+
+/*
+ * Finds a command by its opcode, or nullptr
+ */
+const CommandSpec* findCommand(const char* t_name, const size_t t_length)
+{
+    int8_t index = s_slots.command[commandSlot(t_name, t_length)];
+
+    if (index < 0) return nullptr;
+
+    const CommandSpec& command = s_commands[index];
+
+    return ((command.name_length == t_length) && (memcmp(command.name, t_name, t_length) == 0)) ? &command : nullptr;
+}
+
+/*
+ * Position of a word in a space separated list, or -1
+ */
+static long findChoice(const char* t_choices, const char* t_text, const size_t t_length)
+{
+    long position = 0;
+
+    for (const char* choice = t_choices; *choice; position++)
+    {
+        size_t length = 0;
+        while (choice[length] && (choice[length] != ' ')) length++;
+
+        if ((length == t_length) && (strncasecmp(choice, t_text, t_length) == 0)) return position;
+
+        choice += length;
+        if (*choice) choice++;
+    }
+
+    return -1;
+}
+
+/**
+ * Parses a command read from a card
+ *
+ * Splits the opcode and first argument out of the
+ * buffer, and checks the argument against the
+ * command's schema. Nothing is copied or modified,
+ * the argument points in to the buffer. Returns
+ * nullptr for unknown commands or bad arguments.
+ */
+const CommandSpec* parseCommand(const char* t_data, const size_t t_size, CommandArgs& t_args)
+{
+    size_t position = 0;
+
+    // Cards are NUL padded, so the data may end before the buffer does
+    while ((position < t_size) && t_data[position] && isSeparator(t_data[position])) position++;
+
+    const char* name = t_data + position;
+    while ((position < t_size) && t_data[position] && !isSeparator(t_data[position])) position++;
+
+    const CommandSpec* command = findCommand(name, (t_data + position) - name);
+
+    if (!command)
+    {
+        DEBUG_COMMAND(Serial.println(F("parseCommand unknown command")));
+        return nullptr;
+    }
+
+    while ((position < t_size) && t_data[position] && isSeparator(t_data[position])) position++;
+
+    t_args.text = t_data + position;
+    while ((position < t_size) && t_data[position] && !isSeparator(t_data[position])) position++;
+
+    t_args.length = (t_data + position) - t_args.text;
+    t_args.value = 0;
+
+    switch (command->arg)
+    {
+        case COMMAND_ARG_NONE :
+        case COMMAND_ARG_OPTIONAL_TOKEN :
+            return command;
+
+        case COMMAND_ARG_TOKEN :
+            if (t_args.length) return command;
+            break;
+
+        case COMMAND_ARG_NUMBER :
+        {
+            bool negative = (t_args.length > 1) && (t_args.text[0] == '-');
+            size_t digits = (negative || ((t_args.length > 1) && (t_args.text[0] == '+'))) ? 1 : 0;
+            long value = 0;
+
+            for (; digits < t_args.length; digits++)
+            {
+                if ((t_args.text[digits] < '0') || (t_args.text[digits] > '9') || (value > command->max)) break;
+                value = (value * 10) + (t_args.text[digits] - '0');
+            }
+
+            if (negative) value = -value;
+
+            if (t_args.length && (digits == t_args.length) && (value >= command->min) && (value <= command->max))
+            {
+                t_args.value = value;
+                return command;
+            }
+            break;
+        }
+
+        case COMMAND_ARG_CHOICE :
+            t_args.value = findChoice(command->choices, t_args.text, t_args.length);
+            if (t_args.value >= 0) return command;
+            break;
+
+        case COMMAND_ARG_STEPS :
+        {
+            // Everything up to the end of the card, less any trailing space
+            while ((position < t_size) && t_data[position]) position++;
+            while ((position > (size_t)(t_args.text - t_data)) && isSeparator(t_data[position - 1])) position--;
+
+            t_args.length = (t_data + position) - t_args.text;
+
+            CommandStep steps[COMMAND_MACRO_MAX_STEPS];
+            t_args.value = compileMacro(t_args.text, t_args.length, steps, COMMAND_MACRO_MAX_STEPS);
+            if (t_args.value) return command;
+            break;
+        }
+    }
+
+    LOG(COMMAND_INVALID_ARGUMENT, command->name);
+
+    return nullptr;
+}
+
+/**
+ * Compiles the steps of a macro
+ *
+ * Splits the text on COMMAND_MACRO_SEPARATOR and
+ * parses each step, so the whole macro is checked
+ * before any of it runs. Steps point in to the text,
+ * like any other command arguments. Returns the
+ * number of steps, or 0 if any step is invalid, a
+ * step is itself a macro, or there are too many.
+ */
+uint8_t compileMacro(const char* t_text, const size_t t_length, CommandStep* t_steps, const uint8_t t_max_steps)
+{
+    uint8_t count = 0;
+    size_t start = 0;
+
+    while (start < t_length)
+    {
+        size_t end = start;
+        while ((end < t_length) && (t_text[end] != COMMAND_MACRO_SEPARATOR)) end++;
+
+        // Allow for a trailing separator, or an empty step
+        size_t first = start;
+        while ((first < end) && isSeparator(t_text[first])) first++;
+
+        if (first < end)
+        {
+            if (count >= t_max_steps)
+            {
+                LOG(COMMAND_TOO_MANY_STEPS);
+                return 0;
+            }
+
+            // A macro step is turned away before it's parsed, as
+            // parsing it would compile it, once per MACRO on the card
+            size_t name_end = first;
+            while ((name_end < end) && !isSeparator(t_text[name_end])) name_end++;
+
+            const CommandSpec* command = findCommand(t_text + first, name_end - first);
+            CommandStep& step = t_steps[count];
+
+            step.command = (command && (command->arg != COMMAND_ARG_STEPS)) ? parseCommand(t_text + first, end - first, step.args) : nullptr;
+
+            if (!step.command)
+            {
+                LOG(COMMAND_INVALID_STEP, count + 1);
+                return 0;
+            }
+
+            count++;
+        }
+
+        start = end + 1;
+    }
+
+    return count;
+}
@@ -0,0 +1,106 @@
+#ifndef Command_h
+#define Command_h
+
+#include <Arduino.h>
+
+#ifdef DEBUG
+    #define DEBUG_COMMAND(x) x
+#else
+    #define DEBUG_COMMAND(x) do{}while(0)
+#endif
+
+enum CommandArgType : uint8_t
+{
+    COMMAND_ARG_NONE,           // Anything after the opcode is ignored
+    COMMAND_ARG_TOKEN,          // One word, required
+    COMMAND_ARG_OPTIONAL_TOKEN,
+    COMMAND_ARG_NUMBER,         // Whole number between min and max, optionally signed
+    COMMAND_ARG_CHOICE,         // One of the space separated choices, value is its position
+    COMMAND_ARG_STEPS           // Rest of the card, COMMAND_MACRO_SEPARATOR separated commands
+};
+
+#define COMMAND_FLAG_TRANSPORT      0x01    // Only the latest matters, so a newer one supersedes it
+#define COMMAND_FLAG_IGNORES_LOCK   0x02    // Still runs while the system is locked
+
+#define COMMAND_MACRO_MAX_STEPS     8
+#define COMMAND_MACRO_SEPARATOR     ';'
+
+/*
+ * Card commands: X(id, handler, arg, min, max, choices, flags)
+ *
+ * The opcode written on the card is the id. Handlers
+ * are defined by the application (main.cpp), and
+ * return false if the command failed.
+ */
+#define COMMANDS(X) \
+    X(PLAY,     commandPlay,        COMMAND_ARG_TOKEN,          0,    0,     nullptr,            COMMAND_FLAG_TRANSPORT) \
+    X(LOCATION, commandLocation,    COMMAND_ARG_TOKEN,          0,    0,     nullptr,            0) \
+    X(STOP,     commandStop,        COMMAND_ARG_NONE,           0,    0,     nullptr,            COMMAND_FLAG_TRANSPORT) \
+    X(PAUSEALL, commandPauseAll,    COMMAND_ARG_NONE,           0,    0,     nullptr,            0) \
+    X(LOCK,     commandLock,        COMMAND_ARG_NONE,           0,    0,     nullptr,            COMMAND_FLAG_IGNORES_LOCK) \
+    X(VOLUME,   commandVolume,      COMMAND_ARG_NUMBER,         -100, 100,   nullptr,            0) \
+    X(NEXT,     commandNext,        COMMAND_ARG_NONE,           0,    0,     nullptr,            COMMAND_FLAG_TRANSPORT) \
+    X(PREV,     commandPrevious,    COMMAND_ARG_NONE,           0,    0,     nullptr,            COMMAND_FLAG_TRANSPORT) \
+    X(SHUFFLE,  commandShuffle,     COMMAND_ARG_CHOICE,         0,    0,     "OFF ON",           0) \
+    X(REPEAT,   commandRepeat,      COMMAND_ARG_CHOICE,         0,    0,     "OFF ALL ONE",      0) \
+    X(GROUP,    commandGroup,       COMMAND_ARG_OPTIONAL_TOKEN, 0,    0,     nullptr,            0) \
+    X(SLEEP,    commandSleep,       COMMAND_ARG_NUMBER,         0,    1440,  nullptr,            0) \
+    X(MACRO,    commandMacro,       COMMAND_ARG_STEPS,          0,    0,     nullptr,            0)
+
+#define COMMAND_ENUM_ID(id, handler, arg, min, max, choices, flags) COMMAND_##id,
+
+enum CommandId : uint8_t
+{
+    COMMANDS(COMMAND_ENUM_ID)
+    COMMAND_COUNT
+};
+
+#undef COMMAND_ENUM_ID
+
+/*
+ * Argument of a parsed command. The text points in to
+ * the original buffer and isn't NUL terminated, so
+ * always use the length.
+ */
+struct CommandArgs
+{
+    const char* text;
+    size_t length;
+    long value;     // For numbers and choices
+};
+
+typedef bool (*CommandHandler)(const CommandArgs&);
+
+struct CommandSpec
+{
+    CommandId id;
+    const char* name;
+    uint8_t name_length;
+    CommandArgType arg;
+    int16_t min;
+    int16_t max;
+    const char* choices;
+    uint8_t flags;
+    CommandHandler handler;
+};
+
+#define COMMAND_DECLARE_HANDLER(id, handler, arg, min, max, choices, flags) bool handler(const CommandArgs&);
+
+COMMANDS(COMMAND_DECLARE_HANDLER)
+
+#undef COMMAND_DECLARE_HANDLER
+
+/*
+ * One parsed step of a macro
+ */
+struct CommandStep
+{
+    const CommandSpec* command;
+    CommandArgs args;
+};
+
+const CommandSpec* findCommand(const char*, const size_t);
+const CommandSpec* parseCommand(const char*, const size_t, CommandArgs&);
+uint8_t compileMacro(const char*, const size_t, CommandStep*, const uint8_t);
+
+#endif
@@ -1,19 +1,65 @@
 #include <Arduino.h>
 #include <ESP_EEPROM.h>
 #include "Config.h"
+#include "Log.h"
+
+// Layout written by the ESP_EEPROM library, before the config store
+struct LegacyConfigStruct
+{
+    char last_sonos_serial[20];
+};
 
 /**
  * Call at the start, to prep for execution
  *
  * Initialisation functio that preps the
- * class before configs can be read or written.
- * Doesn't recover any saved config so should
- * be followed by a call to readConfig().
+ * class before configs can be read or written,
+ * bringing any older config up to the current
+ * schema. Doesn't recover any saved config so
+ * should be followed by a call to readConfig().
  */
 void ConfigClass::begin()
 {
-    // The library needs to know what size you need for your EEPROM variables
-    EEPROM.begin(sizeof(ConfigStruct));
+    if (!m_store.begin(&m_flash))
+    {
+        LOG(CONFIG_STORE_FAILED);
+        return;
+    }
+
+    // An empty store has never been used (version 0), and
+    // the first version of the store didn't save a version
+    uint16_t version = 0;
+
+    if (!m_store.isEmpty() && !m_store.read(CONFIG_KEY_VERSION, &version, sizeof(version)))
+    {
+        version = 1;
+    }
+
+    if (version < CONFIG_SCHEMA_VERSION)
+    {
+        migrate(version);
+    }
+    else if (version > CONFIG_SCHEMA_VERSION)
+    {
+        // Firmware has been rolled back. Fields are stored
+        // by key, so anything we know about still reads fine.
+        LOG(CONFIG_NEWER_VERSION, version);
+    }
+}
+
+/**
+ * Commits any changed config once things go quiet
+ *
+ * Changes made through set() are held until there
+ * have been none for CONFIG_COMMIT_DELAY, so a burst
+ * of changes only results in one write to flash.
+ */
+void ConfigClass::handle()
+{
+    if (m_dirty && ((millis() - m_last_change) >= CONFIG_COMMIT_DELAY))
+    {
+        commit();
+    }
 }
 
 /**
@@ -21,81 +67,193 @@ void ConfigClass::begin()
  *
  * Clears any current config that is set, and reverts
  * back to the class defaults. Immediately saves to
- * EEPROM.
+ * the config store.
  */
 void ConfigClass::clearConfig()
 {
-    // Probably not the best solution, but let's just write
-    // a blank struct over the top
-    ConfigStruct temp;
-    EEPROM.put(CONFIG_EEPROM_ADDRESS, temp);
+    stored_config = ConfigStruct();
+    writeConfig();
 }
 
 /**
- * Wipes the EEPROM of any data
+ * Wipes the config store of any data
  *
- * Atempts to clear the EEPROM of any data
- * that might be stores there. Doesn't return
- * a result, but will log an error on the
- * serial port if something fails.
+ * Atempts to erase all of the flash used by the
+ * config store. Doesn't return a result, but will
+ * log an error on the serial port if something fails.
  */
 void ConfigClass::wipeConfig()
 {
-    if (EEPROM.wipe())
+    // Record the version again, otherwise the next boot
+    // would treat the store as new and import the EEPROM
+    if (m_store.wipe() && m_store.write(CONFIG_KEY_VERSION, &CONFIG_SCHEMA_VERSION, sizeof(CONFIG_SCHEMA_VERSION)))
     {
-        DEBUG_CONFIG(Serial.println(F("ConfigClass::wipeConfig EEPROM wiped successfully")));
+        m_dirty = 0;
+        DEBUG_CONFIG(Serial.println(F("ConfigClass::wipeConfig config store wiped successfully")));
     }
     else
     {
-        Serial.println(F("ConfigClass::wipeConfig error occured while wiping EEPROM"));
+        LOG(CONFIG_WIPE_FAILED);
     }
 }
 
 /**
- * Reads any existing config from the EEPROM
+ * Reads any existing config from the config store
  *
- * Reads the EEPROM and tries to recover any
- * previously saved config variables. Best to
- * only do this at the start of your programme.
+ * Reads the config store and tries to recover any
+ * previously saved config variables. Fields that
+ * have never been saved, or were saved with a
+ * different size, keep their default values. Best
+ * to only do this at the start of your programme.
  */
 void ConfigClass::readConfig()
 {
-    // Read any old config from the EEPROM
-    EEPROM.get(CONFIG_EEPROM_ADDRESS, stored_config);
+    uint8_t value[CONFIG_STORE_MAX_VALUE];
+
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++)
+    {
+        const ConfigFieldLayout& field = CONFIG_LAYOUT[i];
+        size_t length = m_store.read(field.key, value, sizeof(value));
+
+        if (length == field.size)
+        {
+            memcpy((uint8_t*)&stored_config + field.offset, value, length);
+        }
+        else if (length)
+        {
+            LOG(CONFIG_WRONG_SIZE, field.key);
+        }
+    }
+
+    // Strings are saved whole, but don't trust the terminator
+    stored_config.last_sonos_serial[sizeof(stored_config.last_sonos_serial) - 1] = '\0';
+    stored_config.active_speaker.serial_num[sizeof(stored_config.active_speaker.serial_num) - 1] = '\0';
+    stored_config.active_speaker.location[sizeof(stored_config.active_speaker.location) - 1] = '\0';
+
+    for (ConfigVolumeCap& cap : stored_config.volume_caps)
+    {
+        cap.serial_num[sizeof(cap.serial_num) - 1] = '\0';
+    }
+
+    m_dirty = 0;
 
-    Serial.println(F("ConfigClass::readConfig successfully from EEPROM"));
+    LOG(CONFIG_READ);
 }
 
 /**
- * Writes any existing config to the EEPROM
+ * Writes any existing config to the config store
  *
- * Writes the existing config variables to the
- * EEPROM, and attempts to commit them immediately
- * to memory. Doesn't return a result, but will
- * log any error to the Serial port.
+ * Appends any config values that have changed to
+ * the config store straight away, rather than
+ * waiting for handle(). Unchanged values aren't
+ * written, and nothing is erased unless a flash
+ * sector fills up. Doesn't return a result, but
+ * will log any error to the Serial port.
  */
 void ConfigClass::writeConfig()
 {
-    // Write the data to EEPROM - ignoring
-    // anything that might be there already
-    // (re-flash is guaranteed)
-    EEPROM.commitReset();
-
-    // Replace values in byte-array cache with modified data
-    // no changes made to flash, all in local byte-array cache
-    EEPROM.put(CONFIG_EEPROM_ADDRESS, stored_config);
-    
-    // Actually write the content of byte-array cache to
-    // hardware flash. Flash write occurs if and only if one or more byte
-    // in byte-array cache has been changed, but if so, ALL bytes are 
-    // written to flash
-    if (EEPROM.commit())
-    {
-        DEBUG_CONFIG(Serial.println(F("ConfigClass::writeConfig config written successfully to EEPROM")));
+    m_dirty = (1UL << CONFIG_FIELD_COUNT) - 1;
+    commit();
+}
+
+void ConfigClass::markDirty(const size_t t_offset)
+{
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++)
+    {
+        if (CONFIG_LAYOUT[i].offset == t_offset)
+        {
+            m_dirty |= (1UL << i);
+            m_last_change = millis();
+            return;
+        }
+    }
+}
+
+/*
+ * Writes every dirty field to the config store.
+ * Fields that fail stay dirty, to be retried.
+ */
+void ConfigClass::commit()
+{
+    uint32_t failed = 0;
+
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++)
+    {
+        const ConfigFieldLayout& field = CONFIG_LAYOUT[i];
+
+        if ((m_dirty & (1UL << i)) && !m_store.write(field.key, (const uint8_t*)&stored_config + field.offset, field.size))
+        {
+            failed |= (1UL << i);
+        }
+    }
+
+    m_dirty = failed;
+    m_last_change = millis();
+
+    if (failed)
+    {
+        LOG(CONFIG_COMMIT_FAILED);
     }
     else
     {
-        Serial.println(F("ConfigClass::writeConfig error writing config to EEPROM"));
+        DEBUG_CONFIG(Serial.println(F("ConfigClass::commit config written successfully to config store")));
+    }
+}
+
+/*
+ * Brings the stored config up to the current
+ * schema, one version at a time
+ */
+void ConfigClass::migrate(uint16_t t_version)
+{
+    LOG(CONFIG_MIGRATE, t_version);
+
+    if (t_version < 1)
+    {
+        importLegacyConfig();
+        t_version = 1;
+    }
+
+    if (t_version < 2)
+    {
+        // Version 2 added fields under new keys, and
+        // last_sonos_serial is unchanged, so there's
+        // nothing to convert
+        t_version = 2;
+    }
+
+    if (!m_store.write(CONFIG_KEY_VERSION, &t_version, sizeof(t_version)))
+    {
+        LOG(CONFIG_MIGRATE_FAILED);
+    }
+}
+
+/*
+ * Copies the config saved by the ESP_EEPROM library
+ * (the whole struct in one sector) in to the
+ * config store
+ */
+void ConfigClass::importLegacyConfig()
+{
+    LegacyConfigStruct legacy;
+
+    EEPROM.begin(sizeof(LegacyConfigStruct));
+    EEPROM.get(CONFIG_EEPROM_ADDRESS, legacy);
+    EEPROM.end();
+
+    // An EEPROM that's never been written reads back as 0xFF
+    legacy.last_sonos_serial[sizeof(legacy.last_sonos_serial) - 1] = '\0';
+    for (const char* c = legacy.last_sonos_serial; *c; c++)
+    {
+        if (!isprint(*c)) return;
+    }
+
+    if (legacy.last_sonos_serial[0])
+    {
+        LOG(CONFIG_LEGACY_IMPORT, legacy.last_sonos_serial);
+
+        static_assert(sizeof(legacy.last_sonos_serial) == sizeof(ConfigStruct::last_sonos_serial), "Legacy serial must be stored as-is");
+        m_store.write(CONFIG_LAYOUT[CONFIG_FIELD_last_sonos_serial].key, legacy.last_sonos_serial, sizeof(legacy.last_sonos_serial));
     }
 }
 
@@ -1,6 +1,8 @@
 #ifndef ConfigClass_h
 #define ConfigClass_h
 
+#include "ConfigStore.h"
+
 #ifdef DEBUG
     #define DEBUG_CONFIG(x) x
 #else
@@ -18,21 +20,155 @@ static const long CONFIG_SERIAL_SPEED      = 74880; // 74880 gives us some addit
 static const char* CONFIG_WEB_NAME         = "musicbox";
 static const int CONFIG_WEB_PORT           = 80;
 
-typedef struct {
-    char last_sonos_serial[20] = "";
-} ConfigStruct;
+static const char* CONFIG_NTP_SERVER       = "pool.ntp.org";
+static const time_t CONFIG_CLOCK_VALID_AFTER = 1577836800; // 2020-01-01, anything earlier means NTP hasn't synced
+
+static const uint32_t CONFIG_COMMIT_DELAY  = 5000; // Quiet period (ms) before changes are written to flash
+
+typedef char ConfigSerial[20];
+
+// Enough about the active speaker to use it before discovery has run
+struct ConfigSpeaker
+{
+    uint32_t ip;
+    ConfigSerial serial_num;
+    char location[128];
+};
+
+// Volume limit for one speaker, overriding volume_max
+struct ConfigVolumeCap
+{
+    ConfigSerial serial_num;
+    uint8_t max;
+};
+
+#define CONFIG_VOLUME_CAPS  8
+
+typedef ConfigVolumeCap ConfigVolumeCaps[CONFIG_VOLUME_CAPS];
+
+/*
+ * Config fields: X(key, type, name, default)
+ *
+ * Each field is stored under its own key, so a key
+ * must never be reused or renumbered. If a field's
+ * type changes it needs a new key (and a migration
+ * if the old value should be carried across).
+ */
+#define CONFIG_FIELDS(X) \
+    X(1,    ConfigSerial,   last_sonos_serial,  "") \
+    X(2,    bool,           locked,             false) \
+    X(3,    uint16_t,       service_id,         0) \
+    X(4,    uint8_t,        volume_max,         100) \
+    X(5,    ConfigSpeaker,  active_speaker,     {}) \
+    X(6,    ConfigVolumeCaps, volume_caps,      {})
+
+// Bump when a migration is added to ConfigClass::migrate
+static const uint16_t CONFIG_SCHEMA_VERSION = 2;
+static const uint16_t CONFIG_KEY_VERSION    = 0;
+
+#define CONFIG_STRUCT_FIELD(key, type, name, def) type name = def;
+
+struct ConfigStruct
+{
+    CONFIG_FIELDS(CONFIG_STRUCT_FIELD)
+};
+
+#undef CONFIG_STRUCT_FIELD
+
+#define CONFIG_FIELD_ID(key, type, name, def) CONFIG_FIELD_##name,
+
+enum ConfigField : uint8_t
+{
+    CONFIG_FIELDS(CONFIG_FIELD_ID)
+    CONFIG_FIELD_COUNT
+};
+
+#undef CONFIG_FIELD_ID
+
+// Where each field lives, and the key it's stored under
+struct ConfigFieldLayout
+{
+    uint16_t key;
+    uint16_t offset;
+    uint16_t size;
+};
+
+#define CONFIG_FIELD_LAYOUT(key, type, name, def) { key, offsetof(ConfigStruct, name), sizeof(type) },
+
+static constexpr ConfigFieldLayout CONFIG_LAYOUT[CONFIG_FIELD_COUNT] = {
+    CONFIG_FIELDS(CONFIG_FIELD_LAYOUT)
+};
+
+#undef CONFIG_FIELD_LAYOUT
+
+constexpr bool configLayoutValid()
+{
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++)
+    {
+        if ((CONFIG_LAYOUT[i].key == CONFIG_KEY_VERSION) || (CONFIG_LAYOUT[i].size > CONFIG_STORE_MAX_VALUE)) return false;
+
+        for (uint8_t j = i + 1; j < CONFIG_FIELD_COUNT; j++)
+        {
+            if (CONFIG_LAYOUT[i].key == CONFIG_LAYOUT[j].key) return false;
+        }
+    }
+
+    return true;
+}
+
+static_assert(configLayoutValid(), "Config keys must be unique, not the version key, and fields must fit in the config store");
+static_assert(CONFIG_FIELD_COUNT <= 32, "Dirty tracking holds at most 32 fields");
+static_assert(CONFIG_FIELD_COUNT < CONFIG_STORE_MAX_KEYS, "Config store can't hold all the fields");
 
 class ConfigClass
 {
 public:
     ConfigClass() {};
-    ConfigStruct stored_config;
+    ConfigStruct stored_config; // Read directly, but change through set()
 
     void begin();
+    void handle(); // Call from the loop, to commit any changes
     void clearConfig(); // Use sparingly
     void readConfig();
     void writeConfig(); // Use sparingly
     void wipeConfig(); // Use sparingly
+
+    /*
+     * Changes a field, and schedules it to be written
+     * once there have been no changes for CONFIG_COMMIT_DELAY.
+     * Setting a field to its current value does nothing.
+     */
+    template<typename T>
+    void set(T ConfigStruct::* t_field, const T& t_value)
+    {
+        T& field = stored_config.*t_field;
+
+        if (memcmp(&field, &t_value, sizeof(T)) != 0)
+        {
+            memcpy(&field, &t_value, sizeof(T));
+            markDirty((const uint8_t*)&field - (const uint8_t*)&stored_config);
+        }
+    }
+
+    // As set(), for string fields, truncating if needed
+    template<size_t N>
+    void setString(char (ConfigStruct::* t_field)[N], const char* t_value)
+    {
+        char value[N] = {};
+        strncpy(value, t_value, N - 1);
+        set(t_field, value);
+    }
+
+private:
+    ConfigFlashEsp m_flash;
+    ConfigStore m_store;
+    uint32_t m_dirty = 0;
+    unsigned long m_last_change = 0;
+
+    void markDirty(const size_t);
+    void commit();
+    void migrate(uint16_t);
+    void importLegacyConfig();
 };
 
 extern ConfigClass CONFIG;
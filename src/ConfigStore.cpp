@@ -0,0 +1,449 @@
+#include <Arduino.h>
+#include <flash_hal.h>
+#include "ConfigStore.h"
+#include "Log.h"
+#include "Utility.h"
+
+/*
+ * The store sits in the last sectors of the OTA staging
+ * space, just below the filesystem. We don't do OTA
+ * updates, and it keeps the store away from both the
+ * sketch and the filesystem.
+ */
+uint32_t ConfigFlashEsp::baseAddress()
+{
+    return FS_PHYS_ADDR - (CONFIG_STORE_SECTORS * CONFIG_STORE_SECTOR_SIZE);
+}
+
+bool ConfigFlashEsp::read(const uint32_t t_address, uint32_t* t_buffer, const size_t t_length)
+{
+    return ESP.flashRead(baseAddress() + t_address, t_buffer, t_length);
+}
+
+bool ConfigFlashEsp::write(const uint32_t t_address, const uint32_t* t_buffer, const size_t t_length)
+{
+    return ESP.flashWrite(baseAddress() + t_address, t_buffer, t_length);
+}
+
+bool ConfigFlashEsp::erase(const uint8_t t_sector)
+{
+    return ESP.flashEraseSector((baseAddress() / SPI_FLASH_SEC_SIZE) + t_sector);
+}
+
+/**
+ * Recovers the latest value of every key
+ *
+ * Scans every sector once, keeping the record with
+ * the highest sequence number for each key. The
+ * sector with the highest sector sequence is the one
+ * we carry on appending to.
+ */
+bool ConfigStore::begin(ConfigFlash* t_flash)
+{
+    m_flash = t_flash;
+    m_key_count = 0;
+    m_sector_sequence = 0;
+    m_record_sequence = 0;
+
+    bool found = false;
+    SectorHeader header;
+
+    for (uint8_t i = 0; i < CONFIG_STORE_SECTORS; i++)
+    {
+        if (!readSectorHeader(i, header)) continue;
+
+        if (!found || (header.sequence > m_sector_sequence))
+        {
+            m_active_sector = i;
+            m_sector_sequence = header.sequence;
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        DEBUG_CONFIG_STORE(Serial.println(F("ConfigStore::begin no existing store, starting a new one")));
+        return startSector(0);
+    }
+
+    for (uint8_t i = 0; i < CONFIG_STORE_SECTORS; i++)
+    {
+        uint32_t end = scanSector(i);
+
+        if (i == m_active_sector) m_write_address = end;
+    }
+
+    // The sector after the active one should be the erased
+    // spare. If it isn't, we lost power part way through
+    // a rotation so finish moving its live values forward.
+    uint8_t next = (m_active_sector + 1) % CONFIG_STORE_SECTORS;
+    if (readSectorHeader(next, header))
+    {
+        LOG(CONFIG_STORE_ROTATION);
+        evacuate(next);
+    }
+
+    DEBUG_CONFIG_STORE(Serial.print(F("ConfigStore::begin recovered "));
+                       Serial.print(m_key_count);
+                       Serial.print(F(" keys, active sector "));
+                       Serial.println(m_active_sector));
+
+    return true;
+}
+
+/*
+ * Reads the latest value for a key, returning its
+ * length (0 if the key has never been written)
+ */
+size_t ConfigStore::read(const uint16_t t_key, void* t_value, const size_t t_length)
+{
+    KeyEntry* entry = findKey(t_key);
+
+    if (!entry || !m_flash->read(entry->address + sizeof(RecordHeader), m_buffer, paddedLength(entry->length)))
+    {
+        return 0;
+    }
+
+    size_t length = (entry->length < t_length) ? entry->length : t_length;
+    memcpy(t_value, m_buffer, length);
+
+    return length;
+}
+
+/*
+ * Stores a value for a key. Values that haven't
+ * changed aren't written again.
+ */
+bool ConfigStore::write(const uint16_t t_key, const void* t_value, const size_t t_length)
+{
+    if (!m_flash || (t_length > CONFIG_STORE_MAX_VALUE)) return false;
+
+    KeyEntry* entry = findKey(t_key);
+
+    if (entry && (entry->length == t_length)
+        && m_flash->read(entry->address + sizeof(RecordHeader), m_buffer, paddedLength(t_length))
+        && (memcmp(m_buffer, t_value, t_length) == 0))
+    {
+        DEBUG_CONFIG_STORE(Serial.println(F("ConfigStore::write value unchanged")));
+        return true;
+    }
+
+    return append(t_key, t_value, t_length);
+}
+
+bool ConfigStore::wipe()
+{
+    if (!m_flash) return false;
+
+    for (uint8_t i = 0; i < CONFIG_STORE_SECTORS; i++)
+    {
+        if (!m_flash->erase(i)) return false;
+    }
+
+    m_key_count = 0;
+    m_sector_sequence = 0;
+    m_record_sequence = 0;
+
+    return startSector(0);
+}
+
+bool ConfigStore::isEmpty()
+{
+    return m_key_count == 0;
+}
+
+bool ConfigStore::readSectorHeader(const uint8_t t_sector, SectorHeader& t_header)
+{
+    return m_flash->read(t_sector * CONFIG_STORE_SECTOR_SIZE, (uint32_t*)&t_header, sizeof(t_header))
+        && (t_header.magic == s_sector_magic);
+}
+
+/*
+ * Loads the valid records of a sector in to the key
+ * table, returning the address new records would be
+ * appended at.
+ *
+ * A corrupt record is one power was lost part way
+ * through writing (or an erased gap where a write
+ * failed outright), and we can't trust its length to
+ * find the next one. Anything appended since was put
+ * after all of it, so from there we look for records
+ * whose CRC checks at every word, and append after
+ * whatever was written last.
+ */
+uint32_t ConfigStore::scanSector(const uint8_t t_sector)
+{
+    uint32_t sector_start = t_sector * CONFIG_STORE_SECTOR_SIZE;
+    uint32_t sector_end = sector_start + CONFIG_STORE_SECTOR_SIZE;
+    uint32_t address = sector_start + sizeof(SectorHeader);
+    bool damaged = false;
+    SectorHeader sector_header;
+
+    if (!readSectorHeader(t_sector, sector_header)) return sector_end;
+
+    if (sector_header.sequence > m_sector_sequence) m_sector_sequence = sector_header.sequence;
+
+    while ((address + sizeof(RecordHeader)) <= sector_end)
+    {
+        RecordHeader header;
+
+        if (!m_flash->read(address, (uint32_t*)&header, sizeof(header))) return sector_end;
+
+        // Erased flash, so we've reached the end of the log, unless
+        // it's the space left by a write that failed, with more after
+        if (!damaged && (header.key == 0xFFFF) && (header.length == 0xFFFF) && isErased(address, sector_end)) return address;
+
+        if (!readRecord(address, sector_end, header))
+        {
+            if (!damaged)
+            {
+                LOG(CONFIG_STORE_CORRUPT, t_sector);
+                damaged = true;
+            }
+
+            address += sizeof(uint32_t);
+            continue;
+        }
+
+        if (header.sequence > m_record_sequence) m_record_sequence = header.sequence;
+
+        KeyEntry* entry = findKey(header.key);
+
+        if (!entry && (m_key_count < CONFIG_STORE_MAX_KEYS))
+        {
+            entry = &m_keys[m_key_count++];
+            entry->key = header.key;
+            entry->sequence = 0;
+        }
+
+        if (entry && (header.sequence >= entry->sequence))
+        {
+            entry->length = header.length;
+            entry->address = address;
+            entry->sequence = header.sequence;
+        }
+
+        address += sizeof(RecordHeader) + paddedLength(header.length);
+    }
+
+    return damaged ? writtenEnd(t_sector) : address;
+}
+
+/*
+ * True if every word from t_address to t_end is
+ * erased. Read through m_buffer, a record at a time.
+ */
+bool ConfigStore::isErased(uint32_t t_address, const uint32_t t_end)
+{
+    while (t_address < t_end)
+    {
+        size_t length = ((t_end - t_address) < sizeof(m_buffer)) ? (t_end - t_address) : sizeof(m_buffer);
+
+        if (!m_flash->read(t_address, m_buffer, length)) return false;
+
+        for (size_t i = 0; i < (length / sizeof(uint32_t)); i++)
+        {
+            if (m_buffer[i] != 0xFFFFFFFF) return false;
+        }
+
+        t_address += length;
+    }
+
+    return true;
+}
+
+/*
+ * Reads the header of the record at t_address, and
+ * its value in to m_buffer. True if the record fits
+ * before t_sector_end and its CRC checks.
+ */
+bool ConfigStore::readRecord(const uint32_t t_address, const uint32_t t_sector_end, RecordHeader& t_header)
+{
+    if (((t_address + sizeof(RecordHeader)) > t_sector_end)
+        || !m_flash->read(t_address, (uint32_t*)&t_header, sizeof(t_header))) return false;
+
+    return (t_header.length <= CONFIG_STORE_MAX_VALUE)
+        && ((t_address + sizeof(RecordHeader) + paddedLength(t_header.length)) <= t_sector_end)
+        && m_flash->read(t_address + sizeof(RecordHeader), m_buffer, paddedLength(t_header.length))
+        && (calculateCrc32(m_buffer, t_header.length, calculateCrc32(&t_header, offsetof(RecordHeader, crc))) == t_header.crc);
+}
+
+/*
+ * Just past the last thing written to a sector,
+ * walking forward from its start. Whole records are
+ * stepped over, so erased-looking words inside a
+ * value (or its padding) aren't taken for the end,
+ * and anything else not erased, such as what's left
+ * of a cut off record, is passed a word at a time.
+ */
+uint32_t ConfigStore::writtenEnd(const uint8_t t_sector)
+{
+    uint32_t sector_end = (t_sector + 1) * CONFIG_STORE_SECTOR_SIZE;
+    uint32_t address = (t_sector * CONFIG_STORE_SECTOR_SIZE) + sizeof(SectorHeader);
+    uint32_t end = address;
+    RecordHeader header;
+    uint32_t word;
+
+    while (address < sector_end)
+    {
+        if (readRecord(address, sector_end, header))
+        {
+            address += sizeof(RecordHeader) + paddedLength(header.length);
+            end = address;
+            continue;
+        }
+
+        if (!m_flash->read(address, &word, sizeof(word))) return sector_end;
+
+        address += sizeof(word);
+
+        if (word != 0xFFFFFFFF) end = address;
+    }
+
+    return end;
+}
+
+ConfigStore::KeyEntry* ConfigStore::findKey(const uint16_t t_key)
+{
+    for (uint8_t i = 0; i < m_key_count; i++)
+    {
+        if (m_keys[i].key == t_key) return &m_keys[i];
+    }
+
+    return nullptr;
+}
+
+bool ConfigStore::append(const uint16_t t_key, const void* t_value, const size_t t_length)
+{
+    uint32_t record_length = sizeof(RecordHeader) + paddedLength(t_length);
+    uint32_t sector_end = (m_active_sector + 1) * CONFIG_STORE_SECTOR_SIZE;
+
+    if ((m_write_address + record_length) > sector_end)
+    {
+        if (m_rotating || !rotate()) return false;
+    }
+
+    KeyEntry* entry = findKey(t_key);
+
+    if (!entry)
+    {
+        if (m_key_count >= CONFIG_STORE_MAX_KEYS) return false;
+
+        entry = &m_keys[m_key_count++];
+        entry->key = t_key;
+    }
+
+    RecordHeader* header = (RecordHeader*)m_buffer;
+    header->key = t_key;
+    header->length = t_length;
+    header->sequence = ++m_record_sequence;
+
+    // The value may already be in place (when evacuating a sector)
+    uint8_t* value = (uint8_t*)m_buffer + sizeof(RecordHeader);
+    if (value != t_value) memcpy(value, t_value, t_length);
+    memset(value + t_length, 0xFF, paddedLength(t_length) - t_length);
+
+    header->crc = calculateCrc32(value, t_length, calculateCrc32(header, offsetof(RecordHeader, crc)));
+
+    uint32_t address = m_write_address;
+
+    // Whatever happens, don't append over a partly written record
+    m_write_address += record_length;
+
+    if (!m_flash->write(address, m_buffer, record_length))
+    {
+        LOG(CONFIG_STORE_WRITE);
+        return false;
+    }
+
+    entry->length = t_length;
+    entry->address = address;
+    entry->sequence = header->sequence;
+
+    return true;
+}
+
+bool ConfigStore::startSector(const uint8_t t_sector)
+{
+    SectorHeader header = { s_sector_magic, ++m_sector_sequence };
+    uint32_t address = t_sector * CONFIG_STORE_SECTOR_SIZE;
+
+    // The magic goes last, so a sector with it has its whole sequence
+    if (!m_flash->erase(t_sector)
+        || !m_flash->write(address + offsetof(SectorHeader, sequence), &header.sequence, sizeof(header.sequence))
+        || !m_flash->write(address + offsetof(SectorHeader, magic), &header.magic, sizeof(header.magic)))
+    {
+        LOG(CONFIG_STORE_START, t_sector);
+        return false;
+    }
+
+    m_active_sector = t_sector;
+    m_write_address = (t_sector * CONFIG_STORE_SECTOR_SIZE) + sizeof(header);
+
+    return true;
+}
+
+/*
+ * Copies any values whose latest record is in the
+ * sector forward to the active sector, then erases
+ * it so it becomes the spare
+ */
+bool ConfigStore::evacuate(const uint8_t t_sector)
+{
+    uint32_t sector_start = t_sector * CONFIG_STORE_SECTOR_SIZE;
+    bool ok = true;
+
+    m_rotating = true;
+
+    for (uint8_t i = 0; (i < m_key_count) && ok; i++)
+    {
+        KeyEntry& entry = m_keys[i];
+
+        if ((entry.address >= sector_start) && (entry.address < (sector_start + CONFIG_STORE_SECTOR_SIZE)))
+        {
+            // Value is read in to the record buffer, which append builds on in place
+            ok = m_flash->read(entry.address + sizeof(RecordHeader), (uint32_t*)((uint8_t*)m_buffer + sizeof(RecordHeader)), paddedLength(entry.length))
+                && append(entry.key, (uint8_t*)m_buffer + sizeof(RecordHeader), entry.length);
+        }
+    }
+
+    m_rotating = false;
+
+    // Only erase once everything live has been copied
+    if (!ok)
+    {
+        LOG(CONFIG_STORE_EVACUATE, t_sector);
+        return false;
+    }
+
+    return m_flash->erase(t_sector);
+}
+
+/*
+ * Moves on to the spare sector, and frees up the
+ * oldest sector to be the next spare. A spare that
+ * still has its header wasn't evacuated, and may
+ * hold the only copy of some values, so it's only
+ * started on once they've been moved out of it.
+ */
+bool ConfigStore::rotate()
+{
+    uint8_t spare = (m_active_sector + 1) % CONFIG_STORE_SECTORS;
+    uint8_t oldest = (spare + 1) % CONFIG_STORE_SECTORS;
+    SectorHeader header;
+
+    DEBUG_CONFIG_STORE(Serial.print(F("ConfigStore::rotate moving to sector "));
+                       Serial.println(spare));
+
+    if (readSectorHeader(spare, header) && !evacuate(spare))
+    {
+        LOG(CONFIG_STORE_NOT_ERASED, spare);
+        return false;
+    }
+
+    if (!startSector(spare)) return false;
+
+    if (!readSectorHeader(oldest, header)) return true;
+
+    return evacuate(oldest);
+}
@@ -0,0 +1,117 @@
+#ifndef ConfigStore_h
+#define ConfigStore_h
+
+#include <Arduino.h>
+
+#ifdef DEBUG
+    #define DEBUG_CONFIG_STORE(x) x
+#else
+    #define DEBUG_CONFIG_STORE(x) do{}while(0)
+#endif
+
+#define CONFIG_STORE_SECTORS        4
+#define CONFIG_STORE_SECTOR_SIZE    4096
+#define CONFIG_STORE_MAX_KEYS       32
+#define CONFIG_STORE_MAX_VALUE      256
+
+/*
+ * Raw access to the flash sectors used by the store.
+ * Addresses are relative to the start of the store,
+ * and reads/writes are 4 byte aligned.
+ */
+class ConfigFlash
+{
+public:
+    virtual ~ConfigFlash() {};
+    virtual bool read(const uint32_t, uint32_t*, const size_t) = 0;
+    virtual bool write(const uint32_t, const uint32_t*, const size_t) = 0;
+    virtual bool erase(const uint8_t) = 0;
+};
+
+/*
+ * Flash sectors immediately below the filesystem
+ */
+class ConfigFlashEsp : public ConfigFlash
+{
+public:
+    ConfigFlashEsp() {};
+    bool read(const uint32_t, uint32_t*, const size_t) override;
+    bool write(const uint32_t, const uint32_t*, const size_t) override;
+    bool erase(const uint8_t) override;
+
+private:
+    static uint32_t baseAddress();
+};
+
+/*
+ * Log-structured key/value store
+ *
+ * Each write appends a record (key, length, sequence,
+ * CRC, value) to the active sector, so changing one
+ * value never rewrites the others. When the active
+ * sector fills, the store moves on to the spare erased
+ * sector and copies forward any values still live in
+ * the oldest sector before erasing it. A record cut off
+ * by power loss fails its CRC and is ignored, so the
+ * previous value for that key is used instead.
+ */
+class ConfigStore
+{
+public:
+    ConfigStore() {};
+    bool begin(ConfigFlash*);
+    size_t read(const uint16_t, void*, const size_t);
+    bool write(const uint16_t, const void*, const size_t);
+    bool wipe();
+    bool isEmpty();
+
+private:
+    static const uint32_t s_sector_magic = 0x53474643; // "CFGS"
+
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+    };
+
+    struct RecordHeader
+    {
+        uint16_t key;
+        uint16_t length;
+        uint32_t sequence;
+        uint32_t crc;
+    };
+
+    struct KeyEntry
+    {
+        uint16_t key;
+        uint16_t length;
+        uint32_t address;   // Of the record header
+        uint32_t sequence;
+    };
+
+    ConfigFlash* m_flash = nullptr;
+    KeyEntry m_keys[CONFIG_STORE_MAX_KEYS];
+    uint8_t m_key_count = 0;
+    uint8_t m_active_sector = 0;
+    uint32_t m_write_address = 0;
+    uint32_t m_sector_sequence = 0;
+    uint32_t m_record_sequence = 0;
+    uint32_t m_buffer[(sizeof(RecordHeader) + CONFIG_STORE_MAX_VALUE) / sizeof(uint32_t)];
+    bool m_rotating = false;
+
+    static size_t paddedLength(const size_t t_length) { return (t_length + 3) & ~3; }
+
+    uint32_t scanSector(const uint8_t);
+    bool isErased(uint32_t, const uint32_t);
+    bool readRecord(const uint32_t, const uint32_t, RecordHeader&);
+    uint32_t writtenEnd(const uint8_t);
+    bool readSectorHeader(const uint8_t, SectorHeader&);
+    KeyEntry* findKey(const uint16_t);
+    bool append(const uint16_t, const void*, const size_t);
+    bool startSector(const uint8_t);
+    bool evacuate(const uint8_t);
+    bool rotate();
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include <Arduino.h>
+#include "Heap.h"
+#include "Metrics.h"
+
+#ifdef HEAP_COUNT_ALLOCATIONS
+
+extern "C"
+{
+    void* __real_malloc(size_t);
+    void* __real_calloc(size_t, size_t);
+    void* __real_realloc(void*, size_t);
+    void __real_free(void*);
+
+    void* __wrap_malloc(size_t t_size)
+    {
+        HEAP.recordAllocation(t_size);
+        return __real_malloc(t_size);
+    }
+
+    void* __wrap_calloc(size_t t_count, size_t t_size)
+    {
+        HEAP.recordAllocation(t_count * t_size);
+        return __real_calloc(t_count, t_size);
+    }
+
+    // Growing a String is an allocation, whether or not it moves
+    void* __wrap_realloc(void* t_pointer, size_t t_size)
+    {
+        HEAP.recordAllocation(t_size);
+        return __real_realloc(t_pointer, t_size);
+    }
+
+    void __wrap_free(void* t_pointer)
+    {
+        if (t_pointer) HEAP.recordFree();
+        __real_free(t_pointer);
+    }
+}
+
+#endif
+
+/**
+ * Writes the allocation counts in Prometheus text format
+ *
+ * Follows on from the output of METRICS.printTo, which
+ * has the free heap, largest block and fragmentation.
+ */
+void HeapClass::printTo(Print& t_out)
+{
+#ifdef HEAP_COUNT_ALLOCATIONS
+    MetricsClass::printHeader(t_out, "musicbox_heap_allocations_total", "Heap allocations, including reallocs", "counter");
+    t_out.print(F("musicbox_heap_allocations_total "));t_out.println(m_allocations);
+
+    MetricsClass::printHeader(t_out, "musicbox_heap_allocated_bytes_total", "Bytes asked for by heap allocations", "counter");
+    t_out.print(F("musicbox_heap_allocated_bytes_total "));t_out.println(m_allocated_bytes);
+
+    MetricsClass::printHeader(t_out, "musicbox_heap_frees_total", "Heap blocks freed", "counter");
+    t_out.print(F("musicbox_heap_frees_total "));t_out.println(m_frees);
+#endif
+}
+
+HeapClass HEAP;
@@ -0,0 +1,48 @@
+#ifndef Heap_h
+#define Heap_h
+
+#include <Arduino.h>
+
+/*
+ * Allocation counts
+ *
+ * Built with HEAP_COUNT_ALLOCATIONS and the linker
+ * wrapping malloc, calloc, realloc and free (see
+ * platformio.ini), every allocation made through
+ * them, or through new, is counted here. The
+ * scheduler charges each task with what it
+ * allocates, so /metrics shows which of them, if
+ * any, allocate in the steady state. Without the
+ * flag the counts stay at 0 and aren't reported.
+ */
+class HeapClass
+{
+public:
+    HeapClass() {};
+
+    uint32_t getAllocations() const { return m_allocations; }
+    uint32_t getAllocatedBytes() const { return m_allocated_bytes; }
+    uint32_t getFrees() const { return m_frees; }
+    void printTo(Print&);
+
+    inline void recordAllocation(const size_t t_size)
+    {
+        m_allocations++;
+        m_allocated_bytes += t_size;
+    }
+
+    inline void recordFree()
+    {
+        m_frees++;
+    }
+
+private:
+    // Also updated from the SDK's callbacks
+    volatile uint32_t m_allocations = 0;
+    volatile uint32_t m_allocated_bytes = 0;
+    volatile uint32_t m_frees = 0;
+};
+
+extern HeapClass HEAP;
+
+#endif
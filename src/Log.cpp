@@ -0,0 +1,254 @@
+#include <Arduino.h>
+#include "Log.h"
+#include "Metrics.h"
+
+static const char s_level_names[] = { 'D', 'I', 'W', 'E' };
+
+// Formats for writing out, kept in flash. LOG_FORMATS
+// in Log.h is only used at compile time.
+#define LOG_FORMAT_STRING(id, level, format) static const char s_format_##id[] PROGMEM = format;
+#define LOG_FORMAT_POINTER(id, level, format) s_format_##id,
+
+LOG_MESSAGES(LOG_FORMAT_STRING)
+
+static const char* const s_formats[] = { LOG_MESSAGES(LOG_FORMAT_POINTER) };
+
+#undef LOG_FORMAT_STRING
+#undef LOG_FORMAT_POINTER
+
+/**
+ * Writes out records not yet written, as text
+ *
+ * Never waits on the output: only as many bytes as
+ * availableForWrite() allows go out, and the rest of
+ * the line is picked up on the next call.
+ */
+void LogClass::drainTo(Print& t_out)
+{
+    for (;;)
+    {
+        if (m_line_written == m_line_length)
+        {
+            if (m_dropped)
+            {
+                uint32_t dropped = m_dropped;
+
+                m_dropped = 0;
+                LOG(LOG_DROPPED, dropped);
+            }
+
+            if (m_drained == m_head) return;
+
+            uint8_t record[LOG_MAX_RECORD];
+            size_t length = readRecord(m_drained, record);
+
+            m_drained += length;
+            m_line_length = formatRecord(record, length, m_line, sizeof(m_line));
+            m_line_written = 0;
+        }
+
+        int room = t_out.availableForWrite();
+
+        if (room <= 0) return;
+
+        size_t length = m_line_length - m_line_written;
+        if ((size_t)room < length) length = room;
+
+        size_t written = t_out.write((const uint8_t*)m_line + m_line_written, length);
+
+        if (!written) return;
+
+        m_line_written += written;
+    }
+}
+
+/**
+ * Writes the raw ring, oldest record first, after a
+ * four byte magic. See tools/logdecode.py.
+ */
+void LogClass::dumpTo(Print& t_out)
+{
+    uint32_t magic = s_dump_magic;
+    uint32_t start = m_tail & (LOG_RING_SIZE - 1);
+    uint32_t length = m_head - m_tail;
+
+    t_out.write((const uint8_t*)&magic, sizeof(magic));
+
+    if ((start + length) > LOG_RING_SIZE)
+    {
+        t_out.write(m_ring + start, LOG_RING_SIZE - start);
+        t_out.write(m_ring, length - (LOG_RING_SIZE - start));
+    }
+    else
+    {
+        t_out.write(m_ring + start, length);
+    }
+}
+
+/**
+ * Writes every record still in the ring as text
+ */
+void LogClass::printTo(Print& t_out)
+{
+    uint8_t record[LOG_MAX_RECORD];
+    char line[LOG_LINE_SIZE];
+
+    for (uint32_t position = m_tail; position != m_head; )
+    {
+        size_t length = readRecord(position, record);
+
+        position += length;
+        t_out.write((const uint8_t*)line, formatRecord(record, length, line, sizeof(line)));
+    }
+}
+
+void LogClass::encodeWord(uint8_t* t_record, size_t& t_length, const uint32_t t_value)
+{
+    if ((t_length + sizeof(t_value)) > LOG_MAX_RECORD) return;
+
+    memcpy(t_record + t_length, &t_value, sizeof(t_value));
+    t_length += sizeof(t_value);
+}
+
+// One length byte, then the characters
+void LogClass::encodeString(uint8_t* t_record, size_t& t_length, const char* t_text, size_t t_text_length)
+{
+    if ((t_length + 1) > LOG_MAX_RECORD) return;
+
+    if (t_text_length > LOG_MAX_STRING) t_text_length = LOG_MAX_STRING;
+    if ((t_length + 1 + t_text_length) > LOG_MAX_RECORD) t_text_length = LOG_MAX_RECORD - t_length - 1;
+
+    t_record[t_length++] = t_text_length;
+    memcpy(t_record + t_length, t_text, t_text_length);
+    t_length += t_text_length;
+}
+
+/*
+ * Copies a record in to the ring, overwriting the
+ * oldest records to make room
+ */
+void LogClass::append(const uint8_t* t_record, const size_t t_length)
+{
+    while ((m_head + t_length - m_tail) > LOG_RING_SIZE)
+    {
+        uint8_t length = m_ring[m_tail & (LOG_RING_SIZE - 1)];
+
+        // Not written out yet, so it's lost
+        if (m_drained == m_tail)
+        {
+            m_drained += length;
+            m_dropped++;
+            METRICS.increment(METRIC_LOG_DROPPED);
+        }
+
+        m_tail += length;
+    }
+
+    uint32_t start = m_head & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - start;
+
+    if (first > t_length) first = t_length;
+
+    memcpy(m_ring + start, t_record, first);
+    memcpy(m_ring, t_record + first, t_length - first);
+
+    m_head += t_length;
+}
+
+size_t LogClass::readRecord(const uint32_t t_position, uint8_t* t_record)
+{
+    size_t length = m_ring[t_position & (LOG_RING_SIZE - 1)];
+
+    for (size_t i = 0; i < length; i++) t_record[i] = m_ring[(t_position + i) & (LOG_RING_SIZE - 1)];
+
+    return length;
+}
+
+/*
+ * Formats a record as a line of text, e.g.
+ *   12.345 W Sonos::evictClient evicting [Kitchen]
+ * returning its length
+ */
+size_t LogClass::formatRecord(const uint8_t* t_record, const size_t t_length, char* t_line, const size_t t_size)
+{
+    uint8_t id = t_record[1];
+    uint32_t time;
+    const uint8_t* arg = t_record + s_header_size;
+    const uint8_t* end = t_record + t_length;
+    size_t limit = t_size - 2; // Room for the line ending
+    size_t position;
+
+    memcpy(&time, t_record + 2, sizeof(time));
+
+    if (id >= LOG_MESSAGE_COUNT)
+    {
+        position = snprintf(t_line, limit, "%lu.%03lu ? unknown message %u",
+                            (unsigned long)(time / 1000), (unsigned long)(time % 1000), id);
+    }
+    else
+    {
+        position = snprintf(t_line, limit, "%lu.%03lu %c ",
+                            (unsigned long)(time / 1000), (unsigned long)(time % 1000), s_level_names[LOG_LEVELS[id]]);
+
+        for (const char* format = s_formats[id]; pgm_read_byte(format) && (position < (limit - 1)); format++)
+        {
+            char c = pgm_read_byte(format);
+
+            if (c != '%')
+            {
+                t_line[position++] = c;
+                continue;
+            }
+
+            c = pgm_read_byte(++format);
+
+            if (c == '\0') break;
+
+            if (c == 's')
+            {
+                size_t length = (arg < end) ? *arg++ : 0;
+
+                if (length > (size_t)(end - arg)) length = end - arg;
+                if (length > (limit - 1 - position)) length = limit - 1 - position;
+
+                memcpy(t_line + position, arg, length);
+                position += length;
+                arg += length;
+                continue;
+            }
+
+            uint32_t value = 0;
+
+            if ((arg + sizeof(value)) <= end)
+            {
+                memcpy(&value, arg, sizeof(value));
+                arg += sizeof(value);
+            }
+
+            if (c == 'd')
+            {
+                position += snprintf(t_line + position, limit - position, "%ld", (long)(int32_t)value);
+            }
+            else if (c == 'a')
+            {
+                position += snprintf(t_line + position, limit - position, "%u.%u.%u.%u",
+                                     (unsigned)(value & 0xFF), (unsigned)((value >> 8) & 0xFF),
+                                     (unsigned)((value >> 16) & 0xFF), (unsigned)(value >> 24));
+            }
+            else
+            {
+                position += snprintf(t_line + position, limit - position, "%lu", (unsigned long)value);
+            }
+        }
+    }
+
+    // snprintf returns what it would have written
+    if (position > (limit - 1)) position = limit - 1;
+
+    t_line[position++] = '\r';
+    t_line[position++] = '\n';
+
+    return position;
+}
+
+LogClass LOGGER;
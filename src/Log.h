@@ -0,0 +1,235 @@
+#ifndef Log_h
+#define Log_h
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <type_traits>
+
+#define LOG_RING_SIZE               2048    // Power of two, bytes
+#define LOG_MAX_RECORD              96      // Header and arguments
+#define LOG_MAX_STRING              40      // Longer strings are cut short
+#define LOG_LINE_SIZE               160     // A record written out as text
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+static_assert(LOG_MAX_RECORD <= 255, "A record's length is kept in one byte");
+
+#define LOG_LEVEL_DEBUG             0
+#define LOG_LEVEL_INFO              1
+#define LOG_LEVEL_WARN              2
+#define LOG_LEVEL_ERROR             3
+
+// Messages below this level are compiled out
+#ifndef LOG_MIN_LEVEL
+    #ifdef DEBUG
+        #define LOG_MIN_LEVEL       LOG_LEVEL_DEBUG
+    #else
+        #define LOG_MIN_LEVEL       LOG_LEVEL_INFO
+    #endif
+#endif
+
+/*
+ * Messages: X(id, level, format)
+ *
+ * Only the id and the arguments are recorded, the
+ * format is applied when the record is written out
+ * (and by tools/logdecode.py, which reads this table,
+ * so keep each entry on one line). Formats take:
+ *   %d  signed integer
+ *   %u  unsigned integer
+ *   %s  string, up to LOG_MAX_STRING characters
+ *   %a  IPv4 address
+ * Add new messages at the end, so ids in old dumps
+ * still decode.
+ */
+#define LOG_MESSAGES(X) \
+    X(LOG_DROPPED,              WARN,   "Log %u records dropped before they were written out") \
+    X(MAIN_LOCATION_SAVED,      INFO,   "main::checkLocationChange saving Location change: %s") \
+    X(MAIN_LOCK,                INFO,   "main::commandLock [%s]") \
+    X(MAIN_MACRO_STEP,          INFO,   "main::commandMacro step %u %s [%s]") \
+    X(MAIN_MACRO_FAILED,        WARN,   "main::commandMacro step %u failed, stopping") \
+    X(MAIN_READ_NO_BUFFER,      ERROR,  "main::readRFIDCallback no valid buffer provided/found") \
+    X(MAIN_READ_CARD,           INFO,   "main::readRFIDCallback called [%s]") \
+    X(MAIN_READ_LOCKED,         INFO,   "main::readRFIDCallback locked, ignoring %s") \
+    X(MAIN_READ_COMMAND,        INFO,   "main::readRFIDCallback %s command [%s]") \
+    X(MAIN_READ_FAILED,         WARN,   "main::readRFIDCallback %s command failed") \
+    X(MAIN_WRITE_FAILED,        ERROR,  "main::writeRFIDCallback card write failed, not saving to library") \
+    X(MAIN_CARD_SUPERSEDED,     INFO,   "main::cardTask skipping superseded card [%s]") \
+    X(MAIN_DISCOVER,            DEBUG,  "main::discoverTask running discovery for clients") \
+    X(RFID_WRITE_EXPIRED,       WARN,   "Rfid::handleRfid Write timer expired. Cancelling write to card") \
+    X(RFID_NEW_CARD,            INFO,   "Rfid::handleRfid New card detected") \
+    X(RFID_NOT_CLASSIC,         WARN,   "Rfid::handleRfid This app only works with MIFARE Classic cards.") \
+    X(SONOS_DISCOVERED,         INFO,   "Sonos::discover Completed and found %u new devices") \
+    X(SONOS_URI_TOO_LONG,       ERROR,  "Sonos::queueUri URI too long") \
+    X(SONOS_JOIN_UNKNOWN,       WARN,   "Sonos::joinGroup no other client with that serial") \
+    X(SONOS_FANOUT_TOO_LONG,    ERROR,  "Sonos::fanOut request too long") \
+    X(SONOS_SKIPPED,            WARN,   "Sonos::sendRequest skipping request to %s") \
+    X(SONOS_CLIENT_DOWN,        WARN,   "Sonos::recordResponse marking client down [%s]") \
+    X(SONOS_CLIENT_BACK,        INFO,   "Sonos::checkClients client is back [%s]") \
+    X(SONOS_ADDRESS_TAKEN,      WARN,   "Sonos::probeClient another speaker now has the address of [%s]") \
+    X(SONOS_EVICTED,            WARN,   "Sonos::evictClient evicting [%s]") \
+    X(SONOS_MERGED,             INFO,   "Sonos::mergeClient found [%s] at %a") \
+    X(VOLUME_READ_FAILED,       WARN,   "Volume::handle unable to read the current volume") \
+    X(VOLUME_SET_FAILED,        WARN,   "Volume::handle error setting volume") \
+    X(VOLUME_CAPS_FULL,         WARN,   "Volume::setCap no room for another speaker") \
+    X(CONFIG_STORE_FAILED,      ERROR,  "ConfigClass::begin error starting config store") \
+    X(CONFIG_NEWER_VERSION,     WARN,   "ConfigClass::begin config is from a newer version [%u]") \
+    X(CONFIG_WIPE_FAILED,       ERROR,  "ConfigClass::wipeConfig error occured while wiping config store") \
+    X(CONFIG_WRONG_SIZE,        WARN,   "ConfigClass::readConfig ignoring field with wrong size, key [%u]") \
+    X(CONFIG_READ,              INFO,   "ConfigClass::readConfig successfully from config store") \
+    X(CONFIG_COMMIT_FAILED,     ERROR,  "ConfigClass::commit error writing config to config store") \
+    X(CONFIG_MIGRATE,           INFO,   "ConfigClass::migrate upgrading config from version %u") \
+    X(CONFIG_MIGRATE_FAILED,    ERROR,  "ConfigClass::migrate error saving config version") \
+    X(CONFIG_LEGACY_IMPORT,     INFO,   "ConfigClass::importLegacyConfig importing EEPROM config [%s]") \
+    X(CAPTURE_STARTED,          INFO,   "CaptureClass::start capturing Sonos traffic") \
+    X(CAPTURE_STOPPED,          INFO,   "CaptureClass::stop captured %u bytes") \
+    X(CAPTURE_FULL,             WARN,   "CaptureClass::reserve capture file is full, stopping") \
+    X(SONOS_SSDP_TRUNCATED,     WARN,   "Sonos::discover response of %u bytes cut short") \
+    X(SONOS_RESTARTED,          INFO,   "Sonos::addSonosClient [%s] has restarted") \
+    X(SONOS_RESTORED,           INFO,   "Sonos::restoreClient using [%s] at %a until discovery") \
+    X(MAIN_READY,               INFO,   "main::setup ready for cards %u ms after boot") \
+    X(MAIN_FIRST_TAP,           INFO,   "main::cardTask first card handled %u ms after boot") \
+    X(COMMAND_INVALID_ARGUMENT, INFO,   "parseCommand invalid argument for %s") \
+    X(COMMAND_TOO_MANY_STEPS,   INFO,   "compileMacro too many steps") \
+    X(COMMAND_INVALID_STEP,     INFO,   "compileMacro invalid step %u") \
+    X(MAIN_STARTING,            INFO,   "main::setup starting") \
+    X(MAIN_WIFI_FAILED,         ERROR,  "main::setupWifi failed to connect to WiFi and hit timeout") \
+    X(MAIN_WIFI_CONNECTED,      INFO,   "main::setupWifi connected, IP address %a") \
+    X(MAIN_LAST_SONOS,          INFO,   "main::setup using last Sonos serial [%s]") \
+    X(SCHEDULER_OVER_BUDGET,    DEBUG,  "Scheduler::run task [%s] over budget, took %u us") \
+    X(SCHEDULER_ADD_FAILED,     ERROR,  "Scheduler::addTask unable to add task [%s]") \
+    X(CONFIG_STORE_ROTATION,    WARN,   "ConfigStore::begin completing interrupted rotation") \
+    X(CONFIG_STORE_CORRUPT,     WARN,   "ConfigStore::scanSector skipping corrupt record in sector %u") \
+    X(CONFIG_STORE_WRITE,       ERROR,  "ConfigStore::append error writing to flash") \
+    X(CONFIG_STORE_START,       ERROR,  "ConfigStore::startSector error preparing sector %u") \
+    X(CONFIG_STORE_EVACUATE,    ERROR,  "ConfigStore::evacuate error moving values, keeping sector %u") \
+    X(CONFIG_STORE_NOT_ERASED,  ERROR,  "ConfigStore::rotate spare sector %u still holds values, not erasing it")
+
+#define LOG_ENUM_ID(id, level, format) LOG_##id,
+#define LOG_ENUM_LEVEL(id, level, format) LOG_LEVEL_##level,
+#define LOG_ENUM_FORMAT(id, level, format) format,
+
+enum LogMessage : uint8_t
+{
+    LOG_MESSAGES(LOG_ENUM_ID)
+    LOG_MESSAGE_COUNT
+};
+
+static constexpr uint8_t LOG_LEVELS[] = { LOG_MESSAGES(LOG_ENUM_LEVEL) };
+static constexpr const char* LOG_FORMATS[] = { LOG_MESSAGES(LOG_ENUM_FORMAT) };
+
+#undef LOG_ENUM_ID
+#undef LOG_ENUM_LEVEL
+#undef LOG_ENUM_FORMAT
+
+// Number of arguments a format takes
+static constexpr uint8_t logArgCount(const char* t_format)
+{
+    return !*t_format ? 0 : ((*t_format == '%') ? 1 + logArgCount(t_format + 2) : logArgCount(t_format + 1));
+}
+
+/*
+ * Records a message, if its level is compiled in, e.g.
+ *   LOG(SONOS_SKIPPED, t_client->room_name);
+ * The argument count is checked against the format
+ * at compile time.
+ */
+#define LOG(id, ...) \
+    do { if (LOG_LEVELS[LOG_##id] >= LOG_MIN_LEVEL) LOGGER.write<logArgCount(LOG_FORMATS[LOG_##id])>(LOG_##id, ##__VA_ARGS__); } while(0)
+
+// A string that isn't null terminated, for %s
+struct LogString
+{
+    const char* text;
+    size_t length;
+};
+
+/*
+ * Binary ring buffer log
+ *
+ * A record is its length, the message id, millis()
+ * and the raw arguments, appended to a byte ring with
+ * no formatting, so logging from the tap path costs a
+ * few copies rather than a blocking Serial.print. When
+ * the ring is full the oldest records are overwritten.
+ *
+ * The log task turns records in to text and writes
+ * them to serial, only as much as the UART buffer will
+ * take without waiting. /log dumps the raw ring, to be
+ * decoded with tools/logdecode.py. Only log from the
+ * loop, not from interrupts.
+ */
+class LogClass
+{
+public:
+    LogClass() {};
+
+    template<uint8_t t_arg_count, typename... T>
+    inline void write(const LogMessage t_id, const T&... t_args)
+    {
+        static_assert(t_arg_count == sizeof...(T), "Wrong number of arguments for the log message format");
+
+        uint8_t record[LOG_MAX_RECORD];
+        size_t length = s_header_size;
+        uint32_t now = millis();
+
+        record[1] = t_id;
+        memcpy(record + 2, &now, sizeof(now));
+
+        // Expands to one encode() per argument, in order
+        int expand[] = { 0, (encode(record, length, t_args), 0)... };
+        (void)expand;
+
+        record[0] = length;
+        append(record, length);
+    }
+
+    void drainTo(Print&);
+    void dumpTo(Print&);
+    void printTo(Print&);
+
+    static const uint32_t s_dump_magic = 0x31474F4C; // "LOG1"
+
+private:
+    static const size_t s_header_size = 6; // Length, id, millis
+
+    uint8_t m_ring[LOG_RING_SIZE];
+    uint32_t m_head = 0;        // Where the next record goes
+    uint32_t m_tail = 0;        // Oldest record still in the ring
+    uint32_t m_drained = 0;     // Next record to write out
+    uint32_t m_dropped = 0;     // Overwritten before being written out
+    char m_line[LOG_LINE_SIZE];
+    size_t m_line_length = 0;
+    size_t m_line_written = 0;
+
+    template<typename T>
+    static inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+    encode(uint8_t* t_record, size_t& t_length, const T t_value)
+    {
+        encodeWord(t_record, t_length, (uint32_t)t_value);
+    }
+
+    static inline void encode(uint8_t* t_record, size_t& t_length, const IPAddress& t_ip)
+    {
+        encodeWord(t_record, t_length, (uint32_t)t_ip);
+    }
+
+    static inline void encode(uint8_t* t_record, size_t& t_length, const char* t_text)
+    {
+        encodeString(t_record, t_length, t_text, t_text ? strnlen(t_text, LOG_MAX_STRING) : 0);
+    }
+
+    static inline void encode(uint8_t* t_record, size_t& t_length, const LogString& t_string)
+    {
+        encodeString(t_record, t_length, t_string.text, t_string.length);
+    }
+
+    static void encodeWord(uint8_t*, size_t&, const uint32_t);
+    static void encodeString(uint8_t*, size_t&, const char*, size_t);
+    void append(const uint8_t*, const size_t);
+    size_t readRecord(const uint32_t, uint8_t*);
+    size_t formatRecord(const uint8_t*, const size_t, char*, const size_t);
+};
+
+extern LogClass LOGGER;
+
+#endif
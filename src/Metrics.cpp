@@ -0,0 +1,177 @@
+#include <Arduino.h>
+#include "Metrics.h"
+
+struct MetricsDescriptor
+{
+    const char* name;
+    const char* labels;
+    const char* help;
+};
+
+#define METRICS_DESCRIPTOR(id, name, labels, help) { name, labels, help },
+
+static const MetricsDescriptor s_histograms[] = { METRICS_HISTOGRAMS(METRICS_DESCRIPTOR) };
+static const MetricsDescriptor s_counters[] = { METRICS_COUNTERS(METRICS_DESCRIPTOR) };
+
+#undef METRICS_DESCRIPTOR
+
+#define METRICS_BOOT_DESCRIPTOR(id, name, help) { name, "", help },
+
+static const MetricsDescriptor s_boot_stages[] = { METRICS_BOOT_STAGES(METRICS_BOOT_DESCRIPTOR) };
+
+#undef METRICS_BOOT_DESCRIPTOR
+
+/**
+ * Tracks the free heap low watermark
+ *
+ * Called from the main loop so that we catch the
+ * worst case between scrapes, not just the value
+ * at the time of the scrape.
+ */
+void MetricsClass::sampleHeap()
+{
+    uint32_t free_heap = ESP.getFreeHeap();
+
+    if (free_heap < m_min_free_heap) m_min_free_heap = free_heap;
+}
+
+/*
+ * Records how long after boot a stage was reached,
+ * the first time only
+ */
+void MetricsClass::markBoot(const MetricsBootStage t_stage)
+{
+    if (!m_boot_ms[t_stage]) m_boot_ms[t_stage] = millis();
+}
+
+/**
+ * Writes all metrics in Prometheus text format
+ *
+ * Renders histograms, counters and heap gauges in
+ * the Prometheus text exposition format (v0.0.4).
+ * Bucket values are converted to cumulative counts
+ * here rather than on the recording path.
+ */
+void MetricsClass::printTo(Print& t_out)
+{
+    const char* previous = nullptr;
+
+    for (uint8_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+    {
+        const MetricsDescriptor& descriptor = s_histograms[i];
+        const MetricsHistogramData& histogram = m_histograms[i];
+        uint32_t cumulative = 0;
+        char le[24];
+
+        if (!previous || strcmp(previous, descriptor.name) != 0)
+        {
+            printHeader(t_out, descriptor.name, descriptor.help, "histogram");
+            previous = descriptor.name;
+        }
+
+        for (uint8_t bucket = 0; bucket <= METRICS_BUCKET_COUNT; bucket++)
+        {
+            cumulative += histogram.buckets[bucket];
+
+            if (bucket < METRICS_BUCKET_COUNT)
+            {
+                uint32_t bound = 1UL << (bucket + METRICS_FIRST_BUCKET_SHIFT);
+                snprintf(le, sizeof(le), "le=\"%lu.%06lu\"", (unsigned long)(bound / 1000000UL), (unsigned long)(bound % 1000000UL));
+            }
+            else
+            {
+                strncpy(le, "le=\"+Inf\"", sizeof(le));
+            }
+
+            printSeries(t_out, descriptor.name, "_bucket", descriptor.labels, le);
+            t_out.println(cumulative);
+        }
+
+        printSeries(t_out, descriptor.name, "_sum", descriptor.labels, "");
+        printSeconds(t_out, histogram.sum_us);
+        t_out.println();
+
+        printSeries(t_out, descriptor.name, "_count", descriptor.labels, "");
+        t_out.println(cumulative);
+    }
+
+    for (uint8_t i = 0; i < METRIC_COUNTER_COUNT; i++)
+    {
+        printHeader(t_out, s_counters[i].name, s_counters[i].help, "counter");
+        printSeries(t_out, s_counters[i].name, "", s_counters[i].labels, "");
+        t_out.println(m_counters[i]);
+    }
+
+    uint32_t free_heap;
+    uint16_t max_block;
+    uint8_t fragmentation;
+    ESP.getHeapStats(&free_heap, &max_block, &fragmentation);
+
+    printHeader(t_out, "musicbox_heap_free_bytes", "Free heap", "gauge");
+    t_out.print(F("musicbox_heap_free_bytes "));t_out.println(free_heap);
+
+    printHeader(t_out, "musicbox_heap_free_min_bytes", "Lowest free heap seen by the main loop", "gauge");
+    t_out.print(F("musicbox_heap_free_min_bytes "));t_out.println(m_min_free_heap == UINT32_MAX ? free_heap : m_min_free_heap);
+
+    printHeader(t_out, "musicbox_heap_max_block_bytes", "Largest allocatable heap block", "gauge");
+    t_out.print(F("musicbox_heap_max_block_bytes "));t_out.println(max_block);
+
+    printHeader(t_out, "musicbox_heap_fragmentation_ratio", "Heap fragmentation", "gauge");
+    t_out.print(F("musicbox_heap_fragmentation_ratio "));t_out.println(fragmentation / 100.0, 2);
+
+    printHeader(t_out, "musicbox_uptime_seconds", "Time since boot", "gauge");
+    t_out.print(F("musicbox_uptime_seconds "));t_out.println(millis() / 1000UL);
+
+    // Left out until the stage is reached
+    for (uint8_t i = 0; i < METRIC_BOOT_STAGE_COUNT; i++)
+    {
+        if (!m_boot_ms[i]) continue;
+
+        printHeader(t_out, s_boot_stages[i].name, s_boot_stages[i].help, "gauge");
+        printSeries(t_out, s_boot_stages[i].name, "", "", "");
+        printSeconds(t_out, m_boot_ms[i] * 1000ULL);
+        t_out.println();
+    }
+}
+
+const char* MetricsClass::getLabels(const MetricsHistogram t_id)
+{
+    return (t_id < METRIC_HISTOGRAM_COUNT) ? s_histograms[t_id].labels : "";
+}
+
+void MetricsClass::printSeconds(Print& t_out, const uint64_t t_micros)
+{
+    char buffer[24];
+
+    snprintf(buffer, sizeof(buffer), "%lu.%06lu", (unsigned long)(t_micros / 1000000ULL), (unsigned long)(t_micros % 1000000ULL));
+    t_out.print(buffer);
+}
+
+void MetricsClass::printSeries(Print& t_out, const char* t_name, const char* t_suffix, const char* t_labels, const char* t_extra_label)
+{
+    t_out.print(t_name);
+    t_out.print(t_suffix);
+
+    if (t_labels[0] || t_extra_label[0])
+    {
+        t_out.print('{');
+        t_out.print(t_labels);
+        if (t_labels[0] && t_extra_label[0]) t_out.print(',');
+        t_out.print(t_extra_label);
+        t_out.print('}');
+    }
+
+    t_out.print(' ');
+}
+
+void MetricsClass::printHeader(Print& t_out, const char* t_name, const char* t_help, const char* t_type)
+{
+    if (t_help[0])
+    {
+        t_out.print(F("# HELP "));t_out.print(t_name);t_out.print(' ');t_out.println(t_help);
+    }
+
+    t_out.print(F("# TYPE "));t_out.print(t_name);t_out.print(' ');t_out.println(t_type);
+}
+
+MetricsClass METRICS;
@@ -0,0 +1,157 @@
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <Arduino.h>
+
+#ifdef DEBUG
+    #define DEBUG_METRICS(x) x
+#else
+    #define DEBUG_METRICS(x) do{}while(0)
+#endif
+
+// Histogram buckets are powers of two in microseconds, starting
+// at 2^METRICS_FIRST_BUCKET_SHIFT (128us) up to ~4.2s, with a
+// final +Inf bucket for anything longer
+#define METRICS_FIRST_BUCKET_SHIFT  7
+#define METRICS_BUCKET_COUNT        16
+
+/*
+ * Histograms: X(id, name, labels, help)
+ *
+ * Entries sharing a name must be next to each other
+ * so that they are rendered as one metric family.
+ */
+#define METRICS_HISTOGRAMS(X) \
+    X(TAP_READ,             "musicbox_tap_read_seconds",        "",                         "Card detected to card memory read") \
+    X(TAP_DISPATCH,         "musicbox_tap_dispatch_seconds",    "",                         "Card queued to command dispatched") \
+    X(TAP_TOTAL,            "musicbox_tap_total_seconds",       "",                         "Card detected to command dispatched") \
+    X(MACRO,                "musicbox_macro_seconds",           "",                         "Macro card steps run as one batch") \
+    X(SOAP_QUEUE,           "musicbox_soap_request_seconds",    "action=\"queueUri\"",      "SOAP request connect and response time") \
+    X(SOAP_PLAY,            "musicbox_soap_request_seconds",    "action=\"play\"",          "") \
+    X(SOAP_PAUSE,           "musicbox_soap_request_seconds",    "action=\"pause\"",         "") \
+    X(SOAP_SERVICES,        "musicbox_soap_request_seconds",    "action=\"services\"",      "") \
+    X(SOAP_NEXT,            "musicbox_soap_request_seconds",    "action=\"next\"",          "") \
+    X(SOAP_PREVIOUS,        "musicbox_soap_request_seconds",    "action=\"previous\"",      "") \
+    X(SOAP_VOLUME,          "musicbox_soap_request_seconds",    "action=\"volume\"",        "") \
+    X(SOAP_GET_VOLUME,      "musicbox_soap_request_seconds",    "action=\"getVolume\"",     "") \
+    X(SOAP_PLAY_MODE,       "musicbox_soap_request_seconds",    "action=\"playMode\"",      "") \
+    X(SOAP_GROUP,           "musicbox_soap_request_seconds",    "action=\"group\"",         "") \
+    X(SOAP_SLEEP,           "musicbox_soap_request_seconds",    "action=\"sleep\"",         "") \
+    X(SOAP_FANOUT,          "musicbox_soap_request_seconds",    "action=\"fanOut\"",        "") \
+    X(SOAP_BODY_SERVICES,   "musicbox_soap_body_seconds",       "action=\"services\"",      "SOAP response body read time") \
+    X(SOAP_CONNECT,         "musicbox_soap_connect_seconds",    "",                         "Speaker connection setup, for requests that opened one") \
+    X(SOAP_FIRST_BYTE,      "musicbox_soap_first_byte_seconds", "",                         "Speaker request sent to the first byte of its response") \
+    X(DISCOVERY,            "musicbox_discovery_seconds",       "",                         "Sonos discovery duration") \
+    X(LOOP,                 "musicbox_loop_seconds",            "",                         "Main loop iteration time") \
+    X(WEB_REQUEST,          "musicbox_web_request_seconds",     "",                         "Web request service time")
+
+/*
+ * Counters: X(id, name, labels, help)
+ */
+#define METRICS_COUNTERS(X) \
+    X(TAPS,                 "musicbox_taps_total",              "",                         "Cards presented to the reader") \
+    X(RFID_READ_ERRORS,     "musicbox_rfid_read_errors_total",  "",                         "Cards that could not be fully read") \
+    X(TAPS_SUPERSEDED,      "musicbox_taps_superseded_total",   "",                         "Taps skipped because a newer tap replaced them") \
+    X(SPEAKER_WARMUPS,      "musicbox_speaker_warmups_total",   "",                         "Taps where the speaker's address was resolved while the card was read") \
+    X(SOAP_SKIPPED,         "musicbox_soap_skipped_total",      "",                         "SOAP requests not sent, as the speaker is down or the tap deadline passed") \
+    X(SOAP_ERRORS,          "musicbox_soap_errors_total",       "",                         "SOAP requests without a 200 response") \
+    X(MACROS_ABORTED,       "musicbox_macros_aborted_total",    "",                         "Macros stopped early by a failed step") \
+    X(VOLUME_COALESCED,     "musicbox_volume_coalesced_total",  "",                         "Volume changes replaced by a newer one before being sent") \
+    X(DISCOVERED_DEVICES,   "musicbox_discovered_devices_total","",                         "New Sonos devices found by discovery") \
+    X(EVICTED_DEVICES,      "musicbox_evicted_devices_total",   "",                         "Sonos devices dropped after they stopped responding") \
+    X(LOG_DROPPED,          "musicbox_log_dropped_total",       "",                         "Log records overwritten before they were written to serial") \
+    X(SSDP_DUPLICATES,      "musicbox_ssdp_duplicates_total",   "",                         "Discovery responses from a speaker we already knew") \
+    X(SOAP_HEAP_BYTES,      "musicbox_soap_heap_bytes_total",   "",                         "Heap held by SOAP requests once the response headers are in, summed over requests")
+
+/*
+ * Boot milestones, as gauges: X(id, name, help)
+ */
+#define METRICS_BOOT_STAGES(X) \
+    X(READY,                "musicbox_boot_ready_seconds",      "Boot to the reader taking cards") \
+    X(FIRST_TAP,            "musicbox_boot_first_tap_seconds",  "Boot to the first card whose command succeeded")
+
+#define METRICS_ENUM_ID(id, name, labels, help) METRIC_##id,
+
+enum MetricsHistogram : uint8_t
+{
+    METRICS_HISTOGRAMS(METRICS_ENUM_ID)
+    METRIC_HISTOGRAM_COUNT
+};
+
+enum MetricsCounter : uint8_t
+{
+    METRICS_COUNTERS(METRICS_ENUM_ID)
+    METRIC_COUNTER_COUNT
+};
+
+#undef METRICS_ENUM_ID
+
+#define METRICS_ENUM_BOOT(id, name, help) METRIC_BOOT_##id,
+
+enum MetricsBootStage : uint8_t
+{
+    METRICS_BOOT_STAGES(METRICS_ENUM_BOOT)
+    METRIC_BOOT_STAGE_COUNT
+};
+
+#undef METRICS_ENUM_BOOT
+
+struct MetricsHistogramData
+{
+    uint32_t buckets[METRICS_BUCKET_COUNT + 1]{}; // Last bucket is +Inf
+    uint64_t sum_us = 0;
+};
+
+class MetricsClass
+{
+public:
+    MetricsClass() {};
+
+    /*
+     * Records a duration in microseconds. Cheap enough
+     * (one clz and two adds) to call on every loop.
+     */
+    inline void observe(const MetricsHistogram t_id, const uint32_t t_micros)
+    {
+        MetricsHistogramData& histogram = m_histograms[t_id];
+
+        histogram.buckets[bucketFor(t_micros)]++;
+        histogram.sum_us += t_micros;
+    }
+
+    inline void increment(const MetricsCounter t_id, const uint32_t t_count = 1)
+    {
+        m_counters[t_id] += t_count;
+    }
+
+    void sampleHeap();
+    void markBoot(const MetricsBootStage);
+    void printTo(Print&);
+
+    // For other modules adding their own series to the output
+    static void printSeconds(Print&, const uint64_t);
+    static void printHeader(Print&, const char*, const char*, const char*);
+    static const char* getLabels(const MetricsHistogram);
+
+private:
+    MetricsHistogramData m_histograms[METRIC_HISTOGRAM_COUNT];
+    uint32_t m_counters[METRIC_COUNTER_COUNT]{};
+    uint32_t m_min_free_heap = UINT32_MAX;
+    uint32_t m_boot_ms[METRIC_BOOT_STAGE_COUNT]{};  // 0 until reached
+
+    static inline uint8_t bucketFor(const uint32_t t_micros)
+    {
+        if (t_micros <= (1UL << METRICS_FIRST_BUCKET_SHIFT)) return 0;
+
+        // ceil(log2(t_micros)) relative to the first bucket
+        uint8_t bucket = (32 - __builtin_clz(t_micros - 1)) - METRICS_FIRST_BUCKET_SHIFT;
+
+        return (bucket > METRICS_BUCKET_COUNT) ? METRICS_BUCKET_COUNT : bucket;
+    }
+
+    static void printSeries(Print&, const char*, const char*, const char*, const char*);
+};
+
+extern MetricsClass METRICS;
+
+#endif
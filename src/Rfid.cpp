@@ -1,4 +1,7 @@
 #include "Rfid.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Log.h"
 #include <SPI.h>
 
 /**
@@ -29,13 +32,10 @@ void Rfid::writeRfid(const uint8_t* t_write_buffer, uint16_t t_write_buffer_size
     m_write_on_next_card = true;
     m_write_timer = millis();
     
-    // Copy the write buffer over to a new buffer
-    
-    // TODO: Maybe we should just allocate a large char array to buffer this instead
-    if (m_write_buffer) free(m_write_buffer); // Free any previous memory allocated to the pointer
+    // Cards hold no more than a read gives back
+    if (t_write_buffer_size > sizeof(m_write_buffer)) t_write_buffer_size = sizeof(m_write_buffer);
 
-    m_write_buffer = (uint8_t*)malloc(t_write_buffer_size * sizeof(uint8_t));
-    memcpy(m_write_buffer, t_write_buffer, t_write_buffer_size * sizeof(uint8_t));
+    memcpy(m_write_buffer, t_write_buffer, t_write_buffer_size);
     m_write_buffer_size = t_write_buffer_size;
 }
 
@@ -48,38 +48,115 @@ void Rfid::setWriteTimeout(const uint32_t t_length)
     m_write_timeout = t_length;
 }
 
+void Rfid::setWriteCallback(void (*t_write_callback)(const uint8_t*, const uint8_t, const uint8_t*, const uint16_t, const bool))
+{
+    m_write_callback = t_write_callback;
+}
+
+/*
+ * Optional lookup of a card's command by its UID. If the
+ * resolver returns true the card memory isn't read at all,
+ * which also allows read-only or non MIFARE Classic tags.
+ */
+void Rfid::setUidResolver(bool (*t_uid_resolver)(const uint8_t*, const uint8_t, uint8_t*, const uint16_t))
+{
+    m_uid_resolver = t_uid_resolver;
+}
+
+/*
+ * Called as soon as a card is selected, before it's
+ * resolved or read, so the caller can get ready for
+ * the command while the card is still being read.
+ * Not called for cards being written.
+ */
+void Rfid::setDetectCallback(void (*t_detect_callback)(const uint8_t*, const uint8_t))
+{
+    m_detect_callback = t_detect_callback;
+}
+
+uint8_t Rfid::getLastUid(uint8_t* t_uid, const uint8_t t_uid_size)
+{
+    uint8_t size = (m_last_uid.size < t_uid_size) ? m_last_uid.size : t_uid_size;
+
+    memcpy(t_uid, m_last_uid.uidByte, size);
+
+    return size;
+}
+
 void Rfid::cancelWriteRfid()
 {
     DEBUG_RFID(Serial.println(F("Rfid::cancelWriteRfid Cancelling write")));
     
     m_write_on_next_card = false;
-    if (m_write_buffer) free(m_write_buffer);
-    m_write_buffer = nullptr;
     m_write_buffer_size = 0;
 }
 
-void Rfid::handle(void (*read_callback)(const uint8_t*, const uint8_t*, const uint8_t), uint8_t* t_read_buffer, uint16_t t_buffer_size)
+void Rfid::handle(RfidEventQueue& t_events)
 {
     // Check whether the write timer has expired 
     if (m_write_on_next_card && (millis() > (m_write_timeout + m_write_timer)))
     {
-        Serial.println(F("Rfid::handleRfid Write timer expired. Cancelling write to card"));
+        LOG(RFID_WRITE_EXPIRED);
 
         cancelWriteRfid(); // Clear everything out
     }
 
+    // Leave any new card unselected until there's room to
+    // queue it, it'll still be there to detect next time
+    RfidCardEvent* event = t_events.claim();
+
+    if (!event)
+        return;
+
     // Check whether a card has been presented
 
     //TODO: improve the new card detection routine as per researched code
     // Reset the loop if no new card present on the sensor/reader. This saves the entire process when idle.
+    unsigned long poll_start = micros();
+
     if (!m_mfrc522.PICC_IsNewCardPresent())
         return;
 
+    unsigned long detect_time = micros();
+
     // Select one of the cards
     if (!m_mfrc522.PICC_ReadCardSerial())
         return;
 
-    Serial.println(F("Rfid::handleRfid New card detected"));
+    event->tap = TRACE.beginTap();
+    TRACE.record(TRACE_DETECT, poll_start);
+
+    LOG(RFID_NEW_CARD);
+
+    m_last_uid = m_mfrc522.uid;
+
+    if (!m_write_on_next_card && m_detect_callback) m_detect_callback(m_mfrc522.uid.uidByte, m_mfrc522.uid.size);
+
+    memcpy(event->uid, m_mfrc522.uid.uidByte, sizeof(event->uid));
+    event->uid_size = m_mfrc522.uid.size;
+    event->detect_time = detect_time;
+
+    unsigned long resolve_start = micros();
+
+    // UID mapped cards don't need to be read
+    if (!m_write_on_next_card && m_uid_resolver && m_uid_resolver(m_mfrc522.uid.uidByte, m_mfrc522.uid.size, event->data, sizeof(event->data)))
+    {
+        DEBUG_RFID(Serial.println(F("Rfid::handleRfid Resolved card by UID")));
+
+        TRACE.record(TRACE_RESOLVE, resolve_start);
+
+        m_mfrc522.PICC_HaltA();
+
+        METRICS.increment(METRIC_TAPS);
+        METRICS.observe(METRIC_TAP_READ, micros() - detect_time);
+
+        event->queue_time = micros();
+        t_events.publish();
+
+        TRACE.setTap(0);
+
+        return;
+    }
 
     MFRC522::PICC_Type piccType = m_mfrc522.PICC_GetType(m_mfrc522.uid.sak);
 
@@ -96,15 +173,23 @@ void Rfid::handle(void (*read_callback)(const uint8_t*, const uint8_t*, const ui
         &&  piccType != MFRC522::PICC_TYPE_MIFARE_1K
         &&  piccType != MFRC522::PICC_TYPE_MIFARE_4K)
     {
-        Serial.println(F("Rfid::handleRfid This app only works with MIFARE Classic cards."));
+        LOG(RFID_NOT_CLASSIC);
+        TRACE.setTap(0);
         return;
     }
 
+    bool card_read = false;
+
     if (m_write_on_next_card)
     {
         DEBUG_RFID(Serial.println(F("Rfid::handleRfid Writing to a card...")));
 
-        writeBufferToCard(RFID_START_SECTOR, m_write_buffer, m_write_buffer_size);
+        RfidIfaceReturn result = writeBufferToCard(RFID_START_SECTOR, m_write_buffer, m_write_buffer_size);
+
+        if (m_write_callback)
+        {
+            m_write_callback(m_mfrc522.uid.uidByte, m_mfrc522.uid.size, m_write_buffer, m_write_buffer_size, result == RfidIfaceReturn::OK);
+        }
         
         cancelWriteRfid(); // Clear everything out
     }
@@ -112,16 +197,36 @@ void Rfid::handle(void (*read_callback)(const uint8_t*, const uint8_t*, const ui
     {
         DEBUG_RFID(Serial.println(F("Rfid::handleRfid Reading from a card...")));
 
-        readBufferFromCard(RFID_START_SECTOR, t_read_buffer, t_buffer_size);
-        
-        read_callback(m_mfrc522.uid.uidByte, t_read_buffer, t_buffer_size);
+        unsigned long read_start = micros();
+
+        if (readBufferFromCard(RFID_START_SECTOR, event->data, sizeof(event->data)) != RfidIfaceReturn::OK)
+        {
+            METRICS.increment(METRIC_RFID_READ_ERRORS);
+        }
+
+        TRACE.record(TRACE_READ, read_start);
+
+        card_read = true;
     }
 
+    // Release the card before anything acts on what was read,
+    // so network requests never run mid-transaction
     // Halt PICC
     m_mfrc522.PICC_HaltA();
     // Stop encryption on PCD
     m_mfrc522.PCD_StopCrypto1();
 
+    if (card_read)
+    {
+        METRICS.increment(METRIC_TAPS);
+        METRICS.observe(METRIC_TAP_READ, micros() - detect_time);
+
+        event->queue_time = micros();
+        t_events.publish();
+    }
+
+    TRACE.setTap(0);
+
     DEBUG_RFID(Serial.println(F("Rfid::handleRfid Completed")));
 }
 
@@ -154,6 +259,7 @@ Rfid::RfidIfaceReturn Rfid::writeBufferToCard(uint8_t t_starting_sector, const u
         else
         {
             DEBUG_RFID(Serial.println(F("Rfid::writeBufferToCard Error while writing a card")));
+            ret_val = RfidIfaceReturn::WRITE_FAILURE;
         }
     }
     return ret_val;
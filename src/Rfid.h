@@ -2,6 +2,7 @@
 #define Rfid_h
 
 #include <MFRC522.h>
+#include "SpscQueue.h"
 
 #define SS_PIN                      D4
 #define RST_PIN                     D3
@@ -10,12 +11,28 @@
 #define RFID_BLOCK_SIZE_ULTRA       4
 #define RFID_START_SECTOR           1   // Need to change how this works
 
+#define RFID_EVENT_QUEUE_SIZE       4
+#define RFID_EVENT_DATA_SIZE        255
+
 #ifdef DEBUG
     #define DEBUG_RFID(x) x
 #else 
     #define DEBUG_RFID(x) do{}while(0)
 #endif
 
+// A card that has been read (or resolved by UID), waiting to be acted on
+struct RfidCardEvent
+{
+    uint8_t uid[10];
+    uint8_t uid_size;
+    uint8_t data[RFID_EVENT_DATA_SIZE];
+    uint32_t detect_time;   // micros() when the card was detected
+    uint32_t queue_time;    // micros() when it was queued
+    uint16_t tap;           // For tracing
+};
+
+typedef SpscQueue<RfidCardEvent, RFID_EVENT_QUEUE_SIZE> RfidEventQueue;
+
 class Rfid
 {
 public:
@@ -23,10 +40,14 @@ public:
         m_mfrc522(SS_PIN, RST_PIN)
         {};
     void begin();
-    void handle(void (*callback)(const uint8_t*, const uint8_t*, const uint8_t), uint8_t*, uint16_t);
+    void handle(RfidEventQueue&);
     void writeRfid(const uint8_t*, uint16_t);
     void cancelWriteRfid();
     void setWriteTimeout(const uint32_t);
+    void setWriteCallback(void (*)(const uint8_t*, const uint8_t, const uint8_t*, const uint16_t, const bool));
+    void setUidResolver(bool (*)(const uint8_t*, const uint8_t, uint8_t*, const uint16_t));
+    void setDetectCallback(void (*)(const uint8_t*, const uint8_t));
+    uint8_t getLastUid(uint8_t*, const uint8_t);
   
 private:
     enum RfidIfaceReturn
@@ -44,8 +65,12 @@ private:
     uint32_t m_write_timeout =  (10 * 1000); // 10 Seconds
     uint32_t m_write_timer = 0;
     bool m_write_on_next_card = false;
-    uint8_t* m_write_buffer = nullptr;
-    uint16_t m_write_buffer_size;
+    uint8_t m_write_buffer[RFID_EVENT_DATA_SIZE];
+    uint16_t m_write_buffer_size = 0;
+    void (*m_write_callback)(const uint8_t*, const uint8_t, const uint8_t*, const uint16_t, const bool) = nullptr;
+    bool (*m_uid_resolver)(const uint8_t*, const uint8_t, uint8_t*, const uint16_t) = nullptr;
+    void (*m_detect_callback)(const uint8_t*, const uint8_t) = nullptr;
+    MFRC522::Uid m_last_uid{};
 
     Rfid::RfidIfaceReturn writeBufferToCard(uint8_t, const uint8_t*, const uint16_t);
     Rfid::RfidIfaceReturn readBufferFromCard(uint8_t, uint8_t*, const uint16_t);
@@ -0,0 +1,216 @@
+#include <Arduino.h>
+#include "Scheduler.h"
+#include "Metrics.h"
+#include "Heap.h"
+#include "Log.h"
+
+uint32_t Scheduler::defaultClock()
+{
+    return micros();
+}
+
+/*
+ * Replaces the clock (in microseconds) used for
+ * periods and budgets, so the scheduler can be
+ * driven by a fake clock
+ */
+void Scheduler::setClock(SchedulerClock t_clock)
+{
+    m_clock = t_clock ? t_clock : defaultClock;
+}
+
+/**
+ * Adds a task that runs every period
+ *
+ * The first run is one period from now; signal()
+ * the task as well if it should run straight away.
+ * Returns the task ID, or -1 if there's no room.
+ */
+int8_t Scheduler::addPeriodic(const char* t_name, SchedulerCallback t_callback, void* t_context, const uint32_t t_period_ms, const SchedulerPriority t_priority, const uint32_t t_budget_us)
+{
+    int8_t id = addTask(t_name, t_callback, t_context, t_priority, t_budget_us);
+
+    if (id >= 0)
+    {
+        m_tasks[id].periodic = true;
+        m_tasks[id].period_us = t_period_ms * 1000UL;
+        m_tasks[id].next_run_us = m_clock() + m_tasks[id].period_us;
+    }
+
+    return id;
+}
+
+/**
+ * Adds a task that only runs when signalled
+ *
+ * Returns the task ID, or -1 if there's no room.
+ */
+int8_t Scheduler::addEvent(const char* t_name, SchedulerCallback t_callback, void* t_context, const SchedulerPriority t_priority, const uint32_t t_budget_us)
+{
+    return addTask(t_name, t_callback, t_context, t_priority, t_budget_us);
+}
+
+/*
+ * Marks a task to run on the next pass. Signalling
+ * a task more than once before it runs only runs
+ * it once.
+ */
+void Scheduler::signal(const int8_t t_id)
+{
+    if ((t_id >= 0) && (t_id < m_task_count)) m_tasks[t_id].pending = true;
+}
+
+/**
+ * Runs one pass of the scheduler
+ *
+ * Repeatedly picks the highest priority task that
+ * is ready and hasn't run yet this pass (ties go to
+ * the task registered first), until there are none
+ * left. Readiness is checked again after each task,
+ * so a task signalled by another runs in the same
+ * pass if it hasn't already had its turn.
+ */
+void Scheduler::run()
+{
+    uint32_t has_run = 0;
+
+    while (true)
+    {
+        uint32_t now = m_clock();
+        int8_t next = -1;
+
+        for (uint8_t i = 0; i < m_task_count; i++)
+        {
+            if ((has_run & (1UL << i)) || !isReady(m_tasks[i], now)) continue;
+
+            if ((next < 0) || (m_tasks[i].priority > m_tasks[next].priority)) next = i;
+        }
+
+        if (next < 0) break;
+
+        SchedulerTask& task = m_tasks[next];
+
+        has_run |= (1UL << next);
+        task.pending = false;
+
+        // A signalled run before the task is due leaves its
+        // schedule alone. Otherwise the next run is a period
+        // on from this one, but don't try to catch up on
+        // missed runs, just carry on a period from now.
+        if (task.periodic && ((int32_t)(now - task.next_run_us) >= 0))
+        {
+            task.next_run_us += task.period_us;
+            if ((int32_t)(now - task.next_run_us) >= 0) task.next_run_us = now + task.period_us;
+        }
+
+        uint32_t allocations = HEAP.getAllocations();
+        uint32_t allocated_bytes = HEAP.getAllocatedBytes();
+        uint32_t start = m_clock();
+        task.callback(task.context);
+        uint32_t elapsed = m_clock() - start;
+
+        task.allocations += HEAP.getAllocations() - allocations;
+        task.allocated_bytes += HEAP.getAllocatedBytes() - allocated_bytes;
+        task.runs++;
+        task.total_us += elapsed;
+        if (elapsed > task.max_us) task.max_us = elapsed;
+
+        if (elapsed > task.budget_us)
+        {
+            task.overruns++;
+            LOG(SCHEDULER_OVER_BUDGET, task.name, elapsed);
+        }
+    }
+}
+
+uint8_t Scheduler::getTaskCount()
+{
+    return m_task_count;
+}
+
+const SchedulerTask* Scheduler::getTask(const uint8_t t_id)
+{
+    return (t_id < m_task_count) ? &m_tasks[t_id] : nullptr;
+}
+
+/**
+ * Writes the task stats in Prometheus text format
+ *
+ * Follows on from the output of METRICS.printTo,
+ * with one series per task.
+ */
+void Scheduler::printTo(Print& t_out)
+{
+    MetricsClass::printHeader(t_out, "musicbox_task_runs_total", "Scheduler task runs", "counter");
+    for (uint8_t i = 0; i < m_task_count; i++)
+    {
+        t_out.print(F("musicbox_task_runs_total{task=\""));t_out.print(m_tasks[i].name);t_out.print(F("\"} "));
+        t_out.println(m_tasks[i].runs);
+    }
+
+    MetricsClass::printHeader(t_out, "musicbox_task_overruns_total", "Scheduler task runs over budget", "counter");
+    for (uint8_t i = 0; i < m_task_count; i++)
+    {
+        t_out.print(F("musicbox_task_overruns_total{task=\""));t_out.print(m_tasks[i].name);t_out.print(F("\"} "));
+        t_out.println(m_tasks[i].overruns);
+    }
+
+    MetricsClass::printHeader(t_out, "musicbox_task_seconds_total", "Time spent running scheduler tasks", "counter");
+    for (uint8_t i = 0; i < m_task_count; i++)
+    {
+        t_out.print(F("musicbox_task_seconds_total{task=\""));t_out.print(m_tasks[i].name);t_out.print(F("\"} "));
+        MetricsClass::printSeconds(t_out, m_tasks[i].total_us);
+        t_out.println();
+    }
+
+    MetricsClass::printHeader(t_out, "musicbox_task_max_seconds", "Longest run of a scheduler task", "gauge");
+    for (uint8_t i = 0; i < m_task_count; i++)
+    {
+        t_out.print(F("musicbox_task_max_seconds{task=\""));t_out.print(m_tasks[i].name);t_out.print(F("\"} "));
+        MetricsClass::printSeconds(t_out, m_tasks[i].max_us);
+        t_out.println();
+    }
+
+#ifdef HEAP_COUNT_ALLOCATIONS
+    MetricsClass::printHeader(t_out, "musicbox_task_allocations_total", "Heap allocations made by scheduler tasks", "counter");
+    for (uint8_t i = 0; i < m_task_count; i++)
+    {
+        t_out.print(F("musicbox_task_allocations_total{task=\""));t_out.print(m_tasks[i].name);t_out.print(F("\"} "));
+        t_out.println(m_tasks[i].allocations);
+    }
+
+    MetricsClass::printHeader(t_out, "musicbox_task_allocated_bytes_total", "Bytes allocated by scheduler tasks", "counter");
+    for (uint8_t i = 0; i < m_task_count; i++)
+    {
+        t_out.print(F("musicbox_task_allocated_bytes_total{task=\""));t_out.print(m_tasks[i].name);t_out.print(F("\"} "));
+        t_out.println(m_tasks[i].allocated_bytes);
+    }
+#endif
+}
+
+int8_t Scheduler::addTask(const char* t_name, SchedulerCallback t_callback, void* t_context, const SchedulerPriority t_priority, const uint32_t t_budget_us)
+{
+    if (!t_callback || (m_task_count >= SCHEDULER_MAX_TASKS))
+    {
+        LOG(SCHEDULER_ADD_FAILED, t_name);
+        return -1;
+    }
+
+    SchedulerTask& task = m_tasks[m_task_count];
+
+    memset(&task, 0, sizeof(task));
+    task.name = t_name;
+    task.callback = t_callback;
+    task.context = t_context;
+    task.priority = t_priority;
+    task.budget_us = t_budget_us;
+
+    return m_task_count++;
+}
+
+bool Scheduler::isReady(const SchedulerTask& t_task, const uint32_t t_now)
+{
+    return t_task.pending || (t_task.periodic && ((int32_t)(t_now - t_task.next_run_us) >= 0));
+}
+
+Scheduler SCHEDULER;
@@ -0,0 +1,79 @@
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS         12
+
+static_assert(SCHEDULER_MAX_TASKS <= 32, "A pass tracks the tasks that have run in a 32 bit mask");
+
+enum SchedulerPriority : uint8_t
+{
+    SCHEDULER_PRIORITY_LOW,
+    SCHEDULER_PRIORITY_NORMAL,
+    SCHEDULER_PRIORITY_HIGH
+};
+
+typedef void (*SchedulerCallback)(void*);
+typedef uint32_t (*SchedulerClock)();
+
+struct SchedulerTask
+{
+    const char* name;
+    SchedulerCallback callback;
+    void* context;
+    SchedulerPriority priority;
+    bool periodic;
+    bool pending;           // Signalled, run on the next pass
+    uint32_t period_us;
+    uint32_t budget_us;
+    uint32_t next_run_us;
+
+    // Stats
+    uint32_t runs;
+    uint32_t overruns;      // Runs that took longer than the budget
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t allocations;   // Heap allocations made while running, see Heap.h
+    uint32_t allocated_bytes;
+};
+
+/*
+ * Cooperative scheduler
+ *
+ * Tasks are either periodic, or event tasks that
+ * only run when signalled. Each call to run() is one
+ * pass, which runs every ready task at most once,
+ * highest priority first. Nothing is pre-empted, so
+ * a task's budget is what it's expected to take per
+ * run; going over is recorded as an overrun so that
+ * anything holding up card handling shows up in the
+ * stats. Periods must be under ~35 minutes, as times
+ * are kept in (wrapping) microseconds.
+ */
+class Scheduler
+{
+public:
+    Scheduler() {};
+    void setClock(SchedulerClock);
+    int8_t addPeriodic(const char*, SchedulerCallback, void*, const uint32_t, const SchedulerPriority, const uint32_t);
+    int8_t addEvent(const char*, SchedulerCallback, void*, const SchedulerPriority, const uint32_t);
+    void signal(const int8_t);
+    void run();
+    uint8_t getTaskCount();
+    const SchedulerTask* getTask(const uint8_t);
+    void printTo(Print&);
+
+private:
+    SchedulerTask m_tasks[SCHEDULER_MAX_TASKS];
+    uint8_t m_task_count = 0;
+    SchedulerClock m_clock = defaultClock;
+
+    static uint32_t defaultClock();
+    int8_t addTask(const char*, SchedulerCallback, void*, const SchedulerPriority, const uint32_t);
+    bool isReady(const SchedulerTask&, const uint32_t);
+};
+
+extern Scheduler SCHEDULER;
+
+#endif
@@ -0,0 +1,374 @@
+#include <Arduino.h>
+#include "SoapClient.h"
+#include "Metrics.h"
+#include "Utility.h"
+
+static const char* s_request_prefix = SOAP_HEADER_PREFIX("%s", "%s");
+
+// After the prefix, what changes with the speaker and the payload
+static const char* s_request_header =
+    "Host: %u.%u.%u.%u:%u\r\n"
+    "Content-Length: %u\r\n"
+    "Connection: %s\r\n"
+    "\r\n";
+
+// Not one of HTTPClient's, so it never gets past request()
+static const int16_t s_stale_connection = -100;
+
+static const char* s_get_header =
+    "GET %s HTTP/1.1\r\n"
+    "Host: %u.%u.%u.%u:%u\r\n"
+    "User-Agent: " SOAP_USER_AGENT "\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+/**
+ * Sends a request and reads the response headers
+ *
+ * With t_keep_alive the connection is left open
+ * after the response, if the speaker agrees, and
+ * the next request to the same speaker goes out on
+ * it. If the speaker has closed it since, the
+ * request is sent again on a new connection.
+ *
+ * Returns the HTTP status, or an HTTPC_ERROR_* code.
+ */
+int16_t SoapClient::post(const IPAddress& t_ip, const SoapAction& t_action, const char* t_payload, const uint16_t t_timeout, const bool t_keep_alive)
+{
+    char header[SOAP_HEADER_SIZE];
+    size_t payload_length = strlen(t_payload);
+    int header_length = formatHeader(header, sizeof(header), t_ip, t_action, payload_length, t_keep_alive);
+
+    if ((header_length < 0) || ((size_t)header_length >= sizeof(header))) return HTTPC_ERROR_SEND_HEADER_FAILED;
+
+    m_timeout = t_timeout;
+    m_client.setTimeout(t_timeout);
+    setTimeout(t_timeout);
+
+    return request(t_ip, header, header_length, t_payload, payload_length, t_keep_alive);
+}
+
+/**
+ * As above, for an endpoint and action only known
+ * at run time, e.g. from a capture
+ */
+int16_t SoapClient::post(const IPAddress& t_ip, const char* t_endpoint, const char* t_action, const char* t_payload, const uint16_t t_timeout, const bool t_keep_alive)
+{
+    char header[SOAP_HEADER_SIZE];
+    size_t payload_length = strlen(t_payload);
+    int header_length = formatHeader(header, sizeof(header), t_ip, t_endpoint, t_action, payload_length, t_keep_alive);
+
+    if ((header_length < 0) || ((size_t)header_length >= sizeof(header))) return HTTPC_ERROR_SEND_HEADER_FAILED;
+
+    m_timeout = t_timeout;
+    m_client.setTimeout(t_timeout);
+    setTimeout(t_timeout);
+
+    return request(t_ip, header, header_length, t_payload, payload_length, t_keep_alive);
+}
+
+/**
+ * Fetches a URL from a speaker, e.g. the LOCATION
+ * from discovery. The host in the URL is ignored in
+ * favour of t_ip; only the port and path are used.
+ *
+ * Returns the HTTP status, or an HTTPC_ERROR_* code.
+ */
+int16_t SoapClient::get(const IPAddress& t_ip, const char* t_url, const uint16_t t_timeout)
+{
+    const char* host = strstr(t_url, "://");
+    host = host ? (host + 3) : t_url;
+
+    const char* path = strchr(host, '/');
+    const char* port = (const char*)memchr(host, ':', path ? (size_t)(path - host) : strlen(host));
+    char header[SOAP_HEADER_SIZE];
+    uint16_t port_number = port ? atoi(port + 1) : 80;
+
+    int header_length = snprintf(header, sizeof(header), s_get_header, path ? path : "/", t_ip[0], t_ip[1], t_ip[2], t_ip[3], port_number);
+
+    if ((header_length < 0) || ((size_t)header_length >= sizeof(header))) return HTTPC_ERROR_SEND_HEADER_FAILED;
+
+    m_timeout = t_timeout;
+    m_client.setTimeout(t_timeout);
+    setTimeout(t_timeout);
+
+    // A kept-alive SOAP connection isn't reused for this
+    m_reusable = false;
+
+    int16_t status = send(t_ip, port_number, header, header_length, nullptr, 0);
+
+    if (status < 0) return status;
+
+    return readHeaders(false, false);
+}
+
+/*
+ * A kept-alive connection the speaker has closed
+ * since shows up as the send failing, or as the
+ * connection going without a status line coming
+ * back, so either way it's sent again on a new one.
+ * Once the status line has started to arrive the
+ * speaker has the request, so it isn't repeated.
+ */
+int16_t SoapClient::request(const IPAddress& t_ip, const char* t_header, const size_t t_header_length, const char* t_payload, const size_t t_payload_length, const bool t_keep_alive)
+{
+    bool reused = m_reusable && (m_ip == t_ip) && (m_port == SOAP_PORT) && m_client.connected();
+    int16_t status = send(t_ip, SOAP_PORT, t_header, t_header_length, t_payload, t_payload_length);
+
+    if (status == 0) status = readHeaders(t_keep_alive, reused);
+
+    if (reused && ((status == HTTPC_ERROR_SEND_HEADER_FAILED) || (status == HTTPC_ERROR_CONNECTION_LOST) || (status == s_stale_connection)))
+    {
+        DEBUG_SOAP(Serial.println(F("SoapClient::request kept-alive connection was closed, reconnecting")));
+
+        stop();
+        status = send(t_ip, SOAP_PORT, t_header, t_header_length, t_payload, t_payload_length);
+
+        if (status == 0) status = readHeaders(t_keep_alive, false);
+    }
+
+    return status;
+}
+
+int16_t SoapClient::send(const IPAddress& t_ip, const uint16_t t_port, const char* t_header, const size_t t_header_length, const char* t_payload, const size_t t_payload_length)
+{
+    if (!(m_reusable && (m_ip == t_ip) && (m_port == t_port) && m_client.connected()))
+    {
+        unsigned long connect_start = micros();
+
+        m_client.stop();
+
+        if (!m_client.connect(t_ip, t_port)) return HTTPC_ERROR_CONNECTION_FAILED;
+
+        METRICS.observe(METRIC_SOAP_CONNECT, micros() - connect_start);
+
+        m_client.setNoDelay(true);
+        m_ip = t_ip;
+        m_port = t_port;
+    }
+
+    m_reusable = false;
+    m_body_remaining = 0;
+
+    if (m_client.write((const uint8_t*)t_header, t_header_length) != t_header_length) return HTTPC_ERROR_SEND_HEADER_FAILED;
+    if (t_payload_length && (m_client.write((const uint8_t*)t_payload, t_payload_length) != t_payload_length)) return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+
+    m_sent = micros();
+
+    return 0;
+}
+
+/*
+ * Reads the status line and headers, leaving
+ * the client at the start of the body. On a
+ * t_reused connection, the speaker hanging up or
+ * an empty line where the status should be is
+ * s_stale_connection, for request() to retry.
+ */
+int16_t SoapClient::readHeaders(const bool t_keep_alive, const bool t_reused)
+{
+    unsigned long start = millis();
+    char line[SOAP_LINE_SIZE];
+
+    // The first byte, for the wait apart from reading the rest
+    while (!m_client.available() && m_client.connected() && ((millis() - start) < m_timeout)) yield();
+
+    if (m_client.available()) METRICS.observe(METRIC_SOAP_FIRST_BYTE, micros() - m_sent);
+
+    int16_t length = readLine(line, sizeof(line), start);
+
+    if (t_reused && ((length == 0) || (length == HTTPC_ERROR_CONNECTION_LOST))) return s_stale_connection;
+
+    if (length < 0) return length;
+
+    // "HTTP/1.1 200 OK"
+    if ((length < 12) || (strncmp(line, "HTTP/1.", 7) != 0)) return HTTPC_ERROR_NO_HTTP_SERVER;
+
+    int16_t status = atoi(&line[9]);
+    bool close = (line[7] == '0');  // HTTP/1.0 closes unless asked not to
+    int32_t content_length = -1;
+
+    while ((length = readLine(line, sizeof(line), start)) > 0)
+    {
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+        {
+            content_length = atol(&line[15]);
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0)
+        {
+            close = (stristr(&line[11], "close") != nullptr);
+        }
+    }
+
+    if (length < 0) return length;
+
+    m_body_remaining = content_length;
+
+    // Without a length we can't tell where the next response would start
+    m_reusable = t_keep_alive && !close && (content_length >= 0);
+
+    return status;
+}
+
+/*
+ * Reads a line, without the line ending, cutting it
+ * to fit. Returns its length, or an HTTPC_ERROR_* code
+ * if the connection drops or the response is too slow.
+ */
+int16_t SoapClient::readLine(char* t_line, const size_t t_size, const unsigned long t_start)
+{
+    size_t length = 0;
+
+    while (true)
+    {
+        int c = m_client.read();
+
+        if (c < 0)
+        {
+            if (!m_client.connected()) return HTTPC_ERROR_CONNECTION_LOST;
+            if ((millis() - t_start) >= m_timeout) return HTTPC_ERROR_READ_TIMEOUT;
+
+            yield();
+            continue;
+        }
+
+        if (c == '\n') break;
+
+        if ((c != '\r') && (length < (t_size - 1))) t_line[length++] = c;
+    }
+
+    t_line[length] = '\0';
+
+    return length;
+}
+
+/*
+ * Hands the rest of the body to t_callback a chunk at
+ * a time (or drops it, if t_callback is null). Returns
+ * true once the whole body has been read.
+ */
+bool SoapClient::readBody(SoapBodyCallback t_callback, void* t_context)
+{
+    char chunk[SOAP_BODY_CHUNK];
+    unsigned long start = millis();
+
+    while (m_body_remaining != 0)
+    {
+        int length = read((uint8_t*)chunk, sizeof(chunk));
+
+        if (length > 0)
+        {
+            if (t_callback) t_callback(chunk, length, t_context);
+            continue;
+        }
+
+        // Without a length, the body ends when the speaker hangs up
+        if (!m_client.connected()) return (m_body_remaining < 0);
+        if ((millis() - start) >= m_timeout) return false;
+
+        yield();
+    }
+
+    return true;
+}
+
+/*
+ * Finishes with the response. A kept-alive connection
+ * stays open if the rest of the body could be read.
+ */
+void SoapClient::end()
+{
+    if (m_reusable && (m_body_remaining > 0)) readBody(nullptr, nullptr);
+
+    if (!m_reusable || (m_body_remaining != 0)) stop();
+}
+
+void SoapClient::stop()
+{
+    m_client.stop();
+    m_reusable = false;
+    m_body_remaining = 0;
+}
+
+/*
+ * Formats the request line and headers, copying in
+ * the action's prefix. Returns the length, as
+ * snprintf does.
+ */
+int SoapClient::formatHeader(char* t_buffer, const size_t t_size, const IPAddress& t_ip, const SoapAction& t_action, const size_t t_payload_length, const bool t_keep_alive)
+{
+    if (t_action.prefix_length >= t_size) return t_action.prefix_length;
+
+    memcpy(t_buffer, t_action.prefix, t_action.prefix_length);
+
+    int length = snprintf(t_buffer + t_action.prefix_length, t_size - t_action.prefix_length, s_request_header,
+                          t_ip[0], t_ip[1], t_ip[2], t_ip[3], SOAP_PORT, (unsigned int)t_payload_length, t_keep_alive ? "keep-alive" : "close");
+
+    return (length < 0) ? length : (t_action.prefix_length + length);
+}
+
+/*
+ * As above, with the prefix formatted too
+ */
+int SoapClient::formatHeader(char* t_buffer, const size_t t_size, const IPAddress& t_ip, const char* t_endpoint, const char* t_action, const size_t t_payload_length, const bool t_keep_alive)
+{
+    int prefix_length = snprintf(t_buffer, t_size, s_request_prefix, t_endpoint, t_action);
+
+    if ((prefix_length < 0) || ((size_t)prefix_length >= t_size)) return prefix_length;
+
+    int length = snprintf(t_buffer + prefix_length, t_size - prefix_length, s_request_header,
+                          t_ip[0], t_ip[1], t_ip[2], t_ip[3], SOAP_PORT, (unsigned int)t_payload_length, t_keep_alive ? "keep-alive" : "close");
+
+    return (length < 0) ? length : (prefix_length + length);
+}
+
+int SoapClient::available()
+{
+    int available = m_client.available();
+
+    return ((m_body_remaining >= 0) && (available > m_body_remaining)) ? m_body_remaining : available;
+}
+
+int SoapClient::read()
+{
+    if (m_body_remaining == 0) return -1;
+
+    int c = m_client.read();
+
+    if ((c >= 0) && (m_body_remaining > 0)) m_body_remaining--;
+
+    return c;
+}
+
+int SoapClient::read(uint8_t* t_buffer, size_t t_length)
+{
+    if (m_body_remaining == 0) return 0;
+
+    if ((m_body_remaining > 0) && (t_length > (size_t)m_body_remaining)) t_length = m_body_remaining;
+
+    int length = m_client.read(t_buffer, t_length);
+
+    if ((length > 0) && (m_body_remaining > 0)) m_body_remaining -= length;
+
+    return length;
+}
+
+int SoapClient::peek()
+{
+    return (m_body_remaining == 0) ? -1 : m_client.peek();
+}
+
+/**
+ * Bytes of the body still to come
+ *
+ * What's left of Content-Length, or without one, 0
+ * once the speaker has closed the connection and
+ * everything it sent has been read. -1 while more
+ * may still arrive.
+ */
+ssize_t SoapClient::streamRemaining()
+{
+    if (m_body_remaining >= 0) return m_body_remaining;
+
+    return (!m_client.connected() && !m_client.available()) ? 0 : -1;
+}
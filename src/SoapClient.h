@@ -0,0 +1,112 @@
+#ifndef SoapClient_h
+#define SoapClient_h
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266HTTPClient.h>
+
+#ifdef DEBUG
+    #define DEBUG_SOAP(x) x
+#else
+    #define DEBUG_SOAP(x) do{}while(0)
+#endif
+
+#define SOAP_PORT                   1400
+#define SOAP_USER_AGENT             "sonos_lib"
+#define SOAP_HEADER_SIZE            384     // Request line and headers, Host and action included
+#define SOAP_LINE_SIZE              64      // Response header lines are cut to this, we only need the start
+#define SOAP_BODY_CHUNK             128     // Bytes handed to a body callback at a time
+
+/*
+ * The request line and the headers that are the same
+ * every time an action is sent, as one literal. Host,
+ * Content-Length and Connection follow, per request.
+ */
+#define SOAP_HEADER_PREFIX(endpoint, action)    \
+    "POST " endpoint " HTTP/1.1\r\n"            \
+    "User-Agent: " SOAP_USER_AGENT "\r\n"       \
+    "Content-type: text/xml\r\n"                \
+    "SOAPACTION: " action "\r\n"
+
+#define SOAP_ACTION(endpoint, action) \
+    { endpoint, action, SOAP_HEADER_PREFIX(endpoint, action), sizeof(SOAP_HEADER_PREFIX(endpoint, action)) - 1 }
+
+/**
+ * An action's endpoint and SOAPACTION, and its header
+ * prefix built from them at compile time
+ */
+struct SoapAction
+{
+    const char* endpoint;
+    const char* action;
+    const char* prefix;
+    uint16_t prefix_length;
+};
+
+/*
+ * Called with each chunk of a response body
+ */
+typedef void (*SoapBodyCallback)(const char*, const size_t, void*);
+
+/**
+ * SOAP over HTTP/1.1 to a speaker
+ *
+ * Sends a POST straight to a WiFiClient, without
+ * the Strings HTTPClient builds its headers in, or a
+ * GET for the device description. The
+ * request line and headers go out in one write from
+ * the stack. For a SoapAction, everything in them
+ * that doesn't change between requests is copied
+ * from its prefix, so only Host, Content-Length and
+ * Connection are formatted each time. Only the
+ * status line, Content-Length and Connection are
+ * looked at in the response.
+ *
+ * Errors are HTTPClient's (HTTPC_ERROR_*), so callers
+ * can treat the two the same. Connecting and waiting
+ * for the first byte back are timed separately, in
+ * METRIC_SOAP_CONNECT and METRIC_SOAP_FIRST_BYTE.
+ *
+ * The client is also a Stream over the response body,
+ * ending at Content-Length, so a kept-alive connection
+ * is left at the start of the next response.
+ */
+class SoapClient : public Stream
+{
+public:
+    SoapClient() {};
+    int16_t post(const IPAddress&, const SoapAction&, const char*, const uint16_t, const bool);
+    int16_t post(const IPAddress&, const char*, const char*, const char*, const uint16_t, const bool);
+    int16_t get(const IPAddress&, const char*, const uint16_t);
+    bool readBody(SoapBodyCallback, void*);
+    void end();
+    void stop();
+
+    static int formatHeader(char*, const size_t, const IPAddress&, const SoapAction&, const size_t, const bool);
+    static int formatHeader(char*, const size_t, const IPAddress&, const char*, const char*, const size_t, const bool);
+
+    int available() override;
+    int read() override;
+    int read(uint8_t*, size_t) override;
+    int peek() override;
+    ssize_t streamRemaining() override;
+    size_t write(uint8_t) override { return 0; }
+    using Print::write;
+
+private:
+    WiFiClient m_client;
+    IPAddress m_ip;
+    uint16_t m_port = 0;
+    uint16_t m_timeout = 0;
+    bool m_reusable = false;        // Speaker will keep the connection open after this response
+    int32_t m_body_remaining = -1;  // From Content-Length, -1 if not given
+    unsigned long m_sent = 0;       // us, when the request was written
+
+    int16_t request(const IPAddress&, const char*, const size_t, const char*, const size_t, const bool);
+    int16_t send(const IPAddress&, const uint16_t, const char*, const size_t, const char*, const size_t);
+    int16_t readHeaders(const bool, const bool);
+    int16_t readLine(char*, const size_t, const unsigned long);
+};
+
+#endif
@@ -1,18 +1,27 @@
 #include <IPAddress.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266HTTPClient.h> 
+#include <lwip/etharp.h>
+#include <lwip/netif.h>
+#include <lwip/tcp.h>
 #include "Sonos.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Log.h"
+#include "Capture.h"
 #include "Utility.h"
 
 static const int s_default_timeout = 5000;
 
 static const IPAddress SSDP_MULTICAST_ADDR(239, 255, 255, 250);
 
-static const char *s_user_agent = "sonos_lib";
+static const int s_soap_port = SOAP_PORT;
 
-static const int s_soap_port = 1400;
+#ifdef SONOS_SOAP_HTTPCLIENT
+static const char *s_user_agent = SOAP_USER_AGENT;
 
 static const char *s_content_type = "text/xml";
+#endif
 
 static const char *s_search_unicast_SSDP_template =
   "M-SEARCH * HTTP/1.1\r\n"
@@ -22,6 +31,13 @@ static const char *s_search_unicast_SSDP_template =
   "ST: urn:schemas-upnp-org:device:ZonePlayer:1\r\n"
   "USER-AGENT: Arduino UPnP/2.0 Sonos Library/0.1\r\n";
 
+static const StriSearch s_zone_player_search("ZonePlayer");
+
+// The service list is mostly &quot; entities, so these skip ahead
+// where a search for the first '&' would stop at every one
+static const StriSearch s_service_start_search("&lt;Service ");
+static const StriSearch s_service_end_search("&lt;/Service");
+
 /**
 <s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">
   <s:Body>
@@ -32,12 +48,10 @@ static const char *s_search_unicast_SSDP_template =
   </s:Body>
 </s:Envelope>
 */
-static const char *s_sonos_play_transport_endpoint = "/MediaRenderer/AVTransport/Control";
-static const char *s_sonos_play_action = "\"urn:schemas-upnp-org:service:AVTransport:1#Play\"";
+static const SoapAction s_sonos_play_action = SOAP_ACTION("/MediaRenderer/AVTransport/Control", "\"urn:schemas-upnp-org:service:AVTransport:1#Play\"");
 static const char *s_sonos_play_payload = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:Play xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\"><InstanceID>0</InstanceID><Speed>1</Speed></u:Play></s:Body></s:Envelope>";
 
-static const char *s_sonos_pause_transport_endpoint = "/MediaRenderer/AVTransport/Control";
-static const char *s_sonos_pause_action = "\"urn:schemas-upnp-org:service:AVTransport:1#Pause\"";
+static const SoapAction s_sonos_pause_action = SOAP_ACTION("/MediaRenderer/AVTransport/Control", "\"urn:schemas-upnp-org:service:AVTransport:1#Pause\"");
 static const char *s_sonos_pause_payload = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:Pause xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\"><InstanceID>0</InstanceID></u:Pause></s:Body></s:Envelope>";
 
 /**
@@ -51,28 +65,50 @@ static const char *s_sonos_pause_payload = "<s:Envelope xmlns:s=\"http://schemas
   </s:Body>
 </s:Envelope>
 */
-static const char *s_sonos_queue_transport_endpoint = "/MediaRenderer/AVTransport/Control";
-static const char *s_sonos_queue_action = "\"urn:schemas-upnp-org:service:AVTransport:1#SetAVTransportURI\"";
+static const SoapAction s_sonos_queue_action = SOAP_ACTION("/MediaRenderer/AVTransport/Control", "\"urn:schemas-upnp-org:service:AVTransport:1#SetAVTransportURI\"");
 static const char *s_sonos_queue_payload_1 = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:SetAVTransportURI xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\"><InstanceID>0</InstanceID><CurrentURI>";
 static const char *s_sonos_queue_payload_2 = "?sid=";
 static const char *s_sonos_queue_payload_3 = "</CurrentURI><CurrentURIMetaData></CurrentURIMetaData></u:SetAVTransportURI></s:Body></s:Envelope>";
 
 
 /**
+Generic action, used for the simpler commands, e.g. (service AVTransport, action Next)
 <s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">
   <s:Body>
-    <u:SetAVTransportURI xmlns:u="urn:schemas-upnp-org:service:RenderingControl:1">
+    <u:Next xmlns:u="urn:schemas-upnp-org:service:AVTransport:1">
       <InstanceID>0</InstanceID>
-      <CurrentURI>TRACK_ID?sid=SERVICE_ID</CurrentURI>
-      <CurrentURIMetaData></CurrentURIMetaData>
-    </u:SetAVTransportURI>
+      ARGUMENTS
+    </u:Next>
   </s:Body>
 </s:Envelope>
 */
-//TO BE FINISHED & CHECKED
-//static const char *s_sonos_set_volume_transport_endpoint = "/MediaRenderer/RenderingControl/Control";
-//static const char *s_sonos_set_volume_action = "\"urn:schemas-upnp-org:service:RenderingControl:1#SetVolume\"";
-//static const char *s_sonos_set_volume_payload = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:SetVolume xmlns:u=\"urn:schemas-upnp-org:service:RenderingControl:1\"><InstanceID>0</InstanceID><Channel>Master</Channel><DesiredVolume>%d</DesiredVolume></u:SetVolume></s:Body></s:Envelope>";
+static const char *s_sonos_action_payload = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:%s xmlns:u=\"urn:schemas-upnp-org:service:%s:1\"><InstanceID>0</InstanceID>%s</u:%s></s:Body></s:Envelope>";
+
+static const SonosAction s_sonos_next = SONOS_ACTION("AVTransport", "Next");
+static const SonosAction s_sonos_previous = SONOS_ACTION("AVTransport", "Previous");
+static const SonosAction s_sonos_set_volume = SONOS_ACTION("RenderingControl", "SetVolume");
+static const SonosAction s_sonos_get_volume = SONOS_ACTION("RenderingControl", "GetVolume");
+static const SonosAction s_sonos_set_play_mode = SONOS_ACTION("AVTransport", "SetPlayMode");
+static const SonosAction s_sonos_join_group = SONOS_ACTION("AVTransport", "SetAVTransportURI");
+static const SonosAction s_sonos_leave_group = SONOS_ACTION("AVTransport", "BecomeCoordinatorOfStandaloneGroup");
+static const SonosAction s_sonos_sleep_timer = SONOS_ACTION("AVTransport", "ConfigureSleepTimer");
+
+// Fan-out requests are written straight to the socket, as
+// HTTPClient can only have one request open at a time
+static const SonosAction s_sonos_pause_all = SONOS_ACTION("AVTransport", "Pause");
+
+static const char *s_sonos_set_volume_arguments = "<Channel>Master</Channel><DesiredVolume>%u</DesiredVolume>";
+static const char *s_sonos_get_volume_arguments = "<Channel>Master</Channel>";
+static const char *s_sonos_play_mode_arguments = "<NewPlayMode>%s</NewPlayMode>";
+static const char *s_sonos_join_group_arguments = "<CurrentURI>x-rincon:%s</CurrentURI><CurrentURIMetaData></CurrentURIMetaData>";
+static const char *s_sonos_sleep_timer_arguments = "<NewSleepTimerDuration>%02u:%02u:00</NewSleepTimerDuration>";
+static const char *s_sonos_sleep_timer_cancel_arguments = "<NewSleepTimerDuration></NewSleepTimerDuration>";
+
+// Indexed by [shuffle][repeat]
+static const char *s_sonos_play_modes[2][3] = {
+    { "NORMAL", "REPEAT_ALL", "REPEAT_ONE" },
+    { "SHUFFLE_NOREPEAT", "SHUFFLE", "SHUFFLE_REPEAT_ONE" }
+};
 
 
 /**
@@ -84,14 +120,10 @@ static const char *s_sonos_queue_payload_3 = "</CurrentURI><CurrentURIMetaData><
   </s:Body>
 </s:Envelope>
 */
-static const char *s_sonos_get_services_transport_endpoint = "/MusicServices/Control";
-static const char *s_sonos_get_services_action = "\"urn:schemas-upnp-org:service:MusicServices:1#ListAvailableServices\"";
+static const SoapAction s_sonos_get_services_action = SOAP_ACTION("/MusicServices/Control", "\"urn:schemas-upnp-org:service:MusicServices:1#ListAvailableServices\"");
 static const char *s_sonos_get_services_payload = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:ListAvailableServices xmlns:u=\"urn:schemas-upnp-org:service:MusicServices:1\"><InstanceID>0</InstanceID></u:ListAvailableServices></s:Body></s:Envelope>";
 
 
-void KMP(WiFiClient* t_x, const char* t_needle, int t_stream_len, int t_needle_len); // x, y, m, n
-
-
 void Sonos::begin()
 {
     m_udp.begin(m_ssdp_port);
@@ -110,81 +142,181 @@ long Sonos::discover()
 
 long Sonos::discover(unsigned long t_time_out)
 {
-    long num_new_devices = 0;
-    IPAddress sonosIP;
-    unsigned long search_start = millis();
-    
+    startDiscovery(t_time_out);
+
+    while (!handleDiscovery()) yield();
+
+    return m_discovery_new_devices;
+}
+
+void Sonos::startDiscovery()
+{
+    startDiscovery(s_default_timeout);
+}
+
+/**
+ * Starts discovery without waiting for it
+ *
+ * Sends the M-SEARCH, then handleDiscovery() picks up
+ * the responses and fills in the new speakers' details
+ * a little at a time. Does nothing if discovery is
+ * already running.
+ */
+void Sonos::startDiscovery(unsigned long t_time_out)
+{
+    if (m_discovering) return;
+
     DEBUG_SONOS(Serial.println(F("Sonos::discover Sending M-SEARCH multicast")));
 
     m_udp.beginPacketMulticast(SSDP_MULTICAST_ADDR, m_ssdp_port, WiFi.localIP());
     m_udp.write(s_search_unicast_SSDP_template, strlen(s_search_unicast_SSDP_template));
     m_udp.endPacket();
 
-    do
-    {
-        int packet_size = m_udp.parsePacket();
+    CAPTURE.record(CAPTURE_SSDP_SENT, SSDP_MULTICAST_ADDR, s_search_unicast_SSDP_template, strlen(s_search_unicast_SSDP_template));
 
-        // If we received a packet
-        if (packet_size)
-        {
-            char packet_buffer[255];
-            IPAddress ip;
+    m_discovering = true;
+    m_discovery_listening = true;
+    m_discovery_start = millis();
+    m_discovery_time_out = t_time_out;
+    m_discovery_new_devices = 0;
+    m_discovery_next_client = 0;
+}
 
-            ip = m_udp.remoteIP();
-            
-            DEBUG_SONOS(Serial.print(F("Sonos::discover Received packet of size "));
-                        Serial.println(packet_size);
-                        Serial.print(F("Sonos::discover From "));
-                        Serial.print(ip);
-                        Serial.print(F(", port "));
-                        Serial.println(m_udp.remotePort()););
-
-            // Read the packet into packet_buffer
-            int len = m_udp.read(packet_buffer, sizeof(packet_buffer) * sizeof(*packet_buffer));
-            if (len > 0)
-            {
-                packet_buffer[len] = 0;
-            }
-            
-            DEBUG_SONOS(Serial.println(F("Sonos::discover Contents:"));
-                        Serial.println(packet_buffer));
-            
-            char* token;
-            token = strtok(packet_buffer, "\n");
+/**
+ * Moves discovery along, returning true once it's done
+ *
+ * While listening, takes whatever responses have
+ * already arrived and returns, so it never waits on
+ * the network. Once the time out is up, fetches one
+ * new speaker's details per call, so a tap is only
+ * ever held up by one request.
+ */
+bool Sonos::handleDiscovery()
+{
+    if (!m_discovering) return false;
 
-            while (token != NULL)
-            {
-                // TODO: fix this up to give a better way of grabbing the location
-                if (strncmp(token, "LOCATION:", 9) == 0)
-                {
-                    if (addSonosClient(ip, &token[10]))
-                    {
-                        num_new_devices += 1;
-                    }
-                }
+    if (m_discovery_listening)
+    {
+        int packet_size;
 
-                token = strtok(NULL, "\n");
-            }
-            
+        while ((packet_size = m_udp.parsePacket()))
+        {
+            readSsdpPacket(packet_size);
         }
-    } while ((millis() - search_start) < t_time_out);
+
+        if ((millis() - m_discovery_start) < m_discovery_time_out) return false;
+
+        m_discovery_listening = false;
+    }
 
     // Fill in the details for any found servers
-    // Note, we can't do this above as we discover services
+    // Note, we can't do this while we discover services
     // I believe it's due to conflicts with our single thread
     // and so it seems best to wait until we've finished discovery
-    fillBlankSonosDetails();
+    if (m_discovery_next_client < m_sonos_client_count)
+    {
+        m_discovery_next_client = fillBlankSonosDetails(m_discovery_next_client);
+        return false;
+    }
+
+    m_discovering = false;
 
-    Serial.print(F("Sonos::discover Completed and found "));Serial.print(num_new_devices);Serial.println(F(" new devices"));
+    METRICS.observe(METRIC_DISCOVERY, (millis() - m_discovery_start) * 1000UL);
+    METRICS.increment(METRIC_DISCOVERED_DEVICES, m_discovery_new_devices);
 
-    // Set an active client if none has been set
-    if ((!m_active_client) && num_new_devices > 0)
+    LOG(SONOS_DISCOVERED, m_discovery_new_devices);
+
+    // Set an active client if none has been set, or
+    // the one restored at boot turned out to be stale
+    if (!m_active_client)
     {
         // Just set it to the first one in the list
-        setActiveClient(m_sonos_clients[0].serial_num);
+        for (uint8_t i = 0; i < m_sonos_client_count; i++)
+        {
+            if (m_sonos_clients[i].serial_num[0] && setActiveClient(m_sonos_clients[i].serial_num)) break;
+        }
     }
+
+    return true;
+}
+
+bool Sonos::isDiscovering()
+{
+    return m_discovering;
+}
+
+void Sonos::readSsdpPacket(const int t_packet_size)
+{
+    SsdpResponse response;
+    IPAddress ip;
+
+    ip = m_udp.remoteIP();
+    
+    DEBUG_SONOS(Serial.print(F("Sonos::discover Received packet of size "));
+                Serial.println(t_packet_size);
+                Serial.print(F("Sonos::discover From "));
+                Serial.print(ip);
+                Serial.print(F(", port "));
+                Serial.println(m_udp.remotePort()););
+
+    // Anything past the end of the buffer is dropped with the packet
+    int len = m_udp.read(m_ssdp_packet, SSDP_PACKET_SIZE);
+
+    if (len <= 0) return;
+
+    m_ssdp_packet[len] = 0;
+    CAPTURE.record(CAPTURE_SSDP_RECEIVED, ip, m_ssdp_packet, len);
+
+    if (t_packet_size > len) LOG(SONOS_SSDP_TRUNCATED, t_packet_size);
     
-    return num_new_devices;
+    DEBUG_SONOS(Serial.println(F("Sonos::discover Contents:"));
+                Serial.println(m_ssdp_packet));
+
+    if (!response.parse(m_ssdp_packet, len)) return;
+
+    DEBUG_SONOS(const SsdpField& household = response.get(SSDP_HOUSEHOLD);
+                Serial.print(F("Sonos::discover Household "));
+                Serial.write(household.text, household.length);
+                Serial.print(F(", max-age "));
+                Serial.println(response.maxAge()));
+
+    if (addSonosClient(ip, response))
+    {
+        m_discovery_new_devices += 1;
+    }
+}
+
+/**
+ * Adds a speaker saved from an earlier boot
+ *
+ * Lets the box use the last active speaker as soon
+ * as WiFi is up, without waiting for discovery. The
+ * entry has no room name until discovery fills in
+ * its details, and is checked to still be the same
+ * speaker before that.
+ */
+bool Sonos::restoreClient(const IPAddress& t_ip, const char* t_serial_num, const char* t_location)
+{
+    if (!t_ip || !t_serial_num[0] || !t_location[0]) return false;
+
+    if (findClient(t_serial_num, strlen(t_serial_num))) return false;
+
+    if ((strlen(t_serial_num) >= sizeof(SonosClient::serial_num))
+        || (strlen(t_location) >= sizeof(SonosClient::location))) return false;
+
+    SonosClient* free_client = freeClient();
+
+    if (!free_client) return false;
+
+    SonosClient& client = *free_client;
+
+    client.ip = t_ip;
+    strcpy(client.serial_num, t_serial_num);
+    strcpy(client.location, t_location);
+
+    LOG(SONOS_RESTORED, client.serial_num, client.ip);
+
+    return true;
 }
 
 uint16_t Sonos::getServiceID(const char* t_service_name)
@@ -205,32 +337,49 @@ uint16_t Sonos::getServiceID(SonosClient* t_client, const char* t_service_name)
 
     uint16_t service_id = -1;
 
-    if (sendRequest(t_client->ip, s_soap_port, s_sonos_get_services_transport_endpoint, s_sonos_get_services_action, s_sonos_get_services_payload))
+    if (sendRequest(t_client, s_sonos_get_services_action, s_sonos_get_services_payload, METRIC_SOAP_SERVICES))
     {
-        while (m_http_client.getStream().find("&lt;Service ", 12))
+        unsigned long body_start = micros();
+
+        StreamWindow& window = responseWindow(t_client);
+
+        // Skip tables are built once for every <Service> element
+        StriSearch service(t_service_name);
+        StriSearch id_attribute("id=&quot;");
+        StriSearch quote("&quot;");
+
+        while (window.findAndConsume(s_service_start_search))
         {
             char buffer[255];
             
-            readUntil(m_http_client.getStream(), "&lt;/Service", 12, buffer, 255);
+            // Id and Name come first, the rest can be cut
+            window.copyUntil(s_service_end_search, buffer, sizeof(buffer));
 
-            if (stristr(buffer, t_service_name))
-            {
-                int start = 0;
-                char dest[5];
+            size_t length = strlen(buffer);
 
-                char* value = stristr(buffer, "id=&quot;");
-                start = value - buffer + 9;
-                value = stristr(value + 9, "&quot;");
+            if (!service.find(buffer, length)) continue;
 
-                memset(dest, '\0', sizeof(dest));
-                strncpy(dest, buffer + start, value - buffer - start);
+            const char* id = id_attribute.find(buffer, length);
 
-                service_id = atoi(dest);
-            }
+            if (!id) continue;
+
+            id += id_attribute.length();
+
+            const char* id_end = quote.find(id, length - (id - buffer));
+            char dest[5];
+
+            if (!id_end || ((size_t)(id_end - id) >= sizeof(dest))) continue;
+
+            memcpy(dest, id, id_end - id);
+            dest[id_end - id] = '\0';
+
+            service_id = atoi(dest);
         }
 
+        METRICS.observe(METRIC_SOAP_BODY_SERVICES, micros() - body_start);
+
         // End the session
-        m_http_client.end();
+        endRequest(t_client);
     }
 
     DEBUG_SONOS(Serial.print(F("Sonos::getServiceID matched service id ["));
@@ -245,6 +394,43 @@ bool Sonos::stop()
     return pause();
 }
 
+/*
+ * Pauses every client we know of, at once. Grouped
+ * speakers follow their coordinator, so the others
+ * in a group answer with an error, which is fine.
+ * Returns true if every client answered.
+ */
+bool Sonos::pauseAll()
+{
+    SonosClient* clients[SONOS_MAX_CLIENTS];
+    int16_t status[SONOS_MAX_CLIENTS];
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < m_sonos_client_count; i++)
+    {
+        if (m_sonos_clients[i].ip) clients[count++] = &m_sonos_clients[i];
+    }
+
+    if (!count) return false;
+
+    fanOut(clients, count, s_sonos_pause_all, "", status);
+
+    bool answered = true;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        DEBUG_SONOS(Serial.print(F("Sonos::pauseAll ["));
+                    Serial.print(clients[i]->room_name);
+                    Serial.print(F("] ["));
+                    Serial.print(status[i]);
+                    Serial.println(F("]")));
+
+        if (!status[i]) answered = false;
+    }
+
+    return answered;
+}
+
 bool Sonos::pause()
 {
     if (m_active_client && m_active_client->ip)
@@ -265,7 +451,7 @@ bool Sonos::pause(SonosClient* t_client)
                 Serial.print(t_client->ip);
                 Serial.println(F("]")));
 
-    return sendRequest_End(t_client->ip, s_soap_port, s_sonos_pause_transport_endpoint, s_sonos_pause_action, s_sonos_pause_payload);
+    return sendRequest_End(t_client, s_sonos_pause_action, s_sonos_pause_payload, METRIC_SOAP_PAUSE);
 }
 
 bool Sonos::play()
@@ -288,20 +474,25 @@ bool Sonos::play(SonosClient* t_client)
                 Serial.print(t_client->ip);
                 Serial.println(F("]")));
 
-    return sendRequest_End(t_client->ip, s_soap_port, s_sonos_play_transport_endpoint, s_sonos_play_action, s_sonos_play_payload);
+    return sendRequest_End(t_client, s_sonos_play_action, s_sonos_play_payload, METRIC_SOAP_PLAY);
 }
 
 bool Sonos::queueUri(const uint16_t t_service_id, const char* t_uri)
+{
+    return queueUri(t_service_id, t_uri, strlen(t_uri));
+}
+
+bool Sonos::queueUri(const uint16_t t_service_id, const char* t_uri, const size_t t_uri_len)
 {
     if (m_active_client && m_active_client->ip)
     {
-        return queueUri(m_active_client, t_service_id, t_uri);
+        return queueUri(m_active_client, t_service_id, t_uri, t_uri_len);
     } else {
         return false;
     }
 }
 
-bool Sonos::queueUri(SonosClient* t_client, const uint16_t t_service_id, const char* t_uri)
+bool Sonos::queueUri(SonosClient* t_client, const uint16_t t_service_id, const char* t_uri, const size_t t_uri_len)
 {
     DEBUG_SONOS(Serial.print(F("Sonos::queueUri Queuing track ["));
                 Serial.print(t_client->room_name);
@@ -311,254 +502,1228 @@ bool Sonos::queueUri(SonosClient* t_client, const uint16_t t_service_id, const c
                 Serial.print(t_client->ip);
                 Serial.println(F("]"));
                 Serial.print(F("Sonos::queueUri Queuing track ["));
-                Serial.print(t_uri);
+                Serial.write((const uint8_t*)t_uri, t_uri_len);
                 Serial.println(F("]")));
 
     char buffer[1024];
-    uint8_t uri_len = strlen(t_uri);
-    char service_id[5];
-    itoa(t_service_id, service_id, 10);
-    uint8_t id_len = strlen(service_id);
-
-    // TODO: rewrite this mess
-    // Should just be able to use strlen of the buffer since it's null terminated
-    // I also need to ensure we don't overrun the 1024 buffer which we might do at the moment
-    memset(buffer, 0, 1024);
-    memcpy(buffer, s_sonos_queue_payload_1, 244 * sizeof(char));
-    memcpy(buffer + (244 * sizeof(char)), t_uri, uri_len * sizeof(char));
-    memcpy(buffer + (244 * sizeof(char)) + (uri_len * sizeof(char)), s_sonos_queue_payload_2, 5 * sizeof(char));
-    memcpy(buffer + (244 * sizeof(char)) + (uri_len * sizeof(char)) + (5 * sizeof(char)), service_id, id_len * sizeof(char));
-    memcpy(buffer + (244 * sizeof(char)) + (uri_len * sizeof(char)) + (5 * sizeof(char)) + (id_len * sizeof(char)), s_sonos_queue_payload_3, 98 * sizeof(char));
-
-    bool ret_val = sendRequest_End(t_client->ip, s_soap_port, s_sonos_queue_transport_endpoint, s_sonos_queue_action, buffer);
+
+    // The URI doesn't need to be NUL terminated, so it can
+    // point straight in to the card data
+    int length = snprintf(buffer, sizeof(buffer), "%s%.*s%s%u%s", s_sonos_queue_payload_1, (int)t_uri_len, t_uri, s_sonos_queue_payload_2, t_service_id, s_sonos_queue_payload_3);
+
+    if ((length < 0) || ((size_t)length >= sizeof(buffer)))
+    {
+        LOG(SONOS_URI_TOO_LONG);
+        return false;
+    }
+
+    bool ret_val = sendRequest_End(t_client, s_sonos_queue_action, buffer, METRIC_SOAP_QUEUE);
 
     return ret_val;
 }
 
-bool Sonos::sendRequest_End(IPAddress& t_ip_address, const int t_port, const char* t_transport_endpoint, const char* t_action, const char* t_payload)
+bool Sonos::next()
 {
-    bool ret = sendRequest(t_ip_address, t_port, t_transport_endpoint, t_action, t_payload);
-    
-    // End the request
-    m_http_client.end();
-
-    return ret;
+    return m_active_client && m_active_client->ip && next(m_active_client);
 }
 
-bool Sonos::sendRequest(IPAddress& t_ip_address, const int t_port, const char* t_transport_endpoint, const char* t_action, const char* t_payload)
+bool Sonos::next(SonosClient* t_client)
 {
-    DEBUG_SONOS(Serial.println(F("Sonos::sendRequest started")));
+    return sendAction(t_client, s_sonos_next, "", METRIC_SOAP_NEXT);
+}
 
-    m_http_client.begin(m_wifi_client, t_ip_address.toString(), t_port, t_transport_endpoint, false);
-    m_http_client.setUserAgent(s_user_agent);
-    m_http_client.setReuse(false);
-    m_http_client.addHeader(F("Content-type"), s_content_type);
-    m_http_client.addHeader(F("SOAPACTION"), t_action);
-    
-    int http_response_code = m_http_client.POST(t_payload);
-    
-    if (http_response_code > 0)
-    {
-        DEBUG_SONOS(Serial.print(F("Sonos::sendRequest response code: "));
-                    Serial.println(http_response_code));
-    } else {
-        DEBUG_SONOS(Serial.print(F("Sonos::sendRequest error on sending POST ["));
-                    Serial.print(http_response_code);
-                    Serial.print(F("] ["));
-                    Serial.print(m_http_client.errorToString(http_response_code));
-                    Serial.println(F("]")));
-    }
+bool Sonos::previous()
+{
+    return m_active_client && m_active_client->ip && previous(m_active_client);
+}
 
-    if (http_response_code == HTTP_CODE_OK)
-    {
-        return true;
-    }
-    else
-    {
-        return false;
-    }
+bool Sonos::previous(SonosClient* t_client)
+{
+    return sendAction(t_client, s_sonos_previous, "", METRIC_SOAP_PREVIOUS);
 }
 
-void Sonos::printStream(WiFiClient* stream)
+bool Sonos::setVolume(const uint8_t t_volume)
 {
-    // create buffer for read
-    uint8_t buffer[128] = { 0 };
+    return m_active_client && m_active_client->ip && setVolume(m_active_client, t_volume);
+}
 
-    // Get available data size
-    unsigned int size = stream->available();
+bool Sonos::setVolume(SonosClient* t_client, const uint8_t t_volume)
+{
+    char arguments[80];
+    snprintf(arguments, sizeof(arguments), s_sonos_set_volume_arguments, (t_volume > 100) ? 100 : t_volume);
 
-    if (size)
-    {
-        // Read up to 128 bytes
-        int c = stream->readBytes(buffer, ((size > sizeof(buffer)) ? sizeof(buffer) : size));
+    return sendAction(t_client, s_sonos_set_volume, arguments, METRIC_SOAP_VOLUME);
+}
 
-        Serial.write(buffer, c);
-    }
+bool Sonos::getVolume(uint8_t& t_volume)
+{
+    return m_active_client && m_active_client->ip && getVolume(m_active_client, t_volume);
 }
 
-bool Sonos::addSonosClient(IPAddress& t_ip, const char* t_location)
+/*
+ * Reads the current volume of a client, from
+ * the <CurrentVolume> element of the response
+ */
+bool Sonos::getVolume(SonosClient* t_client, uint8_t& t_volume)
 {
     bool found = false;
-    bool added = false;
-  
-    for (auto i = 0; i < m_sonos_client_count; i++)
+
+    if (beginAction(t_client, s_sonos_get_volume, s_sonos_get_volume_arguments, METRIC_SOAP_GET_VOLUME))
     {
-        if (t_ip == m_sonos_clients[i].ip)
+        char buffer[8];
+
+        memset(buffer, 0, sizeof(buffer));
+
+        StreamWindow& window = responseWindow(t_client);
+
+        if (window.findAndConsume("<CurrentVolume>", 15)
+            && window.copyUntil("<", 1, buffer, sizeof(buffer)))
         {
+            t_volume = atoi(buffer);
             found = true;
-            break;
         }
     }
 
-    if ((!found) && (m_sonos_client_count < NUM(m_sonos_clients)))
-    {
-        m_sonos_clients[m_sonos_client_count].ip = t_ip;
+    endRequest(t_client);
 
-        memset(m_sonos_clients[m_sonos_client_count].location, 0, NUM(m_sonos_clients[m_sonos_client_count].location));
-        strncpy(m_sonos_clients[m_sonos_client_count].location, t_location, NUM(m_sonos_clients[m_sonos_client_count].location) - 1);
-        
-        m_sonos_client_count++;
-        added = true;
-    }
+    DEBUG_SONOS(Serial.print(F("Sonos::getVolume ["));
+                Serial.print(found ? t_volume : -1);
+                Serial.println(F("]")));
 
-    return added;
+    return found;
 }
 
-void Sonos::printClients()
+bool Sonos::setShuffle(const bool t_shuffle)
 {
-    Serial.print(F("Sonos::printClients starting client list"));
+    return m_active_client && m_active_client->ip && setPlayMode(m_active_client, t_shuffle, m_repeat);
+}
 
-    for (auto i = 0; i < m_sonos_client_count; i++)
-    {
-        Serial.print(F("Client #"));Serial.print(i + 1);Serial.print(F(" of "));Serial.println(m_sonos_client_count);
-        Serial.print(F("IP: "));Serial.println((IPAddress)m_sonos_clients[i].ip);
-        Serial.print(F("Location: "));Serial.println(m_sonos_clients[i].location);
-        Serial.print(F("RoomName: "));Serial.println(m_sonos_clients[i].room_name);
-        Serial.print(F("DisplayName: "));Serial.println(m_sonos_clients[i].display_name);
-        Serial.print(F("SerialNum: "));Serial.println(m_sonos_clients[i].serial_num);
-    }
+bool Sonos::setRepeat(const SonosRepeat t_repeat)
+{
+    return m_active_client && m_active_client->ip && setPlayMode(m_active_client, m_shuffle, t_repeat);
+}
 
-    Serial.println(F("Sonos::printClients finished client list"));
+/*
+ * Shuffle and repeat are set together as one play
+ * mode, so the half not being changed comes from
+ * whatever we last set
+ */
+bool Sonos::setPlayMode(SonosClient* t_client, const bool t_shuffle, const SonosRepeat t_repeat)
+{
+    char arguments[48];
+    snprintf(arguments, sizeof(arguments), s_sonos_play_mode_arguments, s_sonos_play_modes[t_shuffle ? 1 : 0][t_repeat]);
+
+    if (!sendAction(t_client, s_sonos_set_play_mode, arguments, METRIC_SOAP_PLAY_MODE)) return false;
+
+    m_shuffle = t_shuffle;
+    m_repeat = t_repeat;
+
+    return true;
 }
 
-void Sonos::fillBlankSonosDetails()
+/*
+ * Joins the active client to the group of
+ * another client, found by serial number
+ */
+bool Sonos::joinGroup(const char* t_serial_num, const size_t t_serial_num_len)
 {
-    DEBUG_SONOS(Serial.println(F("Sonos::fillBlankSonosDetails starting client list")));
-    
-    for (auto i = 0; i < m_sonos_client_count; i++)
-    {
-        if (!m_sonos_clients[i].serial_num[0])
-        {
-            getSonosDetails(m_sonos_clients[i]);
+    SonosClient* coordinator = findClient(t_serial_num, t_serial_num_len);
 
-            DEBUG_SONOS(Serial.print(F("Client #"));
-                        Serial.print(i);
-                        Serial.print(F(": "));
-                        Serial.println(m_sonos_clients[i].serial_num));
-        }
+    if (!coordinator || (coordinator == m_active_client))
+    {
+        LOG(SONOS_JOIN_UNKNOWN);
+        return false;
     }
 
-    DEBUG_SONOS(Serial.println(F("Sonos::fillBlankSonosDetails finished client list")));
+    return m_active_client && m_active_client->ip && joinGroup(m_active_client, coordinator);
 }
 
-void Sonos::getSonosDetails(SonosClient& t_client)
+bool Sonos::joinGroup(SonosClient* t_client, SonosClient* t_coordinator)
 {
-    DEBUG_SONOS(Serial.print(F("Sonos::getSonosDetails IP:"));
-                Serial.println(t_client.ip));
+    if (!t_coordinator->uuid[0]) return false;
 
-    m_http_client.begin(m_wifi_client, t_client.location);
-    m_http_client.setUserAgent(s_user_agent);
-    m_http_client.setReuse(false);
+    char arguments[128];
+    snprintf(arguments, sizeof(arguments), s_sonos_join_group_arguments, t_coordinator->uuid);
 
-    int http_response_code = m_http_client.GET();
+    return sendAction(t_client, s_sonos_join_group, arguments, METRIC_SOAP_GROUP);
+}
 
-    if (http_response_code > 0)
-    {
-        long index_start;
-        long index_end;
-        
-        String response = m_http_client.getString();  //Get the response to the request
+bool Sonos::leaveGroup()
+{
+    return m_active_client && m_active_client->ip && leaveGroup(m_active_client);
+}
+
+bool Sonos::leaveGroup(SonosClient* t_client)
+{
+    return sendAction(t_client, s_sonos_leave_group, "", METRIC_SOAP_GROUP);
+}
 
-        index_start = response.indexOf(F("<roomName>"));
-        index_end = response.indexOf(F("</roomName>"), index_start);
-        memset(t_client.room_name, '\0', sizeof(t_client.room_name));
-        strncpy(t_client.room_name, response.substring(index_start + 10, index_end).c_str(), sizeof(t_client.room_name) - 1);
+bool Sonos::setSleepTimer(const uint16_t t_minutes)
+{
+    return m_active_client && m_active_client->ip && setSleepTimer(m_active_client, t_minutes);
+}
 
-        index_start = response.indexOf(F("<displayName>"));
-        index_end = response.indexOf(F("</displayName>"), index_start);
-        memset(t_client.display_name, '\0', sizeof(t_client.display_name));
-        strncpy(t_client.display_name, response.substring(index_start + 13, index_end).c_str(), sizeof(t_client.display_name) - 1);
+/*
+ * Stops playback after the given number of
+ * minutes, or cancels the timer if 0
+ */
+bool Sonos::setSleepTimer(SonosClient* t_client, const uint16_t t_minutes)
+{
+    char arguments[80];
 
-        index_start = response.indexOf(F("<serialNum>"));
-        index_end = response.indexOf(F("</serialNum>"));
-        memset(t_client.serial_num, '\0', sizeof(t_client.serial_num));
-        strncpy(t_client.serial_num, response.substring(index_start + 11, index_end).c_str(), sizeof(t_client.serial_num) - 1);
+    if (t_minutes)
+    {
+        snprintf(arguments, sizeof(arguments), s_sonos_sleep_timer_arguments, (unsigned int)(t_minutes / 60), (unsigned int)(t_minutes % 60));
     }
     else
     {
-        DEBUG_SONOS(Serial.print(F("Sonos::sendRequest error on sending GET ["));
-                    Serial.print(http_response_code);
-                    Serial.print(F("] ["));
-                    Serial.print(m_http_client.errorToString(http_response_code));
-                    Serial.println(F("]")));
+        strncpy(arguments, s_sonos_sleep_timer_cancel_arguments, sizeof(arguments));
     }
 
-    m_http_client.end();
+    return sendAction(t_client, s_sonos_sleep_timer, arguments, METRIC_SOAP_SLEEP);
 }
 
-const SonosClient* Sonos::getActiveClient()
+/*
+ * Sends an action that has no response we need
+ */
+bool Sonos::sendAction(SonosClient* t_client, const SonosAction& t_action, const char* t_arguments, const MetricsHistogram t_metric)
 {
-    return m_active_client;
+    bool ret = beginAction(t_client, t_action, t_arguments, t_metric);
+
+    // End the request
+    endRequest(t_client);
+
+    return ret;
 }
 
-bool Sonos::setActiveClient(const char* t_serial_num)
+/*
+ * Sends an action, building the envelope from the
+ * service and action names. The response is left
+ * to be read, so the caller must end the request.
+ */
+bool Sonos::beginAction(SonosClient* t_client, const SonosAction& t_action, const char* t_arguments, const MetricsHistogram t_metric)
 {
-    DEBUG_SONOS(Serial.print(F("Sonos::setActiveClient Setting active client ["));
-                Serial.print(t_serial_num);
+    DEBUG_SONOS(Serial.print(F("Sonos::beginAction ["));
+                Serial.print(t_action.name);
+                Serial.print(F("] ["));
+                Serial.print(t_client->room_name);
+                Serial.print(":");
+                Serial.print(t_client->ip);
                 Serial.println(F("]")));
-    
-    bool found_client;
-    
-    for (auto i = 0; i < m_sonos_client_count; i++)
+
+    char payload[512];
+
+    snprintf(payload, sizeof(payload), s_sonos_action_payload, t_action.name, t_action.service, t_arguments, t_action.name);
+
+    return sendRequest(t_client, t_action.soap, payload, t_metric);
+}
+
+/*
+ * One of fanOut's connections, moved along by lwIP's
+ * callbacks while fanOut yields
+ */
+struct FanOutConnection
+{
+    struct tcp_pcb* pcb;
+    SonosClient* client;                // nullptr while the slot's free
+    int16_t* status;
+    const SoapAction* action;
+    const char* payload;
+    uint16_t payload_length;
+    unsigned long started;              // ms
+    uint16_t timeout;                   // ms
+    unsigned long connect_start;        // us
+    unsigned long connected;            // us, 0 until then
+    unsigned long first_byte;           // us, 0 until then
+    char status_line[13];               // "HTTP/1.1 200"
+    uint8_t status_length;
+    bool done;                          // The status line is in, or the connection's gone
+};
+
+/*
+ * Connected, so the request goes out
+ */
+static err_t fanOutConnected(void* t_arg, struct tcp_pcb* t_pcb, err_t)
+{
+    FanOutConnection* connection = (FanOutConnection*)t_arg;
+    char header[SOAP_HEADER_SIZE];
+
+    connection->connected = micros();
+
+    int header_length = SoapClient::formatHeader(header, sizeof(header), connection->client->ip, *connection->action, connection->payload_length, false);
+
+    if ((tcp_write(t_pcb, header, header_length, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) != ERR_OK)
+        || (tcp_write(t_pcb, connection->payload, connection->payload_length, TCP_WRITE_FLAG_COPY) != ERR_OK))
     {
-        if (strcmp(m_sonos_clients[i].serial_num, t_serial_num) == 0)
-        {
-            m_active_client = &m_sonos_clients[i];
-            found_client = true;
-            
-            DEBUG_SONOS(Serial.print(F("Sonos::setActiveClient Found active client ["));
-                        Serial.print(m_active_client->room_name);
-                        Serial.print(":");
-                        Serial.print(m_active_client->serial_num);
-                        Serial.print(":");
-                        Serial.print(m_active_client->ip);
-                        Serial.println(F("]")));
-            break;
-        }
+        connection->done = true;
+        return ERR_OK;
     }
 
-    DEBUG_SONOS(if (!found_client)
-                {
-                    Serial.print(F("Sonos::setActiveClient Could not find client ["));
-                    Serial.print(t_serial_num);
-                    Serial.println(F("]"));
-                });
+    tcp_output(t_pcb);
 
-    return found_client;
+    return ERR_OK;
 }
 
-/*bool Sonos::decodeUri(char *p)
+/*
+ * Keeps the start of the response, up to the status
+ * code. A null t_data is the client hanging up.
+ */
+static err_t fanOutReceived(void* t_arg, struct tcp_pcb* t_pcb, struct pbuf* t_data, err_t)
 {
-    int n = strlen(p);
+    FanOutConnection* connection = (FanOutConnection*)t_arg;
 
-    while (*p)
+    if (!t_data)
     {
-        if (*p != '%')
-        {
-            p++;
-            n--;
-            continue;
-        }
+        connection->done = true;
+        return ERR_OK;
+    }
+
+    if (!connection->first_byte) connection->first_byte = micros();
+
+    uint8_t wanted = sizeof(connection->status_line) - 1 - connection->status_length;
+
+    connection->status_length += pbuf_copy_partial(t_data, connection->status_line + connection->status_length, wanted, 0);
+
+    if (connection->status_length == (sizeof(connection->status_line) - 1)) connection->done = true;
+
+    tcp_recved(t_pcb, t_data->tot_len);
+    pbuf_free(t_data);
+
+    return ERR_OK;
+}
+
+/*
+ * Refused or reset. lwIP has already freed the pcb.
+ */
+static void fanOutFailed(void* t_arg, err_t)
+{
+    FanOutConnection* connection = (FanOutConnection*)t_arg;
+
+    connection->pcb = nullptr;
+    connection->done = true;
+}
+
+/*
+ * Starts the connect, without waiting for it
+ */
+static err_t fanOutConnect(FanOutConnection& t_connection)
+{
+    ip_addr_t address;
+    err_t err;
+
+    t_connection.pcb = tcp_new();
+
+    if (!t_connection.pcb) return ERR_MEM;
+
+    tcp_arg(t_connection.pcb, &t_connection);
+    tcp_err(t_connection.pcb, fanOutFailed);
+    tcp_recv(t_connection.pcb, fanOutReceived);
+    tcp_nagle_disable(t_connection.pcb);
+
+    ip_addr_set_ip4_u32(&address, (uint32_t)t_connection.client->ip);
+
+    err = tcp_connect(t_connection.pcb, &address, s_soap_port, fanOutConnected);
+
+    if (err != ERR_OK)
+    {
+        tcp_arg(t_connection.pcb, nullptr);
+        tcp_err(t_connection.pcb, nullptr);
+        tcp_abort(t_connection.pcb);
+        t_connection.pcb = nullptr;
+    }
+
+    return err;
+}
+
+/*
+ * Closes what's left of the connection, first taking
+ * the callbacks off so nothing late reaches the slot
+ */
+static void fanOutClose(FanOutConnection& t_connection)
+{
+    if (t_connection.pcb)
+    {
+        tcp_arg(t_connection.pcb, nullptr);
+        tcp_recv(t_connection.pcb, nullptr);
+        tcp_err(t_connection.pcb, nullptr);
+
+        // Given up on, or lwIP can't close it cleanly just now
+        if (!t_connection.done || (tcp_close(t_connection.pcb) != ERR_OK)) tcp_abort(t_connection.pcb);
+    }
+
+    t_connection.pcb = nullptr;
+    t_connection.client = nullptr;
+}
+
+/**
+ * Sends the same action to several clients at once
+ *
+ * The connects are lwIP's own non-blocking ones, so
+ * a SYN goes out to up to SONOS_FANOUT_CONNECTIONS
+ * clients before waiting on any of them. Each request
+ * is written as its connection comes up, and the
+ * status lines are collected as they arrive, with a
+ * freed connection going straight to the next client.
+ * Everything shares the one deadline, and a client
+ * that doesn't answer within its own timeout gives
+ * up its connection early, so one unreachable speaker
+ * can't hold up the rest. Clients already marked
+ * down are skipped.
+ *
+ * Fills in the HTTP status for each client (0 if it
+ * couldn't be reached in time), and returns how many
+ * answered with 200.
+ */
+uint8_t Sonos::fanOut(SonosClient** t_clients, const uint8_t t_count, const SonosAction& t_action, const char* t_arguments, int16_t* t_status, const unsigned long t_timeout_ms)
+{
+    char payload[512];
+    char request[SOAP_HEADER_SIZE];
+
+    int payload_length = snprintf(payload, sizeof(payload), s_sonos_action_payload, t_action.name, t_action.service, t_arguments, t_action.name);
+
+    // The longest address, so every client's request fits
+    int request_length = SoapClient::formatHeader(request, sizeof(request), IPAddress(255, 255, 255, 255), t_action.soap, payload_length, false);
+
+    for (uint8_t i = 0; i < t_count; i++) t_status[i] = 0;
+
+    if ((payload_length < 0) || ((size_t)payload_length >= sizeof(payload))
+        || (request_length < 0) || ((size_t)request_length >= sizeof(request)))
+    {
+        LOG(SONOS_FANOUT_TOO_LONG);
+        return 0;
+    }
+
+    FanOutConnection connections[SONOS_FANOUT_CONNECTIONS] = {};
+    unsigned long fanout_start = millis();
+    unsigned long request_start = micros();
+    uint8_t succeeded = 0;
+    uint8_t next = 0;
+    uint8_t open = 0;
+
+    while (true)
+    {
+        bool expired = (millis() - fanout_start) >= t_timeout_ms;
+
+        // Pick up the finished connections, and any out of time
+        for (uint8_t i = 0; i < SONOS_FANOUT_CONNECTIONS; i++)
+        {
+            FanOutConnection& connection = connections[i];
+
+            if (!connection.client) continue;
+            if (!connection.done && !expired && ((millis() - connection.started) < connection.timeout)) continue;
+
+            bool complete = (connection.status_length == (sizeof(connection.status_line) - 1));
+
+            if (connection.connected) METRICS.observe(METRIC_SOAP_CONNECT, connection.connected - connection.connect_start);
+            if (connection.first_byte) METRICS.observe(METRIC_SOAP_FIRST_BYTE, connection.first_byte - connection.connected);
+
+            connection.status_line[connection.status_length] = '\0';
+
+            if (complete && (strncmp(connection.status_line, "HTTP/1.", 7) == 0)) *connection.status = atoi(&connection.status_line[9]);
+
+            if (*connection.status == HTTP_CODE_OK) succeeded++;
+
+            recordResponse(connection.client, *connection.status > 0, micros() - request_start);
+
+            CAPTURE.status(connection.client->ip, *connection.status);
+            CAPTURE.end(connection.client->ip);
+
+            fanOutClose(connection);
+            open--;
+        }
+
+        if (expired) break;
+
+        bool out_of_pcbs = false;
+
+        // Every free connection to the next client, all before waiting on any
+        for (uint8_t i = 0; (i < SONOS_FANOUT_CONNECTIONS) && (next < t_count) && !out_of_pcbs; i++)
+        {
+            FanOutConnection& connection = connections[i];
+
+            if (connection.client) continue;
+
+            while (next < t_count)
+            {
+                SonosClient* client = t_clients[next];
+                uint16_t timeout = requestTimeout(client);
+
+                // Down, so not worth a connection
+                if (!timeout)
+                {
+                    METRICS.increment(METRIC_SOAP_SKIPPED);
+                    next++;
+                    continue;
+                }
+
+                connection = {};
+                connection.client = client;
+                connection.status = &t_status[next];
+                connection.action = &t_action.soap;
+                connection.payload = payload;
+                connection.payload_length = payload_length;
+                connection.started = millis();
+                connection.timeout = timeout;
+                connection.connect_start = micros();
+
+                err_t err = fanOutConnect(connection);
+
+                if (err == ERR_OK)
+                {
+                    CAPTURE.request(client->ip, "POST", t_action.soap.endpoint, t_action.soap.action, payload);
+
+                    next++;
+                    open++;
+                    break;
+                }
+
+                connection.client = nullptr;
+
+                // Out of pcbs (the web server has some), so wait for one to close
+                if (err == ERR_MEM)
+                {
+                    out_of_pcbs = true;
+                    break;
+                }
+
+                DEBUG_SONOS(Serial.print(F("Sonos::fanOut unable to connect to "));
+                            Serial.println(client->ip));
+                recordResponse(client, false, 0);
+                next++;
+            }
+        }
+
+        if (!open && (next >= t_count)) break;
+
+        yield();
+    }
+
+    for (uint8_t i = 0; i < t_count; i++)
+    {
+        if (t_status[i] != HTTP_CODE_OK) METRICS.increment(METRIC_SOAP_ERRORS);
+    }
+
+    METRICS.observe(METRIC_SOAP_FANOUT, micros() - request_start);
+    TRACE.record(TRACE_FANOUT, request_start, METRIC_SOAP_FANOUT);
+
+    DEBUG_SONOS(Serial.print(F("Sonos::fanOut ["));
+                Serial.print(t_action.name);
+                Serial.print(F("] "));
+                Serial.print(succeeded);
+                Serial.print(F(" of "));
+                Serial.print(t_count);
+                Serial.println(F(" succeeded")));
+
+    return succeeded;
+}
+
+bool Sonos::sendRequest_End(SonosClient* t_client, const SoapAction& t_action, const char* t_payload, const MetricsHistogram t_metric)
+{
+    bool ret = sendRequest(t_client, t_action, t_payload, t_metric);
+    
+    // End the request
+    endRequest(t_client);
+
+    return ret;
+}
+
+/*
+ * The response body, read through the capture
+ * while one is running
+ */
+Stream& Sonos::responseStream(const SonosClient* t_client)
+{
+    if (!m_response) m_response = &m_soap_client;
+
+    if (!CAPTURE.isActive()) return *m_response;
+
+    m_capture_stream.attach(m_response, t_client->ip);
+
+    return m_capture_stream;
+}
+
+/*
+ * The response body, for parsing. Only good
+ * until the request is ended.
+ */
+StreamWindow& Sonos::responseWindow(const SonosClient* t_client)
+{
+    m_window.attach(responseStream(t_client));
+
+    return m_window;
+}
+
+void Sonos::endRequest(const SonosClient* t_client)
+{
+    if (CAPTURE.isActive())
+    {
+        // Keep what's arrived of the rest of the response, so
+        // a replay has the whole body and not just what we parsed
+        Stream& stream = responseStream(t_client);
+
+        while (stream.available()) stream.read();
+
+        CAPTURE.end(t_client->ip);
+    }
+
+#ifdef SONOS_SOAP_HTTPCLIENT
+    if (m_response != &m_soap_client)
+    {
+        m_http_client.end();
+        m_response = nullptr;
+        return;
+    }
+#endif
+
+    m_soap_client.end();
+    m_response = nullptr;
+}
+
+bool Sonos::sendRequest(SonosClient* t_client, const SoapAction& t_action, const char* t_payload, const MetricsHistogram t_metric)
+{
+    DEBUG_SONOS(Serial.println(F("Sonos::sendRequest started")));
+
+    uint16_t timeout = requestTimeout(t_client);
+
+    // Fail fast, rather than wait out a timeout we already expect
+    if (!timeout)
+    {
+        LOG(SONOS_SKIPPED, t_client->room_name);
+        METRICS.increment(METRIC_SOAP_SKIPPED);
+        return false;
+    }
+
+    uint32_t free_heap = ESP.getFreeHeap();
+    unsigned long request_start = micros();
+
+    CAPTURE.request(t_client->ip, "POST", t_action.endpoint, t_action.action, t_payload);
+
+#ifdef SONOS_SOAP_HTTPCLIENT
+    m_http_client.begin(m_wifi_client, t_client->ip.toString(), s_soap_port, t_action.endpoint, false);
+    m_http_client.setUserAgent(s_user_agent);
+    m_http_client.setTimeout(timeout);
+    m_http_client.setReuse(m_batch);
+    m_http_client.addHeader(F("Content-type"), s_content_type);
+    m_http_client.addHeader(F("SOAPACTION"), t_action.action);
+    
+    int http_response_code = m_http_client.POST(t_payload);
+
+    m_response = &m_http_client.getStream();
+#else
+    int http_response_code = m_soap_client.post(t_client->ip, t_action, t_payload, timeout, m_batch);
+
+    m_response = &m_soap_client;
+#endif
+
+    // Heap still held by the request, the connection included
+    uint32_t free_heap_after = ESP.getFreeHeap();
+
+    CAPTURE.status(t_client->ip, http_response_code);
+
+    // Covers connect, send and the response headers
+    uint32_t request_time = micros() - request_start;
+
+    METRICS.observe(t_metric, request_time);
+    METRICS.increment(METRIC_SOAP_HEAP_BYTES, (free_heap > free_heap_after) ? (free_heap - free_heap_after) : 0);
+    TRACE.record(TRACE_SOAP, request_start, t_metric);
+
+    // Any HTTP response, even an error, means it's still there
+    recordResponse(t_client, http_response_code > 0, request_time);
+    
+    if (http_response_code > 0)
+    {
+        DEBUG_SONOS(Serial.print(F("Sonos::sendRequest response code: "));
+                    Serial.println(http_response_code));
+    } else {
+        DEBUG_SONOS(Serial.print(F("Sonos::sendRequest error on sending POST ["));
+                    Serial.print(http_response_code);
+                    Serial.print(F("] ["));
+                    Serial.print(HTTPClient::errorToString(http_response_code));
+                    Serial.println(F("]")));
+    }
+
+    if (http_response_code == HTTP_CODE_OK)
+    {
+        return true;
+    }
+    else
+    {
+        METRICS.increment(METRIC_SOAP_ERRORS);
+        return false;
+    }
+}
+
+/**
+ * Starts a batch of requests
+ *
+ * Until endBatch(), requests ask the speaker to keep
+ * the connection alive and it's left open after each
+ * response, so consecutive requests to the same
+ * speaker skip the TCP connect. Moving on to another
+ * speaker still opens a new connection.
+ */
+void Sonos::beginBatch()
+{
+    m_batch = true;
+}
+
+void Sonos::endBatch()
+{
+    m_batch = false;
+
+    // Closes any connection left open by the batch
+    m_soap_client.stop();
+
+#ifdef SONOS_SOAP_HTTPCLIENT
+    m_http_client.setReuse(false);
+    m_http_client.end();
+#endif
+}
+
+/*
+ * Sets how long (ms) the requests from here on have,
+ * between them, to finish. 0 removes the deadline.
+ */
+void Sonos::setDeadline(const unsigned long t_budget_ms)
+{
+    m_deadline = millis() + t_budget_ms;
+    m_has_deadline = (t_budget_ms > 0);
+}
+
+/**
+ * Gets ready to send to the active client
+ *
+ * Called when a card is detected, while it's still
+ * being read. lwIP forgets addresses after 5 minutes,
+ * so the first tap after a quiet spell would wait on
+ * an ARP round trip before it could even connect.
+ * This sends the ARP request now, so the reply comes
+ * back while the card is read. It doesn't wait for
+ * the reply, or connect, as either would block the
+ * read. Returns true if the address wasn't cached.
+ */
+bool Sonos::warmUp()
+{
+    // Nothing to do for a client we wouldn't send to anyway
+    if (!requestTimeout(m_active_client) || !netif_default) return false;
+
+    ip4_addr_t address;
+    struct eth_addr* eth_address;
+    const ip4_addr_t* ip_address;
+
+    ip4_addr_set_u32(&address, (uint32_t)m_active_client->ip);
+
+    if (etharp_find_addr(netif_default, &address, &eth_address, &ip_address) >= 0) return false;
+
+    DEBUG_SONOS(Serial.print(F("Sonos::warmUp resolving "));
+                Serial.println(m_active_client->ip));
+
+    etharp_request(netif_default, &address);
+
+    METRICS.increment(METRIC_SPEAKER_WARMUPS);
+
+    return true;
+}
+
+/**
+ * Timeout (ms) for the next request to a client
+ *
+ * A few times the client's usual response time, so a
+ * speaker that's gone away is noticed quickly, and
+ * never past the deadline. Returns 0 if the request
+ * shouldn't be sent at all: the client is down, or
+ * the deadline has already passed.
+ */
+uint16_t Sonos::requestTimeout(const SonosClient* t_client)
+{
+    if (!t_client || !t_client->ip || (t_client->failures >= SONOS_CLIENT_DOWN_AFTER)) return 0;
+
+    uint32_t timeout = s_default_timeout;
+
+    if (t_client->rtt_us)
+    {
+        timeout = (4 * t_client->rtt_us) / 1000;
+
+        if (timeout < SONOS_MIN_TIMEOUT) timeout = SONOS_MIN_TIMEOUT;
+        if (timeout > (uint32_t)s_default_timeout) timeout = s_default_timeout;
+    }
+
+    if (m_has_deadline)
+    {
+        long remaining = (long)(m_deadline - millis());
+
+        if (remaining <= 0) return 0;
+        if ((uint32_t)remaining < timeout) timeout = remaining;
+    }
+
+    return timeout;
+}
+
+/*
+ * Updates a client's health after a request. The
+ * response time is smoothed (EWMA, 1/4 weight to
+ * the newest) so one slow reply doesn't shorten or
+ * stretch the next timeout by much.
+ */
+void Sonos::recordResponse(SonosClient* t_client, const bool t_responded, const uint32_t t_time_us)
+{
+    if (!t_responded)
+    {
+        if (t_client->failures < UINT8_MAX) t_client->failures++;
+
+        if (t_client->failures == SONOS_CLIENT_DOWN_AFTER)
+        {
+            LOG(SONOS_CLIENT_DOWN, t_client->room_name);
+            t_client->last_probe = millis();
+        }
+
+        return;
+    }
+
+    t_client->failures = 0;
+    t_client->failed_probes = 0;
+    t_client->rtt_us = t_client->rtt_us ? (t_client->rtt_us - (t_client->rtt_us / 4) + (t_time_us / 4)) : t_time_us;
+}
+
+/**
+ * Re-probes clients that have stopped responding
+ *
+ * Run as a scheduled task. Each down client has its
+ * description fetched again every SONOS_PROBE_PERIOD;
+ * if it answers as the same speaker it's back in use.
+ * If a different speaker answers, it has moved IP,
+ * and if nothing answers SONOS_CLIENT_EVICT_AFTER
+ * times it's gone. Either way it's evicted until
+ * discovery finds it again. One probe per run, so
+ * a run is bounded by SONOS_PROBE_TIMEOUT.
+ */
+void Sonos::checkClients()
+{
+    for (uint8_t i = 0; i < m_sonos_client_count; i++)
+    {
+        SonosClient& client = m_sonos_clients[i];
+
+        if (!client.ip || (client.failures < SONOS_CLIENT_DOWN_AFTER) || ((millis() - client.last_probe) < SONOS_PROBE_PERIOD)) continue;
+
+        client.last_probe = millis();
+
+        if (probeClient(client))
+        {
+            LOG(SONOS_CLIENT_BACK, client.room_name);
+            client.failures = 0;
+            client.failed_probes = 0;
+        }
+        else if (++client.failed_probes >= SONOS_CLIENT_EVICT_AFTER)
+        {
+            evictClient(client);
+        }
+
+        return;
+    }
+}
+
+/*
+ * Fetches a client's description, checking it's still
+ * the same speaker at that address. Evicts it straight
+ * away if it isn't.
+ */
+bool Sonos::probeClient(SonosClient& t_client)
+{
+    bool same = false;
+    bool moved = false;
+    char serial_num[sizeof(t_client.serial_num)];
+
+    memset(serial_num, 0, sizeof(serial_num));
+
+    CAPTURE.request(t_client.ip, "GET", t_client.location, nullptr, nullptr);
+
+    int http_response_code = m_soap_client.get(t_client.ip, t_client.location, SONOS_PROBE_TIMEOUT);
+
+    m_response = &m_soap_client;
+
+    CAPTURE.status(t_client.ip, http_response_code);
+
+    StreamWindow& window = responseWindow(&t_client);
+
+    if ((http_response_code == HTTP_CODE_OK)
+        && window.findAndConsume("<serialNum>", 11)
+        && window.copyUntil("<", 1, serial_num, sizeof(serial_num)))
+    {
+        same = (strcmp(serial_num, t_client.serial_num) == 0);
+        moved = !same;
+    }
+
+    endRequest(&t_client);
+
+    if (moved)
+    {
+        LOG(SONOS_ADDRESS_TAKEN, t_client.room_name);
+        evictClient(t_client);
+    }
+
+    return same;
+}
+
+/*
+ * Stops using a client until discovery finds it again.
+ * The entry is kept (with no address) so pointers to it
+ * stay valid, and so it's picked back up in place.
+ */
+void Sonos::evictClient(SonosClient& t_client)
+{
+    LOG(SONOS_EVICTED, t_client.room_name);
+
+    t_client.ip = IPAddress();
+    t_client.failures = 0;
+    t_client.failed_probes = 0;
+    t_client.rtt_us = 0;
+
+    METRICS.increment(METRIC_EVICTED_DEVICES);
+}
+
+/*
+ * A newly found client may be one we already knew,
+ * at a new address. If so the new details go in to
+ * the old entry (which may be the active client),
+ * and the new entry is cleared. It isn't removed, as
+ * discovery runs alongside everything else now, and
+ * moving the entries after it would leave the active
+ * client (and anything else holding one) pointing at
+ * the wrong speaker. The slot is reused by the next
+ * client found.
+ */
+void Sonos::mergeClient(const uint8_t t_index)
+{
+    SonosClient& found = m_sonos_clients[t_index];
+
+    if (!found.serial_num[0]) return;
+
+    for (uint8_t i = 0; i < m_sonos_client_count; i++)
+    {
+        SonosClient& known = m_sonos_clients[i];
+
+        if ((i == t_index) || (strcmp(known.serial_num, found.serial_num) != 0)) continue;
+
+        LOG(SONOS_MERGED, known.room_name, found.ip);
+
+        known.ip = found.ip;
+        memcpy(known.location, found.location, sizeof(known.location));
+        memcpy(known.uuid, found.uuid, sizeof(known.uuid));
+        memcpy(known.room_name, found.room_name, sizeof(known.room_name));
+        memcpy(known.display_name, found.display_name, sizeof(known.display_name));
+        known.boot_id = found.boot_id;
+        known.failures = 0;
+        known.failed_probes = 0;
+        known.rtt_us = 0;
+
+        found = SonosClient();
+        return;
+    }
+}
+
+void Sonos::printStream(Stream& t_stream)
+{
+    uint8_t buffer[128];
+
+    // Whatever has arrived, up to 128 bytes, in one read
+    int length = t_stream.read(buffer, sizeof(buffer));
+
+    if (length > 0) Serial.write(buffer, length);
+}
+
+/*
+ * Adds the speaker a discovery response came from,
+ * unless we already know it. Speakers are matched on
+ * the uuid in their USN, so repeat responses, and a
+ * known speaker at a new address, don't cost a fetch
+ * of the device description.
+ */
+bool Sonos::addSonosClient(IPAddress& t_ip, const SsdpResponse& t_response)
+{
+    const SsdpField& location = t_response.get(SSDP_LOCATION);
+    SsdpField uuid = t_response.uuid();
+    uint32_t boot_id = t_response.bootId();
+
+    if (!location.isSet() || (location.length >= sizeof(SonosClient::location))) return false;
+
+    // Other UPnP devices sometimes answer searches that aren't for them
+    const SsdpField& search_target = t_response.get(SSDP_ST);
+    if (search_target.isSet() && !s_zone_player_search.find(search_target.text, search_target.length)) return false;
+
+    if (uuid.length >= sizeof(SonosClient::uuid)) uuid = SsdpField();
+  
+    for (auto i = 0; i < m_sonos_client_count; i++)
+    {
+        SonosClient& known = m_sonos_clients[i];
+        bool same = (uuid.isSet() && known.uuid[0])
+                    ? ((strlen(known.uuid) == uuid.length) && (strncmp(known.uuid, uuid.text, uuid.length) == 0))
+                    : (t_ip == known.ip);
+
+        if (!same) continue;
+
+        if (t_ip != known.ip)
+        {
+            LOG(SONOS_MERGED, known.room_name, t_ip);
+
+            known.ip = t_ip;
+            memcpy(known.location, location.text, location.length);
+            known.location[location.length] = 0;
+            known.failures = 0;
+            known.failed_probes = 0;
+            known.rtt_us = 0;
+        }
+        else if (boot_id && known.boot_id && (boot_id != known.boot_id))
+        {
+            LOG(SONOS_RESTARTED, known.room_name);
+
+            known.failures = 0;
+            known.rtt_us = 0;
+        }
+        else
+        {
+            METRICS.increment(METRIC_SSDP_DUPLICATES);
+        }
+
+        known.boot_id = boot_id;
+        return false;
+    }
+
+    SonosClient* free_client = freeClient();
+
+    if (!free_client) return false;
+
+    SonosClient& client = *free_client;
+
+    client.ip = t_ip;
+    memcpy(client.location, location.text, location.length);
+    client.location[location.length] = 0;
+    memcpy(client.uuid, uuid.text, uuid.length);
+    client.uuid[uuid.length] = 0;
+    client.boot_id = boot_id;
+
+    return true;
+}
+
+/*
+ * An entry for a new client: the first one cleared by
+ * mergeClient, otherwise the next one on the end, or
+ * nullptr if the list is full. Entries never move, so
+ * pointers to them stay valid.
+ */
+SonosClient* Sonos::freeClient()
+{
+    for (uint8_t i = 0; i < m_sonos_client_count; i++)
+    {
+        if (!m_sonos_clients[i].location[0]) return &m_sonos_clients[i];
+    }
+
+    if (m_sonos_client_count >= NUM(m_sonos_clients)) return nullptr;
+
+    return &m_sonos_clients[m_sonos_client_count++];
+}
+
+void Sonos::printClients()
+{
+    Serial.print(F("Sonos::printClients starting client list"));
+
+    for (auto i = 0; i < m_sonos_client_count; i++)
+    {
+        Serial.print(F("Client #"));Serial.print(i + 1);Serial.print(F(" of "));Serial.println(m_sonos_client_count);
+        Serial.print(F("IP: "));Serial.println((IPAddress)m_sonos_clients[i].ip);
+        Serial.print(F("Location: "));Serial.println(m_sonos_clients[i].location);
+        Serial.print(F("RoomName: "));Serial.println(m_sonos_clients[i].room_name);
+        Serial.print(F("DisplayName: "));Serial.println(m_sonos_clients[i].display_name);
+        Serial.print(F("SerialNum: "));Serial.println(m_sonos_clients[i].serial_num);
+    }
+
+    Serial.println(F("Sonos::printClients finished client list"));
+}
+
+void Sonos::fillBlankSonosDetails()
+{
+    DEBUG_SONOS(Serial.println(F("Sonos::fillBlankSonosDetails starting client list")));
+    
+    uint8_t i = 0;
+
+    while (i < m_sonos_client_count)
+    {
+        i = fillBlankSonosDetails(i);
+    }
+
+    DEBUG_SONOS(Serial.println(F("Sonos::fillBlankSonosDetails finished client list")));
+}
+
+/*
+ * Fills in the details of the first client from t_index
+ * that's missing them, returning where to carry on from
+ */
+uint8_t Sonos::fillBlankSonosDetails(uint8_t t_index)
+{
+    for (; t_index < m_sonos_client_count; t_index++)
+    {
+        SonosClient& client = m_sonos_clients[t_index];
+
+        // Filled in already, or cleared by mergeClient
+        if ((client.serial_num[0] && client.room_name[0]) || !client.location[0]) continue;
+
+        // Restored at boot, so make sure it's still the same
+        // speaker before its details are taken from that address
+        if (client.serial_num[0] && (!client.ip || !probeClient(client))) return t_index + 1;
+
+        getSonosDetails(client);
+
+        DEBUG_SONOS(Serial.print(F("Client #"));
+                    Serial.print(t_index);
+                    Serial.print(F(": "));
+                    Serial.println(client.serial_num));
+
+        // May be cleared in favour of an existing entry
+        mergeClient(t_index);
+
+        return t_index + 1;
+    }
+
+    return m_sonos_client_count;
+}
+
+void Sonos::getSonosDetails(SonosClient& t_client)
+{
+    DEBUG_SONOS(Serial.print(F("Sonos::getSonosDetails IP:"));
+                Serial.println(t_client.ip));
+
+    CAPTURE.request(t_client.ip, "GET", t_client.location, nullptr, nullptr);
+
+    int http_response_code = m_soap_client.get(t_client.ip, t_client.location, s_default_timeout);
+
+    m_response = &m_soap_client;
+
+    CAPTURE.status(t_client.ip, http_response_code);
+
+    if (http_response_code > 0)
+    {
+        struct
+        {
+            const char* tag;
+            char* value;
+            size_t size;
+            bool found;
+        } fields[] = {
+            { "roomName",       t_client.room_name,     sizeof(t_client.room_name),     false },
+            { "displayName",    t_client.display_name,  sizeof(t_client.display_name),  false },
+            { "serialNum",      t_client.serial_num,    sizeof(t_client.serial_num),    false },
+            { "UDN",            t_client.uuid,          sizeof(t_client.uuid),          false }
+        };
+        uint8_t remaining = NUM(fields);
+
+        StreamWindow& window = responseWindow(&t_client);
+
+        // One pass over the description, in whatever order the
+        // elements come. The device's own UDN comes first, ahead
+        // of its sub-devices.
+        bool at_tag = window.findAndConsume("<", 1);
+
+        while (at_tag && remaining)
+        {
+            char tag[16];
+
+            if (!window.copyUntil(">", 1, tag, sizeof(tag))) break;
+
+            at_tag = false;
+
+            for (auto& field : fields)
+            {
+                if (field.found || (strcmp(tag, field.tag) != 0)) continue;
+
+                at_tag = window.copyUntil("<", 1, field.value, field.size);
+                field.found = true;
+                remaining--;
+                break;
+            }
+
+            if (!at_tag) at_tag = window.findAndConsume("<", 1);
+        }
+
+        // "uuid:RINCON_..."
+        if (strncmp(t_client.uuid, "uuid:", 5) == 0) memmove(t_client.uuid, t_client.uuid + 5, strlen(t_client.uuid + 5) + 1);
+    }
+    else
+    {
+        DEBUG_SONOS(Serial.print(F("Sonos::sendRequest error on sending GET ["));
+                    Serial.print(http_response_code);
+                    Serial.print(F("] ["));
+                    Serial.print(HTTPClient::errorToString(http_response_code));
+                    Serial.println(F("]")));
+    }
+
+    endRequest(&t_client);
+}
+
+const SonosClient* Sonos::getActiveClient()
+{
+    return m_active_client;
+}
+
+bool Sonos::setActiveClient(const char* t_serial_num)
+{
+    return setActiveClient(t_serial_num, strlen(t_serial_num));
+}
+
+bool Sonos::setActiveClient(const char* t_serial_num, const size_t t_serial_num_len)
+{
+    DEBUG_SONOS(Serial.print(F("Sonos::setActiveClient Setting active client ["));
+                Serial.write((const uint8_t*)t_serial_num, t_serial_num_len);
+                Serial.println(F("]")));
+    
+    SonosClient* client = findClient(t_serial_num, t_serial_num_len);
+
+    if (client)
+    {
+        m_active_client = client;
+
+        DEBUG_SONOS(Serial.print(F("Sonos::setActiveClient Found active client ["));
+                    Serial.print(m_active_client->room_name);
+                    Serial.print(":");
+                    Serial.print(m_active_client->serial_num);
+                    Serial.print(":");
+                    Serial.print(m_active_client->ip);
+                    Serial.println(F("]")));
+    }
+
+    DEBUG_SONOS(if (!client)
+                {
+                    Serial.print(F("Sonos::setActiveClient Could not find client ["));
+                    Serial.write((const uint8_t*)t_serial_num, t_serial_num_len);
+                    Serial.println(F("]"));
+                });
+
+    return client != nullptr;
+}
+
+SonosClient* Sonos::findClient(const char* t_serial_num, const size_t t_serial_num_len)
+{
+    for (auto i = 0; i < m_sonos_client_count; i++)
+    {
+        if ((strlen(m_sonos_clients[i].serial_num) == t_serial_num_len) && (strncmp(m_sonos_clients[i].serial_num, t_serial_num, t_serial_num_len) == 0))
+        {
+            return &m_sonos_clients[i];
+        }
+    }
+
+    return nullptr;
+}
+
+/*bool Sonos::decodeUri(char *p)
+{
+    int n = strlen(p);
+
+    while (*p)
+    {
+        if (*p != '%')
+        {
+            p++;
+            n--;
+            continue;
+        }
 
         if (!isxdigit(p[1]) || !isxdigit(p[2])) return false;
 
@@ -593,33 +1758,4 @@ uint8_t Sonos::getClientCount()
 const SonosClient* Sonos::getClient(const uint8_t id)
 {
     return &m_sonos_clients[id];
-}
-
-// Not mine - copied from Arduino forums
-bool Sonos::readUntil(WiFiClient& client, const char *target, size_t targetLen, char* buffer, int buffer_len)
-{
-    size_t index = 0;  // maximum target string length is 64k bytes!
-    int c;
-    int i = 0;
-
-    if(*target == 0)
-        return true;   // return true if target is a null string
-    
-    while(((c = client.read()) > 0) && (i < (buffer_len - 1)))
-    {
-        buffer[i++] = c;
-
-        if(c != target[index])
-            index = 0; // reset index if any char does not match
-
-        if(c == target[index])
-        {
-            if(++index >= targetLen)
-            { // return true if all chars in the target match
-                return true;
-            }
-        }
-    }
-
-    return false;
 }
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include <WiFiUDP.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266HTTPClient.h> 
+#include "Metrics.h"
+#include "Capture.h"
+#include "Ssdp.h"
+#include "SoapClient.h"
+#include "StreamWindow.h"
 
 #ifdef DEBUG
     #define DEBUG_SONOS(x) x
@@ -14,15 +19,59 @@
 
 #define NUM(a) (sizeof(a) / sizeof(*a))
 
+#define SONOS_MAX_CLIENTS           20
+#define SONOS_FANOUT_CONNECTIONS    4       // lwIP allows 5 TCP connections, leave one for the web server
+#define SONOS_FANOUT_TIMEOUT        2000    // ms, for the whole fan-out
+
+#define SONOS_TAP_BUDGET            3000    // ms for all the requests made for one tap
+#define SONOS_MIN_TIMEOUT           500     // ms, shortest timeout we'll give a request
+#define SONOS_PROBE_TIMEOUT         1000    // ms, for re-probing a client that's gone quiet
+#define SONOS_PROBE_PERIOD          10000   // ms between re-probes of a down client
+#define SONOS_CLIENT_DOWN_AFTER     2       // Requests without a response before we stop sending to a client
+#define SONOS_CLIENT_EVICT_AFTER    3       // Failed re-probes before a client is forgotten
+
+// Uncomment to send SOAP requests with HTTPClient, as before
+// SoapClient, to compare the two in /metrics
+// #define SONOS_SOAP_HTTPCLIENT
+
+enum SonosRepeat : uint8_t
+{
+    SONOS_REPEAT_OFF,
+    SONOS_REPEAT_ALL,
+    SONOS_REPEAT_ONE
+};
+
 struct SonosClient
 {
     IPAddress ip;
     char location[255]{};
     char serial_num[20]{};
+    char uuid[32]{};        // e.g. RINCON_000E58XXXXXXXX01400
     char room_name[255]{};
     char display_name[255]{};
+
+    // Health, from the requests we send it
+    uint8_t failures = 0;           // Consecutive requests without a response
+    uint8_t failed_probes = 0;      // Since it went down
+    uint32_t rtt_us = 0;            // Smoothed response time, 0 until it first answers
+    unsigned long last_probe = 0;
+    uint32_t boot_id = 0;           // From discovery, changes when the speaker restarts
+};
+
+/**
+ * An action on one of a speaker's services, with its
+ * request header built from them at compile time
+ */
+struct SonosAction
+{
+    SoapAction soap;
+    const char* service;
+    const char* name;
 };
 
+#define SONOS_ACTION(service, name) \
+    { SOAP_ACTION("/MediaRenderer/" service "/Control", "\"urn:schemas-upnp-org:service:" service ":1#" name "\""), service, name }
+
 
 class Sonos
 {
@@ -32,40 +81,110 @@ public:
     void begin(unsigned int);
     long discover();
     long discover(unsigned long);
+    void startDiscovery();
+    void startDiscovery(unsigned long);
+    bool handleDiscovery();
+    bool isDiscovering();
+    bool restoreClient(const IPAddress&, const char*, const char*);
+    void setDeadline(const unsigned long);
+    bool warmUp();
+    void checkClients();
     void subscribe(WiFiClient&, IPAddress&);
     bool play();
     bool play(SonosClient*);
     bool pause();
     bool pause(SonosClient*);
     bool stop();
+    bool pauseAll();
+    uint8_t fanOut(SonosClient**, const uint8_t, const SonosAction&, const char*, int16_t*, const unsigned long = SONOS_FANOUT_TIMEOUT);
     bool queueUri(const uint16_t, const char*);
-    bool queueUri(SonosClient*, const uint16_t, const char*);
+    bool queueUri(const uint16_t, const char*, const size_t);
+    bool queueUri(SonosClient*, const uint16_t, const char*, const size_t);
+    bool next();
+    bool next(SonosClient*);
+    bool previous();
+    bool previous(SonosClient*);
+    bool setVolume(const uint8_t);
+    bool setVolume(SonosClient*, const uint8_t);
+    bool getVolume(uint8_t&);
+    bool getVolume(SonosClient*, uint8_t&);
+    bool setShuffle(const bool);
+    bool setRepeat(const SonosRepeat);
+    bool setPlayMode(SonosClient*, const bool, const SonosRepeat);
+    bool joinGroup(const char*, const size_t);
+    bool joinGroup(SonosClient*, SonosClient*);
+    bool leaveGroup();
+    bool leaveGroup(SonosClient*);
+    bool setSleepTimer(const uint16_t);
+    bool setSleepTimer(SonosClient*, const uint16_t);
     uint16_t getServiceID(const char*);
     uint16_t getServiceID(SonosClient*, const char*);
     bool setActiveClient(const char*);
+    bool setActiveClient(const char*, const size_t);
     const SonosClient* getActiveClient();
     void printClients();
     uint8_t getClientCount();
     const SonosClient* getClient(const uint8_t);
+    void beginBatch();
+    void endBatch();
 
 private:
     WiFiUDP m_udp;
+#ifdef SONOS_SOAP_HTTPCLIENT
     WiFiClient m_wifi_client;
     HTTPClient m_http_client;
+#endif
+    SoapClient m_soap_client;
+    Stream* m_response = nullptr;   // Body of the request in progress
+    CaptureStream m_capture_stream;
+    StreamWindow m_window;
     SonosClient* m_active_client = nullptr;
-    SonosClient m_sonos_clients[20];
+    SonosClient m_sonos_clients[SONOS_MAX_CLIENTS];
     uint8_t m_sonos_client_count = 0;
     uint16_t m_ssdp_port = 1900;
+    char m_ssdp_packet[SSDP_PACKET_SIZE + 1];
+
+    // Last play mode we set, Sonos wants both halves at once
+    bool m_shuffle = false;
+    SonosRepeat m_repeat = SONOS_REPEAT_OFF;
+
+    // Discovery in progress, see startDiscovery()
+    bool m_discovering = false;
+    bool m_discovery_listening = false;
+    unsigned long m_discovery_start = 0;
+    unsigned long m_discovery_time_out = 0;
+    long m_discovery_new_devices = 0;
+    uint8_t m_discovery_next_client = 0;
+
+    // Keep the connection open between requests
+    bool m_batch = false;
+
+    // Requests give up at this point (millis), if set
+    unsigned long m_deadline = 0;
+    bool m_has_deadline = false;
 
+    SonosClient* findClient(const char*, const size_t);
     void getSonosDetails(SonosClient&);
     void fillBlankSonosDetails();
-    bool addSonosClient(IPAddress&, const char*);
-    bool sendRequest(IPAddress&, const int, const char*, const char*, const char*);
-    bool sendRequest_End(IPAddress&, const int, const char*, const char*, const char*);
+    uint8_t fillBlankSonosDetails(uint8_t);
+    void readSsdpPacket(const int);
+    bool addSonosClient(IPAddress&, const SsdpResponse&);
+    bool sendRequest(SonosClient*, const SoapAction&, const char*, const MetricsHistogram);
+    bool sendRequest_End(SonosClient*, const SoapAction&, const char*, const MetricsHistogram);
+    Stream& responseStream(const SonosClient*);
+    StreamWindow& responseWindow(const SonosClient*);
+    void endRequest(const SonosClient*);
+    uint16_t requestTimeout(const SonosClient*);
+    void recordResponse(SonosClient*, const bool, const uint32_t);
+    bool probeClient(SonosClient&);
+    void evictClient(SonosClient&);
+    void mergeClient(const uint8_t);
+    SonosClient* freeClient();
+    bool sendAction(SonosClient*, const SonosAction&, const char*, const MetricsHistogram);
+    bool beginAction(SonosClient*, const SonosAction&, const char*, const MetricsHistogram);
     static char *appendF(const char*, ...);
     bool decodeUri(char*);
-    void printStream(WiFiClient*);
-    bool readUntil(WiFiClient& client, const char *target, size_t targetLen, char* buffer, int buffer_len);
+    void printStream(Stream&);
 };
 
 #endif
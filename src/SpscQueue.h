@@ -0,0 +1,75 @@
+#ifndef SpscQueue_h
+#define SpscQueue_h
+
+#include <Arduino.h>
+#include <atomic>
+
+/*
+ * Lock-free single producer, single consumer queue
+ *
+ * The producer fills a slot in place with claim() and
+ * hands it over with publish(); the consumer works on
+ * the oldest slot in place with peek() and frees it
+ * with release(). Nothing is copied, and neither side
+ * ever waits on the other. Each index is only written
+ * by one side, so the only ordering needed is release
+ * on publish/release and acquire when reading the
+ * other side's index.
+ */
+template<typename T, uint8_t N>
+class SpscQueue
+{
+    static_assert((N > 0) && (N <= 128) && ((N & (N - 1)) == 0), "Queue size must be a power of two, no more than 128");
+
+public:
+    SpscQueue() {};
+
+    // Producer: slot to fill, or nullptr if the queue is full
+    T* claim()
+    {
+        uint8_t head = m_head.load(std::memory_order_relaxed);
+
+        if ((uint8_t)(head - m_tail.load(std::memory_order_acquire)) >= N) return nullptr;
+
+        return &m_items[head & (N - 1)];
+    }
+
+    // Producer: makes the claimed slot visible to the consumer
+    void publish()
+    {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool full() const
+    {
+        return (uint8_t)(m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire)) >= N;
+    }
+
+    // Consumer: the t_offset'th oldest item, or nullptr if there aren't that many
+    T* peek(const uint8_t t_offset = 0)
+    {
+        uint8_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if ((uint8_t)(m_head.load(std::memory_order_acquire) - tail) <= t_offset) return nullptr;
+
+        return &m_items[(uint8_t)(tail + t_offset) & (N - 1)];
+    }
+
+    // Consumer: frees the oldest item
+    void release()
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<uint8_t> m_head{0};  // Next slot to publish, written by the producer
+    std::atomic<uint8_t> m_tail{0};  // Oldest unreleased slot, written by the consumer
+    T m_items[N];
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include <string.h>
+#include <strings.h>
+#include "Ssdp.h"
+
+struct SsdpHeaderName
+{
+    SsdpHeader header;
+    const char* name;
+    uint8_t length;
+};
+
+#define SSDP_HEADER_NAME(id, name) { SSDP_##id, name, sizeof(name) - 1 },
+
+static const SsdpHeaderName s_header_names[] = { SSDP_HEADERS(SSDP_HEADER_NAME) };
+
+#undef SSDP_HEADER_NAME
+
+static bool isSpace(const char t_char)
+{
+    return (t_char == ' ') || (t_char == '\t') || (t_char == '\r');
+}
+
+static bool startsWith(const char* t_text, const size_t t_length, const char* t_prefix)
+{
+    size_t length = strlen(t_prefix);
+
+    return (t_length >= length) && (strncasecmp(t_text, t_prefix, length) == 0);
+}
+
+static uint32_t parseNumber(const char* t_text, const char* t_end)
+{
+    uint32_t value = 0;
+
+    while ((t_text < t_end) && (*t_text >= '0') && (*t_text <= '9')) value = (value * 10) + (*t_text++ - '0');
+
+    return value;
+}
+
+/*
+ * Returns false unless the packet is a successful
+ * search response or an advertisement
+ */
+bool SsdpResponse::parse(const char* t_packet, const size_t t_length)
+{
+    const char* end = t_packet + t_length;
+    const char* line = t_packet;
+    bool first = true;
+
+    for (uint8_t i = 0; i < SSDP_HEADER_COUNT; i++) m_fields[i] = SsdpField();
+
+    while (line < end)
+    {
+        const char* line_end = (const char*)memchr(line, '\n', end - line);
+        const char* next = line_end ? line_end + 1 : end;
+
+        if (!line_end) line_end = end;
+
+        if (first)
+        {
+            size_t length = line_end - line;
+
+            if (!(startsWith(line, length, "HTTP/1.1 200") || startsWith(line, length, "NOTIFY "))) return false;
+
+            first = false;
+            line = next;
+            continue;
+        }
+
+        const char* colon = (const char*)memchr(line, ':', line_end - line);
+
+        if (colon)
+        {
+            const char* name_end = colon;
+
+            while ((name_end > line) && isSpace(name_end[-1])) name_end--;
+
+            for (const SsdpHeaderName& header : s_header_names)
+            {
+                if (((size_t)(name_end - line) != header.length) || (strncasecmp(line, header.name, header.length) != 0)) continue;
+
+                const char* value = colon + 1;
+                const char* value_end = line_end;
+
+                while ((value < value_end) && isSpace(*value)) value++;
+                while ((value_end > value) && isSpace(value_end[-1])) value_end--;
+
+                m_fields[header.header].text = value;
+                m_fields[header.header].length = value_end - value;
+                break;
+            }
+        }
+
+        line = next;
+    }
+
+    return !first;
+}
+
+/*
+ * The speaker's id from the USN, e.g. RINCON_000E58XXXXXXXX01400
+ * from "uuid:RINCON_000E58XXXXXXXX01400::urn:schemas-upnp-org:..."
+ */
+SsdpField SsdpResponse::uuid() const
+{
+    const SsdpField& usn = m_fields[SSDP_USN];
+    SsdpField uuid;
+
+    if (!startsWith(usn.text, usn.length, "uuid:")) return uuid;
+
+    uuid.text = usn.text + 5;
+    uuid.length = usn.length - 5;
+
+    for (uint16_t i = 0; (i + 1) < uuid.length; i++)
+    {
+        if ((uuid.text[i] == ':') && (uuid.text[i + 1] == ':'))
+        {
+            uuid.length = i;
+            break;
+        }
+    }
+
+    return uuid;
+}
+
+/*
+ * Seconds the response is valid for, from
+ * "max-age = 1800", or 0 if not given
+ */
+uint32_t SsdpResponse::maxAge() const
+{
+    const SsdpField& cache_control = m_fields[SSDP_CACHE_CONTROL];
+    const char* end = cache_control.text + cache_control.length;
+
+    if (!startsWith(cache_control.text, cache_control.length, "max-age")) return 0;
+
+    const char* value = cache_control.text + 7;
+
+    while ((value < end) && (isSpace(*value) || (*value == '='))) value++;
+
+    return parseNumber(value, end);
+}
+
+/*
+ * Goes up each time the speaker restarts its
+ * network stack, or 0 if not given
+ */
+uint32_t SsdpResponse::bootId() const
+{
+    const SsdpField& boot_id = m_fields[SSDP_BOOT_ID];
+
+    return parseNumber(boot_id.text, boot_id.text + boot_id.length);
+}
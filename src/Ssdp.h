@@ -0,0 +1,71 @@
+#ifndef Ssdp_h
+#define Ssdp_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SSDP_PACKET_SIZE            1024    // Sonos responses are ~600 bytes, longer ones are cut here
+
+/*
+ * Headers we pick out of a response: X(id, name)
+ *
+ * An id can be listed more than once for headers
+ * that go by more than one name; the last one in
+ * the packet wins.
+ */
+#define SSDP_HEADERS(X) \
+    X(LOCATION,         "LOCATION") \
+    X(USN,              "USN") \
+    X(ST,               "ST") \
+    X(ST,               "NT") \
+    X(CACHE_CONTROL,    "CACHE-CONTROL") \
+    X(BOOT_ID,          "BOOTID.UPNP.ORG") \
+    X(HOUSEHOLD,        "X-RINCON-HOUSEHOLD") \
+    X(HOUSEHOLD,        "HOUSEHOLD.SMARTSPEAKER.AUDIO")
+
+enum SsdpHeader : uint8_t
+{
+    SSDP_LOCATION,
+    SSDP_USN,
+    SSDP_ST,
+    SSDP_CACHE_CONTROL,
+    SSDP_BOOT_ID,
+    SSDP_HOUSEHOLD,
+    SSDP_HEADER_COUNT
+};
+
+/*
+ * A header's value, pointing in to the packet.
+ * Not NUL terminated.
+ */
+struct SsdpField
+{
+    const char* text = nullptr;
+    uint16_t length = 0;
+
+    bool isSet() const { return length > 0; }
+};
+
+/*
+ * Parses an M-SEARCH response (or NOTIFY) in place,
+ * in one pass over the packet. Header names are
+ * matched regardless of case, and values have the
+ * surrounding space and line endings trimmed. The
+ * packet must outlive the response.
+ */
+class SsdpResponse
+{
+public:
+    SsdpResponse() {};
+    bool parse(const char*, const size_t);
+    const SsdpField& get(const SsdpHeader t_header) const { return m_fields[t_header]; }
+
+    SsdpField uuid() const;
+    uint32_t maxAge() const;
+    uint32_t bootId() const;
+
+private:
+    SsdpField m_fields[SSDP_HEADER_COUNT];
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include <Arduino.h>
+#include "StreamWindow.h"
+
+void StreamWindow::attach(Stream& t_stream)
+{
+    m_stream = &t_stream;
+    m_start = 0;
+    m_end = 0;
+}
+
+/*
+ * The next byte, without consuming it, or -1
+ * if nothing arrives in time
+ */
+int StreamWindow::peek()
+{
+    if (!buffered() && !fill()) return -1;
+
+    return (uint8_t)m_buffer[m_start];
+}
+
+void StreamWindow::consume(const size_t t_length)
+{
+    m_start += (t_length < buffered()) ? t_length : buffered();
+}
+
+/*
+ * Consumes up to and including the target, given
+ * either as bytes or as a StriSearch. Returns false
+ * if it doesn't turn up in time.
+ */
+bool StreamWindow::seek(const char* t_target, const StriSearch* t_search, const size_t t_length)
+{
+    if (!t_length || (t_length > (STREAM_WINDOW_SIZE / 2))) return false;
+
+    while (true)
+    {
+        const char* found = search(t_target, t_search, t_length);
+
+        if (found)
+        {
+            m_start = (found - m_buffer) + t_length;
+            return true;
+        }
+
+        // Keep what could be the start of a match
+        m_start += safeLength(t_length);
+
+        if (!fill()) return false;
+    }
+}
+
+/*
+ * Copies what comes before the target in to t_buffer,
+ * then consumes the target. Anything that doesn't fit
+ * in t_buffer is dropped, and t_buffer is always
+ * terminated. Returns false if the target doesn't
+ * turn up in time.
+ */
+bool StreamWindow::copy(const char* t_target, const StriSearch* t_search, const size_t t_length, char* t_buffer, const size_t t_size)
+{
+    size_t copied = 0;
+
+    if (!t_size || !t_length || (t_length > (STREAM_WINDOW_SIZE / 2))) return false;
+
+    while (true)
+    {
+        const char* found = search(t_target, t_search, t_length);
+        size_t length = found ? (size_t)(found - (m_buffer + m_start)) : safeLength(t_length);
+        size_t room = t_size - 1 - copied;
+        size_t copy = (length < room) ? length : room;
+
+        memcpy(t_buffer + copied, m_buffer + m_start, copy);
+        copied += copy;
+        t_buffer[copied] = '\0';
+
+        m_start += length;
+
+        if (found)
+        {
+            m_start += t_length;
+            return true;
+        }
+
+        if (!fill()) return false;
+    }
+}
+
+/*
+ * Moves what's left to the front and reads as
+ * much as fits, waiting for at least one byte
+ * unless the stream has ended
+ */
+bool StreamWindow::fill()
+{
+    if (!m_stream) return false;
+
+    if (m_start)
+    {
+        memmove(m_buffer, m_buffer + m_start, buffered());
+        m_end -= m_start;
+        m_start = 0;
+    }
+
+    if (m_end == sizeof(m_buffer)) return false;
+
+    unsigned long start = millis();
+
+    do
+    {
+        int length = m_stream->read((uint8_t*)m_buffer + m_end, sizeof(m_buffer) - m_end);
+
+        if (length > 0)
+        {
+            m_end += length;
+            return true;
+        }
+
+        // The whole body has been read, so there's nothing to wait for
+        if (m_stream->streamRemaining() == 0) return false;
+
+        yield();
+    } while ((millis() - start) < m_stream->getTimeout());
+
+    return false;
+}
+
+const char* StreamWindow::search(const char* t_target, const StriSearch* t_search, const size_t t_length) const
+{
+    if (buffered() < t_length) return nullptr;
+
+    if (t_search) return t_search->find(m_buffer + m_start, buffered());
+
+    const char* position = m_buffer + m_start;
+    const char* last = m_buffer + m_end - t_length;
+
+    while (position <= last)
+    {
+        position = (const char*)memchr(position, t_target[0], last - position + 1);
+
+        if (!position) return nullptr;
+
+        if (memcmp(position + 1, t_target + 1, t_length - 1) == 0) return position;
+
+        position++;
+    }
+
+    return nullptr;
+}
+
+/*
+ * How much can be consumed without losing
+ * the start of a match split across fills
+ */
+size_t StreamWindow::safeLength(const size_t t_length) const
+{
+    return (buffered() >= t_length) ? (buffered() - (t_length - 1)) : 0;
+}
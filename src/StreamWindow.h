@@ -0,0 +1,51 @@
+#ifndef StreamWindow_h
+#define StreamWindow_h
+
+#include <Arduino.h>
+#include "Utility.h"
+
+#define STREAM_WINDOW_SIZE          256     // Longest target is half of this
+
+/**
+ * Read window over a Stream
+ *
+ * Stream::find() and read() go through the stream
+ * (and for a WiFiClient, lwIP's pbufs) a byte at a
+ * time. The window is filled with bulk read()s and
+ * searched in memory instead. Waits up to the
+ * stream's timeout for more data, like find(),
+ * unless the stream says nothing more is coming.
+ *
+ * Targets given as a StriSearch are matched without
+ * regard to case, using its skip table.
+ *
+ * Only reads what it needs to, so the stream stays
+ * usable afterwards, less what's still buffered.
+ */
+class StreamWindow
+{
+public:
+    StreamWindow() {};
+    void attach(Stream&);
+    int peek();
+    void consume(const size_t);
+    bool findAndConsume(const char* t_target, const size_t t_length) { return seek(t_target, nullptr, t_length); }
+    bool findAndConsume(const StriSearch& t_target) { return seek(nullptr, &t_target, t_target.length()); }
+    bool copyUntil(const char* t_target, const size_t t_length, char* t_buffer, const size_t t_size) { return copy(t_target, nullptr, t_length, t_buffer, t_size); }
+    bool copyUntil(const StriSearch& t_target, char* t_buffer, const size_t t_size) { return copy(nullptr, &t_target, t_target.length(), t_buffer, t_size); }
+    size_t buffered() const { return m_end - m_start; }
+
+private:
+    Stream* m_stream = nullptr;
+    char m_buffer[STREAM_WINDOW_SIZE];
+    uint16_t m_start = 0;
+    uint16_t m_end = 0;
+
+    bool seek(const char*, const StriSearch*, const size_t);
+    bool copy(const char*, const StriSearch*, const size_t, char*, const size_t);
+    bool fill();
+    const char* search(const char*, const StriSearch*, const size_t) const;
+    size_t safeLength(const size_t) const;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include <Arduino.h>
+#include "Trace.h"
+
+#define TRACE_SPAN_NAME(id, name) name,
+
+static const char* s_span_names[] = { TRACE_SPANS(TRACE_SPAN_NAME) };
+
+#undef TRACE_SPAN_NAME
+
+/**
+ * Writes the recorded spans as Chrome trace JSON
+ *
+ * Oldest first, as complete ("X") events. Each tap
+ * gets its own thread id, so a tap waiting in the
+ * queue doesn't overlap the one being dispatched.
+ * Load the output in chrome://tracing or Perfetto.
+ */
+void TraceClass::printTo(Print& t_out)
+{
+    uint32_t count = (m_next < TRACE_RING_SIZE) ? m_next : TRACE_RING_SIZE;
+
+    t_out.print(F("{\"traceEvents\":["));
+
+    for (uint32_t i = m_next - count; i != m_next; i++)
+    {
+        const TraceSpan& span = m_spans[i & (TRACE_RING_SIZE - 1)];
+
+        if (i != (m_next - count)) t_out.print(',');
+
+        t_out.print(F("\r\n{\"name\":\""));t_out.print(s_span_names[span.id]);
+        t_out.print(F("\",\"ph\":\"X\",\"pid\":1,\"tid\":"));t_out.print(span.tap);
+        t_out.print(F(",\"ts\":"));t_out.print(span.start);
+        t_out.print(F(",\"dur\":"));t_out.print(span.duration);
+
+        if (span.detail != TRACE_NO_DETAIL)
+        {
+            // Labels are already quoted, e.g. action="play"
+            t_out.print(F(",\"args\":{\"request\":\""));
+
+            for (const char* c = MetricsClass::getLabels((MetricsHistogram)span.detail); *c; c++)
+            {
+                if (*c == '"') t_out.print('\\');
+                t_out.print(*c);
+            }
+
+            t_out.print(F("\"}"));
+        }
+
+        t_out.print('}');
+    }
+
+    t_out.print(F("\r\n],\"displayTimeUnit\":\"ms\"}"));
+}
+
+/**
+ * Writes percentiles for each stage, as text
+ *
+ * Covers every span since boot, not just those still
+ * in the ring. Percentiles come from the log2 buckets
+ * so are an upper bound, within a factor of two.
+ */
+void TraceClass::printSummaryTo(Print& t_out)
+{
+    char line[80];
+
+    snprintf(line, sizeof(line), "%-10s %8s %10s %10s %10s %10s", "stage", "count", "p50_us", "p90_us", "p99_us", "max_us");
+    t_out.println(line);
+
+    for (uint8_t i = 0; i < TRACE_SPAN_COUNT; i++)
+    {
+        uint32_t count = 0;
+
+        for (uint8_t bucket = 0; bucket < TRACE_BUCKET_COUNT; bucket++) count += m_buckets[i][bucket];
+
+        snprintf(line, sizeof(line), "%-10s %8lu %10lu %10lu %10lu %10lu", s_span_names[i], (unsigned long)count,
+                 (unsigned long)percentile((TraceSpanId)i, count, 50),
+                 (unsigned long)percentile((TraceSpanId)i, count, 90),
+                 (unsigned long)percentile((TraceSpanId)i, count, 99),
+                 (unsigned long)m_max_us[i]);
+        t_out.println(line);
+    }
+}
+
+/*
+ * Upper bound of the bucket holding the percentile,
+ * no more than the longest span seen
+ */
+uint32_t TraceClass::percentile(const TraceSpanId t_id, const uint32_t t_count, const uint8_t t_percent)
+{
+    if (!t_count) return 0;
+
+    uint32_t rank = ((uint64_t)t_count * t_percent + 99) / 100;
+    uint32_t cumulative = 0;
+
+    for (uint8_t bucket = 0; bucket < TRACE_BUCKET_COUNT; bucket++)
+    {
+        cumulative += m_buckets[t_id][bucket];
+
+        if ((cumulative >= rank) && (bucket < (TRACE_BUCKET_COUNT - 1)))
+        {
+            uint32_t bound = (1UL << bucket) - 1;
+
+            return (bound < m_max_us[t_id]) ? bound : m_max_us[t_id];
+        }
+    }
+
+    return m_max_us[t_id];
+}
+
+TraceClass TRACE;
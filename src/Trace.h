@@ -0,0 +1,125 @@
+#ifndef Trace_h
+#define Trace_h
+
+#include <Arduino.h>
+#include "Metrics.h"
+
+#ifdef DEBUG
+    #define DEBUG_TRACE(x) x
+#else
+    #define DEBUG_TRACE(x) do{}while(0)
+#endif
+
+#define TRACE_RING_SIZE             64      // Power of two, 12 bytes per span
+#define TRACE_BUCKET_COUNT          24      // Powers of two in us, up to ~8s
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+/*
+ * Stages of a tap: X(id, name)
+ */
+#define TRACE_SPANS(X) \
+    X(DETECT,   "detect")       /* Rfid: card present check and select */ \
+    X(WARMUP,   "warmup")       /* main: getting the speaker ready */ \
+    X(RESOLVE,  "resolve")      /* Rfid: command looked up by UID */ \
+    X(READ,     "read")         /* Rfid: authenticating and reading the card */ \
+    X(QUEUE,    "queue")        /* main: waiting for the card task */ \
+    X(PARSE,    "parse")        /* main: finding the command */ \
+    X(DISPATCH, "dispatch")     /* main: running the command */ \
+    X(SOAP,     "soap")         /* Sonos: one request, connect to response headers */ \
+    X(FANOUT,   "fanout")       /* Sonos: one action sent to several speakers */ \
+    X(TAP,      "tap")          /* main: card detected to command finished */
+
+#define TRACE_ENUM_ID(id, name) TRACE_##id,
+
+enum TraceSpanId : uint8_t
+{
+    TRACE_SPANS(TRACE_ENUM_ID)
+    TRACE_SPAN_COUNT
+};
+
+#undef TRACE_ENUM_ID
+
+#define TRACE_NO_DETAIL             0xFF
+
+struct TraceSpan
+{
+    uint32_t start;         // micros()
+    uint32_t duration;      // us
+    uint16_t tap;           // Tap the span belongs to, 0 if none
+    TraceSpanId id;
+    uint8_t detail;         // For SOAP, the request's histogram
+};
+
+/*
+ * Tap latency tracing
+ *
+ * Each stage of a tap records a span, which goes in to
+ * a ring of the last TRACE_RING_SIZE spans (dumped as
+ * Chrome trace JSON, see chrome://tracing) and a per
+ * stage log2 histogram (summarised as percentiles).
+ * Recording is a micros() call, a few stores and a
+ * clz, so it's left on all the time.
+ */
+class TraceClass
+{
+public:
+    TraceClass() {};
+
+    // Starts a new tap, which later spans belong to
+    inline uint16_t beginTap()
+    {
+        if (++m_tap == 0) m_tap = 1;
+
+        return m_tap;
+    }
+
+    // Spans from here on belong to this tap (0 for none)
+    inline void setTap(const uint16_t t_tap)
+    {
+        m_tap = t_tap;
+    }
+
+    /*
+     * Records a span that started at t_start (micros)
+     * and ends now
+     */
+    inline void record(const TraceSpanId t_id, const uint32_t t_start, const uint8_t t_detail = TRACE_NO_DETAIL)
+    {
+        uint32_t duration = micros() - t_start;
+        TraceSpan& span = m_spans[m_next++ & (TRACE_RING_SIZE - 1)];
+
+        span.start = t_start;
+        span.duration = duration;
+        span.tap = m_tap;
+        span.id = t_id;
+        span.detail = t_detail;
+
+        m_buckets[t_id][bucketFor(duration)]++;
+        if (duration > m_max_us[t_id]) m_max_us[t_id] = duration;
+    }
+
+    void printTo(Print&);
+    void printSummaryTo(Print&);
+
+private:
+    TraceSpan m_spans[TRACE_RING_SIZE]{};
+    uint32_t m_next = 0;
+    uint16_t m_tap = 0;
+    uint32_t m_buckets[TRACE_SPAN_COUNT][TRACE_BUCKET_COUNT]{};
+    uint32_t m_max_us[TRACE_SPAN_COUNT]{};
+
+    // Bucket b holds durations under 2^b us
+    static inline uint8_t bucketFor(const uint32_t t_micros)
+    {
+        uint8_t bucket = t_micros ? (32 - __builtin_clz(t_micros)) : 0;
+
+        return (bucket >= TRACE_BUCKET_COUNT) ? (TRACE_BUCKET_COUNT - 1) : bucket;
+    }
+
+    uint32_t percentile(const TraceSpanId, const uint32_t, const uint8_t);
+};
+
+extern TraceClass TRACE;
+
+#endif
@@ -1,44 +1,164 @@
-#include <ctype.h>
+#include <string.h>
 #include "Utility.h"
 
+static const uint32_t s_swar_ones = 0x01010101UL ;
+static const uint32_t s_swar_highs = 0x80808080UL ;
+static const uint32_t s_swar_case = 0x20202020UL ;
+
+// Same as tolower() in the C locale
+static inline uint8_t foldCase( uint8_t c )
+{
+    return ( (uint8_t)( c - 'A' ) < 26 ) ? ( c | 0x20 ) : c ;
+}
+
+// High bit set in each zero byte. Bytes above the first zero
+// can be flagged wrongly, but the lowest one is always right.
+static inline uint32_t zeroBytes( uint32_t v )
+{
+    return ( v - s_swar_ones ) & ~v & s_swar_highs ;
+}
+
+/*
+ * Finds the next byte that could start a match (its
+ * case bit ignored), or the terminating null, a word
+ * at a time. Words are only ever read aligned, so
+ * reading past the null can't fault.
+ */
+static const char* scanFirst( const char* p, const uint8_t first )
+{
+    const uint8_t folded = first | 0x20 ;
+
+    while( (uintptr_t)p & 3 )
+    {
+        if( !*p || ( ( (uint8_t)*p | 0x20 ) == folded ) ) return p ;
+        p++ ;
+    }
+
+    const uint32_t pattern = folded * s_swar_ones ;
+
+    for( ;; )
+    {
+        uint32_t word ;
+
+        memcpy( &word, __builtin_assume_aligned( p, 4 ), sizeof( word ) ) ;
+
+        uint32_t hits = zeroBytes( ( word | s_swar_case ) ^ pattern ) | zeroBytes( word ) ;
+
+        if( hits ) return p + ( __builtin_ctz( hits ) >> 3 ) ;
+
+        p += 4 ;
+    }
+}
+
+// Compares folded characters until the needle ends
+static inline bool matchRest( const char* h, const char* n )
+{
+    for( ; *n ; h++, n++ )
+    {
+        if( foldCase( *h ) != foldCase( *n ) ) return false ;
+    }
+
+    return true ;
+}
+
+/*
+ * Candidates for the first character are found a word
+ * at a time, then the rest of the needle is checked
+ */
 char* stristr( const char* str1, const char* str2 )
 {
-    const char* p1 = str1 ;
-    const char* p2 = str2 ;
-    const char* r = *p2 == 0 ? str1 : 0 ;
+    const uint8_t first = foldCase( *str2 ) ;
+
+    if( !first ) return (char*)str1 ;
+
+    for( const char* p = str1 ; ; p++ )
+    {
+        p = scanFirst( p, first ) ;
+
+        if( !*p ) return 0 ;
+
+        if( ( foldCase( *p ) == first ) && matchRest( p + 1, str2 + 1 ) ) return (char*)p ;
+    }
+}
+
+StriSearch::StriSearch( const char* needle )
+{
+    m_original = needle ;
+    m_length = strlen( needle ) ;
+
+    if( m_length > STRI_SEARCH_MAX_NEEDLE ) return ;
+
+    memset( m_skip, m_length, sizeof( m_skip ) ) ;
+
+    for( size_t i = 0 ; i < m_length ; i++ )
+    {
+        m_needle[i] = foldCase( needle[i] ) ;
+    }
 
-    while( *p1 != 0 && *p2 != 0 )
+    // Both cases of each character skip the same distance
+    for( size_t i = 0 ; ( i + 1 ) < m_length ; i++ )
     {
-        if( tolower( (unsigned char)*p1 ) == tolower( (unsigned char)*p2 ) )
+        uint8_t c = m_needle[i] ;
+
+        m_skip[c] = m_length - 1 - i ;
+        if( ( (uint8_t)( c - 'a' ) ) < 26 ) m_skip[c & ~0x20] = m_length - 1 - i ;
+    }
+}
+
+/*
+ * Returns the first match in the first length bytes
+ * of the haystack, which needn't be null terminated
+ */
+const char* StriSearch::find( const char* haystack, const size_t length ) const
+{
+    if( !m_length ) return haystack ;
+    if( m_length > length ) return 0 ;
+
+    const size_t last = m_length - 1 ;
+
+    if( m_length > STRI_SEARCH_MAX_NEEDLE )
+    {
+        for( size_t i = 0 ; i <= ( length - m_length ) ; i++ )
         {
-            if( r == 0 )
-            {
-                r = p1 ;
-            }
+            size_t j = 0 ;
+
+            while( ( j < m_length ) && ( foldCase( haystack[i + j] ) == foldCase( m_original[j] ) ) ) j++ ;
 
-            p2++ ;
+            if( j == m_length ) return haystack + i ;
         }
-        else
+
+        return 0 ;
+    }
+
+    for( size_t i = 0 ; i <= ( length - m_length ) ; i += m_skip[(uint8_t)haystack[i + last]] )
+    {
+        if( foldCase( haystack[i + last] ) != (uint8_t)m_needle[last] ) continue ;
+
+        size_t j = 0 ;
+
+        while( ( j < last ) && ( foldCase( haystack[i + j] ) == (uint8_t)m_needle[j] ) ) j++ ;
+
+        if( j == last ) return haystack + i ;
+    }
+
+    return 0 ;
+}
+
+uint32_t calculateCrc32( const void* data, size_t length, uint32_t crc )
+{
+    const uint8_t* p = (const uint8_t*)data ;
+
+    crc = ~crc ;
+
+    while( length-- )
+    {
+        crc ^= *p++ ;
+
+        for( uint8_t bit = 0 ; bit < 8 ; bit++ )
         {
-            p2 = str2 ;
-            if( r != 0 )
-            {
-                p1 = r + 1 ;
-            }
-
-            if( tolower( (unsigned char)*p1 ) == tolower( (unsigned char)*p2 ) )
-            {
-                r = p1 ;
-                p2++ ;
-            }
-            else
-            {
-                r = 0 ;
-            }
+            crc = ( crc >> 1 ) ^ ( 0xEDB88320UL & ( 0 - ( crc & 1 ) ) ) ;
         }
-
-        p1++ ;
     }
 
-    return *p2 == 0 ? (char*)r : 0 ;
-}
\ No newline at end of file
+    return ~crc ;
+}
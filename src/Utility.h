@@ -1,5 +1,10 @@
-#ifndef ConfigClass_h
-#define ConfigClass_h
+#ifndef Utility_h
+#define Utility_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRI_SEARCH_MAX_NEEDLE      32      // Longer needles fall back to a plain search
 
 /*
  * Case Insenstive comparison implemntation
@@ -7,4 +12,31 @@
  */
 char* stristr(const char*, const char*);
 
+/*
+ * Case insensitive search for a needle that's looked
+ * for many times, e.g. in every element of a response.
+ * The Horspool skip table is built once, then each
+ * search looks at the last character of the window and
+ * skips ahead by up to the needle's length.
+ */
+class StriSearch
+{
+public:
+    StriSearch(const char*);
+    const char* find(const char*, const size_t) const;
+    size_t length() const { return m_length; }
+
+private:
+    const char* m_original;
+    char m_needle[STRI_SEARCH_MAX_NEEDLE];  // Lower case
+    size_t m_length;
+    uint8_t m_skip[256];
+};
+
+/*
+ * CRC-32 (IEEE 802.3), can be chained by passing
+ * the previous result as the last argument
+ */
+uint32_t calculateCrc32(const void*, size_t, uint32_t = 0);
+
 #endif
\ No newline at end of file
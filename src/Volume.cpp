@@ -0,0 +1,257 @@
+#include <Arduino.h>
+#include "Volume.h"
+#include "Config.h"
+#include "Metrics.h"
+#include "Log.h"
+
+void Volume::begin(Sonos* t_sonos)
+{
+    m_sonos = t_sonos;
+}
+
+/**
+ * Sets the volume of the active speaker
+ *
+ * Records the target (capped for the speaker) to be
+ * sent by handle(), replacing any target that hasn't
+ * been sent yet. With a ramp time, the volume moves
+ * to the target gradually over that many ms.
+ */
+void Volume::set(const uint8_t t_volume, const uint16_t t_ramp_ms)
+{
+    if (m_target != VOLUME_UNKNOWN) METRICS.increment(METRIC_VOLUME_COALESCED);
+
+    m_target = clamp(t_volume);
+    m_pending_adjust = 0;
+    m_ramp_ms = t_ramp_ms;
+    m_ramp_from = m_current;
+    m_ramp_start = millis();
+
+    DEBUG_VOLUME(Serial.print(F("Volume::set target ["));
+                 Serial.print(m_target);
+                 Serial.println(F("]")));
+}
+
+/**
+ * Changes the volume of the active speaker
+ *
+ * Relative to any target still waiting to be sent,
+ * otherwise the last known volume. If we don't know
+ * the volume yet, handle() reads it from the speaker
+ * first and then applies the change.
+ */
+void Volume::adjust(const int8_t t_change, const uint16_t t_ramp_ms)
+{
+    checkClient();
+
+    int16_t base = (m_target != VOLUME_UNKNOWN) ? m_target : m_current;
+
+    if (base == VOLUME_UNKNOWN)
+    {
+        if (m_pending_adjust) METRICS.increment(METRIC_VOLUME_COALESCED);
+
+        m_pending_adjust += t_change;
+        m_ramp_adjust_ms = t_ramp_ms;
+        return;
+    }
+
+    set(clamp(base + t_change), t_ramp_ms);
+}
+
+/**
+ * Sends any change to the speaker
+ *
+ * Run as a scheduled task every VOLUME_STEP_PERIOD.
+ * Sends at most one request per run: the target, or
+ * the next step towards it when ramping.
+ */
+void Volume::handle()
+{
+    const SonosClient* client = checkClient();
+
+    if (!client || ((m_target == VOLUME_UNKNOWN) && !m_pending_adjust)) return;
+
+    // Adjusting and ramping both need to start from the current volume
+    if ((m_current == VOLUME_UNKNOWN) && (m_pending_adjust || m_ramp_ms))
+    {
+        uint8_t volume;
+
+        if (m_sonos->getVolume(volume))
+        {
+            m_current = volume;
+        }
+        else
+        {
+            LOG(VOLUME_READ_FAILED);
+            m_pending_adjust = 0;
+            m_ramp_ms = 0;
+        }
+    }
+
+    if (m_pending_adjust && (m_current != VOLUME_UNKNOWN))
+    {
+        int16_t change = m_pending_adjust;
+
+        m_pending_adjust = 0;
+        set(clamp(m_current + change), m_ramp_adjust_ms);
+    }
+
+    if (m_target == VOLUME_UNKNOWN) return;
+
+    // The cap, or the speaker, may have changed since the target was set
+    int16_t target = clamp(m_target);
+    int16_t next = target;
+
+    if (m_ramp_from == VOLUME_UNKNOWN)
+    {
+        m_ramp_from = m_current;
+        m_ramp_start = millis();
+    }
+
+    if (m_ramp_ms && (m_ramp_from != VOLUME_UNKNOWN))
+    {
+        unsigned long elapsed = millis() - m_ramp_start;
+
+        if (elapsed < m_ramp_ms)
+        {
+            next = m_ramp_from + (((int32_t)(target - m_ramp_from) * (int32_t)elapsed) / m_ramp_ms);
+        }
+
+        // Nothing to send until the ramp has moved on a step
+        if ((next == m_current) && (next != target)) return;
+    }
+
+    if (!m_sonos->setVolume(next))
+    {
+        LOG(VOLUME_SET_FAILED);
+        m_target = VOLUME_UNKNOWN;
+        m_current = VOLUME_UNKNOWN;
+        return;
+    }
+
+    m_current = next;
+
+    if (next == target) m_target = VOLUME_UNKNOWN;
+}
+
+/**
+ * Sends any change to the speaker now
+ *
+ * For when the volume has to be in place before
+ * whatever comes next (e.g. the next step of a
+ * macro), so any ramp is skipped. Returns false if
+ * the change couldn't be sent.
+ */
+bool Volume::flush()
+{
+    if ((m_target == VOLUME_UNKNOWN) && !m_pending_adjust) return true;
+
+    m_ramp_ms = 0;
+    m_ramp_adjust_ms = 0;
+
+    handle();
+
+    return (m_target == VOLUME_UNKNOWN) && !m_pending_adjust && (m_current != VOLUME_UNKNOWN);
+}
+
+/*
+ * Last volume set or read, or VOLUME_UNKNOWN
+ */
+int16_t Volume::getVolume()
+{
+    return m_current;
+}
+
+/*
+ * Highest volume allowed for a speaker, its own
+ * cap if it has one, otherwise the default
+ */
+uint8_t Volume::getCap(const SonosClient* t_client)
+{
+    if (t_client && t_client->serial_num[0])
+    {
+        for (const ConfigVolumeCap& cap : CONFIG.stored_config.volume_caps)
+        {
+            if (strcmp(cap.serial_num, t_client->serial_num) == 0) return cap.max;
+        }
+    }
+
+    return CONFIG.stored_config.volume_max;
+}
+
+/**
+ * Sets the highest volume allowed for a speaker
+ *
+ * Without a serial number this sets the default
+ * for speakers without their own cap. If the active
+ * speaker is now over its cap, it's turned down.
+ */
+bool Volume::setCap(const char* t_serial_num, const size_t t_serial_num_len, const uint8_t t_max)
+{
+    uint8_t max = (t_max > 100) ? 100 : t_max;
+
+    if (!t_serial_num_len)
+    {
+        CONFIG.set(&ConfigStruct::volume_max, max);
+    }
+    else
+    {
+        if (t_serial_num_len >= sizeof(ConfigSerial)) return false;
+
+        ConfigVolumeCaps caps;
+        ConfigVolumeCap* slot = nullptr;
+
+        memcpy(caps, CONFIG.stored_config.volume_caps, sizeof(caps));
+
+        for (ConfigVolumeCap& cap : caps)
+        {
+            if ((strlen(cap.serial_num) == t_serial_num_len) && (strncmp(cap.serial_num, t_serial_num, t_serial_num_len) == 0))
+            {
+                slot = &cap;
+                break;
+            }
+
+            if (!slot && !cap.serial_num[0]) slot = &cap;
+        }
+
+        if (!slot)
+        {
+            LOG(VOLUME_CAPS_FULL);
+            return false;
+        }
+
+        memset(slot->serial_num, 0, sizeof(slot->serial_num));
+        memcpy(slot->serial_num, t_serial_num, t_serial_num_len);
+        slot->max = max;
+
+        CONFIG.set(&ConfigStruct::volume_caps, caps);
+    }
+
+    if ((m_current != VOLUME_UNKNOWN) && (m_current > getCap(m_sonos->getActiveClient()))) set(m_current);
+
+    return true;
+}
+
+/*
+ * The active speaker, forgetting the volume we knew
+ * if it was for another one
+ */
+const SonosClient* Volume::checkClient()
+{
+    const SonosClient* client = m_sonos ? m_sonos->getActiveClient() : nullptr;
+
+    if (client != m_client)
+    {
+        m_client = client;
+        m_current = VOLUME_UNKNOWN;
+    }
+
+    return client;
+}
+
+int16_t Volume::clamp(const int16_t t_volume)
+{
+    int16_t cap = getCap(m_sonos ? m_sonos->getActiveClient() : nullptr);
+
+    return (t_volume < 0) ? 0 : ((t_volume > cap) ? cap : t_volume);
+}
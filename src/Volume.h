@@ -0,0 +1,55 @@
+#ifndef Volume_h
+#define Volume_h
+
+#include <Arduino.h>
+#include "Sonos.h"
+
+#ifdef DEBUG
+    #define DEBUG_VOLUME(x) x
+#else
+    #define DEBUG_VOLUME(x) do{}while(0)
+#endif
+
+#define VOLUME_STEP_PERIOD          100     // ms between requests while ramping (the task period)
+#define VOLUME_UNKNOWN              -1
+
+/*
+ * Volume of the active speaker
+ *
+ * Changes only record a target, which handle() (run
+ * as a scheduled task) sends to the speaker. However
+ * many changes arrive between runs, only the latest
+ * target is sent, so a burst of taps or web calls
+ * becomes one request. A ramp moves towards the target
+ * one step per run, rather than blocking the loop.
+ * Targets are capped per speaker, from the config.
+ */
+class Volume
+{
+public:
+    Volume() {};
+    void begin(Sonos*);
+    void set(const uint8_t, const uint16_t = 0);
+    void adjust(const int8_t, const uint16_t = 0);
+    void handle();
+    bool flush();
+    int16_t getVolume();
+    uint8_t getCap(const SonosClient*);
+    bool setCap(const char*, const size_t, const uint8_t);
+
+private:
+    Sonos* m_sonos = nullptr;
+    const SonosClient* m_client = nullptr;  // The speaker m_current belongs to
+    int16_t m_current = VOLUME_UNKNOWN;     // Last volume we set or read
+    int16_t m_target = VOLUME_UNKNOWN;      // Waiting to be sent
+    int16_t m_pending_adjust = 0;           // Waiting on m_current being known
+    int16_t m_ramp_from = VOLUME_UNKNOWN;
+    uint16_t m_ramp_ms = 0;
+    uint16_t m_ramp_adjust_ms = 0;
+    unsigned long m_ramp_start = 0;
+
+    const SonosClient* checkClient();
+    int16_t clamp(const int16_t);
+};
+
+#endif
@@ -29,7 +29,17 @@ const char HTML[] PROGMEM = R"rawliteral(
               <option value="PLAY">Play Item</option>
               <option value="LOCATION">Set Audio Destination</option>
               <option value="STOP">Stop/Pause Playback</option>
+              <option value="PAUSEALL">Pause All Speakers</option>
               <option value="LOCK">Lock System</option>
+              <option value="NEXT">Next Track</option>
+              <option value="PREV">Previous Track</option>
+              <option value="VOLUME">Set Volume</option>
+              <option value="SHUFFLE">Shuffle</option>
+              <option value="REPEAT">Repeat</option>
+              <option value="GROUP">Join Group</option>
+              <option value="GROUP_LEAVE">Leave Group</option>
+              <option value="SLEEP">Sleep Timer</option>
+              <option value="MACRO">Macro (several actions)</option>
             </select>
           </div>
           <div class="col-md-8">
@@ -43,6 +53,25 @@ const char HTML[] PROGMEM = R"rawliteral(
               <label for="locationItem">Location <small>(<a href="javascript:void(0);" id="refreshLocations">refresh</a>)</small></label>
               <select type="text" class="form-control" id="locationDropdown" placeholder="URL"></select>
             </div>
+            <div id="sectionNumber" class="collapse">
+              <label for="commandNumber" id="commandNumberLabel">Value</label>
+              <input type="number" class="form-control" id="commandNumber" min="0" />
+            </div>
+            <div id="sectionChoice" class="collapse">
+              <label for="commandChoice">Mode</label>
+              <select class="form-control" id="commandChoice"></select>
+            </div>
+            <div id="sectionMacro" class="collapse">
+              <label for="macroSteps">Actions <small>(one per line, run in order, up to 8)</small></label>
+              <textarea class="form-control" id="macroSteps" rows="4" placeholder="LOCATION RINCON_000E58XXXXXXXX01400&#10;VOLUME 20&#10;PLAY x-sonos-spotify:...&#10;SHUFFLE ON"></textarea>
+              <small>Choose any other action and click <i>Add to Macro</i> to add it here</small>
+            </div>
+          </div>
+        </div>
+        <div class="row">
+          <div class="col-md-12">
+            <label for="cardLabel">Card Label <small>(optional)</small></label>
+            <input type="text" class="form-control" id="cardLabel" maxlength="47" placeholder="e.g. Frozen Soundtrack" />
           </div>
         </div>
         <div class="row">&nbsp;</div>
@@ -50,6 +79,8 @@ const char HTML[] PROGMEM = R"rawliteral(
           <div class="col-md-12">
             <div class="btn-group">
               <button type="submit" id="writeCardButton" class="btn btn-primary">Write to Card</button>
+              <button id="mapCardButton" class="btn btn-secondary" type="button" title="Assign to the last card tapped, without writing to it">Map Last Tapped Card</button>
+              <button id="addMacroButton" class="btn btn-secondary" type="button" title="Add this action as a step of a macro card">Add to Macro</button>
               <button id="loadingButton" class="btn btn-primary d-none" type="button" disabled>
                 <span class="spinner-border spinner-border-sm" role="status" aria-hidden="true"></span>
                 <span id="loadingButtonText">Loading...</div>
@@ -61,12 +92,91 @@ const char HTML[] PROGMEM = R"rawliteral(
           </div>
         </div>
       </form>
+      <div class="row">&nbsp;</div>
+      <div class="row">
+        <div class="col-md-8"><h4>Card Library</h4></div>
+        <div class="col-md-4">
+          <input type="text" class="form-control" id="cardSearch" placeholder="Search" />
+        </div>
+      </div>
+      <table class="table table-sm">
+        <thead><tr><th>Label</th><th>Command</th><th>Card</th><th></th></tr></thead>
+        <tbody id="cardList"></tbody>
+      </table>
+      <div class="btn-group">
+        <button id="cardsPrevious" class="btn btn-secondary btn-sm" type="button">&laquo; Previous</button>
+        <button id="cardsNext" class="btn btn-secondary btn-sm" type="button">Next &raquo;</button>
+      </div>
+      <small id="cardsSummary"></small>
     </div>
     <script src="https://code.jquery.com/jquery-3.5.1.min.js" integrity="sha256-9/aliU8dGd2tb6OSsuzixeV4y/faTqgFtohetphbbj0=" crossorigin="anonymous"></script>
     <script src="https://cdnjs.cloudflare.com/ajax/libs/popper.js/1.14.7/umd/popper.min.js" integrity="sha384-UO2eT0CpHqdSJQ6hJty5KVphtPhzWj9WO1clHTMGa3JDZwrnQq4sF86dIHNDz0W1" crossorigin="anonymous"></script>
     <script src="https://stackpath.bootstrapcdn.com/bootstrap/4.4.1/js/bootstrap.min.js" integrity="sha384-wfSDF2E50Y2D1uUdj0O3uMBJnjuUD4Ih7YwaYd1iqfktj0Uod8GCExl3Og8ifwB6" crossorigin="anonymous"></script><script>
       
       var g_countdown;
+      var g_cards_offset = 0;
+      const g_cards_limit = 20;
+
+      function getCards(offset) {
+        const url = '/cards?offset=' + offset + '&limit=' + g_cards_limit + '&q=' + encodeURIComponent($('#cardSearch').val());
+
+        $.getJSON(url, function (data) {
+          let list = $('#cardList');
+
+          g_cards_offset = data.offset;
+          list.empty();
+
+          $.each(data.cards, function (index, card) {
+            let row = $('<tr></tr>');
+            row.append($('<td></td>').text(card.label));
+            row.append($('<td class="text-truncate" style="max-width: 300px;"></td>').text(card.command));
+            row.append($('<td></td>').text(card.uid + (card.mapped ? ' (mapped)' : '')));
+            row.append($('<td></td>').append($('<button type="button" class="btn btn-primary btn-sm">Copy</button>').on('click', function() {
+              startWriteRequest('/write?type=CARD&uid=' + card.uid);
+            })));
+            list.append(row);
+          });
+
+          $('#cardsSummary').text(data.total ? ((data.offset + 1) + '-' + (data.offset + data.cards.length) + ' of ' + data.total) : 'No cards');
+          $('#cardsPrevious').prop('disabled', data.offset == 0);
+          $('#cardsNext').prop('disabled', (data.offset + data.cards.length) >= data.total);
+        });
+      }
+
+      function startWriteRequest(url) {
+        if ($('#cardLabel').val() != '') {
+          url += '&label=' + encodeURIComponent($('#cardLabel').val());
+        }
+
+        showAlert(1, 'Please hold RFID card to reader to update changes...');
+        $('#writeCardButton').addClass('d-none');
+        $('#mapCardButton').addClass('d-none');
+        $('#loadingButton').removeClass('d-none');
+        $('#cancelWriteButton').removeClass('d-none');
+
+        // Submit the request
+        $.get(url, function() {
+          // Successfully submitted
+        })
+        .fail(function() {
+          showAlert(3, 'Something went wrong while submitting your request. Please try again.');
+        });
+
+        // Update the UI
+        var counter = 10;
+
+        g_countdown = setInterval(function() {
+          $('#loadingButtonText').html('Loading... (' + counter + ')');
+
+          counter -= 1;
+
+          if (counter < 0) {
+            cancelWriteRequest(false);
+            showAlert(0, '');
+            getCards(g_cards_offset);
+          }
+        }, 1000);
+      }
       
       function getLocations() {
         let dropdown = $('#locationDropdown');
@@ -87,6 +197,7 @@ const char HTML[] PROGMEM = R"rawliteral(
 
       function cancelWriteRequest(submit_request) {
         $('#writeCardButton').removeClass('d-none');
+        $('#mapCardButton').removeClass('d-none');
         $('#loadingButton').addClass('d-none');
         $('#cancelWriteButton').addClass('d-none');
         clearInterval(g_countdown);
@@ -152,57 +263,106 @@ const char HTML[] PROGMEM = R"rawliteral(
         }
       });
 
-      $('#writeCardButton').on('click', function() {
+      function buildCommandQuery() {
         var submit = false;
-        var url = '/write?type=' + $('#type').val();
+        var type = $('#type').val();
+        var url = 'type=' + ((type == "GROUP_LEAVE") ? "GROUP" : type);
 
-        if (($('#type').val() == "STOP") || ($('#type').val() == "LOCK")) {
+        if ((type == "STOP") || (type == "PAUSEALL") || (type == "LOCK") || (type == "NEXT") || (type == "PREV") || (type == "GROUP_LEAVE")) {
           submit = true;
-        } else if ($('#type').val() == "PLAY") {
+        } else if (type == "PLAY") {
           if ($('#playBackURI').val() == '') {
             showAlert(3, 'Please specify a URL to play before submitting');
           } else {
             url += '&url=' + $('#playBackURI').val();
             submit = true;
           }
-        } else if ($('#type').val() == "LOCATION") {
+        } else if ((type == "LOCATION") || (type == "GROUP")) {
           if (!$('#locationDropdown').val()) {
             showAlert(3, 'Please specify a Location before submitting');
           } else {
-            url += '&location=' + $('#locationDropdown').val();
+            url += ((type == "LOCATION") ? '&location=' : '&value=') + $('#locationDropdown').val();
+            submit = true;
+          }
+        } else if ((type == "VOLUME") || (type == "SLEEP")) {
+          var value = $('#commandNumber').val();
+          if ((value === '') || (Number(value) < 0) || (Number(value) > Number($('#commandNumber').attr('max')))) {
+            showAlert(3, 'Please specify a value between 0 and ' + $('#commandNumber').attr('max'));
+          } else {
+            url += '&value=' + value;
+            submit = true;
+          }
+        } else if ((type == "SHUFFLE") || (type == "REPEAT")) {
+          url += '&value=' + $('#commandChoice').val();
+          submit = true;
+        } else if (type == "MACRO") {
+          var steps = $('#macroSteps').val().split('\n').map(function(step) { return step.trim(); }).filter(Boolean);
+          if (steps.length == 0) {
+            showAlert(3, 'Please add at least one action to the macro');
+          } else {
+            url += '&value=' + encodeURIComponent(steps.join(';'));
             submit = true;
           }
         } else {
           showAlert(3, 'Please specify an option first');
         }
 
-        if (submit) {
-          showAlert(1, 'Please hold RFID card to reader to update changes...');
-          $('#writeCardButton').addClass('d-none');
-          $('#loadingButton').removeClass('d-none');
-          $('#cancelWriteButton').removeClass('d-none');
+        return submit ? url : null;
+      }
 
-          // Submit the request
-          $.get(url, function() {
-            // Successfully submitted
-          })
-          .fail(function() {
-            showAlert(3, 'Something went wrong while submitting your request. Please try again.');
-          });
+      $('#writeCardButton').on('click', function() {
+        var query = buildCommandQuery();
 
-          // Update the UI
-          var counter = 10;
+        if (query) {
+          startWriteRequest('/write?' + query);
+        }
+
+        return false;
+      });
 
-          g_countdown = setInterval(function() {
-            $('#loadingButtonText').html('Loading... (' + counter + ')');
+      $('#mapCardButton').on('click', function() {
+        var query = buildCommandQuery();
 
-            counter -= 1;
+        if (query) {
+          $.get('/lastcard', function(uid) {
+            if (uid == '') {
+              showAlert(3, 'Tap the card on the reader first, then try again.');
+              return;
+            }
 
-            if (counter < 0) {
-              cancelWriteRequest(false);
-              showAlert(0, '');
+            if ($('#cardLabel').val() != '') {
+              query += '&label=' + encodeURIComponent($('#cardLabel').val());
             }
-          }, 1000);
+
+            $.get('/map?uid=' + uid + '&' + query, function() {
+              showAlert(2, 'Card ' + uid + ' mapped. It will no longer be read when tapped.');
+              getCards(g_cards_offset);
+            })
+            .fail(function() {
+              showAlert(3, 'Something went wrong while mapping the card. Please try again.');
+            });
+          });
+        }
+
+        return false;
+      });
+
+      $('#addMacroButton').on('click', function() {
+        if ($('#type').val() == "MACRO") {
+          showAlert(3, 'Choose the action to add to the macro first');
+          return false;
+        }
+
+        var query = buildCommandQuery();
+
+        if (query) {
+          // Same command the card would hold, e.g. VOLUME 20
+          var params = new URLSearchParams(query);
+          var step = (params.get('type') + ' ' + (params.get('url') || params.get('location') || params.get('value') || '')).trim();
+          var steps = $('#macroSteps').val().trim();
+
+          $('#macroSteps').val((steps ? steps + '\n' : '') + step);
+          showAlert(2, 'Added ' + step + ' to the macro.');
         }
 
         return false;
@@ -213,20 +373,51 @@ const char HTML[] PROGMEM = R"rawliteral(
 
         $('#sectionLocation').hide();
         $('#sectionPlayBack').hide();
+        $('#sectionNumber').hide();
+        $('#sectionChoice').hide();
+        $('#sectionMacro').hide();
 
         switch ($( this ).val()) {
           case "PLAY" :
             $('#sectionPlayBack').show();
             break;
           case "LOCATION" :
+          case "GROUP" :
             $('#sectionLocation').show();
             break;
+          case "VOLUME" :
+            $('#commandNumberLabel').text('Volume (0-100)');
+            $('#commandNumber').attr('max', 100);
+            $('#sectionNumber').show();
+            break;
+          case "SLEEP" :
+            $('#commandNumberLabel').text('Minutes (0 cancels the timer)');
+            $('#commandNumber').attr('max', 1440);
+            $('#sectionNumber').show();
+            break;
+          case "SHUFFLE" :
+          case "REPEAT" :
+            var choices = ($( this ).val() == "SHUFFLE") ? ['OFF', 'ON'] : ['OFF', 'ALL', 'ONE'];
+            $('#commandChoice').empty();
+            $.each(choices, function(index, choice) {
+              $('#commandChoice').append($('<option></option>').val(choice).text(choice));
+            });
+            $('#sectionChoice').show();
+            break;
+          case "MACRO" :
+            $('#sectionMacro').show();
+            break;
         }
       });
 
 
 
+      $('#cardSearch').on('input', function() { getCards(0); });
+      $('#cardsPrevious').on('click', function() { getCards(Math.max(0, g_cards_offset - g_cards_limit)); });
+      $('#cardsNext').on('click', function() { getCards(g_cards_offset + g_cards_limit); });
+
       getLocations();
+      getCards(0);
       updateTitle();
     </script>
   </body>
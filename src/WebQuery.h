@@ -0,0 +1,111 @@
+#ifndef WebQuery_h
+#define WebQuery_h
+
+#include <Arduino.h>
+
+#define WEB_QUERY_MAX_PARAMS        8
+
+/*
+ * FNV-1a hash, usable at compile time so that route
+ * and parameter names are hashed once by the compiler
+ */
+constexpr uint32_t webHash(const char* t_str, const size_t t_len)
+{
+    uint32_t hash = 2166136261UL;
+
+    for (size_t i = 0; i < t_len; i++)
+    {
+        hash = (hash ^ (uint8_t)t_str[i]) * 16777619UL;
+    }
+
+    return hash;
+}
+
+constexpr size_t webStrlen(const char* t_str)
+{
+    size_t len = 0;
+    while (t_str[len]) len++;
+    return len;
+}
+
+constexpr uint32_t webHash(const char* t_str)
+{
+    return webHash(t_str, webStrlen(t_str));
+}
+
+struct WebQueryParam
+{
+    uint32_t name_hash;
+    const char* value;
+    size_t length;
+};
+
+/*
+ * Read-only view over the arguments of the request
+ * currently being handled. Values point in to the
+ * server's parsed request, so nothing is copied and
+ * a WebQuery must not outlive the request.
+ */
+class WebQuery
+{
+public:
+    WebQuery() {};
+
+    void add(const uint32_t t_name_hash, const char* t_value, const size_t t_length)
+    {
+        if (m_count < WEB_QUERY_MAX_PARAMS)
+        {
+            m_params[m_count++] = { t_name_hash, t_value, t_length };
+        }
+    }
+
+    bool has(const uint32_t t_name_hash) const
+    {
+        return find(t_name_hash) != nullptr;
+    }
+
+    // Returns a NUL terminated value, or "" if not present
+    const char* get(const uint32_t t_name_hash, size_t* t_length = nullptr) const
+    {
+        const WebQueryParam* param = find(t_name_hash);
+
+        if (t_length) *t_length = param ? param->length : 0;
+
+        return param ? param->value : "";
+    }
+
+    bool is(const uint32_t t_name_hash, const char* t_value) const
+    {
+        const WebQueryParam* param = find(t_name_hash);
+
+        return param && (strlen(t_value) == param->length) && (memcmp(param->value, t_value, param->length) == 0);
+    }
+
+    long getInt(const uint32_t t_name_hash, const long t_default) const
+    {
+        const WebQueryParam* param = find(t_name_hash);
+
+        if (!param || !param->length) return t_default;
+
+        char* end;
+        long value = strtol(param->value, &end, 10);
+
+        return (*end == '\0') ? value : t_default;
+    }
+
+private:
+    WebQueryParam m_params[WEB_QUERY_MAX_PARAMS];
+    uint8_t m_count = 0;
+
+    const WebQueryParam* find(const uint32_t t_name_hash) const
+    {
+        for (uint8_t i = 0; i < m_count; i++)
+        {
+            if (m_params[i].name_hash == t_name_hash) return &m_params[i];
+        }
+
+        return nullptr;
+    }
+};
+
+#endif
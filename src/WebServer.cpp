@@ -1,25 +1,32 @@
 #include <ESP8266WebServer.h>
 #include <ESP8266mDNS.h>
+#include <LittleFS.h>
 #include "WebServer.h"
 #include "WebContent.h"
+#include "Config.h"
+#include "Command.h"
+#include "Metrics.h"
+#include "Scheduler.h"
+#include "Heap.h"
+#include "Trace.h"
+#include "Log.h"
+#include "Capture.h"
 #include "Rfid.h"
 #include "Sonos.h"
 
-void WebServer::begin(const int t_port, const char* t_name, Rfid* t_rfid, Sonos* t_sonos)
+void WebServer::begin(const int t_port, const char* t_name, Rfid* t_rfid, Sonos* t_sonos, CardLibrary* t_cards, Volume* t_volume)
 {
     Serial.println(F("WebServer::begin Starting webserver"));
 
     m_rfid = t_rfid;
     m_sonos = t_sonos;
+    m_cards = t_cards;
+    m_volume = t_volume;
 
     memset(m_name, '\0', sizeof(m_name));
     strncpy(m_name, t_name, sizeof(m_name));
 
-    m_web_server.on(F("/"), HTTP_GET, std::bind(&WebServer::handleRoot, this));
-    m_web_server.on(F("/write"), HTTP_GET, std::bind(&WebServer::handleWriteRequest, this));
-    m_web_server.on(F("/writecancel"), HTTP_GET, std::bind(&WebServer::handleWriteCancelRequest, this));
-    m_web_server.on(F("/locations"), HTTP_GET, std::bind(&WebServer::handleLocations, this));
-    m_web_server.on(F("/name"), HTTP_GET, std::bind(&WebServer::handleName, this));
+    m_web_server.addHandler(&m_router);
 
     m_web_server.begin(t_port);
   
@@ -35,7 +42,174 @@ void WebServer::begin(const int t_port, const char* t_name, Rfid* t_rfid, Sonos*
     Serial.println(F("WebServer::begin Started webserver"));
 }
 
-void WebServer::handleRoot()
+/*
+ * Print adaptor that batches output in to chunks
+ * for a response started with chunkedResponseModeStart
+ */
+class ChunkedPrinter : public Print
+{
+public:
+    ChunkedPrinter(ESP8266WebServer& t_server) :
+        m_server(t_server)
+        {};
+    ~ChunkedPrinter() { flush(); }
+
+    size_t write(uint8_t t_char) override
+    {
+        if (m_length == sizeof(m_buffer)) flush();
+        m_buffer[m_length++] = t_char;
+        return 1;
+    }
+
+    void flush()
+    {
+        if (m_length) m_server.sendContent(m_buffer, m_length);
+        m_length = 0;
+    }
+
+private:
+    ESP8266WebServer& m_server;
+    char m_buffer[256];
+    size_t m_length = 0;
+};
+
+static constexpr uint32_t s_param_type = webHash("type");
+static constexpr uint32_t s_param_url = webHash("url");
+static constexpr uint32_t s_param_location = webHash("location");
+static constexpr uint32_t s_param_label = webHash("label");
+static constexpr uint32_t s_param_uid = webHash("uid");
+static constexpr uint32_t s_param_value = webHash("value");
+static constexpr uint32_t s_param_adjust = webHash("adjust");
+static constexpr uint32_t s_param_ramp = webHash("ramp");
+static constexpr uint32_t s_param_max = webHash("max");
+static constexpr uint32_t s_param_query = webHash("q");
+static constexpr uint32_t s_param_offset = webHash("offset");
+static constexpr uint32_t s_param_limit = webHash("limit");
+static constexpr uint32_t s_param_summary = webHash("summary");
+static constexpr uint32_t s_param_text = webHash("text");
+static constexpr uint32_t s_param_start = webHash("start");
+static constexpr uint32_t s_param_stop = webHash("stop");
+
+static const uint16_t s_cards_default_limit = 20;
+static const uint16_t s_cards_max_limit = 100;
+
+/*
+ * Writes a string as a quoted JSON string value
+ */
+static void printJsonString(Print& t_out, const char* t_value)
+{
+    t_out.print('"');
+
+    for (const char* c = t_value; *c; c++)
+    {
+        if ((*c == '"') || (*c == '\\'))
+        {
+            t_out.print('\\');
+            t_out.print(*c);
+        }
+        else if ((uint8_t)*c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)*c);
+            t_out.print(escaped);
+        }
+        else
+        {
+            t_out.print(*c);
+        }
+    }
+
+    t_out.print('"');
+}
+
+/*
+ * Parses a hex UID (as produced by CardLibrary::formatUid)
+ */
+static uint8_t parseUid(const char* t_hex, const size_t t_length, uint8_t* t_uid, const uint8_t t_uid_size)
+{
+    uint8_t size = 0;
+
+    if ((t_length % 2) || ((t_length / 2) > t_uid_size)) return 0;
+
+    for (size_t i = 0; i < t_length; i += 2)
+    {
+        char byte_hex[3] = { t_hex[i], t_hex[i + 1], '\0' };
+        char* end;
+
+        t_uid[size++] = strtoul(byte_hex, &end, 16);
+        if (*end != '\0') return 0;
+    }
+
+    return size;
+}
+
+#define WEB_ROUTE(uri, method, handler) { uri, sizeof(uri) - 1, webHash(uri), method, handler }
+
+const WebServer::Route WebServer::s_routes[] =
+{
+    WEB_ROUTE("/",             HTTP_GET,   &WebServer::handleRoot),
+    WEB_ROUTE("/write",        HTTP_GET,   &WebServer::handleWriteRequest),
+    WEB_ROUTE("/writecancel",  HTTP_GET,   &WebServer::handleWriteCancelRequest),
+    WEB_ROUTE("/locations",    HTTP_GET,   &WebServer::handleLocations),
+    WEB_ROUTE("/name",         HTTP_GET,   &WebServer::handleName),
+    WEB_ROUTE("/metrics",      HTTP_GET,   &WebServer::handleMetrics),
+    WEB_ROUTE("/trace",        HTTP_GET,   &WebServer::handleTrace),
+    WEB_ROUTE("/log",          HTTP_GET,   &WebServer::handleLog),
+    WEB_ROUTE("/capture",      HTTP_GET,   &WebServer::handleCapture),
+    WEB_ROUTE("/cards",        HTTP_GET,   &WebServer::handleCards),
+    WEB_ROUTE("/map",          HTTP_GET,   &WebServer::handleMapRequest),
+    WEB_ROUTE("/lastcard",     HTTP_GET,   &WebServer::handleLastCard),
+    WEB_ROUTE("/volume",       HTTP_GET,   &WebServer::handleVolume),
+    WEB_ROUTE("/volumecap",    HTTP_GET,   &WebServer::handleVolumeCap),
+};
+
+#undef WEB_ROUTE
+
+bool WebServer::Router::canHandle(HTTPMethod t_method, const String& t_uri)
+{
+    uint32_t uri_hash = webHash(t_uri.c_str(), t_uri.length());
+
+    m_matched = nullptr;
+
+    for (const Route& route : s_routes)
+    {
+        if ((route.uri_hash == uri_hash) && (route.method == t_method)
+            && (route.uri_length == t_uri.length()) && (memcmp(route.uri, t_uri.c_str(), route.uri_length) == 0))
+        {
+            m_matched = &route;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WebServer::Router::handle(ESP8266WebServer& t_server, HTTPMethod t_method, const String& t_uri)
+{
+    if (!m_matched && !canHandle(t_method, t_uri)) return false;
+
+    unsigned long start = micros();
+
+    // Parse the arguments once, as views over the
+    // strings the server has already parsed
+    WebQuery query;
+    for (int i = 0; i < t_server.args(); i++)
+    {
+        const String& name = t_server.argName(i);
+        const String& value = t_server.arg(i);
+
+        query.add(webHash(name.c_str(), name.length()), value.c_str(), value.length());
+    }
+
+    (m_owner->*(m_matched->handler))(query);
+    m_matched = nullptr;
+
+    METRICS.observe(METRIC_WEB_REQUEST, micros() - start);
+
+    return true;
+}
+
+void WebServer::handleRoot(const WebQuery& t_query)
 {
     DEBUG_WEBSERVER(Serial.println(F("WebServer::handleRoot")));
 
@@ -43,13 +217,16 @@ void WebServer::handleRoot()
     m_web_server.send_P(200, "text/html", HTML);
 }
 
-void WebServer::handleWriteRequest()
+void WebServer::handleWriteRequest(const WebQuery& t_query)
 {
     DEBUG_WEBSERVER(Serial.println(F("WebServer::handleWriteRequest")));
 
     m_web_server.sendHeader(F("Connection"), F("close"));
 
-    if (m_web_server.arg(F("type")) == "")
+    size_t type_len;
+    t_query.get(s_param_type, &type_len);
+
+    if (type_len == 0)
     {
         DEBUG_WEBSERVER(Serial.println(F("WebServer::handleWriteRequest No parameter defined: type")));
         m_web_server.send(500, "text/html");
@@ -57,31 +234,35 @@ void WebServer::handleWriteRequest()
     else
     {
         DEBUG_WEBSERVER(Serial.print(F("WebServer::handleWriteRequest Processing request: type["));
-                        Serial.print(m_web_server.arg(F("type")));
+                        Serial.print(t_query.get(s_param_type));
                         Serial.println(F("]")));
 
         char buffer[255];
         bool valid = false;
+        size_t arg_len;
 
-        if ((m_web_server.arg("type") == F("PLAY")) && m_web_server.hasArg("url"))
-        {
-            valid = true;
-            processWriteQuery("PLAY", m_web_server.arg(F("url")).c_str(), buffer, sizeof(buffer));
-        }
-        else if ((m_web_server.arg("type") == F("LOCATION")) && m_web_server.hasArg("location"))
-        {
-            valid = true;
-            processWriteQuery("LOCATION", m_web_server.arg(F("location")).c_str(), buffer, sizeof(buffer));
-        }
-        else if (m_web_server.arg("type") == F("STOP"))
+        m_cards->clearPendingLabel();
+
+        if (buildCommand(t_query, buffer, sizeof(buffer)))
         {
             valid = true;
-            processWriteQuery("STOP", "", buffer, sizeof(buffer));
         }
-        else if (m_web_server.arg("type") == F("LOCK"))
+        else if (t_query.is(s_param_type, "CARD") && t_query.has(s_param_uid))
         {
-            valid = true;
-            processWriteQuery("LOCK", "", buffer, sizeof(buffer));
+            // Copy of a card already in the library
+            uint8_t uid[CARD_LIBRARY_UID_SIZE];
+            const char* uid_hex = t_query.get(s_param_uid, &arg_len);
+            uint8_t uid_size = parseUid(uid_hex, arg_len, uid, sizeof(uid));
+            CardRecord record;
+
+            if (uid_size && m_cards->find(uid, uid_size, record))
+            {
+                valid = true;
+                memset(buffer, 0, sizeof(buffer));
+                strncpy(buffer, record.command, sizeof(buffer) - 1);
+
+                if (!t_query.has(s_param_label)) m_cards->setPendingLabel(record.label, strlen(record.label));
+            }
         }
 
         if (valid)
@@ -89,6 +270,12 @@ void WebServer::handleWriteRequest()
             DEBUG_WEBSERVER(Serial.print(F("WebServer::handleWriteRequest Sending to RFID ["));
                             Serial.print(buffer);
                             Serial.println(F("]")));
+
+            if (t_query.has(s_param_label))
+            {
+                const char* label = t_query.get(s_param_label, &arg_len);
+                m_cards->setPendingLabel(label, arg_len);
+            }
             
             m_rfid->writeRfid((uint8_t*)buffer, strlen(buffer));
 
@@ -105,16 +292,86 @@ void WebServer::handleWriteRequest()
     }
 }
 
-void WebServer::handleWriteCancelRequest()
+/*
+ * Maps a card UID to a command in the card library,
+ * e.g. /map?uid=04A1B2C3&type=PLAY&url=...&label=...
+ * Without a type the mapping is removed, and the card
+ * will be read as normal again.
+ */
+void WebServer::handleMapRequest(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleMapRequest")));
+
+    m_web_server.sendHeader(F("Connection"), F("close"));
+
+    uint8_t uid[CARD_LIBRARY_UID_SIZE];
+    size_t arg_len;
+    const char* uid_hex = t_query.get(s_param_uid, &arg_len);
+    uint8_t uid_size = parseUid(uid_hex, arg_len, uid, sizeof(uid));
+
+    if (!uid_size)
+    {
+        m_web_server.send(500, F("text/html"), "");
+        return;
+    }
+
+    char buffer[CARD_LIBRARY_COMMAND_SIZE];
+    char label[CARD_LIBRARY_LABEL_SIZE];
+    CardRecord record;
+    bool known = m_cards->find(uid, uid_size, record);
+    time_t now = time(nullptr);
+
+    memset(label, 0, sizeof(label));
+    strncpy(label, t_query.has(s_param_label) ? t_query.get(s_param_label) : (known ? record.label : ""), sizeof(label) - 1);
+
+    bool stored;
+
+    if (t_query.has(s_param_type))
+    {
+        if (!buildCommand(t_query, buffer, sizeof(buffer)))
+        {
+            m_web_server.send(500, F("text/html"), "");
+            return;
+        }
+
+        stored = m_cards->add(uid, uid_size, label, buffer, (now > CONFIG_CLOCK_VALID_AFTER) ? (uint32_t)now : 0, CARD_FLAG_MAPPED);
+    }
+    else
+    {
+        // Unmap, but keep the library entry
+        stored = !known || m_cards->add(uid, uid_size, label, record.command, record.written, record.flags & ~CARD_FLAG_MAPPED);
+    }
+
+    m_web_server.send(stored ? 200 : 500, F("text/html"), "");
+}
+
+/*
+ * UID of the last card presented, to make it
+ * easy to map read-only tags
+ */
+void WebServer::handleLastCard(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleLastCard")));
+
+    uint8_t uid[CARD_LIBRARY_UID_SIZE];
+    char uid_hex[(CARD_LIBRARY_UID_SIZE * 2) + 1];
+
+    CardLibrary::formatUid(uid, m_rfid->getLastUid(uid, sizeof(uid)), uid_hex, sizeof(uid_hex));
+
+    m_web_server.send(200, F("text/plain"), uid_hex);
+}
+
+void WebServer::handleWriteCancelRequest(const WebQuery& t_query)
 {
     DEBUG_WEBSERVER(Serial.println(F("WebServer::handleWriteCancelRequest")));
 
     m_rfid->cancelWriteRfid();
+    m_cards->clearPendingLabel();
 
     m_web_server.send(200, F("text/html"), "");
 }
 
-void WebServer::handleLocations()
+void WebServer::handleLocations(const WebQuery& t_query)
 {
     DEBUG_WEBSERVER(Serial.println(F("WebServer::handleLocations")));
 
@@ -127,9 +384,15 @@ void WebServer::handleLocations()
     // Create JSON
     m_web_server.sendContent(F("{\r\n"));
 
+    bool first = true;
+
     for (uint8_t i = 0 ; i < m_sonos->getClientCount() ; i++)
     {
-        if (i > 0) m_web_server.sendContent(F(",\r\n"));
+        // Skip any that have stopped responding
+        if (!m_sonos->getClient(i)->ip) continue;
+
+        if (!first) m_web_server.sendContent(F(",\r\n"));
+        first = false;
 
         m_web_server.sendContent(F("\""));
         m_web_server.sendContent(m_sonos->getClient(i)->serial_num);
@@ -142,30 +405,293 @@ void WebServer::handleLocations()
     m_web_server.chunkedResponseFinalize();
 }
 
-void WebServer::handleName()
+void WebServer::handleName(const WebQuery& t_query)
 {
     DEBUG_WEBSERVER(Serial.println(F("WebServer::handleName")));
 
     m_web_server.send(200, F("text/plain"), m_name);
 }
 
+void WebServer::handleMetrics(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleMetrics")));
+
+    m_web_server.sendHeader(F("Connection"), F("close"));
+    m_web_server.chunkedResponseModeStart(200, F("text/plain; version=0.0.4"));
+
+    {
+        ChunkedPrinter printer(m_web_server);
+        METRICS.printTo(printer);
+        HEAP.printTo(printer);
+        SCHEDULER.printTo(printer);
+    }
+
+    m_web_server.chunkedResponseFinalize();
+}
+
+/*
+ * Recent tap spans as Chrome trace JSON, or with
+ * /trace?summary per stage percentiles as text
+ */
+void WebServer::handleTrace(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleTrace")));
+
+    bool summary = t_query.has(s_param_summary);
+
+    m_web_server.sendHeader(F("Connection"), F("close"));
+    m_web_server.chunkedResponseModeStart(200, summary ? F("text/plain") : F("application/json"));
+
+    {
+        ChunkedPrinter printer(m_web_server);
+
+        if (summary)
+            TRACE.printSummaryTo(printer);
+        else
+            TRACE.printTo(printer);
+    }
+
+    m_web_server.chunkedResponseFinalize();
+}
+
+/*
+ * The log ring as raw records, for tools/logdecode.py,
+ * or with /log?text already written out as text
+ */
+void WebServer::handleLog(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleLog")));
+
+    bool text = t_query.has(s_param_text);
+
+    m_web_server.sendHeader(F("Connection"), F("close"));
+    m_web_server.chunkedResponseModeStart(200, text ? F("text/plain") : F("application/octet-stream"));
+
+    {
+        ChunkedPrinter printer(m_web_server);
+
+        if (text)
+            LOGGER.printTo(printer);
+        else
+            LOGGER.dumpTo(printer);
+    }
+
+    m_web_server.chunkedResponseFinalize();
+}
+
+/*
+ * /capture?start starts capturing Sonos traffic and
+ * /capture?stop stops it. /capture downloads the last
+ * capture, for tools/capture.py.
+ */
+void WebServer::handleCapture(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleCapture")));
+
+    if (t_query.has(s_param_start))
+    {
+        m_web_server.send(CAPTURE.start() ? 200 : 500, F("text/html"), "");
+        return;
+    }
+
+    if (t_query.has(s_param_stop))
+    {
+        CAPTURE.stop();
+        m_web_server.send(200, F("text/html"), "");
+        return;
+    }
+
+    // Can't read the file while it's still being written
+    File file;
+
+    if (CAPTURE.isActive() || !(file = LittleFS.open(CAPTURE_PATH, "r")))
+    {
+        m_web_server.send(404, F("text/html"), "");
+        return;
+    }
+
+    m_web_server.streamFile(file, F("application/octet-stream"));
+    file.close();
+}
+
+/*
+ * Pages through the card library as JSON, e.g.
+ * /cards?q=frozen&offset=20&limit=20
+ */
+struct CardsResponse
+{
+    Print* out;
+    bool first;
+};
+
+static bool printCard(const CardRecord& t_record, void* t_context)
+{
+    CardsResponse* response = (CardsResponse*)t_context;
+    Print& out = *response->out;
+    char uid[(CARD_LIBRARY_UID_SIZE * 2) + 1];
+
+    CardLibrary::formatUid(t_record.uid, t_record.uid_size, uid, sizeof(uid));
+
+    if (!response->first) out.print(',');
+    response->first = false;
+
+    out.print(F("{\"uid\":\""));out.print(uid);
+    out.print(F("\",\"label\":"));printJsonString(out, t_record.label);
+    out.print(F(",\"command\":"));printJsonString(out, t_record.command);
+    out.print(F(",\"written\":"));out.print(t_record.written);
+    out.print(F(",\"mapped\":"));out.print((t_record.flags & CARD_FLAG_MAPPED) ? F("true") : F("false"));
+    out.print('}');
+
+    return true;
+}
+
+void WebServer::handleCards(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleCards")));
+
+    long offset = t_query.getInt(s_param_offset, 0);
+    long limit = t_query.getInt(s_param_limit, s_cards_default_limit);
+
+    if (offset < 0 || offset > UINT16_MAX) offset = 0;
+    if (limit < 1 || limit > s_cards_max_limit) limit = s_cards_default_limit;
+
+    m_web_server.sendHeader(F("Connection"), F("close"));
+    m_web_server.chunkedResponseModeStart(200, F("text/json"));
+
+    {
+        ChunkedPrinter printer(m_web_server);
+        CardsResponse response = { &printer, true };
+
+        printer.print(F("{\"cards\":["));
+        uint16_t total = m_cards->search(t_query.get(s_param_query), offset, limit, printCard, &response);
+        printer.print(F("],\"offset\":"));printer.print(offset);
+        printer.print(F(",\"total\":"));printer.print(total);
+        printer.print('}');
+    }
+
+    m_web_server.chunkedResponseFinalize();
+}
+
+/*
+ * Sets (value=0-100) or changes (adjust=+/-n) the
+ * volume of the active speaker, optionally ramping
+ * over ramp=ms. Replies with the last known volume
+ * (-1 if unknown), as the change is sent in the
+ * background.
+ */
+void WebServer::handleVolume(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleVolume")));
+
+    long ramp = t_query.getInt(s_param_ramp, 0);
+    long value = t_query.getInt(s_param_value, -1);
+    long adjust = t_query.getInt(s_param_adjust, 0);
+
+    if (ramp < 0) ramp = 0;
+    if (ramp > UINT16_MAX) ramp = UINT16_MAX;
+
+    if ((value >= 0) && (value <= 100))
+    {
+        m_volume->set(value, ramp);
+    }
+    else if ((adjust >= -100) && (adjust <= 100) && adjust)
+    {
+        m_volume->adjust(adjust, ramp);
+    }
+    else if (t_query.has(s_param_value) || t_query.has(s_param_adjust))
+    {
+        m_web_server.send(500, F("text/html"), "");
+        return;
+    }
+
+    char volume[8];
+    snprintf(volume, sizeof(volume), "%d", (int)m_volume->getVolume());
+
+    m_web_server.send(200, F("text/plain"), volume);
+}
+
+/*
+ * Sets the volume cap (max=0-100) for a speaker
+ * (location=<serial>), or the default cap for
+ * speakers without their own if no location
+ */
+void WebServer::handleVolumeCap(const WebQuery& t_query)
+{
+    DEBUG_WEBSERVER(Serial.println(F("WebServer::handleVolumeCap")));
+
+    size_t location_len;
+    const char* location = t_query.get(s_param_location, &location_len);
+    long max = t_query.getInt(s_param_max, -1);
+
+    if ((max < 0) || (max > 100) || !m_volume->setCap(location, location_len, max))
+    {
+        m_web_server.send(500, F("text/html"), "");
+        return;
+    }
+
+    m_web_server.send(200, F("text/html"), "");
+}
+
 void WebServer::handle()
 {
     m_web_server.handleClient();
     MDNS.update();
 }
 
-void WebServer::processWriteQuery(const char* t_type, const char* t_arg, char* t_buffer, uint8_t t_buffer_length)
+/*
+ * Builds the card command described by the type
+ * (and type specific) query parameters. Returns
+ * false if they don't describe a valid command.
+ */
+bool WebServer::buildCommand(const WebQuery& t_query, char* t_buffer, const size_t t_buffer_length)
 {
-    uint8_t len = strlen(t_type);
-    uint8_t arg_len = strlen(t_arg);
+    size_t type_len;
+    size_t arg_len;
+    const char* type = t_query.get(s_param_type, &type_len);
+    const CommandSpec* command = findCommand(type, type_len);
+
+    if (!command) return false;
+
+    // PLAY and LOCATION have their own parameter names,
+    // anything else takes its argument (if any) as value
+    if (command->id == COMMAND_PLAY)
+    {
+        const char* url = t_query.get(s_param_url, &arg_len);
+        processWriteQuery(command->name, url, arg_len, t_buffer, t_buffer_length);
+    }
+    else if (command->id == COMMAND_LOCATION)
+    {
+        const char* location = t_query.get(s_param_location, &arg_len);
+        processWriteQuery(command->name, location, arg_len, t_buffer, t_buffer_length);
+    }
+    else
+    {
+        const char* value = t_query.get(s_param_value, &arg_len);
+        processWriteQuery(command->name, value, arg_len, t_buffer, t_buffer_length);
+    }
+
+    // Check it the same way the card will be read
+    CommandArgs args;
+
+    return parseCommand(t_buffer, t_buffer_length, args) == command;
+}
+
+void WebServer::processWriteQuery(const char* t_type, const char* t_arg, const size_t t_arg_len, char* t_buffer, const size_t t_buffer_length)
+{
+    size_t len = strlen(t_type);
 
     memset(t_buffer, 0, t_buffer_length);
-    memcpy(t_buffer, t_type, (len > (t_buffer_length - 1)) ? (t_buffer_length - 1) : len);
 
-    if (arg_len > (uint8_t)0)
+    if (len > (t_buffer_length - 1)) len = t_buffer_length - 1;
+    memcpy(t_buffer, t_type, len);
+
+    if ((t_arg_len > 0) && ((len + 1) < (t_buffer_length - 1)))
     {
-        memcpy(t_buffer + len, " ", ((len + 1) > (t_buffer_length - 1)) ? 0 : 1);
-        memcpy(t_buffer + len + 1, t_arg, (arg_len > (t_buffer_length - len - 1)) ? (t_buffer_length - len - 1) : arg_len);
+        size_t arg_len = t_arg_len;
+
+        if (arg_len > (t_buffer_length - len - 2)) arg_len = t_buffer_length - len - 2;
+
+        t_buffer[len] = ' ';
+        memcpy(t_buffer + len + 1, t_arg, arg_len);
     }
-}
\ No newline at end of file
+}
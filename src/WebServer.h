@@ -6,6 +6,9 @@
 
 #include "Rfid.h"
 #include "Sonos.h"
+#include "CardLibrary.h"
+#include "Volume.h"
+#include "WebQuery.h"
 
 #ifdef DEBUG
     #define DEBUG_WEBSERVER(x) x
@@ -16,22 +19,70 @@
 class WebServer
 {
 public:
-    WebServer() {};
-    void begin(const int, const char*, Rfid*, Sonos*);
+    WebServer() :
+        m_router(this)
+        {};
+    void begin(const int, const char*, Rfid*, Sonos*, CardLibrary*, Volume*);
     void handle();
-    void handleWriteRequest();
-    void handleWriteCancelRequest();
-    void handleLocations();
-    void handleName();
+    void handleWriteRequest(const WebQuery&);
+    void handleWriteCancelRequest(const WebQuery&);
+    void handleLocations(const WebQuery&);
+    void handleName(const WebQuery&);
+    void handleMetrics(const WebQuery&);
+    void handleCards(const WebQuery&);
+    void handleMapRequest(const WebQuery&);
+    void handleLastCard(const WebQuery&);
+    void handleTrace(const WebQuery&);
+    void handleLog(const WebQuery&);
+    void handleCapture(const WebQuery&);
+    void handleVolume(const WebQuery&);
+    void handleVolumeCap(const WebQuery&);
 
 private:
+    typedef void (WebServer::*RouteHandler)(const WebQuery&);
+
+    struct Route
+    {
+        const char* uri;
+        uint8_t uri_length;
+        uint32_t uri_hash;
+        HTTPMethod method;
+        RouteHandler handler;
+    };
+
+    /*
+     * Single request handler for all routes, matching the
+     * uri by its hash against the static route table rather
+     * than a String per registered route, then checking the
+     * uri itself so a collision can't pick the wrong one
+     */
+    class Router : public RequestHandler
+    {
+    public:
+        Router(WebServer* t_owner) :
+            m_owner(t_owner)
+            {};
+        bool canHandle(HTTPMethod, const String&) override;
+        bool handle(ESP8266WebServer&, HTTPMethod, const String&) override;
+
+    private:
+        WebServer* m_owner;
+        const Route* m_matched = nullptr;
+    };
+
+    static const Route s_routes[];
+
     ESP8266WebServer m_web_server;
+    Router m_router;
     Rfid* m_rfid;
     Sonos* m_sonos;
+    CardLibrary* m_cards;
+    Volume* m_volume;
     char m_name[100];
     
-    void handleRoot();
-    void processWriteQuery(const char*, const char*, char*, uint8_t);
+    void handleRoot(const WebQuery&);
+    bool buildCommand(const WebQuery&, char*, const size_t);
+    void processWriteQuery(const char*, const char*, const size_t, char*, const size_t);
 };
 
 #endif
@@ -1,35 +1,99 @@
 #include <Arduino.h>
 #include <WiFiManager.h>
 #include "Config.h"
+#include "Command.h"
+#include "Metrics.h"
+#include "Scheduler.h"
+#include "Trace.h"
+#include "Log.h"
 #include "Sonos.h"
+#include "Volume.h"
 #include "Rfid.h"
+#include "CardLibrary.h"
 #include "WebServer.h"
 
 #define MAIN_START_RFID
 #define MAIN_START_SONOS
 #define MAIN_START_WEB
 
+// Use the speaker from the last boot straight away, and
+// discover in the background. Comment out to wait for
+// discovery before taking cards, as before.
+#define MAIN_FAST_BOOT
+
 // Defining instances to be used later
 // in the setup and loop
 Sonos g_sonos;
+Volume g_volume;
 WiFiManager g_wifi_manager;
 Rfid g_rfid_instance;
+CardLibrary g_card_library;
 WebServer g_web_server;
 
+// Cards read by the RFID task, waiting for the card task
+// to act on them
+RfidEventQueue g_card_events;
+
 // Using this as a bit of a hack to start/stop
-// processing RFID requests
+// processing RFID requests (saved in the config)
 bool g_lock;
 
 // We only support spotify at the moment, so
-// we don't really store this value anywhere
-// except here
+// we only keep the one service ID in the config
 const char* g_service_name = "spotify";
 uint16_t g_service_id = 0;
 
-// Currently using this to manage ongoing discovery
-// of the sonos clients in the loop
-unsigned long target_time = 0L;
+// Checked against the speaker once, after the first discovery
+bool g_service_id_checked = false;
+
+// Set once a card's command has worked, for the boot metrics
+bool g_first_tap = false;
+
+// Periods (ms) and budgets (us) for the scheduled tasks. The
+// budgets are what each task should take per run, anything
+// over is counted as an overrun in the task stats
 const unsigned long DISCOVER_PERIOD = 2*60*1000UL; // 2 minutes
+const unsigned long CONFIG_PERIOD = 1000UL;
+const unsigned long CLIENTS_PERIOD = 1000UL;
+
+const uint32_t RFID_BUDGET = 100000UL;
+const uint32_t CARD_BUDGET = 500000UL;
+const uint32_t VOLUME_BUDGET = 300000UL;
+const uint32_t WEB_BUDGET = 50000UL;
+const uint32_t LOCATION_BUDGET = 1000UL;
+const uint32_t CONFIG_BUDGET = 50000UL;
+const uint32_t CLIENTS_BUDGET = (SONOS_PROBE_TIMEOUT + 100) * 1000UL;
+const uint32_t DISCOVER_BUDGET = 2000UL;      // Only sends the M-SEARCH
+const uint32_t DISCOVERY_BUDGET = 500000UL;   // One speaker's description per run
+const uint32_t LOG_BUDGET = 2000UL;
+
+// Signalled whenever the active client may have changed
+int8_t g_location_task = -1;
+
+// Signalled when there are cards to act on
+int8_t g_card_task = -1;
+
+// Signalled to start discovery ahead of its period
+int8_t g_discover_task = -1;
+
+/**
+ * Check the service ID against the active speaker
+ *
+ * Falls back to the last ID we saw (from the config)
+ * if the speaker doesn't answer.
+ */
+void checkServiceID()
+{
+    uint16_t service_id = g_sonos.getServiceID(g_service_name);
+
+    if (service_id != (uint16_t)-1)
+    {
+        CONFIG.set(&ConfigStruct::service_id, service_id);
+        g_service_id_checked = true;
+    }
+
+    g_service_id = CONFIG.stored_config.service_id;
+}
 
 /**
  * Check and save any change of location
@@ -42,79 +106,396 @@ void checkLocationChange()
 {
     const SonosClient* client = g_sonos.getActiveClient();
 
+    if (!client) return;
+
     if (strcmp(CONFIG.stored_config.last_sonos_serial, client->serial_num) != 0)
     {
-        memset(CONFIG.stored_config.last_sonos_serial, 0, sizeof(CONFIG.stored_config.last_sonos_serial));
-        memcpy(CONFIG.stored_config.last_sonos_serial, client->serial_num, sizeof(client->serial_num));
-        
-        Serial.print(F("main::checkLocationChange saving Location change: "));Serial.println(CONFIG.stored_config.last_sonos_serial);
+        LOG(MAIN_LOCATION_SAVED, client->serial_num);
+    }
+
+    // Saved once things go quiet, so calling this from
+    // the loop doesn't write to flash
+    CONFIG.setString(&ConfigStruct::last_sonos_serial, client->serial_num);
+
+    // Keep enough of the speaker to use it at boot before discovery
+    ConfigSpeaker speaker = {};
+    speaker.ip = (uint32_t)client->ip;
+    strncpy(speaker.serial_num, client->serial_num, sizeof(speaker.serial_num) - 1);
+    strncpy(speaker.location, client->location, sizeof(speaker.location) - 1);
+    CONFIG.set(&ConfigStruct::active_speaker, speaker);
+}
+
+/*
+ * Card command handlers, see COMMANDS in Command.h.
+ * Arguments have already been checked against the
+ * command's schema.
+ */
+bool commandPlay(const CommandArgs& t_args)
+{
+    return g_sonos.queueUri(g_service_id, t_args.text, t_args.length) && g_sonos.play();
+}
+
+bool commandLocation(const CommandArgs& t_args)
+{
+    bool found = g_sonos.setActiveClient(t_args.text, t_args.length);
+
+    // Check & save any change in the active client
+    SCHEDULER.signal(g_location_task);
+
+    return found;
+}
+
+bool commandStop(const CommandArgs& t_args)
+{
+    return g_sonos.stop();
+}
+
+bool commandPauseAll(const CommandArgs& t_args)
+{
+    return g_sonos.pauseAll();
+}
+
+bool commandLock(const CommandArgs& t_args)
+{
+    g_lock = !g_lock;
+    CONFIG.set(&ConfigStruct::locked, g_lock);
+    LOG(MAIN_LOCK, g_lock ? "LOCKED" : "UNLOCKED");
+
+    return true;
+}
+
+bool commandVolume(const CommandArgs& t_args)
+{
+    // VOLUME +5 / VOLUME -5 are relative, VOLUME 30 is absolute
+    if ((t_args.text[0] == '+') || (t_args.text[0] == '-'))
+        g_volume.adjust(t_args.value);
+    else
+        g_volume.set(t_args.value);
+
+    // Sent by the volume task
+    return true;
+}
+
+bool commandNext(const CommandArgs& t_args)
+{
+    return g_sonos.next();
+}
+
+bool commandPrevious(const CommandArgs& t_args)
+{
+    return g_sonos.previous();
+}
+
+bool commandShuffle(const CommandArgs& t_args)
+{
+    return g_sonos.setShuffle(t_args.value == 1);
+}
+
+bool commandRepeat(const CommandArgs& t_args)
+{
+    // Choices are in SonosRepeat order
+    return g_sonos.setRepeat((SonosRepeat)t_args.value);
+}
+
+bool commandGroup(const CommandArgs& t_args)
+{
+    // GROUP <serial> joins that speaker's group, GROUP on its own leaves
+    if (t_args.length)
+        return g_sonos.joinGroup(t_args.text, t_args.length);
+    else
+        return g_sonos.leaveGroup();
+}
+
+bool commandSleep(const CommandArgs& t_args)
+{
+    return g_sonos.setSleepTimer(t_args.value);
+}
+
+/**
+ * Runs the steps of a macro card as one batch
+ *
+ * e.g. MACRO LOCATION <serial>;VOLUME 20;PLAY <uri>;SHUFFLE ON
+ *
+ * Steps run in order over a kept-alive connection to
+ * the speaker, so only the first request pays for the
+ * connect. A volume step is sent straight away rather
+ * than left to the volume task, so it's in place
+ * before the steps after it. The first step to fail
+ * stops the rest, e.g. there's no point playing if
+ * the speaker couldn't be found.
+ */
+bool commandMacro(const CommandArgs& t_args)
+{
+    CommandStep steps[COMMAND_MACRO_MAX_STEPS];
+    uint8_t count = compileMacro(t_args.text, t_args.length, steps, COMMAND_MACRO_MAX_STEPS);
+    bool success = (count > 0);
+
+    unsigned long macro_start = micros();
+
+    g_sonos.beginBatch();
+
+    for (uint8_t i = 0; (i < count) && success; i++)
+    {
+        const CommandStep& step = steps[i];
+
+        LOG(MAIN_MACRO_STEP, i + 1, step.command->name, LogString{step.args.text, step.args.length});
 
-        // Write out the config to save it
-        CONFIG.writeConfig();
+        success = step.command->handler(step.args) && ((step.command->id != COMMAND_VOLUME) || g_volume.flush());
 
-        Serial.print(F("main::checkLocationChange Location change saved: "));Serial.println(CONFIG.stored_config.last_sonos_serial);
+        if (!success)
+        {
+            LOG(MAIN_MACRO_FAILED, i + 1);
+            METRICS.increment(METRIC_MACROS_ABORTED);
+        }
     }
+
+    g_sonos.endBatch();
+
+    METRICS.observe(METRIC_MACRO, micros() - macro_start);
+
+    return success;
 }
 
 /**
  * Process the callback from any RFID tag that's read
  *
- * Main callback passed to the RFID class, which in
- * turn processes the data provided that's read.
+ * Called by the card task for each card taken off
+ * the queue. Looks the command up in the command
+ * table, which also checks its argument, and runs
+ * its handler. The buffer isn't modified. Returns
+ * true if the command ran and worked.
  */
-void readRFIDCallback(const uint8_t* t_card_uid, const uint8_t* t_read_buffer, uint8_t t_buffer_size)
+bool readRFIDCallback(const uint8_t* t_card_uid, const uint8_t t_card_uid_size, const uint8_t* t_read_buffer, const uint8_t t_buffer_size)
 {
     // Just make sure that we have something to process
     if (!t_read_buffer)
     {
-        Serial.print(F("main::readRFIDCallback no valid buffer provided/found"));
-        return;
+        LOG(MAIN_READ_NO_BUFFER);
+        return false;
     }
 
-    Serial.print(F("main::readRFIDCallback called ["));Serial.print((char*)t_read_buffer);Serial.println(F("]"));
+    LOG(MAIN_READ_CARD, LogString{(const char*)t_read_buffer, strnlen((const char*)t_read_buffer, t_buffer_size)});
 
-    // Split the buffer up to the first space character
     // Commands should be one of:
     //   <COMMAND>
     //   <COMMAND> <ARGUMENT>
-    char* command = strtok((char*)t_read_buffer, " ");
-    
-    if ((!g_lock) && strcmp(command, "PLAY") == 0)
+    unsigned long parse_start = micros();
+
+    CommandArgs args;
+    const CommandSpec* command = parseCommand((const char*)t_read_buffer, t_buffer_size, args);
+
+    TRACE.record(TRACE_PARSE, parse_start);
+
+    if (!command) return false;
+
+    if (g_lock && !(command->flags & COMMAND_FLAG_IGNORES_LOCK))
     {
-        // PLAY: expect next argument is a uri
-        char* argument = strtok(NULL, " ");
-        if (argument != NULL)
-        {
-            Serial.print(F("main::readRFIDCallback PLAY command ["));Serial.print(argument);Serial.println(F("]"));
-            g_sonos.queueUri(g_service_id, argument);
-            g_sonos.play();
-        }
+        LOG(MAIN_READ_LOCKED, command->name);
+        return false;
     }
-    else if ((!g_lock) && strcmp(command, "LOCATION") == 0)
+
+    LOG(MAIN_READ_COMMAND, command->name, LogString{args.text, args.length});
+
+    if (!command->handler(args))
     {
-        // LOCATION: expect next number is a Sonos Serial# for a location
-        char* argument = strtok(NULL, " ");
-        if (argument != NULL)
-        {
-            Serial.print(F("main::readRFIDCallback LOCATION command ["));Serial.print(argument);Serial.println(F("]"));
-            g_sonos.setActiveClient(argument);
+        LOG(MAIN_READ_FAILED, command->name);
+        return false;
+    }
 
-            // Check & save any change in the active client
-            checkLocationChange();
-        }
+    return true;
+}
+
+/**
+ * Record any card written in the card library
+ *
+ * Callback passed to the RFID class for completed
+ * writes, so that the library keeps track of which
+ * card holds which command.
+ */
+void writeRFIDCallback(const uint8_t* t_card_uid, const uint8_t t_card_uid_size, const uint8_t* t_write_buffer, const uint16_t t_buffer_size, const bool t_success)
+{
+    if (!t_success)
+    {
+        LOG(MAIN_WRITE_FAILED);
+        g_card_library.clearPendingLabel();
+        return;
     }
-    else if ((!g_lock) && strcmp(command, "STOP") == 0)
+
+    char command[CARD_LIBRARY_COMMAND_SIZE];
+    uint16_t length = (t_buffer_size < (sizeof(command) - 1)) ? t_buffer_size : (sizeof(command) - 1);
+
+    memcpy(command, t_write_buffer, length);
+    command[length] = '\0';
+
+    // Only trust the clock once NTP has set it
+    time_t now = time(nullptr);
+
+    g_card_library.add(t_card_uid, t_card_uid_size, g_card_library.getPendingLabel(), command, (now > CONFIG_CLOCK_VALID_AFTER) ? (uint32_t)now : 0);
+    g_card_library.clearPendingLabel();
+}
+
+/**
+ * Resolve UID mapped cards from the card library
+ *
+ * Lets the RFID class skip reading the card memory
+ * for any card whose UID has been mapped to a command.
+ */
+bool resolveRFIDCallback(const uint8_t* t_card_uid, const uint8_t t_card_uid_size, uint8_t* t_read_buffer, const uint16_t t_buffer_size)
+{
+    return g_card_library.resolve(t_card_uid, t_card_uid_size, t_read_buffer, t_buffer_size);
+}
+
+/**
+ * Get the speaker ready as soon as a card is detected
+ *
+ * Called by the RFID class before it reads the card,
+ * so whatever the speaker needs (e.g. resolving its
+ * address) overlaps reading the card.
+ */
+void detectRFIDCallback(const uint8_t* t_card_uid, const uint8_t t_card_uid_size)
+{
+    unsigned long warmup_start = micros();
+
+    g_sonos.warmUp();
+
+    TRACE.record(TRACE_WARMUP, warmup_start);
+}
+
+/*
+ * Scheduled tasks, registered in setup()
+ */
+void rfidTask(void*)
+{
+    // Check if we need to handle any RFID events
+    g_rfid_instance.handle(g_card_events);
+
+    if (!g_card_events.empty()) SCHEDULER.signal(g_card_task);
+}
+
+/*
+ * Transport commands only matter for the latest tap,
+ * so one can be dropped if another is already queued
+ * behind it (e.g. a second PLAY card tapped while the
+ * first is still waiting). Anything else (LOCATION,
+ * LOCK) changes state, so always runs, in order.
+ */
+bool isTransportCommand(const RfidCardEvent* t_event)
+{
+    CommandArgs args;
+    const CommandSpec* command = parseCommand((const char*)t_event->data, sizeof(t_event->data), args);
+
+    return command && (command->flags & COMMAND_FLAG_TRANSPORT);
+}
+
+void cardTask(void*)
+{
+    RfidCardEvent* event;
+
+    while ((event = g_card_events.peek()))
     {
-        // STOP: no further arguments
-        Serial.println(F("main::readRFIDCallback STOP command"));
-        g_sonos.stop();
+        const RfidCardEvent* next = g_card_events.peek(1);
+
+        if (next && isTransportCommand(event) && isTransportCommand(next))
+        {
+            LOG(MAIN_CARD_SUPERSEDED, LogString{(const char*)event->data, strnlen((const char*)event->data, sizeof(event->data))});
+            METRICS.increment(METRIC_TAPS_SUPERSEDED);
+        }
+        else
+        {
+            unsigned long dispatch_start = micros();
+
+            TRACE.setTap(event->tap);
+            TRACE.record(TRACE_QUEUE, event->queue_time);
+
+            // Time spent waiting in the queue doesn't count against
+            // the budget, so a tap behind a slow one still gets to run
+            g_sonos.setDeadline(SONOS_TAP_BUDGET);
+
+            bool success = readRFIDCallback(event->uid, event->uid_size, event->data, sizeof(event->data));
+
+            g_sonos.setDeadline(0);
+
+            unsigned long dispatch_time = micros();
+
+            TRACE.record(TRACE_DISPATCH, dispatch_start);
+            TRACE.record(TRACE_TAP, event->detect_time);
+            TRACE.setTap(0);
+
+            METRICS.observe(METRIC_TAP_DISPATCH, dispatch_time - dispatch_start);
+            METRICS.observe(METRIC_TAP_TOTAL, dispatch_time - event->detect_time);
+
+            if (success && !g_first_tap)
+            {
+                g_first_tap = true;
+                METRICS.markBoot(METRIC_BOOT_FIRST_TAP);
+                LOG(MAIN_FIRST_TAP, millis());
+            }
+        }
+
+        g_card_events.release();
     }
-    else if (strcmp(command, "LOCK") == 0)
+}
+
+void webTask(void*)
+{
+    // Check for any Web requests
+    g_web_server.handle();
+}
+
+void locationTask(void*)
+{
+    checkLocationChange();
+}
+
+void discoverTask(void*)
+{
+    LOG(MAIN_DISCOVER);
+    g_sonos.startDiscovery();
+}
+
+void discoveryTask(void*)
+{
+    // Picks up responses, then one speaker's details per run
+    if (!g_sonos.handleDiscovery()) return;
+
+    // Back to the saved speaker, if discovery picked
+    // another while it wasn't known
+    const SonosClient* client = g_sonos.getActiveClient();
+
+    if (client && CONFIG.stored_config.last_sonos_serial[0] && (strcmp(client->serial_num, CONFIG.stored_config.last_sonos_serial) != 0))
     {
-        // LOCK: no further arguments
-        g_lock = !g_lock;
-        Serial.print(F("main::readRFIDCallback LOCK command ["));Serial.print(g_lock ? F("LOCKED") : F("UNLOCKED"));Serial.println(F("]"));
+        g_sonos.setActiveClient(CONFIG.stored_config.last_sonos_serial);
     }
+
+    // The saved ID was used until now
+    if (!g_service_id_checked) checkServiceID();
+
+    // Discovery picks an active client if there isn't one
+    SCHEDULER.signal(g_location_task);
+}
+
+void clientsTask(void*)
+{
+    // Re-probe any speaker that's stopped responding
+    g_sonos.checkClients();
+}
+
+void volumeTask(void*)
+{
+    // Send the latest volume change, or the next ramp step
+    g_volume.handle();
+}
+
+void configTask(void*)
+{
+    // Save any config changes once they've settled
+    CONFIG.handle();
+}
+
+void logTask(void*)
+{
+    // Only what the UART buffer can take, never waits
+    LOGGER.drainTo(Serial);
 }
 
 /**
@@ -131,14 +512,18 @@ void setupWifi()
   
   if (!g_wifi_manager.autoConnect(CONFIG_WIFI_AP_NAME, CONFIG_WIFI_AP_PWD))
   {
-    Serial.println(F("main::SetupWifi Failed to connect to WiFi and hit timeout"));
+    LOG(MAIN_WIFI_FAILED);
+
+    // The log task never runs before the reset, so write out what was logged
+    LOGGER.printTo(Serial);
+    Serial.flush();
     
     // Reset and try again, or maybe put it to deep sleep
     ESP.reset();
     delay(1000);
   }
   
-  Serial.print(F("main::SetupWifi connected, IP address: "));Serial.println(WiFi.localIP());
+  LOG(MAIN_WIFI_CONNECTED, WiFi.localIP());
 }
 
 /**
@@ -152,7 +537,7 @@ void setup()
     // Set up the serial port
     Serial.begin(CONFIG_SERIAL_SPEED);
     Serial.println();
-    Serial.println(F("main::Setup starting..."));
+    LOG(MAIN_STARTING);
 
     // Setup Wifi manager
     setupWifi();
@@ -161,68 +546,94 @@ void setup()
     CONFIG.begin();
     CONFIG.readConfig();
 
+    // Load the library of cards we've written
+    g_card_library.begin();
+
 #ifdef MAIN_START_RFID
     // Prep the MFRC522 Card reader interface
     g_rfid_instance.begin();
+    g_rfid_instance.setWriteCallback(writeRFIDCallback);
+    g_rfid_instance.setUidResolver(resolveRFIDCallback);
+    g_rfid_instance.setDetectCallback(detectRFIDCallback);
 #endif
 
 #ifdef MAIN_START_SONOS
-    // Discover Sonos players & set the active clients (based on config)
     g_sonos.begin();
-    g_sonos.discover();
+    g_volume.begin(&g_sonos);
+
+#ifdef MAIN_FAST_BOOT
+    // Use the speaker and service ID from the last boot, discovery
+    // runs in the background and checks the speaker is still there
+    const ConfigSpeaker& speaker = CONFIG.stored_config.active_speaker;
 
-    g_service_id = g_sonos.getServiceID(g_service_name);
+    g_sonos.restoreClient(IPAddress(speaker.ip), speaker.serial_num, speaker.location);
+    g_service_id = CONFIG.stored_config.service_id;
+#else
+    // Discover Sonos players & set the active clients (based on config)
+    g_sonos.discover();
+    checkServiceID();
+#endif
 
     // If there is a previously configured location
     // then set the location
     if (strcmp(CONFIG.stored_config.last_sonos_serial, "") != 0)
     {
-        Serial.print(F("main::Setup using last Sonos Serial ["));Serial.print(CONFIG.stored_config.last_sonos_serial);Serial.println(F("]"));
+        LOG(MAIN_LAST_SONOS, CONFIG.stored_config.last_sonos_serial);
         g_sonos.setActiveClient(CONFIG.stored_config.last_sonos_serial);
     }
 #endif
 
 #ifdef MAIN_START_WEB
     // Start the webserver
-    g_web_server.begin(CONFIG_WEB_PORT, CONFIG_WEB_NAME, &g_rfid_instance, &g_sonos);
+    g_web_server.begin(CONFIG_WEB_PORT, CONFIG_WEB_NAME, &g_rfid_instance, &g_sonos, &g_card_library, &g_volume);
 #endif
 
-    // Start unlocked, but should probably read this from
-    // a config so we don't use a power reset to unlock the device
-    g_lock = false;
+    // Carry on locked if we were locked before the reset
+    g_lock = CONFIG.stored_config.locked;
 
-    Serial.println(F("main::Setup ...completed"));
-}
-
-/**
- * Main loop function
- */
-void loop()
-{
+    // Card handling comes first on every pass, everything
+    // else fits around it
 #ifdef MAIN_START_RFID
-    // Check if we need to handle any RFID events
-    uint8_t buffer[255];
-    g_rfid_instance.handle(readRFIDCallback, buffer, sizeof(buffer));
+    SCHEDULER.addPeriodic("rfid", rfidTask, nullptr, 0, SCHEDULER_PRIORITY_HIGH, RFID_BUDGET);
+    g_card_task = SCHEDULER.addEvent("card", cardTask, nullptr, SCHEDULER_PRIORITY_HIGH, CARD_BUDGET);
 #endif
 
 #ifdef MAIN_START_WEB
-    // Check for any Web requests
-    g_web_server.handle();
+    SCHEDULER.addPeriodic("web", webTask, nullptr, 0, SCHEDULER_PRIORITY_NORMAL, WEB_BUDGET);
 #endif
 
 #ifdef MAIN_START_SONOS
-    // Check if there has been a change to the Active location
-    // that we need to store for next time. This should really
-    // never trigger as we also catch it in the RFID location
-    // change area of the callback, but is here just in case
-    checkLocationChange();
+    g_location_task = SCHEDULER.addEvent("location", locationTask, nullptr, SCHEDULER_PRIORITY_NORMAL, LOCATION_BUDGET);
+    SCHEDULER.addPeriodic("volume", volumeTask, nullptr, VOLUME_STEP_PERIOD, SCHEDULER_PRIORITY_NORMAL, VOLUME_BUDGET);
+    SCHEDULER.addPeriodic("clients", clientsTask, nullptr, CLIENTS_PERIOD, SCHEDULER_PRIORITY_LOW, CLIENTS_BUDGET);
+    g_discover_task = SCHEDULER.addPeriodic("discover", discoverTask, nullptr, DISCOVER_PERIOD, SCHEDULER_PRIORITY_LOW, DISCOVER_BUDGET);
+    SCHEDULER.addPeriodic("discovery", discoveryTask, nullptr, 0, SCHEDULER_PRIORITY_LOW, DISCOVERY_BUDGET);
 
-    // Run discovery of new Sonos clients every period
-    if ((millis() - target_time) >= DISCOVER_PERIOD)
-    {
-        Serial.println(F("main::Loop running discovery for clients"));
-        target_time += DISCOVER_PERIOD;
-        g_sonos.discover();
-    }
+#ifdef MAIN_FAST_BOOT
+    // First discovery now, rather than in DISCOVER_PERIOD
+    SCHEDULER.signal(g_discover_task);
 #endif
+
+    // Pick up the client discovery chose, if the saved one wasn't found
+    SCHEDULER.signal(g_location_task);
+#endif
+
+    SCHEDULER.addPeriodic("config", configTask, nullptr, CONFIG_PERIOD, SCHEDULER_PRIORITY_LOW, CONFIG_BUDGET);
+    SCHEDULER.addPeriodic("log", logTask, nullptr, 0, SCHEDULER_PRIORITY_LOW, LOG_BUDGET);
+
+    METRICS.markBoot(METRIC_BOOT_READY);
+    LOG(MAIN_READY, millis());
+}
+
+/**
+ * Main loop function
+ */
+void loop()
+{
+    unsigned long loop_start = micros();
+
+    SCHEDULER.run();
+
+    METRICS.sampleHeap();
+    METRICS.observe(METRIC_LOOP, micros() - loop_start);
 }
\ No newline at end of file
@@ -0,0 +1,825 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include <sys/resource.h>
+#include <MFRC522.h>
+#include <WiFiUDP.h>
+#include <lwip/tcp.h>
+#include "Command.h"
+#include "Heap.h"
+#include "Metrics.h"
+#include "Rfid.h"
+#include "Sonos.h"
+#include "Ssdp.h"
+#include "SoapClient.h"
+#include "StreamWindow.h"
+#include "Utility.h"
+#include "WebServer.h"
+
+/*
+ * Times the hot paths on the host: a card tap, a
+ * discovery response, building a SOAP request and
+ * reading responses. Host times only compare one
+ * build with another, but the allocation counts are
+ * the device's, and the steady state paths are held
+ * to none.
+ *
+ * The whole firmware is built in, so a tap is timed
+ * from the reader (the fake MFRC522) through the
+ * card task to the speaker (behind the fake network),
+ * after setup() as on the device.
+ */
+
+#define BENCHMARK_ITERATIONS    20000
+
+#define BENCHMARK_OPCODE(id, handler, arg, min, max, choices, flags) #id,
+
+static const char* s_opcodes[] = { COMMANDS(BENCHMARK_OPCODE) };
+
+#undef BENCHMARK_OPCODE
+
+struct BenchmarkResult
+{
+    double ns;              // Per iteration
+    double allocations;     // Per iteration
+};
+
+template<typename F>
+static BenchmarkResult benchmark(const char* t_name, const uint32_t t_iterations, F t_body)
+{
+    // Anything allocated once, up front, isn't the steady state
+    t_body();
+
+    uint32_t allocations = HEAP.getAllocations();
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < t_iterations; i++) t_body();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    BenchmarkResult result = { (double)elapsed / t_iterations, (double)(HEAP.getAllocations() - allocations) / t_iterations };
+
+    printf("%-28s %10.1f ns %8.2f allocations\n", t_name, result.ns, result.allocations);
+
+    return result;
+}
+
+static const char s_ssdp_response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "CACHE-CONTROL: max-age = 1800\r\n"
+    "EXT:\r\n"
+    "LOCATION: http://192.168.1.20:1400/xml/device_description.xml\r\n"
+    "SERVER: Linux UPnP/1.0 Sonos/70.3-35220 (ZPS9)\r\n"
+    "ST: urn:schemas-upnp-org:device:ZonePlayer:1\r\n"
+    "USN: uuid:RINCON_000E58A0B1C201400::urn:schemas-upnp-org:device:ZonePlayer:1\r\n"
+    "X-RINCON-HOUSEHOLD: Sonos_abcdefghijklmnopqrstuvwxyz\r\n"
+    "X-RINCON-BOOTSEQ: 93\r\n"
+    "BOOTID.UPNP.ORG: 93\r\n"
+    "X-RINCON-WIFIMODE: 0\r\n"
+    "X-RINCON-VARIANT: 1\r\n"
+    "HOUSEHOLD.SMARTSPEAKER.AUDIO: Sonos_abcdefghijklmnopqrstuvwxyz.Abc\r\n"
+    "\r\n";
+
+static const char s_volume_response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "CONTENT-LENGTH: 288\r\n"
+    "CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+    "EXT:\r\n"
+    "Server: Linux UPnP/1.0 Sonos/70.3-35220 (ZPS9)\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+    "<s:Body><u:GetVolumeResponse xmlns:u=\"urn:schemas-upnp-org:service:RenderingControl:1\">"
+    "<CurrentVolume>23</CurrentVolume></u:GetVolumeResponse></s:Body></s:Envelope>";
+
+static const char s_play_response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "CONTENT-LENGTH: 240\r\n"
+    "CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+    "EXT:\r\n"
+    "Server: Linux UPnP/1.0 Sonos/70.3-35220 (ZPS9)\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+    "<s:Body><u:PlayResponse xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\"></u:PlayResponse></s:Body></s:Envelope>";
+
+static const char s_play_card[] = "PLAY x-sonos-spotify:spotify%3aplaylist%3a37i9dQZF1DXcBWIGoYBM5M?sid=12&flags=8232&sn=1";
+static const uint8_t s_card_uid[] = { 0x04, 0xA2, 0x3B, 0x5C };
+
+#define BENCHMARK_SPEAKERS      3
+
+static const IPAddress s_speaker(192, 168, 1, 20);
+
+static const SonosAction s_set_volume = SONOS_ACTION("RenderingControl", "SetVolume");
+static const SonosAction s_get_volume = SONOS_ACTION("RenderingControl", "GetVolume");
+static const SonosAction s_pause = SONOS_ACTION("AVTransport", "Pause");
+
+static const StriSearch s_service_start("&lt;Service ");
+static const StriSearch s_service_end("&lt;/Service");
+
+// What each pretend speaker answers to a GET for its description
+static std::string s_descriptions[BENCHMARK_SPEAKERS];
+static std::string s_ssdp_responses[BENCHMARK_SPEAKERS];
+
+// In main.cpp
+extern Sonos g_sonos;
+extern Rfid g_rfid_instance;
+extern RfidEventQueue g_card_events;
+extern WebServer g_web_server;
+void setup();
+void rfidTask(void*);
+void cardTask(void*);
+
+static IPAddress speakerIp(const uint8_t t_index)
+{
+    return IPAddress(192, 168, 1, 20 + t_index);
+}
+
+/*
+ * Descriptions for the speakers, the rest (SOAP
+ * actions) get the canned response
+ */
+static const char* respond(const IPAddress& t_ip, const uint16_t t_port, const char* t_request, const size_t t_length)
+{
+    if (strncmp(t_request, "GET ", 4) != 0) return s_play_response;
+
+    for (uint8_t i = 0; i < BENCHMARK_SPEAKERS; i++)
+    {
+        if (t_ip == speakerIp(i)) return s_descriptions[i].c_str();
+    }
+
+    return nullptr;
+}
+
+void setUp()
+{
+    WiFiClient::fakeReset();
+    WiFiUDP::fakeReset();
+}
+
+void tearDown()
+{
+}
+
+void test_tap()
+{
+    static const char card[] = "PLAY x-sonos-spotify:spotify%3aplaylist%3a37i9dQZF1DXcBWIGoYBM5M?sid=12&flags=8232&sn=1";
+
+    BenchmarkResult result = benchmark("tap: parse PLAY", BENCHMARK_ITERATIONS * 10, []()
+    {
+        CommandArgs args;
+        TEST_ASSERT_NOT_NULL(parseCommand(card, sizeof(card), args));
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+/*
+ * Finding each opcode in the table, against the
+ * strtok and strcmp chain it replaced (on a copy of
+ * the card, as strtok writes to it)
+ */
+void test_dispatch()
+{
+    static char cards[COMMAND_COUNT][32];
+
+    for (uint8_t i = 0; i < COMMAND_COUNT; i++) snprintf(cards[i], sizeof(cards[i]), "%s 1", s_opcodes[i]);
+
+    BenchmarkResult table = benchmark("dispatch: table, all opcodes", BENCHMARK_ITERATIONS * 10, []()
+    {
+        for (uint8_t i = 0; i < COMMAND_COUNT; i++)
+        {
+            TEST_ASSERT_EQUAL(i, findCommand(cards[i], strlen(s_opcodes[i]))->id);
+        }
+    });
+
+    BenchmarkResult chain = benchmark("dispatch: strcmp, all opcodes", BENCHMARK_ITERATIONS * 10, []()
+    {
+        for (uint8_t i = 0; i < COMMAND_COUNT; i++)
+        {
+            char card[32];
+            uint8_t found = COMMAND_COUNT;
+
+            memcpy(card, cards[i], sizeof(card));
+            char* opcode = strtok(card, " ");
+
+            for (uint8_t j = 0; j < COMMAND_COUNT; j++)
+            {
+                if (strcmp(opcode, s_opcodes[j]) == 0)
+                {
+                    found = j;
+                    break;
+                }
+            }
+
+            TEST_ASSERT_EQUAL(i, found);
+        }
+    });
+
+    // Per opcode
+    printf("%-28s %10.1f ns %10.1f ns strcmp\n", "dispatch: lookup", table.ns / COMMAND_COUNT, chain.ns / COMMAND_COUNT);
+
+    TEST_ASSERT_EQUAL(0, table.allocations);
+}
+
+void test_dispatch_unknown()
+{
+    static const char card[] = "PLAYLIST spotify:playlist";
+
+    BenchmarkResult result = benchmark("dispatch: unknown opcode", BENCHMARK_ITERATIONS * 10, []()
+    {
+        CommandArgs args;
+        TEST_ASSERT_NULL(parseCommand(card, sizeof(card), args));
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+void test_tap_macro()
+{
+    static const char card[] = "MACRO LOCATION kitchen; VOLUME 20; SHUFFLE ON; PLAY x-sonos-spotify:spotify%3aplaylist%3a37i9dQZF1DXcBWIGoYBM5M";
+
+    BenchmarkResult result = benchmark("tap: compile MACRO", BENCHMARK_ITERATIONS, []()
+    {
+        CommandArgs args;
+        const CommandSpec* command = parseCommand(card, sizeof(card), args);
+        CommandStep steps[COMMAND_MACRO_MAX_STEPS];
+
+        TEST_ASSERT_NOT_NULL(command);
+        TEST_ASSERT_EQUAL(4, compileMacro(args.text, args.length, steps, COMMAND_MACRO_MAX_STEPS));
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+void test_discovery()
+{
+    BenchmarkResult result = benchmark("discovery: parse response", BENCHMARK_ITERATIONS, []()
+    {
+        SsdpResponse response;
+
+        TEST_ASSERT_TRUE(response.parse(s_ssdp_response, sizeof(s_ssdp_response) - 1));
+        TEST_ASSERT_EQUAL(93, response.bootId());
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+/*
+ * The whole header from one format, as before the
+ * prefix was built at compile time
+ */
+static int oldFormatHeader(char* t_buffer, const size_t t_size, const IPAddress& t_ip, const char* t_endpoint, const char* t_action, const size_t t_payload_length, const bool t_keep_alive)
+{
+    return snprintf(t_buffer, t_size,
+                    "POST %s HTTP/1.1\r\n"
+                    "Host: %u.%u.%u.%u:%u\r\n"
+                    "User-Agent: " SOAP_USER_AGENT "\r\n"
+                    "Content-type: text/xml\r\n"
+                    "SOAPACTION: %s\r\n"
+                    "Content-Length: %u\r\n"
+                    "Connection: %s\r\n"
+                    "\r\n",
+                    t_endpoint, t_ip[0], t_ip[1], t_ip[2], t_ip[3], SOAP_PORT,
+                    t_action, (unsigned int)t_payload_length, t_keep_alive ? "keep-alive" : "close");
+}
+
+void test_soap_header()
+{
+    BenchmarkResult result = benchmark("soap: format header", BENCHMARK_ITERATIONS, []()
+    {
+        char header[SOAP_HEADER_SIZE];
+        int length = SoapClient::formatHeader(header, sizeof(header), s_speaker, s_set_volume.soap, 370, true);
+
+        TEST_ASSERT_TRUE((length > 0) && ((size_t)length < sizeof(header)));
+    });
+
+    BenchmarkResult old_result = benchmark("soap: format header, old", BENCHMARK_ITERATIONS, []()
+    {
+        char header[SOAP_HEADER_SIZE];
+        int length = oldFormatHeader(header, sizeof(header), s_speaker, s_set_volume.soap.endpoint, s_set_volume.soap.action, 370, true);
+
+        TEST_ASSERT_TRUE((length > 0) && ((size_t)length < sizeof(header)));
+    });
+
+    printf("%-28s %10.1f ns %10.1f ns old\n", "soap: header", result.ns, old_result.ns);
+
+    char header[SOAP_HEADER_SIZE];
+
+    // Same length, with the same headers in it
+    TEST_ASSERT_EQUAL(oldFormatHeader(header, sizeof(header), s_speaker, s_set_volume.soap.endpoint, s_set_volume.soap.action, 370, true),
+                      SoapClient::formatHeader(header, sizeof(header), s_speaker, s_set_volume.soap, 370, true));
+    TEST_ASSERT_NOT_NULL(strstr(header, "POST /MediaRenderer/RenderingControl/Control HTTP/1.1\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "\r\nHost: 192.168.1.20:1400\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "\r\nSOAPACTION: \"urn:schemas-upnp-org:service:RenderingControl:1#SetVolume\"\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "\r\nContent-Length: 370\r\nConnection: keep-alive\r\n\r\n"));
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+    TEST_ASSERT_TRUE(result.ns <= old_result.ns);
+}
+
+void test_soap_response()
+{
+    static SoapClient client;
+    static StreamWindow window;
+
+    WiFiClient::fakeRespond(s_volume_response);
+
+    BenchmarkResult result = benchmark("soap: read GetVolume", BENCHMARK_ITERATIONS, []()
+    {
+        char volume[4];
+
+        TEST_ASSERT_EQUAL(HTTP_CODE_OK, client.post(s_speaker, s_get_volume.soap, "<s:Envelope/>", 1000, false));
+
+        window.attach(client);
+
+        TEST_ASSERT_TRUE(window.findAndConsume("<CurrentVolume>", 15));
+        TEST_ASSERT_TRUE(window.copyUntil("<", 1, volume, sizeof(volume)));
+        TEST_ASSERT_EQUAL_STRING("23", volume);
+
+        client.end();
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+class StringPrint : public Print
+{
+public:
+    size_t write(uint8_t t_char) override { m_text += (char)t_char; return 1; }
+    std::string m_text;
+};
+
+/*
+ * Observations so far in a histogram without labels
+ */
+static uint32_t histogramCount(const char* t_name)
+{
+    StringPrint out;
+    std::string name = std::string("\n") + t_name + "_count ";
+
+    METRICS.printTo(out);
+
+    size_t found = out.m_text.find(name);
+
+    return (found == std::string::npos) ? 0 : atol(out.m_text.c_str() + found + name.size());
+}
+
+/*
+ * A kept-alive connection is used again, and when the
+ * speaker has closed it by the time the next request
+ * reaches it, the request goes out again on a new one.
+ * Only the connections opened are timed as connects,
+ * but every answer is timed to its first byte.
+ */
+void test_soap_keep_alive()
+{
+    static SoapClient client;
+    std::string response = s_volume_response;
+    uint32_t connects = histogramCount("musicbox_soap_connect_seconds");
+    uint32_t first_bytes = histogramCount("musicbox_soap_first_byte_seconds");
+
+    response.replace(response.find("Connection: close"), 17, "Connection: keep-alive");
+    WiFiClient::fakeRespond(response.c_str());
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL(HTTP_CODE_OK, client.post(s_speaker, s_get_volume.soap, "<s:Envelope/>", 1000, true));
+        client.end();
+    }
+
+    TEST_ASSERT_EQUAL(1, WiFiClient::fakeConnects());
+    TEST_ASSERT_EQUAL(connects + 1, histogramCount("musicbox_soap_connect_seconds"));
+    TEST_ASSERT_EQUAL(first_bytes + 3, histogramCount("musicbox_soap_first_byte_seconds"));
+
+    WiFiClient::fakeCloseIdle();
+
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, client.post(s_speaker, s_get_volume.soap, "<s:Envelope/>", 1000, true));
+    client.end();
+
+    TEST_ASSERT_EQUAL(2, WiFiClient::fakeConnects());
+    TEST_ASSERT_EQUAL(connects + 2, histogramCount("musicbox_soap_connect_seconds"));
+    TEST_ASSERT_EQUAL(first_bytes + 4, histogramCount("musicbox_soap_first_byte_seconds"));
+
+    client.stop();
+}
+
+/*
+ * The body of a service list, the longest response
+ * we read, with the one we look for last
+ */
+static std::string servicesBody()
+{
+    std::string body;
+
+    for (uint8_t i = 0; i < 100; i++)
+    {
+        body += "&lt;Service Capabilities=&quot;2563&quot; Id=&quot;" + std::to_string(i)
+              + "&quot; Name=&quot;Service " + std::to_string(i)
+              + "&quot; Version=&quot;1.1&quot; Uri=&quot;https://example.com/ws/" + std::to_string(i)
+              + "&quot;&gt;&lt;Policy Auth=&quot;AppLink&quot;/&gt;&lt;/Service&gt;";
+    }
+
+    body += "&lt;Service Id=&quot;12&quot; Name=&quot;Spotify&quot;&gt;&lt;/Service&gt;";
+
+    return body;
+}
+
+/*
+ * stristr as it was, a byte at a time and backing
+ * up after each partial match
+ */
+static char* oldStristr(const char* str1, const char* str2)
+{
+    const char* p1 = str1;
+    const char* p2 = str2;
+    const char* r = *p2 == 0 ? str1 : 0;
+
+    while (*p1 != 0 && *p2 != 0)
+    {
+        if (tolower((unsigned char)*p1) == tolower((unsigned char)*p2))
+        {
+            if (r == 0) r = p1;
+
+            p2++;
+        }
+        else
+        {
+            p2 = str2;
+            if (r != 0) p1 = r + 1;
+
+            if (tolower((unsigned char)*p1) == tolower((unsigned char)*p2))
+            {
+                r = p1;
+                p2++;
+            }
+            else
+            {
+                r = 0;
+            }
+        }
+
+        p1++;
+    }
+
+    return *p2 == 0 ? (char*)r : 0;
+}
+
+/*
+ * Finding a service by name anywhere in a whole
+ * service list, against the stristr it replaced
+ */
+void test_stristr()
+{
+    static std::string body;
+
+    body = servicesBody();
+
+    BenchmarkResult search = benchmark("search: StriSearch, services", BENCHMARK_ITERATIONS / 10, []()
+    {
+        StriSearch service("name=&quot;SPOTIFY");
+
+        TEST_ASSERT_EQUAL_PTR(body.c_str() + body.rfind("Name=&quot;Spotify"), service.find(body.c_str(), body.size()));
+    });
+
+    BenchmarkResult old = benchmark("search: old stristr, services", BENCHMARK_ITERATIONS / 10, []()
+    {
+        TEST_ASSERT_EQUAL_PTR(body.c_str() + body.rfind("Name=&quot;Spotify"), oldStristr(body.c_str(), "name=&quot;SPOTIFY"));
+    });
+
+    printf("%-28s %10.1f ns %10.1f ns old stristr\n", "search: services", search.ns, old.ns);
+
+    TEST_ASSERT_EQUAL(0, search.allocations);
+}
+
+/*
+ * The service list scanned for one service by name,
+ * as getServiceID does
+ */
+void test_soap_services()
+{
+    static SoapClient client;
+    static StreamWindow window;
+    static std::string response;
+    std::string body = servicesBody();
+
+    response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+    WiFiClient::fakeRespond(response.c_str());
+
+    BenchmarkResult result = benchmark("soap: scan services", BENCHMARK_ITERATIONS / 100, []()
+    {
+        StriSearch service("spotify");
+        bool found = false;
+
+        TEST_ASSERT_EQUAL(HTTP_CODE_OK, client.post(s_speaker, "/MusicServices/Control",
+                                                    "urn:schemas-upnp-org:service:MusicServices:1#ListAvailableServices", "<s:Envelope/>", 1000, false));
+
+        window.attach(client);
+
+        while (!found && window.findAndConsume(s_service_start))
+        {
+            char buffer[255];
+
+            window.copyUntil(s_service_end, buffer, sizeof(buffer));
+            found = service.find(buffer, strlen(buffer));
+        }
+
+        TEST_ASSERT_TRUE(found);
+
+        client.end();
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+/*
+ * The reader's side of a tap: a card put down, read
+ * from its blocks and queued for the card task
+ */
+void test_tap_read()
+{
+    MFRC522::fakeFill(RFID_START_SECTOR, s_play_card, sizeof(s_play_card));
+
+    BenchmarkResult result = benchmark("tap: Rfid::handle", BENCHMARK_ITERATIONS, []()
+    {
+        MFRC522::fakePresent(s_card_uid, sizeof(s_card_uid), 0x08);
+
+        g_rfid_instance.handle(g_card_events);
+
+        RfidCardEvent* event = g_card_events.peek();
+
+        TEST_ASSERT_NOT_NULL(event);
+        TEST_ASSERT_EQUAL_STRING(s_play_card, (const char*)event->data);
+
+        g_card_events.release();
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+/*
+ * A whole tap, from the card being put down to the
+ * speaker answering the Play: the RFID task reads
+ * it, and the card task queues the track and plays
+ */
+void test_tap_play()
+{
+    WiFiClient::fakeRespond(s_play_response);
+    MFRC522::fakeFill(RFID_START_SECTOR, s_play_card, sizeof(s_play_card));
+
+    BenchmarkResult result = benchmark("tap: card to play", BENCHMARK_ITERATIONS / 10, []()
+    {
+        MFRC522::fakePresent(s_card_uid, sizeof(s_card_uid), 0x08);
+
+        rfidTask(nullptr);
+        cardTask(nullptr);
+
+        TEST_ASSERT_TRUE(g_card_events.empty());
+        TEST_ASSERT_TRUE(WiFiClient::fakeSent().find("AVTransport:1#Play") != std::string::npos);
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+void test_play()
+{
+    WiFiClient::fakeRespond(s_play_response);
+
+    BenchmarkResult result = benchmark("soap: Sonos::play", BENCHMARK_ITERATIONS / 10, []()
+    {
+        TEST_ASSERT_TRUE(g_sonos.play());
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+/*
+ * Discovery from the M-SEARCH going out to the last
+ * new speaker's details being filled in, on a Sonos
+ * that hasn't seen any of them before
+ */
+void test_discovery_speakers()
+{
+    WiFiClient::fakeServe(respond);
+
+    BenchmarkResult result = benchmark("discovery: 3 new speakers", BENCHMARK_ITERATIONS / 100, []()
+    {
+        static Sonos sonos;
+
+        sonos = Sonos();
+        sonos.begin();
+        sonos.startDiscovery(0);
+
+        TEST_ASSERT_TRUE(WiFiUDP::fakeSent().find("ZonePlayer") != std::string::npos);
+
+        for (uint8_t i = 0; i < BENCHMARK_SPEAKERS; i++)
+        {
+            WiFiUDP::fakeReceive(speakerIp(i), 1900, s_ssdp_responses[i].c_str(), s_ssdp_responses[i].size());
+        }
+
+        while (!sonos.handleDiscovery());
+
+        TEST_ASSERT_EQUAL(BENCHMARK_SPEAKERS, sonos.getClientCount());
+        TEST_ASSERT_EQUAL_STRING("Room 2", sonos.getClient(BENCHMARK_SPEAKERS - 1)->room_name);
+        TEST_ASSERT_NOT_NULL(sonos.getActiveClient());
+    });
+
+    TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+static uint8_t s_most_connecting = 0;
+
+/*
+ * Answers every action, noting how many connections
+ * were already in use by the time the first is
+ * answered, and leaves the last speaker silent
+ */
+static const char* respondPause(const IPAddress& t_ip, const uint16_t t_port, const char* t_request, const size_t t_length)
+{
+    if (fake_tcp_in_use() > s_most_connecting) s_most_connecting = fake_tcp_in_use();
+
+    return (t_ip == speakerIp(BENCHMARK_SPEAKERS - 1)) ? nullptr : s_play_response;
+}
+
+/*
+ * Every speaker is connected to before any of them
+ * is waited on, and the one that doesn't answer
+ * doesn't stop the others being heard from
+ */
+void test_fan_out()
+{
+    static Sonos sonos;
+    SonosClient* clients[BENCHMARK_SPEAKERS];
+    int16_t status[BENCHMARK_SPEAKERS];
+
+    WiFiClient::fakeServe(respond);
+
+    sonos.begin();
+    sonos.startDiscovery(0);
+
+    for (uint8_t i = 0; i < BENCHMARK_SPEAKERS; i++)
+    {
+        WiFiUDP::fakeReceive(speakerIp(i), 1900, s_ssdp_responses[i].c_str(), s_ssdp_responses[i].size());
+    }
+
+    while (!sonos.handleDiscovery());
+
+    TEST_ASSERT_EQUAL(BENCHMARK_SPEAKERS, sonos.getClientCount());
+
+    for (uint8_t i = 0; i < BENCHMARK_SPEAKERS; i++) clients[i] = (SonosClient*)sonos.getClient(i);
+
+    WiFiClient::fakeServe(respondPause);
+    s_most_connecting = 0;
+
+    uint32_t connects = histogramCount("musicbox_soap_connect_seconds");
+    uint32_t first_bytes = histogramCount("musicbox_soap_first_byte_seconds");
+
+    auto start = std::chrono::steady_clock::now();
+
+    TEST_ASSERT_EQUAL(BENCHMARK_SPEAKERS - 1, sonos.fanOut(clients, BENCHMARK_SPEAKERS, s_pause, "", status, 200));
+
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-28s %10.1f ms\n", "fan out: 1 of 3 silent", elapsed);
+
+    TEST_ASSERT_EQUAL(BENCHMARK_SPEAKERS, s_most_connecting);
+    TEST_ASSERT_EQUAL(0, fake_tcp_in_use());
+    TEST_ASSERT_EQUAL(connects + BENCHMARK_SPEAKERS, histogramCount("musicbox_soap_connect_seconds"));
+    TEST_ASSERT_EQUAL(first_bytes + BENCHMARK_SPEAKERS - 1, histogramCount("musicbox_soap_first_byte_seconds"));
+
+    for (uint8_t i = 0; i < BENCHMARK_SPEAKERS; i++)
+    {
+        TEST_ASSERT_EQUAL((clients[i]->ip == speakerIp(BENCHMARK_SPEAKERS - 1)) ? 0 : 200, status[i]);
+    }
+}
+
+/*
+ * Allocations for a request to write a card, through
+ * the Router, against a handler per route added with
+ * on() and reading its arguments by name, as the web
+ * server did before. Both include the server's own,
+ * for the query it parses in to Strings.
+ */
+void test_web_request()
+{
+    static ESP8266WebServer old_server;
+    static const char* s_uris[] = { "/", "/write", "/writecancel", "/locations", "/name", "/metrics", "/trace",
+                                    "/log", "/capture", "/cards", "/map", "/lastcard", "/volume", "/volumecap" };
+    static const char s_request[] = "/write?type=PLAY&url=spotify%3Aplaylist%3A37i9dQZF1DXcBWIGoYBM5M&label=Morning";
+
+    for (const char* uri : s_uris)
+    {
+        if (strcmp(uri, "/write") != 0)
+        {
+            old_server.on(uri, HTTP_GET, []() { old_server.send(200, F("text/html"), ""); });
+            continue;
+        }
+
+        old_server.on(uri, HTTP_GET, []()
+        {
+            char buffer[255];
+
+            old_server.sendHeader(F("Connection"), F("close"));
+
+            if ((old_server.arg(F("type")) == "PLAY") && old_server.hasArg("url"))
+            {
+                snprintf(buffer, sizeof(buffer), "PLAY %s", old_server.arg(F("url")).c_str());
+                g_rfid_instance.writeRfid((uint8_t*)buffer, strlen(buffer));
+                old_server.send(200, F("text/html"), "");
+            }
+            else
+            {
+                old_server.send(500, F("text/html"), "");
+            }
+        });
+    }
+
+    BenchmarkResult router = benchmark("web: write request", BENCHMARK_ITERATIONS, []()
+    {
+        ESP8266WebServer::fakeRequest(HTTP_GET, s_request);
+        g_web_server.handle();
+
+        TEST_ASSERT_EQUAL(200, ESP8266WebServer::fakeStatus());
+
+        g_rfid_instance.cancelWriteRfid();
+    });
+
+    BenchmarkResult old = benchmark("web: write request, on()", BENCHMARK_ITERATIONS, []()
+    {
+        ESP8266WebServer::fakeRequest(HTTP_GET, s_request);
+        old_server.handleClient();
+
+        TEST_ASSERT_EQUAL(200, ESP8266WebServer::fakeStatus());
+
+        g_rfid_instance.cancelWriteRfid();
+    });
+
+    printf("%-28s %10.2f %10.2f allocations with on()\n", "web: allocations/request", router.allocations, old.allocations);
+
+    TEST_ASSERT_TRUE(router.allocations <= old.allocations);
+}
+
+void test_peak_memory()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    // kB on Linux
+    printf("%-28s %10ld kB\n", "peak resident", usage.ru_maxrss);
+}
+
+int main()
+{
+    for (uint8_t i = 0; i < BENCHMARK_SPEAKERS; i++)
+    {
+        std::string ip = std::to_string(speakerIp(i)[0]) + "." + std::to_string(speakerIp(i)[1]) + "."
+                       + std::to_string(speakerIp(i)[2]) + "." + std::to_string(speakerIp(i)[3]);
+        std::string uuid = "RINCON_000E58A0B1C" + std::to_string(i) + "01400";
+        std::string body = "<?xml version=\"1.0\" encoding=\"utf-8\" ?><root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+                           "<specVersion><major>1</major><minor>0</minor></specVersion><device>"
+                           "<deviceType>urn:schemas-upnp-org:device:ZonePlayer:1</deviceType>"
+                           "<friendlyName>" + ip + " - Sonos One</friendlyName><manufacturer>Sonos, Inc.</manufacturer>"
+                           "<modelNumber>S18</modelNumber><modelDescription>Sonos One</modelDescription>"
+                           "<serialNum>00-0E-58-A0-B1-C" + std::to_string(i) + ":7</serialNum>"
+                           "<UDN>uuid:" + uuid + "</UDN><roomName>Room " + std::to_string(i) + "</roomName>"
+                           "<displayName>One</displayName></device></root>";
+
+        s_descriptions[i] = "HTTP/1.1 200 OK\r\nCONTENT-TYPE: text/xml; charset=\"utf-8\"\r\nContent-Length: "
+                          + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+        s_ssdp_responses[i] = "HTTP/1.1 200 OK\r\nCACHE-CONTROL: max-age = 1800\r\nEXT:\r\n"
+                              "LOCATION: http://" + ip + ":1400/xml/device_description.xml\r\n"
+                              "SERVER: Linux UPnP/1.0 Sonos/70.3-35220 (ZPS9)\r\n"
+                              "ST: urn:schemas-upnp-org:device:ZonePlayer:1\r\n"
+                              "USN: uuid:" + uuid + "::urn:schemas-upnp-org:device:ZonePlayer:1\r\n"
+                              "X-RINCON-BOOTSEQ: 93\r\n\r\n";
+    }
+
+    // The firmware as it boots, using the first speaker
+    setup();
+
+    TEST_ASSERT_TRUE(g_sonos.restoreClient(s_speaker, "00-0E-58-A0-B1-C0:7", "http://192.168.1.20:1400/xml/device_description.xml"));
+    TEST_ASSERT_TRUE(g_sonos.setActiveClient("00-0E-58-A0-B1-C0:7"));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_dispatch);
+    RUN_TEST(test_dispatch_unknown);
+    RUN_TEST(test_tap);
+    RUN_TEST(test_tap_macro);
+    RUN_TEST(test_discovery);
+    RUN_TEST(test_soap_header);
+    RUN_TEST(test_soap_response);
+    RUN_TEST(test_soap_keep_alive);
+    RUN_TEST(test_stristr);
+    RUN_TEST(test_soap_services);
+    RUN_TEST(test_tap_read);
+    RUN_TEST(test_tap_play);
+    RUN_TEST(test_play);
+    RUN_TEST(test_discovery_speakers);
+    RUN_TEST(test_fan_out);
+    RUN_TEST(test_web_request);
+    RUN_TEST(test_peak_memory);
+    return UNITY_END();
+}
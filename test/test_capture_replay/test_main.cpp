@@ -0,0 +1,450 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LittleFS.h>
+#include <WiFiUDP.h>
+#include <string>
+#include <vector>
+#include "Capture.h"
+#include "SoapClient.h"
+#include "Sonos.h"
+#include "Ssdp.h"
+#include "StreamWindow.h"
+
+/*
+ * Replays a capture file through the transport
+ *
+ * The firmware first captures a session with a
+ * pretend speaker: discovery, then GetVolume and the
+ * service list. The file it writes is read back as
+ * tools/capture.py reads one, and the speaker's side
+ * of each exchange is played back to SoapClient, Ssdp
+ * and StreamWindow, then to a fresh Sonos, which should
+ * end up where the captured session did.
+ */
+
+#define TEST_TIMEOUT        1000    // ms
+
+struct CaptureRecord
+{
+    CaptureRecordType type;
+    uint32_t micros;
+    IPAddress ip;
+    std::string data;
+};
+
+/*
+ * One request and what came back, paired up as
+ * tools/capture.py does
+ */
+struct CaptureExchange
+{
+    IPAddress ip;
+    std::string method;
+    std::string path;
+    std::string action;
+    std::string payload;
+    int16_t status = 0;
+    std::string body;
+    bool ended = false;
+    bool replayed = false;
+};
+
+static const IPAddress s_speaker(192, 168, 1, 20);
+static const char s_serial_num[] = "00-0E-58-A0-B1-C0:7";
+static const char s_location[] = "http://192.168.1.20:1400/xml/device_description.xml";
+
+static std::string s_live_services;
+static std::string s_file;
+static std::vector<CaptureRecord> s_records;
+static std::vector<CaptureExchange> s_exchanges;
+
+static SoapClient s_client;
+static StreamWindow s_window;
+
+/*
+ * The live speaker, for the session that's captured
+ */
+static const char* respondLive(const IPAddress& t_ip, const uint16_t t_port, const char* t_request, const size_t t_length)
+{
+    static std::string response;
+    std::string request(t_request, t_length);
+    std::string body;
+
+    if (t_ip != s_speaker) return nullptr;
+
+    if (request.compare(0, 4, "GET ") == 0)
+    {
+        body = std::string("<?xml version=\"1.0\" encoding=\"utf-8\" ?><root><device>"
+                           "<deviceType>urn:schemas-upnp-org:device:ZonePlayer:1</deviceType>"
+                           "<serialNum>") + s_serial_num + "</serialNum><UDN>uuid:RINCON_000E58A0B1C001400</UDN>"
+                           "<roomName>Kitchen</roomName><displayName>One</displayName></device></root>";
+    }
+    else if (request.find("#GetVolume") != std::string::npos)
+    {
+        body = "<s:Envelope><s:Body><u:GetVolumeResponse><CurrentVolume>23</CurrentVolume></u:GetVolumeResponse></s:Body></s:Envelope>";
+    }
+    else if (request.find("#ListAvailableServices") != std::string::npos)
+    {
+        body = s_live_services;
+    }
+    else
+    {
+        return "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+
+    response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+    return response.c_str();
+}
+
+static std::string ssdpResponse()
+{
+    return std::string("HTTP/1.1 200 OK\r\nCACHE-CONTROL: max-age = 1800\r\nEXT:\r\n"
+                       "LOCATION: ") + s_location + "\r\n"
+                       "SERVER: Linux UPnP/1.0 Sonos/70.3-35220 (ZPS9)\r\n"
+                       "ST: urn:schemas-upnp-org:device:ZonePlayer:1\r\n"
+                       "USN: uuid:RINCON_000E58A0B1C001400::urn:schemas-upnp-org:device:ZonePlayer:1\r\n"
+                       "X-RINCON-HOUSEHOLD: Sonos_abcdefghijklmnopqrstuvwxyz\r\n\r\n";
+}
+
+/*
+ * Discovery, then a volume and a service looked up,
+ * with the capture running
+ */
+static void captureSession()
+{
+    static Sonos sonos;
+    std::string ssdp = ssdpResponse();
+    uint8_t volume = 0;
+
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        s_live_services += "&lt;Service Capabilities=&quot;2563&quot; Id=&quot;" + std::to_string(i)
+                         + "&quot; Name=&quot;Service " + std::to_string(i) + "&quot;&gt;&lt;/Service&gt;";
+    }
+
+    s_live_services += "&lt;Service Id=&quot;12&quot; Name=&quot;Spotify&quot;&gt;&lt;/Service&gt;";
+
+    WiFiClient::fakeReset();
+    WiFiClient::fakeServe(respondLive);
+    WiFiUDP::fakeReset();
+
+    TEST_ASSERT_TRUE(CAPTURE.start());
+
+    sonos.begin();
+    sonos.startDiscovery(0);
+    WiFiUDP::fakeReceive(s_speaker, 1900, ssdp.c_str(), ssdp.size());
+
+    while (!sonos.handleDiscovery());
+
+    TEST_ASSERT_TRUE(sonos.getVolume(volume));
+    TEST_ASSERT_EQUAL(23, volume);
+    TEST_ASSERT_EQUAL(12, sonos.getServiceID("Spotify"));
+
+    CAPTURE.stop();
+}
+
+static uint32_t readU32(const std::string& t_data, const size_t t_position)
+{
+    uint32_t value;
+
+    memcpy(&value, t_data.data() + t_position, sizeof(value));
+
+    return value;
+}
+
+/*
+ * The file header, then records of type, length,
+ * micros() and address, each followed by its data
+ */
+static bool loadCapture(const std::string& t_data)
+{
+    const size_t header_size = 11;
+    size_t position = 8;
+
+    s_records.clear();
+
+    if ((t_data.size() < position) || (readU32(t_data, 0) != CaptureClass::s_file_magic)) return false;
+
+    while ((position + header_size) <= t_data.size())
+    {
+        CaptureRecord record;
+        uint16_t length;
+
+        record.type = (CaptureRecordType)t_data[position];
+        memcpy(&length, t_data.data() + position + 1, sizeof(length));
+        record.micros = readU32(t_data, position + 3);
+        record.ip = IPAddress(readU32(t_data, position + 7));
+        position += header_size;
+
+        if ((position + length) > t_data.size()) return false;
+
+        record.data = t_data.substr(position, length);
+        position += length;
+
+        s_records.push_back(record);
+    }
+
+    return position == t_data.size();
+}
+
+static void pairExchanges()
+{
+    s_exchanges.clear();
+
+    for (const CaptureRecord& record : s_records)
+    {
+        if (record.type == CAPTURE_HTTP_REQUEST)
+        {
+            CaptureExchange exchange;
+            size_t line_end = record.data.find("\r\n");
+            size_t head_end = record.data.find("\r\n\r\n");
+            size_t action = record.data.find("SOAPACTION: ");
+            size_t space = record.data.find(' ');
+
+            exchange.ip = record.ip;
+            exchange.method = record.data.substr(0, space);
+            exchange.path = record.data.substr(space + 1, line_end - space - 1);
+            exchange.payload = record.data.substr(head_end + 4);
+
+            if ((action != std::string::npos) && (action < head_end)) exchange.action = record.data.substr(action + 12, head_end - action - 12);
+
+            s_exchanges.push_back(exchange);
+            continue;
+        }
+
+        CaptureExchange* exchange = nullptr;
+
+        for (CaptureExchange& open : s_exchanges)
+        {
+            if ((open.ip == record.ip) && !open.ended) exchange = &open;
+        }
+
+        if (!exchange) continue;
+
+        if (record.type == CAPTURE_HTTP_STATUS)
+        {
+            memcpy(&exchange->status, record.data.data(), sizeof(exchange->status));
+        }
+        else if (record.type == CAPTURE_HTTP_BODY)
+        {
+            exchange->body += record.data;
+        }
+        else if (record.type == CAPTURE_HTTP_END)
+        {
+            exchange->ended = true;
+        }
+    }
+}
+
+/*
+ * The speaker's side of the capture: each request is
+ * answered with the next captured response to the
+ * same address, method, path and action
+ */
+static const char* respondReplay(const IPAddress& t_ip, const uint16_t t_port, const char* t_request, const size_t t_length)
+{
+    static std::string response;
+    std::string request(t_request, t_length);
+
+    for (CaptureExchange& exchange : s_exchanges)
+    {
+        if (exchange.replayed || (exchange.ip != t_ip) || (exchange.status <= 0)) continue;
+        if (request.compare(0, exchange.method.size() + 1, exchange.method + " ") != 0) continue;
+
+        // A GET was captured with the whole URL
+        size_t path = exchange.path.find('/', exchange.path.find("://") + 3);
+        std::string wanted = (exchange.method == "GET") ? exchange.path.substr(path) : exchange.path;
+
+        if (request.compare(exchange.method.size() + 1, wanted.size() + 1, wanted + " ") != 0) continue;
+        if (!exchange.action.empty() && (request.find("SOAPACTION: " + exchange.action + "\r\n") == std::string::npos)) continue;
+
+        exchange.replayed = true;
+        response = "HTTP/1.1 " + std::to_string(exchange.status) + " OK\r\nContent-Length: " + std::to_string(exchange.body.size())
+                 + "\r\nConnection: close\r\n\r\n" + exchange.body;
+
+        return response.c_str();
+    }
+
+    return nullptr;
+}
+
+/*
+ * The rest of the body, through the window
+ */
+static std::string readBody()
+{
+    std::string body;
+    int c;
+
+    while ((c = s_window.peek()) >= 0)
+    {
+        body += (char)c;
+        s_window.consume(1);
+    }
+
+    return body;
+}
+
+void setUp()
+{
+    WiFiClient::fakeReset();
+    WiFiClient::fakeServe(respondReplay);
+    WiFiUDP::fakeReset();
+
+    for (CaptureExchange& exchange : s_exchanges) exchange.replayed = false;
+}
+
+void tearDown()
+{
+    s_client.stop();
+}
+
+void test_load_capture()
+{
+    TEST_ASSERT_TRUE(loadCapture(s_file));
+    pairExchanges();
+
+    TEST_ASSERT_EQUAL(CAPTURE_SSDP_SENT, s_records.front().type);
+    TEST_ASSERT_TRUE(s_records.front().data.find("ST: urn:schemas-upnp-org:device:ZonePlayer:1") != std::string::npos);
+
+    // The description, GetVolume and the service list
+    TEST_ASSERT_EQUAL(3, s_exchanges.size());
+    TEST_ASSERT_EQUAL_STRING("GET", s_exchanges[0].method.c_str());
+    TEST_ASSERT_EQUAL_STRING(s_location, s_exchanges[0].path.c_str());
+    TEST_ASSERT_TRUE(s_exchanges[1].action.find("#GetVolume") != std::string::npos);
+    TEST_ASSERT_TRUE(s_exchanges[2].action.find("#ListAvailableServices") != std::string::npos);
+
+    for (const CaptureExchange& exchange : s_exchanges)
+    {
+        TEST_ASSERT_TRUE(exchange.ip == s_speaker);
+        TEST_ASSERT_EQUAL(HTTP_CODE_OK, exchange.status);
+        TEST_ASSERT_TRUE(exchange.ended);
+    }
+
+    TEST_ASSERT_TRUE(s_exchanges[2].body == s_live_services);
+}
+
+/*
+ * A capture cut short, or of something else, is
+ * turned down rather than half read
+ */
+void test_load_bad_capture()
+{
+    TEST_ASSERT_FALSE(loadCapture(s_file.substr(0, s_file.size() - 1)));
+    TEST_ASSERT_FALSE(loadCapture("CAP0" + s_file.substr(4)));
+
+    TEST_ASSERT_TRUE(loadCapture(s_file));
+}
+
+void test_replay_ssdp()
+{
+    uint8_t received = 0;
+
+    for (const CaptureRecord& record : s_records)
+    {
+        if (record.type != CAPTURE_SSDP_RECEIVED) continue;
+
+        SsdpResponse response;
+
+        TEST_ASSERT_TRUE(response.parse(record.data.c_str(), record.data.size()));
+
+        const SsdpField& location = response.get(SSDP_LOCATION);
+        SsdpField uuid = response.uuid();
+
+        TEST_ASSERT_EQUAL_STRING(s_location, std::string(location.text, location.length).c_str());
+        TEST_ASSERT_EQUAL_STRING("RINCON_000E58A0B1C001400", std::string(uuid.text, uuid.length).c_str());
+        TEST_ASSERT_TRUE(record.ip == s_speaker);
+
+        received++;
+    }
+
+    TEST_ASSERT_EQUAL(1, received);
+}
+
+/*
+ * Each captured request sent again gets the same
+ * status and body back
+ */
+void test_replay_soap()
+{
+    for (const CaptureExchange& exchange : s_exchanges)
+    {
+        int16_t status = (exchange.method == "GET")
+                       ? s_client.get(exchange.ip, exchange.path.c_str(), TEST_TIMEOUT)
+                       : s_client.post(exchange.ip, exchange.path.c_str(), exchange.action.c_str(), exchange.payload.c_str(), TEST_TIMEOUT, false);
+
+        TEST_ASSERT_EQUAL(exchange.status, status);
+
+        s_window.attach(s_client);
+
+        TEST_ASSERT_TRUE(readBody() == exchange.body);
+
+        s_client.end();
+    }
+}
+
+void test_replay_volume()
+{
+    char volume[4];
+
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, s_client.post(s_speaker, s_exchanges[1].path.c_str(), s_exchanges[1].action.c_str(),
+                                                  s_exchanges[1].payload.c_str(), TEST_TIMEOUT, false));
+
+    s_window.attach(s_client);
+
+    TEST_ASSERT_TRUE(s_window.findAndConsume("<CurrentVolume>", 15));
+    TEST_ASSERT_TRUE(s_window.copyUntil("<", 1, volume, sizeof(volume)));
+    TEST_ASSERT_EQUAL_STRING("23", volume);
+}
+
+/*
+ * The whole session played back to a new Sonos
+ */
+void test_replay_sonos()
+{
+    static Sonos sonos;
+    uint8_t volume = 0;
+
+    sonos.begin();
+    sonos.startDiscovery(0);
+
+    for (const CaptureRecord& record : s_records)
+    {
+        if (record.type == CAPTURE_SSDP_RECEIVED) WiFiUDP::fakeReceive(record.ip, 1900, record.data.c_str(), record.data.size());
+    }
+
+    while (!sonos.handleDiscovery());
+
+    TEST_ASSERT_EQUAL(1, sonos.getClientCount());
+    TEST_ASSERT_EQUAL_STRING("Kitchen", sonos.getActiveClient()->room_name);
+    TEST_ASSERT_EQUAL_STRING(s_serial_num, sonos.getActiveClient()->serial_num);
+
+    TEST_ASSERT_TRUE(sonos.getVolume(volume));
+    TEST_ASSERT_EQUAL(23, volume);
+    TEST_ASSERT_EQUAL(12, sonos.getServiceID("Spotify"));
+
+    for (const CaptureExchange& exchange : s_exchanges) TEST_ASSERT_TRUE(exchange.replayed);
+}
+
+int main()
+{
+    captureSession();
+
+    File file = LittleFS.open(CAPTURE_PATH, "r");
+
+    TEST_ASSERT_TRUE(file);
+
+    s_file.resize(file.size());
+    file.read((uint8_t*)&s_file[0], s_file.size());
+    file.close();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_load_capture);
+    RUN_TEST(test_load_bad_capture);
+    RUN_TEST(test_replay_ssdp);
+    RUN_TEST(test_replay_soap);
+    RUN_TEST(test_replay_volume);
+    RUN_TEST(test_replay_sonos);
+    return UNITY_END();
+}
@@ -0,0 +1,231 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <limits.h>
+#include <pthread.h>
+#include "Command.h"
+
+#define TEST_OPCODE(id, handler, arg, min, max, choices, flags) #id,
+
+static const char* s_opcodes[] = { COMMANDS(TEST_OPCODE) };
+
+#undef TEST_OPCODE
+
+#define TEST_HANDLER(id, handler, arg, min, max, choices, flags) handler,
+
+// The handlers in main.cpp, in table order
+static const CommandHandler s_handlers[] = { COMMANDS(TEST_HANDLER) };
+
+#undef TEST_HANDLER
+
+/*
+ * Parses a card, NUL padded out to the size of a
+ * card's data like the reader's buffer
+ */
+static const CommandSpec* parseCard(const char* t_card, CommandArgs& t_args)
+{
+    static char card[48];
+
+    memset(card, 0, sizeof(card));
+    strncpy(card, t_card, sizeof(card) - 1);
+
+    return parseCommand(card, sizeof(card), t_args);
+}
+
+static void assertArg(const char* t_card, const CommandId t_id, const char* t_text, const long t_value)
+{
+    CommandArgs args;
+    const CommandSpec* command = parseCard(t_card, args);
+
+    TEST_ASSERT_NOT_NULL(command);
+    TEST_ASSERT_EQUAL(t_id, command->id);
+    TEST_ASSERT_EQUAL(strlen(t_text), args.length);
+    TEST_ASSERT_EQUAL_MEMORY(t_text, args.text, args.length);
+    TEST_ASSERT_EQUAL(t_value, args.value);
+}
+
+static void assertInvalid(const char* t_card)
+{
+    CommandArgs args;
+
+    TEST_ASSERT_NULL(parseCard(t_card, args));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_find_every_opcode()
+{
+    for (uint8_t i = 0; i < COMMAND_COUNT; i++)
+    {
+        const CommandSpec* command = findCommand(s_opcodes[i], strlen(s_opcodes[i]));
+
+        TEST_ASSERT_NOT_NULL(command);
+        TEST_ASSERT_EQUAL(i, command->id);
+        TEST_ASSERT_EQUAL_STRING(s_opcodes[i], command->name);
+
+        // Each runs its own handler
+        TEST_ASSERT_TRUE(command->handler == s_handlers[i]);
+    }
+}
+
+void test_find_unknown()
+{
+    TEST_ASSERT_NULL(findCommand("", 0));
+    TEST_ASSERT_NULL(findCommand("PLA", 3));
+    TEST_ASSERT_NULL(findCommand("PLAYS", 5));
+    TEST_ASSERT_NULL(findCommand("play", 4));
+    TEST_ASSERT_NULL(findCommand("FOO", 3));
+
+    // Only the length given is looked at
+    TEST_ASSERT_NOT_NULL(findCommand("PLAYS", 4));
+}
+
+void test_parse_leaves_card_alone()
+{
+    char card[] = "  PLAY  spotify:album:1234  ";
+    char original[sizeof(card)];
+    CommandArgs args;
+
+    memcpy(original, card, sizeof(card));
+
+    const CommandSpec* command = parseCommand(card, sizeof(card), args);
+
+    TEST_ASSERT_NOT_NULL(command);
+    TEST_ASSERT_EQUAL(COMMAND_PLAY, command->id);
+    TEST_ASSERT_EQUAL_MEMORY(original, card, sizeof(card));
+    TEST_ASSERT_EQUAL_PTR(card + 8, args.text);
+    TEST_ASSERT_EQUAL(18, args.length);
+}
+
+void test_parse_tokens()
+{
+    assertArg("PLAY spotify:album:1234", COMMAND_PLAY, "spotify:album:1234", 0);
+    assertArg("LOCATION kitchen\r\n", COMMAND_LOCATION, "kitchen", 0);
+    assertInvalid("PLAY");
+    assertInvalid("PLAY   ");
+
+    assertArg("GROUP", COMMAND_GROUP, "", 0);
+    assertArg("GROUP RINCON_000E58", COMMAND_GROUP, "RINCON_000E58", 0);
+
+    // Split out, but ignored by commands without arguments
+    assertArg("STOP now", COMMAND_STOP, "now", 0);
+}
+
+void test_parse_numbers()
+{
+    assertArg("VOLUME 20", COMMAND_VOLUME, "20", 20);
+    assertArg("VOLUME +5", COMMAND_VOLUME, "+5", 5);
+    assertArg("VOLUME -100", COMMAND_VOLUME, "-100", -100);
+    assertArg("SLEEP 0", COMMAND_SLEEP, "0", 0);
+    assertArg("SLEEP 1440", COMMAND_SLEEP, "1440", 1440);
+
+    assertInvalid("VOLUME");
+    assertInvalid("VOLUME 101");
+    assertInvalid("VOLUME -101");
+    assertInvalid("VOLUME 2O");
+    assertInvalid("VOLUME -");
+    assertInvalid("VOLUME 99999999999999999999");
+    assertInvalid("SLEEP -1");
+    assertInvalid("SLEEP 1441");
+}
+
+void test_parse_choices()
+{
+    assertArg("SHUFFLE OFF", COMMAND_SHUFFLE, "OFF", 0);
+    assertArg("SHUFFLE on", COMMAND_SHUFFLE, "on", 1);
+    assertArg("REPEAT ONE", COMMAND_REPEAT, "ONE", 2);
+
+    assertInvalid("SHUFFLE");
+    assertInvalid("SHUFFLE ONE");
+    assertInvalid("REPEAT AL");
+}
+
+void test_parse_unknown()
+{
+    assertInvalid("");
+    assertInvalid("   ");
+    assertInvalid("PLAYLIST spotify:album:1234");
+    assertInvalid("play spotify:album:1234");
+}
+
+void test_macro()
+{
+    CommandArgs args;
+    const CommandSpec* command = parseCard("MACRO LOCATION kitchen; VOLUME 20;;PLAY x ; ", args);
+    CommandStep steps[COMMAND_MACRO_MAX_STEPS];
+
+    TEST_ASSERT_NOT_NULL(command);
+    TEST_ASSERT_EQUAL(COMMAND_MACRO, command->id);
+    TEST_ASSERT_EQUAL(3, args.value);
+
+    TEST_ASSERT_EQUAL(3, compileMacro(args.text, args.length, steps, COMMAND_MACRO_MAX_STEPS));
+    TEST_ASSERT_EQUAL(COMMAND_LOCATION, steps[0].command->id);
+    TEST_ASSERT_EQUAL(COMMAND_VOLUME, steps[1].command->id);
+    TEST_ASSERT_EQUAL(20, steps[1].args.value);
+    TEST_ASSERT_EQUAL(COMMAND_PLAY, steps[2].command->id);
+    TEST_ASSERT_EQUAL(1, steps[2].args.length);
+
+    // A bad step, or too many, and none of it runs
+    assertInvalid("MACRO LOCATION kitchen; VOLUME 200");
+    assertInvalid("MACRO");
+    assertInvalid("MACRO ;;");
+    assertInvalid("MACRO STOP;STOP;STOP;STOP;STOP;STOP;STOP;STOP;STOP");
+}
+
+static void* parseOnThread(void* t_card)
+{
+    CommandArgs args;
+
+    return (void*)parseCommand((const char*)t_card, strlen((const char*)t_card), args);
+}
+
+/*
+ * Macros can't nest, and are turned away without
+ * parsing (and so compiling) the inner one. Checked
+ * on a small stack, like the loop's 4 KB on the
+ * device, with as many as fit on a large card.
+ */
+void test_nested_macro()
+{
+    static char card[4096];
+    pthread_attr_t attributes;
+    pthread_t thread;
+    void* result = &result;
+
+    assertInvalid("MACRO MACRO STOP");
+    assertInvalid("MACRO STOP; MACRO STOP");
+    assertInvalid("MACRO STOP;  MACRO");
+
+    card[0] = '\0';
+    while ((strlen(card) + 6 + 5) < sizeof(card)) strcat(card, "MACRO ");
+    strcat(card, "STOP");
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, (PTHREAD_STACK_MIN > 16384) ? PTHREAD_STACK_MIN : 16384);
+
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, &attributes, parseOnThread, card));
+    pthread_join(thread, &result);
+    pthread_attr_destroy(&attributes);
+
+    TEST_ASSERT_NULL(result);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_find_every_opcode);
+    RUN_TEST(test_find_unknown);
+    RUN_TEST(test_parse_leaves_card_alone);
+    RUN_TEST(test_parse_tokens);
+    RUN_TEST(test_parse_numbers);
+    RUN_TEST(test_parse_choices);
+    RUN_TEST(test_parse_unknown);
+    RUN_TEST(test_macro);
+    RUN_TEST(test_nested_macro);
+    return UNITY_END();
+}
@@ -0,0 +1,410 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <map>
+#include <string>
+#include "ConfigStore.h"
+
+/*
+ * Power is cut part way through writing to the store,
+ * at every byte, and the store then has to come back
+ * with the last value that was committed for each key
+ * and carry on taking writes.
+ */
+
+#define CUT_KEYS            5       // Written once, so they're in the oldest sector at rotation
+#define CUT_CHURN_KEY       100     // Written until the store rotates
+#define CUT_VALUE_LENGTH    20
+#define CUT_RECORD_LENGTH   (12 + CUT_VALUE_LENGTH)
+
+/*
+ * Flash held in RAM. Like NOR flash, a write can only
+ * clear bits. Once armed, power is cut after that many
+ * bytes have been written (an erase counts as one),
+ * and nothing after that reaches the flash. With
+ * failWrites, writes and erases fail from then on
+ * instead, but the power stays on.
+ */
+class CutFlash : public ConfigFlash
+{
+public:
+    CutFlash() { memset(m_data, 0xFF, sizeof(m_data)); }
+
+    bool read(const uint32_t t_address, uint32_t* t_buffer, const size_t t_length) override
+    {
+        if (m_cut || !inRange(t_address, t_length)) return false;
+
+        memcpy(t_buffer, m_data + t_address, t_length);
+
+        return true;
+    }
+
+    bool write(const uint32_t t_address, const uint32_t* t_buffer, const size_t t_length) override
+    {
+        if (!inRange(t_address, t_length)) return false;
+
+        const uint8_t* data = (const uint8_t*)t_buffer;
+
+        for (size_t i = 0; i < t_length; i++)
+        {
+            if (!spend()) return false;
+
+            m_data[t_address + i] &= data[i];
+        }
+
+        return true;
+    }
+
+    bool erase(const uint8_t t_sector) override
+    {
+        if ((t_sector >= CONFIG_STORE_SECTORS) || !spend()) return false;
+
+        memset(m_data + (t_sector * CONFIG_STORE_SECTOR_SIZE), 0xFF, CONFIG_STORE_SECTOR_SIZE);
+
+        return true;
+    }
+
+    void arm(const uint32_t t_budget) { m_armed = true; m_budget = t_budget; m_used = 0; m_cut = false; m_fail_only = false; }
+    void failWrites(const uint32_t t_budget) { arm(t_budget); m_fail_only = true; }
+    void disarm() { m_armed = false; m_used = 0; m_cut = false; m_fail_only = false; }
+    uint32_t used() const { return m_used; }
+
+    uint8_t m_data[CONFIG_STORE_SECTORS * CONFIG_STORE_SECTOR_SIZE];
+
+private:
+    bool m_armed = false;
+    bool m_cut = false;
+    bool m_fail_only = false;
+    uint32_t m_budget = 0;
+    uint32_t m_used = 0;
+
+    bool inRange(const uint32_t t_address, const size_t t_length) const
+    {
+        return ((t_address % 4) == 0) && ((t_length % 4) == 0) && ((t_address + t_length) <= sizeof(m_data));
+    }
+
+    bool spend()
+    {
+        if (m_cut || (m_armed && (m_used >= m_budget)))
+        {
+            m_cut = !m_fail_only;
+            return false;
+        }
+
+        m_used++;
+
+        return true;
+    }
+};
+
+typedef std::map<uint16_t, std::string> Values;
+
+static CutFlash s_flash;
+static uint32_t s_counter = 0;
+
+/*
+ * Room for the longest the format can print, then cut
+ * (or padded) to the length every value has
+ */
+static std::string nextValue(const uint16_t t_key)
+{
+    char value[32];
+
+    snprintf(value, sizeof(value), "key %3u value %06u", t_key, ++s_counter);
+
+    std::string cut(value);
+    cut.resize(CUT_VALUE_LENGTH, ' ');
+
+    return cut;
+}
+
+static bool writeValue(ConfigStore& t_store, Values& t_values, const uint16_t t_key)
+{
+    std::string value = nextValue(t_key);
+
+    if (!t_store.write(t_key, value.data(), value.size())) return false;
+
+    t_values[t_key] = value;
+
+    return true;
+}
+
+static void checkValues(ConfigStore& t_store, const Values& t_values)
+{
+    for (const auto& expected : t_values)
+    {
+        char value[CONFIG_STORE_MAX_VALUE];
+        size_t length = t_store.read(expected.first, value, sizeof(value));
+
+        TEST_ASSERT_EQUAL(expected.second.size(), length);
+        TEST_ASSERT_EQUAL_MEMORY(expected.second.data(), value, length);
+    }
+}
+
+/*
+ * Powers back on, checks every key has its last
+ * committed value, then that the store still takes
+ * writes (enough to rotate through every sector,
+ * carrying the fixed keys along) and they survive
+ * another power cycle
+ */
+static void checkRecovery(Values t_values)
+{
+    ConfigStore store;
+
+    s_flash.disarm();
+    TEST_ASSERT_TRUE(store.begin(&s_flash));
+    checkValues(store, t_values);
+
+    for (uint16_t i = 0; i < (CONFIG_STORE_SECTORS * CONFIG_STORE_SECTOR_SIZE) / CUT_RECORD_LENGTH; i++)
+    {
+        TEST_ASSERT_TRUE(writeValue(store, t_values, CUT_CHURN_KEY + (i % 3)));
+    }
+
+    checkValues(store, t_values);
+
+    ConfigStore rebooted;
+
+    TEST_ASSERT_TRUE(rebooted.begin(&s_flash));
+    checkValues(rebooted, t_values);
+}
+
+/*
+ * A store with the fixed keys written once, at
+ * the start of the first sector
+ */
+static void startStore(ConfigStore& t_store, Values& t_values)
+{
+    memset(s_flash.m_data, 0xFF, sizeof(s_flash.m_data));
+    s_flash.disarm();
+    t_values.clear();
+
+    TEST_ASSERT_TRUE(t_store.begin(&s_flash));
+    TEST_ASSERT_TRUE(t_store.isEmpty());
+
+    for (uint16_t key = 0; key < CUT_KEYS; key++) TEST_ASSERT_TRUE(writeValue(t_store, t_values, key));
+}
+
+/*
+ * Cuts the power at every byte of the next write of
+ * t_key to the store in t_image, checking what's
+ * recovered each time
+ */
+static void cutEveryByte(const CutFlash& t_image, const Values& t_values, const uint16_t t_key, const uint32_t t_length)
+{
+    for (uint32_t cut = 0; cut <= t_length; cut++)
+    {
+        ConfigStore store;
+        Values values = t_values;
+
+        memcpy(s_flash.m_data, t_image.m_data, sizeof(s_flash.m_data));
+        s_flash.disarm();
+        TEST_ASSERT_TRUE(store.begin(&s_flash));
+
+        s_flash.arm(cut);
+
+        // Only a write that made it all the way to flash counts
+        bool written = writeValue(store, values, t_key);
+
+        TEST_ASSERT_EQUAL(cut == t_length, written);
+
+        checkRecovery(values);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_rotation()
+{
+    ConfigStore store;
+    Values values;
+
+    startStore(store, values);
+
+    // Round every sector a few times, so the fixed keys are evacuated more than once
+    for (uint16_t i = 0; i < (3 * CONFIG_STORE_SECTORS * CONFIG_STORE_SECTOR_SIZE) / CUT_RECORD_LENGTH; i++)
+    {
+        TEST_ASSERT_TRUE(writeValue(store, values, CUT_CHURN_KEY + (i % 7)));
+        checkValues(store, values);
+    }
+
+    ConfigStore rebooted;
+
+    TEST_ASSERT_TRUE(rebooted.begin(&s_flash));
+    TEST_ASSERT_FALSE(rebooted.isEmpty());
+    checkValues(rebooted, values);
+}
+
+void test_cut_mid_append()
+{
+    ConfigStore store;
+    Values values;
+    static CutFlash image;
+
+    startStore(store, values);
+    memcpy(image.m_data, s_flash.m_data, sizeof(image.m_data));
+
+    // A new key, and a new value for an existing one
+    cutEveryByte(image, values, CUT_CHURN_KEY, CUT_RECORD_LENGTH);
+    cutEveryByte(image, values, 0, CUT_RECORD_LENGTH);
+}
+
+void test_cut_mid_rotation()
+{
+    ConfigStore store;
+    Values values;
+    static CutFlash image;
+    Values committed;
+    uint32_t used = 0;
+
+    startStore(store, values);
+
+    // Find the write that moves on to a new sector and
+    // evacuates the fixed keys from the first one
+    while (used <= (1 + 8 + CUT_RECORD_LENGTH))
+    {
+        memcpy(image.m_data, s_flash.m_data, sizeof(image.m_data));
+        committed = values;
+
+        s_flash.arm(UINT32_MAX);
+        TEST_ASSERT_TRUE(writeValue(store, values, CUT_CHURN_KEY));
+        used = s_flash.used();
+        s_flash.disarm();
+
+        TEST_ASSERT_TRUE(s_counter < 1000000);
+    }
+
+    cutEveryByte(image, committed, CUT_CHURN_KEY, used);
+}
+
+/*
+ * A record that's all there, but whose CRC doesn't
+ * match, is ignored in favour of the previous value
+ */
+void test_torn_crc()
+{
+    ConfigStore store;
+    Values values;
+
+    startStore(store, values);
+
+    Values committed = values;
+    uint32_t address = 8 + (CUT_KEYS * CUT_RECORD_LENGTH);
+
+    TEST_ASSERT_TRUE(writeValue(store, values, 0));
+
+    // The CRC follows key, length and sequence. Clear
+    // the bits of one of its bytes, as a write would.
+    uint32_t crc = address + 8;
+
+    while (!s_flash.m_data[crc]) crc++;
+
+    s_flash.m_data[crc] = 0;
+
+    checkRecovery(committed);
+}
+
+/*
+ * After a record cut off by power loss, the end of
+ * the log is found by walking the records, so a value
+ * that ends in erased-looking words isn't appended
+ * over when the store comes back
+ */
+void test_cut_then_erased_tail()
+{
+    ConfigStore store;
+    Values values;
+
+    startStore(store, values);
+
+    s_flash.arm(6);
+    TEST_ASSERT_FALSE(writeValue(store, values, CUT_CHURN_KEY));
+
+    ConfigStore recovered;
+    std::string tail = nextValue(CUT_CHURN_KEY + 1).substr(0, CUT_VALUE_LENGTH - 8) + std::string(8, '\xFF');
+
+    s_flash.disarm();
+    TEST_ASSERT_TRUE(recovered.begin(&s_flash));
+    TEST_ASSERT_TRUE(recovered.write(CUT_CHURN_KEY + 1, tail.data(), tail.size()));
+    values[CUT_CHURN_KEY + 1] = tail;
+
+    ConfigStore rebooted;
+
+    TEST_ASSERT_TRUE(rebooted.begin(&s_flash));
+    TEST_ASSERT_TRUE(writeValue(rebooted, values, CUT_CHURN_KEY + 2));
+
+    checkRecovery(values);
+}
+
+/*
+ * A sector whose values couldn't be moved out is kept,
+ * and once the store comes round to it again it's
+ * still not erased: writes are refused instead, and
+ * every value is still there, even after a reboot
+ * past the gap the failed write left
+ */
+void test_failed_evacuation_kept()
+{
+    ConfigStore store;
+    Values values;
+    static CutFlash image;
+    Values committed;
+    uint32_t used = 0;
+
+    startStore(store, values);
+
+    // Up to the write that evacuates the fixed keys from the first sector
+    while (used <= (1 + 8 + CUT_RECORD_LENGTH))
+    {
+        memcpy(image.m_data, s_flash.m_data, sizeof(image.m_data));
+        committed = values;
+
+        s_flash.arm(UINT32_MAX);
+        TEST_ASSERT_TRUE(writeValue(store, values, CUT_CHURN_KEY));
+        used = s_flash.used();
+        s_flash.disarm();
+    }
+
+    ConfigStore failing;
+
+    memcpy(s_flash.m_data, image.m_data, sizeof(s_flash.m_data));
+    TEST_ASSERT_TRUE(failing.begin(&s_flash));
+
+    // The new sector is started and one key is moved, then the flash fails
+    s_flash.failWrites(1 + 8 + CUT_RECORD_LENGTH);
+    TEST_ASSERT_FALSE(writeValue(failing, committed, CUT_CHURN_KEY));
+    s_flash.disarm();
+    checkValues(failing, committed);
+
+    // On until the store is back round to the sector it couldn't empty
+    uint16_t written = 0;
+
+    while (writeValue(failing, committed, CUT_CHURN_KEY + (written % 3)))
+    {
+        TEST_ASSERT_TRUE(++written < (CONFIG_STORE_SECTOR_SIZE / CUT_RECORD_LENGTH));
+    }
+
+    checkValues(failing, committed);
+
+    ConfigStore rebooted;
+
+    TEST_ASSERT_TRUE(rebooted.begin(&s_flash));
+    checkValues(rebooted, committed);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rotation);
+    RUN_TEST(test_cut_mid_append);
+    RUN_TEST(test_cut_mid_rotation);
+    RUN_TEST(test_torn_crc);
+    RUN_TEST(test_cut_then_erased_tail);
+    RUN_TEST(test_failed_evacuation_kept);
+    return UNITY_END();
+}
@@ -0,0 +1,324 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "Scheduler.h"
+
+/*
+ * The scheduler on a fake clock. Tasks "take" time
+ * by moving the clock on while they run.
+ */
+
+#define TEST_LOG_SIZE       32
+
+static uint32_t s_now = 0;
+static char s_log[TEST_LOG_SIZE];
+static uint8_t s_log_length = 0;
+
+struct TestTask
+{
+    char name;
+    uint32_t takes_us;
+    Scheduler* scheduler;
+    int8_t signals;     // Task to signal while running, or -1
+    uint32_t allocates;
+};
+
+static uint32_t fakeClock()
+{
+    return s_now;
+}
+
+static void runTask(void* t_context)
+{
+    TestTask* task = (TestTask*)t_context;
+
+    if (s_log_length < (TEST_LOG_SIZE - 1)) s_log[s_log_length++] = task->name;
+
+    s_now += task->takes_us;
+
+    if (task->signals >= 0) task->scheduler->signal(task->signals);
+
+    for (uint32_t i = 0; i < task->allocates; i++)
+    {
+        // Volatile, so the pair isn't optimised away
+        void* volatile block = malloc(16);
+        free(block);
+    }
+}
+
+static const char* takeLog()
+{
+    s_log[s_log_length] = '\0';
+    s_log_length = 0;
+
+    return s_log;
+}
+
+void setUp()
+{
+    s_now = 1000;
+    s_log_length = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_priority_order()
+{
+    Scheduler scheduler;
+    TestTask low = { 'l', 0, &scheduler, -1, 0 };
+    TestTask normal = { 'n', 0, &scheduler, -1, 0 };
+    TestTask high = { 'h', 0, &scheduler, -1, 0 };
+    TestTask normal_later = { 'N', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+
+    int8_t ids[] = {
+        scheduler.addEvent("low", runTask, &low, SCHEDULER_PRIORITY_LOW, 1000),
+        scheduler.addEvent("normal", runTask, &normal, SCHEDULER_PRIORITY_NORMAL, 1000),
+        scheduler.addEvent("high", runTask, &high, SCHEDULER_PRIORITY_HIGH, 1000),
+        scheduler.addEvent("normal later", runTask, &normal_later, SCHEDULER_PRIORITY_NORMAL, 1000)
+    };
+
+    for (int8_t id : ids) scheduler.signal(id);
+
+    // Ties go to the task added first
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("hnNl", takeLog());
+
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("", takeLog());
+}
+
+void test_periodic()
+{
+    Scheduler scheduler;
+    TestTask task = { 'p', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+    int8_t id = scheduler.addPeriodic("periodic", runTask, &task, 10, SCHEDULER_PRIORITY_NORMAL, 1000);
+
+    // First run is a period after it's added
+    s_now += 9999;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("", takeLog());
+
+    s_now += 1;
+    scheduler.run();
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("p", takeLog());
+    TEST_ASSERT_EQUAL_UINT32(s_now + 10000, scheduler.getTask(id)->next_run_us);
+
+    // Running late keeps to the original schedule
+    s_now += 12000;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("p", takeLog());
+    TEST_ASSERT_EQUAL_UINT32(1000 + 30000, scheduler.getTask(id)->next_run_us);
+
+    // Missing several runs doesn't run it several times to catch up
+    s_now += 55000;
+    scheduler.run();
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("p", takeLog());
+    TEST_ASSERT_EQUAL_UINT32(s_now + 10000, scheduler.getTask(id)->next_run_us);
+}
+
+void test_periodic_clock_wrap()
+{
+    Scheduler scheduler;
+    TestTask task = { 'p', 0, &scheduler, -1, 0 };
+
+    s_now = 0xFFFFFFFF - 5000;
+    scheduler.setClock(fakeClock);
+    scheduler.addPeriodic("periodic", runTask, &task, 10, SCHEDULER_PRIORITY_NORMAL, 1000);
+
+    s_now += 9000;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("", takeLog());
+
+    s_now += 1000;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("p", takeLog());
+
+    s_now += 10000;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("p", takeLog());
+}
+
+void test_signal()
+{
+    Scheduler scheduler;
+    TestTask event = { 'e', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+    int8_t id = scheduler.addEvent("event", runTask, &event, SCHEDULER_PRIORITY_NORMAL, 1000);
+
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("", takeLog());
+
+    // However many times it's signalled, it runs once
+    scheduler.signal(id);
+    scheduler.signal(id);
+    scheduler.run();
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("e", takeLog());
+
+    // Bad IDs are ignored
+    scheduler.signal(-1);
+    scheduler.signal(SCHEDULER_MAX_TASKS);
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("", takeLog());
+}
+
+void test_signal_from_task()
+{
+    Scheduler scheduler;
+    TestTask first = { 'f', 0, &scheduler, -1, 0 };
+    TestTask second = { 's', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+    int8_t first_id = scheduler.addEvent("first", runTask, &first, SCHEDULER_PRIORITY_HIGH, 1000);
+    int8_t second_id = scheduler.addEvent("second", runTask, &second, SCHEDULER_PRIORITY_LOW, 1000);
+
+    // Signalled by a task, it runs in the same pass
+    first.signals = second_id;
+    scheduler.signal(first_id);
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("fs", takeLog());
+
+    // Unless it's already had its turn, then it waits for the next
+    first.signals = -1;
+    second.signals = first_id;
+    scheduler.signal(first_id);
+    scheduler.signal(second_id);
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("fs", takeLog());
+
+    second.signals = -1;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("f", takeLog());
+}
+
+/*
+ * Signalling a periodic task runs it early, without
+ * moving its next scheduled run
+ */
+void test_signal_periodic()
+{
+    Scheduler scheduler;
+    TestTask task = { 'p', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+    int8_t id = scheduler.addPeriodic("periodic", runTask, &task, 10, SCHEDULER_PRIORITY_NORMAL, 1000);
+    uint32_t due = scheduler.getTask(id)->next_run_us;
+
+    s_now += 4000;
+    scheduler.signal(id);
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("p", takeLog());
+    TEST_ASSERT_EQUAL_UINT32(due, scheduler.getTask(id)->next_run_us);
+
+    s_now = due;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("p", takeLog());
+    TEST_ASSERT_EQUAL_UINT32(due + 10000, scheduler.getTask(id)->next_run_us);
+}
+
+void test_budget()
+{
+    Scheduler scheduler;
+    TestTask task = { 't', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+    int8_t id = scheduler.addEvent("task", runTask, &task, SCHEDULER_PRIORITY_NORMAL, 500);
+    const uint32_t takes[] = { 200, 500, 501, 3000 };
+
+    for (uint32_t takes_us : takes)
+    {
+        task.takes_us = takes_us;
+        scheduler.signal(id);
+        scheduler.run();
+    }
+
+    const SchedulerTask* stats = scheduler.getTask(id);
+
+    TEST_ASSERT_EQUAL_UINT32(4, stats->runs);
+    TEST_ASSERT_EQUAL_UINT32(2, stats->overruns);
+    TEST_ASSERT_EQUAL_UINT32(3000, stats->max_us);
+    TEST_ASSERT_EQUAL(200 + 500 + 501 + 3000, stats->total_us);
+}
+
+/*
+ * An overrunning task holds up the rest of the pass,
+ * but they still run, and aren't charged for it
+ */
+void test_overrun_delays_others()
+{
+    Scheduler scheduler;
+    TestTask slow = { 's', 20000, &scheduler, -1, 0 };
+    TestTask fast = { 'f', 100, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+    int8_t slow_id = scheduler.addPeriodic("slow", runTask, &slow, 10, SCHEDULER_PRIORITY_HIGH, 1000);
+    int8_t fast_id = scheduler.addPeriodic("fast", runTask, &fast, 10, SCHEDULER_PRIORITY_NORMAL, 1000);
+
+    s_now += 10000;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_STRING("sf", takeLog());
+
+    TEST_ASSERT_EQUAL_UINT32(1, scheduler.getTask(slow_id)->overruns);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.getTask(fast_id)->overruns);
+    TEST_ASSERT_EQUAL_UINT32(100, scheduler.getTask(fast_id)->max_us);
+}
+
+void test_allocations()
+{
+    Scheduler scheduler;
+    TestTask task = { 'a', 0, &scheduler, -1, 3 };
+    TestTask other = { 'o', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+    int8_t id = scheduler.addEvent("allocates", runTask, &task, SCHEDULER_PRIORITY_NORMAL, 1000);
+    int8_t other_id = scheduler.addEvent("other", runTask, &other, SCHEDULER_PRIORITY_NORMAL, 1000);
+
+    scheduler.signal(id);
+    scheduler.signal(other_id);
+    scheduler.run();
+
+    TEST_ASSERT_EQUAL_UINT32(3, scheduler.getTask(id)->allocations);
+    TEST_ASSERT_EQUAL_UINT32(3 * 16, scheduler.getTask(id)->allocated_bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.getTask(other_id)->allocations);
+}
+
+void test_full()
+{
+    Scheduler scheduler;
+    TestTask task = { 't', 0, &scheduler, -1, 0 };
+
+    scheduler.setClock(fakeClock);
+
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TASKS; i++)
+    {
+        TEST_ASSERT_EQUAL(i, scheduler.addEvent("task", runTask, &task, SCHEDULER_PRIORITY_NORMAL, 1000));
+    }
+
+    TEST_ASSERT_EQUAL(-1, scheduler.addEvent("one too many", runTask, &task, SCHEDULER_PRIORITY_NORMAL, 1000));
+    TEST_ASSERT_EQUAL(SCHEDULER_MAX_TASKS, scheduler.getTaskCount());
+    TEST_ASSERT_NULL(scheduler.getTask(SCHEDULER_MAX_TASKS));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_priority_order);
+    RUN_TEST(test_periodic);
+    RUN_TEST(test_periodic_clock_wrap);
+    RUN_TEST(test_signal);
+    RUN_TEST(test_signal_from_task);
+    RUN_TEST(test_signal_periodic);
+    RUN_TEST(test_budget);
+    RUN_TEST(test_overrun_delays_others);
+    RUN_TEST(test_allocations);
+    RUN_TEST(test_full);
+    return UNITY_END();
+}
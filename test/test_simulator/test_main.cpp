@@ -0,0 +1,202 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <WiFiUDP.h>
+#include <chrono>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Heap.h"
+#include "Sonos.h"
+
+/*
+ * The firmware's Sonos against tools/sonossim.py,
+ * over real sockets on loopback: a household as big
+ * as Sonos can hold is discovered, then each speaker
+ * is driven in turn and all of them at once.
+ *
+ * Needs python3, and the test run from the project
+ * directory (as pio test does). Without them the
+ * tests are ignored rather than failed.
+ */
+
+#define SIM_SPEAKERS            SONOS_MAX_CLIENTS
+#define SIM_BASE_ADDRESS        "127.0.1.1"
+#define SIM_START_TIMEOUT       10000   // ms for every speaker to be listening
+#define SIM_SSDP_START          500     // ms, SSDP is listened for once the speakers are
+#define SIM_LISTEN_TIME         2000    // ms, the simulator answers an MX: 1 search within a second
+#define SIM_ROUNDS              5       // Of requests to every speaker, for the timing
+
+static pid_t s_simulator = -1;
+static bool s_running = false;
+static Sonos s_sonos;
+
+/*
+ * Starts the simulator and waits for the line each
+ * speaker prints once it's listening
+ */
+static bool startSimulator()
+{
+    char speakers[8];
+    int output[2];
+
+    snprintf(speakers, sizeof(speakers), "%u", SIM_SPEAKERS);
+
+    if ((access("tools/sonossim.py", R_OK) != 0) || (pipe(output) != 0)) return false;
+
+    s_simulator = fork();
+
+    if (s_simulator < 0) return false;
+
+    if (s_simulator == 0)
+    {
+        dup2(output[1], STDOUT_FILENO);
+        close(output[0]);
+        execlp("python3", "python3", "-u", "tools/sonossim.py", "--speakers", speakers, "--base-address", SIM_BASE_ADDRESS, (char*)nullptr);
+        _exit(127);
+    }
+
+    close(output[1]);
+
+    FILE* lines = fdopen(output[0], "r");
+    char line[128];
+    uint8_t listening = 0;
+    unsigned long start = millis();
+
+    while ((listening < SIM_SPEAKERS) && ((millis() - start) < SIM_START_TIMEOUT) && fgets(line, sizeof(line), lines))
+    {
+        listening++;
+    }
+
+    // The rest of its output isn't read, so it mustn't block on it
+    fclose(lines);
+
+    delay(SIM_SSDP_START);
+
+    return listening == SIM_SPEAKERS;
+}
+
+static void stopSimulator()
+{
+    if (s_simulator <= 0) return;
+
+    kill(s_simulator, SIGTERM);
+    waitpid(s_simulator, nullptr, 0);
+    s_simulator = -1;
+}
+
+static double elapsedMs(const std::chrono::steady_clock::time_point& t_start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+}
+
+void setUp()
+{
+    if (!s_running) TEST_IGNORE_MESSAGE("tools/sonossim.py didn't start");
+}
+
+void tearDown()
+{
+}
+
+void test_discover()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    s_sonos.startDiscovery(SIM_LISTEN_TIME);
+
+    while (!s_sonos.handleDiscovery()) delay(1);
+
+    printf("%-28s %10.1f ms\n", "sim: discover all", elapsedMs(start));
+
+    TEST_ASSERT_EQUAL(SIM_SPEAKERS, s_sonos.getClientCount());
+    TEST_ASSERT_NOT_NULL(s_sonos.getActiveClient());
+
+    for (uint8_t i = 0; i < SIM_SPEAKERS; i++)
+    {
+        const SonosClient* client = s_sonos.getClient(i);
+
+        TEST_ASSERT_TRUE(client->room_name[0] != '\0');
+        TEST_ASSERT_TRUE(strncmp(client->serial_num, "B8-E9-37-", 9) == 0);
+    }
+}
+
+/*
+ * Each speaker keeps the volume it was given, so the
+ * requests went to the right one
+ */
+void test_volume_each()
+{
+    for (uint8_t i = 0; i < s_sonos.getClientCount(); i++)
+    {
+        SonosClient* client = (SonosClient*)s_sonos.getClient(i);
+
+        TEST_ASSERT_TRUE(s_sonos.setVolume(client, 10 + i));
+    }
+
+    for (uint8_t i = 0; i < s_sonos.getClientCount(); i++)
+    {
+        SonosClient* client = (SonosClient*)s_sonos.getClient(i);
+        uint8_t volume = 0;
+
+        TEST_ASSERT_TRUE(s_sonos.getVolume(client, volume));
+        TEST_ASSERT_EQUAL(10 + i, volume);
+    }
+}
+
+/*
+ * Rounds of requests to every speaker, one after
+ * another, as taps across the household would be
+ */
+void test_load()
+{
+    uint32_t allocations = HEAP.getAllocations();
+    uint32_t requests = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint8_t round = 0; round < SIM_ROUNDS; round++)
+    {
+        for (uint8_t i = 0; i < s_sonos.getClientCount(); i++)
+        {
+            SonosClient* client = (SonosClient*)s_sonos.getClient(i);
+            uint8_t volume = 0;
+
+            TEST_ASSERT_TRUE(s_sonos.getVolume(client, volume));
+            requests++;
+        }
+    }
+
+    printf("%-28s %10.2f ms %8.2f allocations\n", "sim: GetVolume", elapsedMs(start) / requests,
+           (double)(HEAP.getAllocations() - allocations) / requests);
+}
+
+void test_pause_all()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    TEST_ASSERT_TRUE(s_sonos.pauseAll());
+
+    printf("%-28s %10.1f ms\n", "sim: pause all", elapsedMs(start));
+}
+
+int main()
+{
+    // Ignored rather than left running if it only half started
+    s_running = startSimulator();
+    if (!s_running) stopSimulator();
+
+    WiFiClient::fakeUseNetwork(true);
+    WiFiUDP::fakeUseNetwork(true);
+
+    s_sonos.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_discover);
+    RUN_TEST(test_volume_each);
+    RUN_TEST(test_load);
+    RUN_TEST(test_pause_all);
+    int failures = UNITY_END();
+
+    stopSimulator();
+
+    return failures;
+}
@@ -0,0 +1,184 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <thread>
+#include "SpscQueue.h"
+
+#define THREADED_ITEMS      1000000
+
+struct TestItem
+{
+    uint32_t sequence;
+    uint32_t check;     // ~sequence, to catch a slot read before it's filled
+};
+
+template<uint8_t N>
+static void push(SpscQueue<TestItem, N>& t_queue, const uint32_t t_sequence)
+{
+    TestItem* item = t_queue.claim();
+
+    TEST_ASSERT_NOT_NULL(item);
+    item->sequence = t_sequence;
+    item->check = ~t_sequence;
+    t_queue.publish();
+}
+
+template<uint8_t N>
+static void pop(SpscQueue<TestItem, N>& t_queue, const uint32_t t_sequence)
+{
+    TestItem* item = t_queue.peek();
+
+    TEST_ASSERT_NOT_NULL(item);
+    TEST_ASSERT_EQUAL_UINT32(t_sequence, item->sequence);
+    TEST_ASSERT_EQUAL_UINT32(~t_sequence, item->check);
+    t_queue.release();
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_empty()
+{
+    SpscQueue<TestItem, 4> queue;
+
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_FALSE(queue.full());
+    TEST_ASSERT_NULL(queue.peek());
+
+    // Claimed but not published isn't visible
+    TestItem* item = queue.claim();
+
+    TEST_ASSERT_NOT_NULL(item);
+    item->sequence = 0;
+    item->check = ~0U;
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_NULL(queue.peek());
+
+    queue.publish();
+    TEST_ASSERT_FALSE(queue.empty());
+    pop(queue, 0);
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_full()
+{
+    SpscQueue<TestItem, 4> queue;
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_FALSE(queue.full());
+        push(queue, i);
+    }
+
+    TEST_ASSERT_TRUE(queue.full());
+    TEST_ASSERT_NULL(queue.claim());
+
+    for (uint8_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL_UINT32(i, queue.peek(i)->sequence);
+
+    TEST_ASSERT_NULL(queue.peek(4));
+
+    // One out makes room for one more
+    pop(queue, 0);
+    TEST_ASSERT_FALSE(queue.full());
+    push(queue, 4);
+    TEST_ASSERT_TRUE(queue.full());
+
+    for (uint32_t i = 1; i <= 4; i++) pop(queue, i);
+
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+/*
+ * The indices are uint8_t and wrap every 256 items,
+ * while the queue is at every level from empty to full
+ */
+void test_wraparound()
+{
+    SpscQueue<TestItem, 128> queue;
+    uint32_t pushed = 0;
+    uint32_t popped = 0;
+
+    for (uint16_t round = 0; round < 20; round++)
+    {
+        uint8_t level = (round * 37) % 129;
+
+        while ((pushed - popped) < level) push(queue, pushed++);
+
+        TEST_ASSERT_EQUAL(level == 128, queue.full());
+        TEST_ASSERT_EQUAL(level == 0, queue.empty());
+
+        if (level) TEST_ASSERT_EQUAL_UINT32(pushed - 1, queue.peek(level - 1)->sequence);
+
+        TEST_ASSERT_NULL(queue.peek(level));
+
+        while (popped < pushed) pop(queue, popped++);
+    }
+
+    TEST_ASSERT_TRUE(pushed > 1000);
+
+    // Full across the wrap
+    while ((pushed % 256) != 200) { push(queue, pushed++); pop(queue, popped++); }
+
+    for (uint8_t i = 0; i < 128; i++) push(queue, pushed++);
+
+    TEST_ASSERT_TRUE(queue.full());
+    TEST_ASSERT_NULL(queue.claim());
+
+    while (popped < pushed) pop(queue, popped++);
+
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+/*
+ * A producer and a consumer thread, with a queue small
+ * enough that each often finds it full or empty
+ */
+void test_threads()
+{
+    static SpscQueue<TestItem, 4> queue;
+    uint32_t mismatches = 0;
+
+    std::thread producer([]()
+    {
+        for (uint32_t i = 0; i < THREADED_ITEMS; i++)
+        {
+            TestItem* item;
+
+            while (!(item = queue.claim())) std::this_thread::yield();
+
+            item->sequence = i;
+            item->check = ~i;
+            queue.publish();
+        }
+    });
+
+    for (uint32_t i = 0; i < THREADED_ITEMS; i++)
+    {
+        TestItem* item;
+
+        while (!(item = queue.peek())) std::this_thread::yield();
+
+        if ((item->sequence != i) || (item->check != ~i)) mismatches++;
+
+        queue.release();
+    }
+
+    producer.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_full);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_threads);
+    return UNITY_END();
+}
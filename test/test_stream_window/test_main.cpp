@@ -0,0 +1,121 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include "SoapClient.h"
+#include "StreamWindow.h"
+#include "Utility.h"
+
+/*
+ * StreamWindow over a SoapClient reading a canned
+ * response from the fake WiFiClient
+ */
+
+#define TEST_TIMEOUT        1000    // ms
+
+static const IPAddress s_speaker(192, 168, 1, 20);
+static SoapClient s_client;
+static StreamWindow s_window;
+
+static void respond(const std::string& t_body)
+{
+    static std::string response;
+
+    response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(t_body.size()) + "\r\n\r\n" + t_body;
+
+    WiFiClient::fakeRespond(response.c_str());
+
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, s_client.get(s_speaker, "/xml/device_description.xml", TEST_TIMEOUT));
+
+    s_window.attach(s_client);
+}
+
+void setUp()
+{
+    WiFiClient::fakeReset();
+}
+
+void tearDown()
+{
+    s_client.stop();
+}
+
+/*
+ * Targets are found across fills of the window, even
+ * when split between one fill and the next
+ */
+void test_find_across_fills()
+{
+    std::string body(STREAM_WINDOW_SIZE - 5, 'x');
+    char room[16];
+
+    body += "<roomName>Kitchen</roomName>";
+    body += std::string(STREAM_WINDOW_SIZE * 2, 'y');
+    body += "<serialNum>";
+
+    respond(body);
+
+    TEST_ASSERT_TRUE(s_window.findAndConsume("<roomName>", 10));
+    TEST_ASSERT_TRUE(s_window.copyUntil("<", 1, room, sizeof(room)));
+    TEST_ASSERT_EQUAL_STRING("Kitchen", room);
+
+    TEST_ASSERT_TRUE(s_window.findAndConsume("<serialNum>", 11));
+    TEST_ASSERT_EQUAL(-1, s_window.peek());
+}
+
+/*
+ * A StriSearch target matches in any case, split
+ * between fills too, and what's copied before it
+ * keeps its case
+ */
+void test_find_ignoring_case()
+{
+    StriSearch service_start("&lt;service ");
+    StriSearch service_end("&LT;/SERVICE");
+    std::string body(STREAM_WINDOW_SIZE - 7, 'x');
+    char service[32];
+
+    body += "&lt;Service Id=&quot;12&quot;&lt;/Service&gt;";
+
+    respond(body);
+
+    TEST_ASSERT_TRUE(s_window.findAndConsume(service_start));
+    TEST_ASSERT_TRUE(s_window.copyUntil(service_end, service, sizeof(service)));
+    TEST_ASSERT_EQUAL_STRING("Id=&quot;12&quot;", service);
+
+    TEST_ASSERT_FALSE(s_window.findAndConsume(service_start));
+}
+
+/*
+ * Once the body has all been read, a missing target
+ * gives up straight away rather than waiting out the
+ * timeout
+ */
+void test_missing_target_at_end_of_body()
+{
+    char room[16];
+
+    respond("<roomName>Kitchen");
+
+    unsigned long start = millis();
+
+    TEST_ASSERT_FALSE(s_window.findAndConsume("<serialNum>", 11));
+    TEST_ASSERT_TRUE((millis() - start) < (TEST_TIMEOUT / 2));
+
+    respond("<roomName>Kitchen");
+
+    start = millis();
+
+    TEST_ASSERT_TRUE(s_window.findAndConsume("<roomName>", 10));
+    TEST_ASSERT_FALSE(s_window.copyUntil("<", 1, room, sizeof(room)));
+    TEST_ASSERT_EQUAL_STRING("Kitchen", room);
+    TEST_ASSERT_TRUE((millis() - start) < (TEST_TIMEOUT / 2));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_find_across_fills);
+    RUN_TEST(test_find_ignoring_case);
+    RUN_TEST(test_missing_target_at_end_of_body);
+    return UNITY_END();
+}
@@ -0,0 +1,326 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include "Sonos.h"
+#include "Volume.h"
+#include "Config.h"
+#include "Metrics.h"
+
+/*
+ * Volume driving the real Sonos, over the fake network
+ * to two pretend speakers that count the GetVolume and
+ * SetVolume requests they get
+ */
+
+class StringPrint : public Print
+{
+public:
+    size_t write(uint8_t t_char) override { m_text += (char)t_char; return 1; }
+    std::string m_text;
+};
+
+/*
+ * Requests fail (with a fault) while fail is set
+ */
+struct FakeSpeaker
+{
+    IPAddress ip;
+    const char* serial_num;
+    uint8_t volume = 0;
+    bool fail = false;
+    uint32_t get_requests = 0;
+    uint32_t set_requests = 0;
+};
+
+static FakeSpeaker s_kitchen;
+static FakeSpeaker s_lounge;
+static Sonos s_sonos;
+static Sonos s_no_speakers;
+
+static const char* respond(const IPAddress& t_ip, const uint16_t t_port, const char* t_request, const size_t t_length)
+{
+    static std::string response;
+    FakeSpeaker* speaker = (t_ip == s_kitchen.ip) ? &s_kitchen : ((t_ip == s_lounge.ip) ? &s_lounge : nullptr);
+    std::string request(t_request, t_length);
+    std::string body;
+
+    if (!speaker) return nullptr;
+
+    if (request.find("#GetVolume") != std::string::npos)
+    {
+        speaker->get_requests++;
+        body = "<s:Envelope><s:Body><u:GetVolumeResponse><CurrentVolume>" + std::to_string(speaker->volume)
+             + "</CurrentVolume></u:GetVolumeResponse></s:Body></s:Envelope>";
+    }
+    else if (request.find("#SetVolume") != std::string::npos)
+    {
+        size_t desired = request.find("<DesiredVolume>");
+
+        speaker->set_requests++;
+        if (!speaker->fail && (desired != std::string::npos)) speaker->volume = atoi(request.c_str() + desired + 15);
+        body = "<s:Envelope><s:Body><u:SetVolumeResponse></u:SetVolumeResponse></s:Body></s:Envelope>";
+    }
+
+    response = std::string(speaker->fail ? "HTTP/1.1 500 Internal Server Error" : "HTTP/1.1 200 OK")
+             + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    return response.c_str();
+}
+
+static void addSpeaker(FakeSpeaker& t_speaker, const IPAddress& t_ip, const char* t_serial_num)
+{
+    char location[64];
+
+    t_speaker = FakeSpeaker();
+    t_speaker.ip = t_ip;
+    t_speaker.serial_num = t_serial_num;
+
+    snprintf(location, sizeof(location), "http://%u.%u.%u.%u:1400/xml/device_description.xml", t_ip[0], t_ip[1], t_ip[2], t_ip[3]);
+
+    // Already there after the first test
+    s_sonos.restoreClient(t_ip, t_serial_num, location);
+}
+
+static uint32_t coalesced()
+{
+    StringPrint out;
+    const char* name = "\nmusicbox_volume_coalesced_total ";
+
+    METRICS.printTo(out);
+
+    size_t found = out.m_text.find(name);
+
+    return (found == std::string::npos) ? 0 : atol(out.m_text.c_str() + found + strlen(name));
+}
+
+void setUp()
+{
+    WiFiClient::fakeReset();
+    WiFiClient::fakeServe(respond);
+
+    addSpeaker(s_kitchen, IPAddress(192, 168, 1, 20), "00-0E-58-AA-AA-AA:1");
+    addSpeaker(s_lounge, IPAddress(192, 168, 1, 21), "00-0E-58-BB-BB-BB:1");
+    s_kitchen.volume = 10;
+
+    TEST_ASSERT_TRUE(s_sonos.setActiveClient(s_kitchen.serial_num));
+
+    CONFIG.stored_config = ConfigStruct();
+}
+
+void tearDown()
+{
+}
+
+/*
+ * However many changes arrive between runs, the
+ * speaker only gets the latest
+ */
+void test_burst_coalesces()
+{
+    Volume volume;
+    uint32_t coalesced_before = coalesced();
+
+    volume.begin(&s_sonos);
+
+    for (uint8_t i = 1; i <= 10; i++) volume.set(i * 5);
+
+    volume.handle();
+    volume.handle();
+
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.set_requests);
+    TEST_ASSERT_EQUAL_UINT32(0, s_kitchen.get_requests);
+    TEST_ASSERT_EQUAL(50, s_kitchen.volume);
+    TEST_ASSERT_EQUAL(50, volume.getVolume());
+    TEST_ASSERT_EQUAL_UINT32(9, coalesced() - coalesced_before);
+
+    // Nothing new, nothing sent
+    volume.handle();
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.set_requests);
+}
+
+/*
+ * Relative changes before the volume is known read
+ * it once, then send the sum of them
+ */
+void test_adjust_burst()
+{
+    Volume volume;
+
+    volume.begin(&s_sonos);
+
+    for (uint8_t i = 0; i < 4; i++) volume.adjust(5);
+
+    volume.adjust(-2);
+    volume.handle();
+
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.get_requests);
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.set_requests);
+    TEST_ASSERT_EQUAL(10 + 20 - 2, s_kitchen.volume);
+
+    // Now it's known, relative changes don't read it again
+    volume.adjust(-8);
+    volume.adjust(-8);
+    volume.handle();
+
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.get_requests);
+    TEST_ASSERT_EQUAL_UINT32(2, s_kitchen.set_requests);
+    TEST_ASSERT_EQUAL(12, s_kitchen.volume);
+
+    // And stop at 0
+    volume.adjust(-50);
+    volume.handle();
+    TEST_ASSERT_EQUAL(0, s_kitchen.volume);
+}
+
+void test_caps()
+{
+    Volume volume;
+
+    volume.begin(&s_sonos);
+
+    TEST_ASSERT_TRUE(volume.setCap(s_kitchen.serial_num, strlen(s_kitchen.serial_num), 40));
+    TEST_ASSERT_TRUE(volume.setCap("", 0, 60));
+
+    TEST_ASSERT_EQUAL(40, volume.getCap(s_sonos.getClient(0)));
+    TEST_ASSERT_EQUAL(60, volume.getCap(s_sonos.getClient(1)));
+
+    volume.set(90);
+    volume.handle();
+    TEST_ASSERT_EQUAL(40, s_kitchen.volume);
+
+    // Another speaker, with the default cap
+    TEST_ASSERT_TRUE(s_sonos.setActiveClient(s_lounge.serial_num));
+    volume.set(90);
+    volume.handle();
+    TEST_ASSERT_EQUAL(60, s_lounge.volume);
+
+    // Lowering the cap turns the active speaker down
+    TEST_ASSERT_TRUE(volume.setCap("", 0, 30));
+    volume.handle();
+    TEST_ASSERT_EQUAL(30, s_lounge.volume);
+    TEST_ASSERT_EQUAL(40, s_kitchen.volume);
+    TEST_ASSERT_EQUAL_UINT32(3, s_kitchen.set_requests + s_lounge.set_requests);
+}
+
+/*
+ * What's known about one speaker's volume isn't
+ * used for the next
+ */
+void test_speaker_change()
+{
+    Volume volume;
+
+    volume.begin(&s_sonos);
+
+    volume.set(30);
+    volume.handle();
+
+    TEST_ASSERT_TRUE(s_sonos.setActiveClient(s_lounge.serial_num));
+    s_lounge.volume = 70;
+
+    volume.adjust(5);
+    volume.handle();
+
+    TEST_ASSERT_EQUAL_UINT32(0, s_kitchen.get_requests);
+    TEST_ASSERT_EQUAL_UINT32(1, s_lounge.get_requests);
+    TEST_ASSERT_EQUAL(75, s_lounge.volume);
+}
+
+/*
+ * A failed request isn't retried every run
+ */
+void test_failure()
+{
+    Volume volume;
+
+    volume.begin(&s_sonos);
+    s_kitchen.fail = true;
+
+    volume.set(30);
+    volume.handle();
+    volume.handle();
+
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.set_requests);
+    TEST_ASSERT_EQUAL(VOLUME_UNKNOWN, volume.getVolume());
+
+    volume.adjust(5);
+    volume.handle();
+    volume.handle();
+
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.get_requests);
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.set_requests);
+
+    // Nothing to send to without an active speaker
+    s_kitchen.fail = false;
+    volume.begin(&s_no_speakers);
+    volume.set(30);
+    volume.handle();
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.set_requests);
+}
+
+/*
+ * A ramp sends one step per run, each closer to the
+ * target, and finishes on it
+ */
+void test_ramp()
+{
+    Volume volume;
+    uint8_t last = 10;
+
+    volume.begin(&s_sonos);
+    volume.set(50, 200);
+
+    unsigned long start = millis();
+
+    while ((millis() - start) < 400)
+    {
+        uint32_t requests = s_kitchen.set_requests;
+
+        volume.handle();
+
+        TEST_ASSERT_TRUE((s_kitchen.set_requests - requests) <= 1);
+        TEST_ASSERT_TRUE(s_kitchen.volume >= last);
+        last = s_kitchen.volume;
+
+        delay(20);
+    }
+
+    TEST_ASSERT_EQUAL(50, s_kitchen.volume);
+    TEST_ASSERT_TRUE(s_kitchen.set_requests > 2);
+    TEST_ASSERT_TRUE(s_kitchen.set_requests <= 21);
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.get_requests);
+}
+
+/*
+ * Flushing skips the rest of a ramp
+ */
+void test_flush()
+{
+    Volume volume;
+
+    volume.begin(&s_sonos);
+    TEST_ASSERT_TRUE(volume.flush());
+
+    volume.set(50, 10000);
+    TEST_ASSERT_TRUE(volume.flush());
+
+    TEST_ASSERT_EQUAL(50, s_kitchen.volume);
+    TEST_ASSERT_EQUAL_UINT32(1, s_kitchen.set_requests);
+
+    s_kitchen.fail = true;
+    volume.set(20);
+    TEST_ASSERT_FALSE(volume.flush());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_burst_coalesces);
+    RUN_TEST(test_adjust_burst);
+    RUN_TEST(test_caps);
+    RUN_TEST(test_speaker_change);
+    RUN_TEST(test_failure);
+    RUN_TEST(test_ramp);
+    RUN_TEST(test_flush);
+    return UNITY_END();
+}
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Reads a capture of Sonos traffic from the music box's /capture endpoint.
+
+    curl http://musicbox.local/capture?start
+    ... tap some cards ...
+    curl http://musicbox.local/capture?stop
+    curl -s http://musicbox.local/capture > capture.bin
+    python3 tools/capture.py capture.bin
+
+Lists every datagram and HTTP exchange with its timing. With
+--exchanges, lists each request with how long the speaker took to
+answer. tools/sonossim.py --replay capture.bin plays the speakers'
+side back.
+"""
+
+import argparse
+import collections
+import socket
+import struct
+import sys
+
+FILE_MAGIC = 0x31504143  # "CAP1"
+FILE_HEADER = struct.Struct("<II")  # Magic, millis at the start
+RECORD_HEADER = struct.Struct("<BHII")  # Type, length, micros, address
+
+SSDP_SENT, SSDP_RECEIVED, HTTP_REQUEST, HTTP_STATUS, HTTP_BODY, HTTP_END = range(6)
+TYPE_NAMES = ["ssdp-sent", "ssdp-received", "request", "status", "body", "end"]
+
+Record = collections.namedtuple("Record", "type micros ip data")
+
+
+class Exchange:
+    """One HTTP request and what came back"""
+
+    def __init__(self, ip, micros, request):
+        self.ip = ip
+        self.start = micros
+        head, _, self.payload = request.partition(b"\r\n\r\n")
+        lines = head.decode("utf-8", "replace").split("\r\n")
+        self.method, _, self.path = lines[0].partition(" ")
+        self.action = ""
+        for line in lines[1:]:
+            if line.upper().startswith("SOAPACTION:"):
+                self.action = line.split(":", 1)[1].strip()
+        self.status = None
+        self.status_micros = None
+        self.body = b""
+        self.end_micros = None
+
+    def latency_us(self):
+        return None if self.status_micros is None else (self.status_micros - self.start) & 0xFFFFFFFF
+
+
+def read_capture(data):
+    """Returns the records of a capture, as a list of Record"""
+    magic, _ = FILE_HEADER.unpack_from(data, 0)
+    if magic != FILE_MAGIC:
+        raise ValueError("Not a capture (bad magic)")
+
+    records = []
+    pos = FILE_HEADER.size
+
+    while pos + RECORD_HEADER.size <= len(data):
+        record_type, length, micros, ip = RECORD_HEADER.unpack_from(data, pos)
+        pos += RECORD_HEADER.size
+
+        if pos + length > len(data):
+            print("Capture cut short at offset %d" % pos, file=sys.stderr)
+            break
+
+        # Addresses are in network order in memory
+        records.append(Record(record_type, micros, socket.inet_ntoa(struct.pack("<I", ip)), data[pos:pos + length]))
+        pos += length
+
+    return records
+
+
+def exchanges(records):
+    """Pairs requests up with their status, body and end"""
+    open_exchanges = {}
+    done = []
+
+    for record in records:
+        if record.type == HTTP_REQUEST:
+            if record.ip in open_exchanges:
+                done.append(open_exchanges.pop(record.ip))
+            open_exchanges[record.ip] = Exchange(record.ip, record.micros, record.data)
+            continue
+
+        exchange = open_exchanges.get(record.ip)
+        if not exchange:
+            continue
+
+        if record.type == HTTP_STATUS:
+            exchange.status = struct.unpack("<h", record.data)[0]
+            exchange.status_micros = record.micros
+        elif record.type == HTTP_BODY:
+            exchange.body += record.data
+        elif record.type == HTTP_END:
+            exchange.end_micros = record.micros
+            done.append(open_exchanges.pop(record.ip))
+
+    done.extend(open_exchanges.values())
+    return sorted(done, key=lambda exchange: exchange.start)
+
+
+def summary(record):
+    if record.type in (SSDP_SENT, SSDP_RECEIVED, HTTP_REQUEST):
+        first_line = record.data.split(b"\r\n", 1)[0].decode("utf-8", "replace")
+        if record.type == HTTP_REQUEST:
+            action = [line for line in record.data.split(b"\r\n") if line.upper().startswith(b"SOAPACTION:")]
+            if action:
+                first_line += "  " + action[0].split(b"#")[-1].strip(b'" ').decode("utf-8", "replace")
+        return "%s (%d bytes)" % (first_line, len(record.data))
+    if record.type == HTTP_STATUS:
+        return str(struct.unpack("<h", record.data)[0])
+    if record.type == HTTP_BODY:
+        return "%d bytes" % len(record.data)
+    return ""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="file saved from /capture")
+    parser.add_argument("--exchanges", action="store_true", help="list requests and their response times")
+    args = parser.parse_args()
+
+    with open(args.capture, "rb") as capture:
+        records = read_capture(capture.read())
+
+    if not records:
+        return
+
+    start = records[0].micros
+
+    if args.exchanges:
+        for exchange in exchanges(records):
+            latency = exchange.latency_us()
+            print("%10.3f %-15s %-4s %-40s %-28s %5s %8s ms %7d bytes" % (
+                ((exchange.start - start) & 0xFFFFFFFF) / 1000.0, exchange.ip, exchange.method,
+                exchange.path[-40:], exchange.action.split("#")[-1].strip('"'),
+                exchange.status, "-" if latency is None else "%.1f" % (latency / 1000.0), len(exchange.body)))
+        return
+
+    for record in records:
+        print("%10.3f %-15s %-13s %s" % (((record.micros - start) & 0xFFFFFFFF) / 1000.0, record.ip,
+                                         TYPE_NAMES[record.type] if record.type < len(TYPE_NAMES) else record.type,
+                                         summary(record)))
+
+
+if __name__ == "__main__":
+    main()
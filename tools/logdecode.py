@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Decodes a binary log dump from the music box's /log endpoint.
+
+    curl -s http://musicbox.local/log > log.bin
+    python3 tools/logdecode.py log.bin
+
+Message formats are read from LOG_MESSAGES in src/Log.h, so
+decode with the source the firmware was built from.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+DUMP_MAGIC = b"LOG1"
+HEADER = struct.Struct("<BBI")  # Length, id, millis
+LEVELS = {"DEBUG": "D", "INFO": "I", "WARN": "W", "ERROR": "E"}
+ENTRY = re.compile(r'^\s*X\((\w+),\s*(\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+
+
+def load_messages(header_path):
+    messages = []
+    in_table = False
+
+    with open(header_path) as header:
+        for line in header:
+            if line.startswith("#define LOG_MESSAGES(X)"):
+                in_table = True
+                continue
+
+            if not in_table:
+                continue
+
+            match = ENTRY.match(line)
+            if match:
+                messages.append((match.group(1), LEVELS[match.group(2)], match.group(3)))
+
+            if not line.rstrip().endswith("\\"):
+                break
+
+    return messages
+
+
+def format_record(message, args):
+    _, level, fmt = message
+    out = []
+    i = 0
+    pos = 0
+
+    while i < len(fmt):
+        if fmt[i] != "%" or i + 1 >= len(fmt):
+            out.append(fmt[i])
+            i += 1
+            continue
+
+        spec = fmt[i + 1]
+        i += 2
+
+        if spec == "s":
+            length = args[pos] if pos < len(args) else 0
+            out.append(args[pos + 1:pos + 1 + length].decode("utf-8", "replace"))
+            pos += 1 + length
+            continue
+
+        value = struct.unpack_from("<I", args, pos)[0] if pos + 4 <= len(args) else 0
+        pos += 4
+
+        if spec == "d":
+            out.append(str(struct.unpack("<i", struct.pack("<I", value))[0]))
+        elif spec == "a":
+            out.append(".".join(str(b) for b in struct.pack("<I", value)))
+        else:
+            out.append(str(value))
+
+    return level, "".join(out)
+
+
+def decode(data, messages, out):
+    if data[:4] != DUMP_MAGIC:
+        sys.exit("Not a log dump (bad magic)")
+
+    pos = 4
+    while pos + HEADER.size <= len(data):
+        length, message_id, millis = HEADER.unpack_from(data, pos)
+
+        if length < HEADER.size or pos + length > len(data):
+            sys.exit("Truncated record at offset %d" % pos)
+
+        args = data[pos + HEADER.size:pos + length]
+        pos += length
+
+        if message_id < len(messages):
+            level, text = format_record(messages[message_id], args)
+        else:
+            level, text = "?", "unknown message %d" % message_id
+
+        out.write("%d.%03d %s %s\n" % (millis // 1000, millis % 1000, level, text))
+
+
+def main():
+    default_header = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "Log.h")
+
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", help="file saved from /log, or - for stdin")
+    parser.add_argument("--header", default=default_header, help="Log.h to read message formats from")
+    args = parser.parse_args()
+
+    data = sys.stdin.buffer.read() if args.dump == "-" else open(args.dump, "rb").read()
+
+    decode(data, load_messages(args.header), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,556 @@
+#!/usr/bin/env python3
+"""
+Simulates a household of Sonos speakers, for trying out the music box
+without real speakers, or with more speakers than you own.
+
+Each simulated speaker needs its own IP address, as the music box
+always talks to port 1400. On Linux, the whole of 127.0.0.0/8 is
+loopback, so for a build running on the same machine:
+
+    python3 tools/sonossim.py --speakers 20 --base-address 127.0.1.1
+
+The native test test_simulator (pio test -e native -f test_simulator)
+starts it like this and runs the firmware's Sonos against it.
+
+For the music box itself, add spare addresses on your LAN to this
+machine's interface (e.g. ip addr add 192.168.1.201/24 dev eth0) and
+start from there. Fault injection:
+
+    --latency 80 --jitter 40    add 80ms +/- 40ms to every response
+    --loss 0.05                 drop 5% of SSDP replies and SOAP requests
+    --error-rate 0.02           answer 2% of SOAP requests with a fault
+
+Speakers answer SSDP M-SEARCH, serve /xml/device_description.xml,
+and implement the AVTransport, RenderingControl, MusicServices and
+ZoneGroupTopology actions the music box uses. GENA subscriptions are
+accepted and NOTIFYs sent when a speaker's state changes.
+MusicServices answers with the recorded response in html/resp.txt.
+Press Ctrl-C for a count of requests per speaker and action.
+
+With --replay capture.bin (see tools/capture.py), there's one speaker
+for each speaker in the capture, answering discovery, the device
+description and each SOAP action with what that speaker sent back
+when it was captured. Add --replay-timing to also wait as long as it
+did. Actions that weren't captured are simulated as usual.
+"""
+
+import argparse
+import collections
+import ipaddress
+import os
+import random
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+import urllib.request
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+import capture
+
+SSDP_ADDR = "239.255.255.250"
+SSDP_PORT = 1900
+SOAP_PORT = 1400
+ZONE_PLAYER = "urn:schemas-upnp-org:device:ZonePlayer:1"
+ROOMS = ["Kitchen", "Living Room", "Bedroom", "Office", "Bathroom", "Dining Room",
+         "Study", "Garage", "Patio", "Nursery", "Hallway", "Den"]
+
+SOAP_ENVELOPE = ('<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" '
+                 's:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/"><s:Body>%s</s:Body></s:Envelope>')
+SOAP_FAULT = ('<s:Fault><faultcode>s:Client</faultcode><faultstring>UPnPError</faultstring><detail>'
+              '<UPnPError xmlns="urn:schemas-upnp-org:control-1-0"><errorCode>%d</errorCode></UPnPError>'
+              '</detail></s:Fault>')
+
+DEVICE_DESCRIPTION = """<?xml version="1.0" encoding="utf-8" ?>
+<root xmlns="urn:schemas-upnp-org:device-1-0">
+<specVersion><major>1</major><minor>0</minor></specVersion>
+<device>
+<deviceType>urn:schemas-upnp-org:device:ZonePlayer:1</deviceType>
+<friendlyName>{ip} - Sonos One - {uuid}</friendlyName>
+<manufacturer>Sonos, Inc.</manufacturer>
+<modelNumber>S18</modelNumber>
+<modelName>Sonos One</modelName>
+<softwareVersion>56.0-76060</softwareVersion>
+<serialNum>{serial}</serialNum>
+<UDN>uuid:{uuid}</UDN>
+<roomName>{room}</roomName>
+<displayName>One</displayName>
+<deviceList>
+<device><deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType><UDN>uuid:{uuid}_MR</UDN></device>
+<device><deviceType>urn:schemas-upnp-org:device:MediaServer:1</deviceType><UDN>uuid:{uuid}_MS</UDN></device>
+</deviceList>
+</device>
+</root>
+"""
+
+
+def load_services_response(path):
+    """The response body of the recorded ListAvailableServices call"""
+    try:
+        with open(path) as recording:
+            text = recording.read()
+    except OSError:
+        return None
+
+    start = text.find("<s:Envelope", text.find("Response Body"))
+    return text[start:].strip() if start >= 0 else None
+
+
+def argument(body, name):
+    match = re.search(r"<%s>(.*?)</%s>" % (name, name), body, re.S)
+    return match.group(1) if match else ""
+
+
+class Faults:
+    def __init__(self, latency, jitter, loss, error_rate):
+        self.latency = latency / 1000.0
+        self.jitter = jitter / 1000.0
+        self.loss = loss
+        self.error_rate = error_rate
+
+    def delay(self):
+        wait = self.latency + random.uniform(-self.jitter, self.jitter)
+        if wait > 0:
+            time.sleep(wait)
+
+    def drop(self):
+        return random.random() < self.loss
+
+    def error(self):
+        return random.random() < self.error_rate
+
+
+class Speaker:
+    def __init__(self, index, ip):
+        self.ip = ip
+        self.room = ROOMS[index % len(ROOMS)] + ("" if index < len(ROOMS) else " %d" % (index // len(ROOMS) + 1))
+        mac = "B8E937%06X" % (0xD60000 + index)
+        self.uuid = "RINCON_%s01400" % mac
+        self.serial = "B8-E9-37-%s-%s-%s:%d" % (mac[6:8], mac[8:10], mac[10:12], 7 + index % 3)
+        self.lock = threading.Lock()
+        self.state = {
+            "TransportState": "STOPPED",
+            "CurrentURI": "",
+            "PlayMode": "NORMAL",
+            "Volume": 20,
+            "SleepTimer": "",
+            "Coordinator": self.uuid,
+        }
+        self.subscriptions = {}  # sid -> (callback url, event path, sequence)
+        self.counts = collections.Counter()
+        self.replay = {}  # (method, action or path) -> deque of (status, body, latency s)
+        self.replay_ssdp = None
+
+    def location(self):
+        return "http://%s:%d/xml/device_description.xml" % (self.ip, SOAP_PORT)
+
+    def description(self):
+        return DEVICE_DESCRIPTION.format(ip=self.ip, uuid=self.uuid, serial=self.serial, room=self.room)
+
+    def ssdp_response(self):
+        if self.replay_ssdp:
+            return self.replay_ssdp
+
+        # Same header order as a real speaker, LOCATION near the top
+        return ("HTTP/1.1 200 OK\r\n"
+                "CACHE-CONTROL: max-age = 1800\r\n"
+                "EXT:\r\n"
+                "LOCATION: %s\r\n"
+                "SERVER: Linux UPnP/1.0 Sonos/56.0-76060 (ZPS18)\r\n"
+                "ST: %s\r\n"
+                "USN: uuid:%s::%s\r\n"
+                "X-RINCON-HOUSEHOLD: Sonos_simulated\r\n"
+                "X-RINCON-BOOTSEQ: 3\r\n"
+                "\r\n" % (self.location(), ZONE_PLAYER, self.uuid, ZONE_PLAYER)).encode()
+
+
+class Household:
+    def __init__(self, speakers, faults, services_response):
+        self.speakers = speakers
+        self.faults = faults
+        self.services_response = services_response
+
+    def by_uuid(self, speaker_uuid):
+        for speaker in self.speakers:
+            if speaker.uuid == speaker_uuid:
+                return speaker
+        return None
+
+    def zone_group_state(self):
+        groups = collections.defaultdict(list)
+        for speaker in self.speakers:
+            groups[speaker.state["Coordinator"]].append(speaker)
+
+        xml = ["<ZoneGroups>"]
+        for coordinator, members in groups.items():
+            xml.append('<ZoneGroup Coordinator="%s" ID="%s:1">' % (coordinator, coordinator))
+            for member in members:
+                xml.append('<ZoneGroupMember UUID="%s" Location="%s" ZoneName="%s"/>'
+                           % (member.uuid, member.location(), member.room))
+            xml.append("</ZoneGroup>")
+        xml.append("</ZoneGroups>")
+
+        return "".join(xml).replace("&", "&amp;").replace("<", "&lt;").replace(">", "&gt;").replace('"', "&quot;")
+
+    def perform(self, speaker, service, action, body):
+        """Returns the response arguments, or an error code"""
+        state = speaker.state
+
+        if service == "AVTransport":
+            if action == "SetAVTransportURI":
+                uri = argument(body, "CurrentURI")
+                if uri.startswith("x-rincon:"):
+                    if not self.by_uuid(uri[9:]):
+                        return 701
+                    state["Coordinator"] = uri[9:]
+                else:
+                    state["Coordinator"] = speaker.uuid
+                state["CurrentURI"] = uri
+                state["TransportState"] = "STOPPED"
+            elif action == "Play":
+                if not state["CurrentURI"]:
+                    return 701
+                state["TransportState"] = "PLAYING"
+            elif action in ("Pause", "Stop"):
+                if state["Coordinator"] != speaker.uuid:
+                    return 701
+                state["TransportState"] = "PAUSED_PLAYBACK" if action == "Pause" else "STOPPED"
+            elif action in ("Next", "Previous"):
+                if state["TransportState"] == "STOPPED":
+                    return 711
+            elif action == "SetPlayMode":
+                state["PlayMode"] = argument(body, "NewPlayMode")
+            elif action == "ConfigureSleepTimer":
+                state["SleepTimer"] = argument(body, "NewSleepTimerDuration")
+            elif action == "GetTransportInfo":
+                return "<CurrentTransportState>%s</CurrentTransportState>" % state["TransportState"]
+            else:
+                return 401
+        elif service == "RenderingControl":
+            if action == "SetVolume":
+                try:
+                    state["Volume"] = max(0, min(100, int(argument(body, "DesiredVolume"))))
+                except ValueError:
+                    return 402
+            elif action == "GetVolume":
+                return "<CurrentVolume>%d</CurrentVolume>" % state["Volume"]
+            else:
+                return 401
+        elif service == "MusicServices":
+            if action != "ListAvailableServices" or not self.services_response:
+                return 401
+        elif service == "ZoneGroupTopology":
+            if action != "GetZoneGroupState":
+                return 401
+            return "<ZoneGroupState>%s</ZoneGroupState>" % self.zone_group_state()
+        else:
+            return 401
+
+        return ""
+
+
+def load_replay(path, base):
+    """Speakers that answer as the ones in a capture did"""
+    with open(path, "rb") as capture_file:
+        records = capture.read_capture(capture_file.read())
+
+    addresses = []
+    for record in records:
+        if record.type != capture.SSDP_SENT and record.ip not in addresses:
+            addresses.append(record.ip)
+
+    speakers = []
+    for index, address in enumerate(addresses):
+        speaker = Speaker(index, str(base + index))
+
+        for record in records:
+            if record.type == capture.SSDP_RECEIVED and record.ip == address:
+                # Point the LOCATION at the simulated speaker
+                speaker.replay_ssdp = re.sub(rb"(?im)^(LOCATION: http://)[^:/]+", rb"\g<1>" + speaker.ip.encode(),
+                                             record.data)
+                break
+
+        for exchange in capture.exchanges(records):
+            if exchange.ip != address or exchange.status is None:
+                continue
+
+            if exchange.method == "GET":
+                key = ("GET", "/xml/device_description.xml")
+                for field, name in (("room", "roomName"), ("serial", "serialNum")):
+                    value = argument(exchange.body.decode("utf-8", "replace"), name)
+                    if value:
+                        setattr(speaker, field, value)
+            else:
+                key = ("POST", exchange.action.strip('"'))
+
+            latency = (exchange.latency_us() or 0) / 1000000.0
+            speaker.replay.setdefault(key, collections.deque()).append((exchange.status, exchange.body, latency))
+
+        speakers.append(speaker)
+
+    return speakers
+
+
+def replayed(speaker, key):
+    """The next captured response, going round again at the end"""
+    with speaker.lock:
+        responses = speaker.replay.get(key)
+        if not responses:
+            return None
+        response = responses[0]
+        responses.rotate(-1)
+        return response
+
+
+def notify(speaker, sid, faults):
+    """Sends the speaker's state to a GENA subscriber"""
+    with speaker.lock:
+        if sid not in speaker.subscriptions:
+            return
+        callback, path, sequence = speaker.subscriptions[sid]
+        speaker.subscriptions[sid] = (callback, path, sequence + 1)
+        state = dict(speaker.state)
+
+    last_change = ('<Event xmlns="urn:schemas-upnp-org:metadata-1-0/AVT/"><InstanceID val="0">'
+                   '<TransportState val="%s"/><CurrentPlayMode val="%s"/><AVTransportURI val="%s"/>'
+                   '<Volume channel="Master" val="%d"/></InstanceID></Event>'
+                   % (state["TransportState"], state["PlayMode"], state["CurrentURI"], state["Volume"]))
+    last_change = last_change.replace("&", "&amp;").replace("<", "&lt;").replace(">", "&gt;").replace('"', "&quot;")
+    body = ('<e:propertyset xmlns:e="urn:schemas-upnp-org:event-1-0"><e:property>'
+            '<LastChange>%s</LastChange></e:property></e:propertyset>' % last_change).encode()
+
+    request = urllib.request.Request(callback, data=body, method="NOTIFY", headers={
+        "Content-Type": 'text/xml; charset="utf-8"',
+        "NT": "upnp:event",
+        "NTS": "upnp:propchange",
+        "SID": sid,
+        "SEQ": str(sequence),
+    })
+
+    try:
+        faults.delay()
+        urllib.request.urlopen(request, timeout=2).close()
+    except OSError:
+        # Subscriber has gone away
+        with speaker.lock:
+            speaker.subscriptions.pop(sid, None)
+
+
+def make_handler(household, speaker, replay_timing):
+    faults = household.faults
+
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+        server_version = "Linux UPnP/1.0 Sonos/56.0-76060 (ZPS18)"
+        sys_version = ""
+
+        def log_message(self, format, *args):
+            pass
+
+        def reply(self, code, body=b"", content_type='text/xml; charset="utf-8"', headers=None):
+            self.send_response(code)
+            self.send_header("Content-Type", content_type)
+            self.send_header("Content-Length", str(len(body)))
+            for name, value in (headers or {}).items():
+                self.send_header(name, value)
+            self.end_headers()
+            self.wfile.write(body)
+
+        def play_back(self, response):
+            status, body, latency = response
+
+            if replay_timing:
+                time.sleep(latency)
+
+            if status <= 0:
+                # HTTPClient error, e.g. a timeout, so don't answer
+                self.close_connection = True
+                return
+
+            self.reply(status, body)
+
+        def do_GET(self):
+            speaker.counts["GET " + self.path] += 1
+            faults.delay()
+
+            response = replayed(speaker, ("GET", self.path))
+            if response:
+                self.play_back(response)
+            elif self.path == "/xml/device_description.xml":
+                self.reply(200, speaker.description().encode())
+            else:
+                self.reply(404)
+
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode("utf-8", "replace")
+            match = re.match(r'"?urn:schemas-upnp-org:service:(\w+):1#(\w+)"?', self.headers.get("SOAPACTION", ""))
+
+            if not match:
+                self.reply(400)
+                return
+
+            service, action = match.groups()
+            speaker.counts[service + "#" + action] += 1
+
+            if faults.drop():
+                # As if the speaker never answered
+                self.close_connection = True
+                time.sleep(5)
+                return
+
+            faults.delay()
+
+            response = replayed(speaker, ("POST", "urn:schemas-upnp-org:service:%s:1#%s" % (service, action)))
+            if response:
+                self.play_back(response)
+                return
+
+            with speaker.lock:
+                result = 501 if faults.error() else household.perform(speaker, service, action, body)
+
+            if isinstance(result, int):
+                self.reply(500, (SOAP_ENVELOPE % (SOAP_FAULT % result)).encode())
+                return
+
+            if service == "MusicServices":
+                self.reply(200, household.services_response.encode())
+            else:
+                response = '<u:%sResponse xmlns:u="urn:schemas-upnp-org:service:%s:1">%s</u:%sResponse>' % (
+                    action, service, result, action)
+                self.reply(200, (SOAP_ENVELOPE % response).encode())
+
+            if action.startswith("Set") or action in ("Play", "Pause", "Stop"):
+                for sid in list(speaker.subscriptions):
+                    threading.Thread(target=notify, args=(speaker, sid, faults), daemon=True).start()
+
+        def do_SUBSCRIBE(self):
+            speaker.counts["SUBSCRIBE " + self.path] += 1
+            sid = self.headers.get("SID")
+
+            with speaker.lock:
+                if sid:
+                    # Renewal
+                    if sid not in speaker.subscriptions:
+                        self.reply(412)
+                        return
+                else:
+                    callback = re.match(r"<([^>]+)>", self.headers.get("CALLBACK", ""))
+                    if not callback:
+                        self.reply(412)
+                        return
+                    sid = "uuid:%s_sub%s" % (speaker.uuid, uuid.uuid4().hex[:10])
+                    speaker.subscriptions[sid] = (callback.group(1), self.path, 0)
+
+            self.reply(200, headers={"SID": sid, "TIMEOUT": self.headers.get("TIMEOUT", "Second-3600")})
+
+            # Initial event, as a real speaker sends
+            threading.Thread(target=notify, args=(speaker, sid, faults), daemon=True).start()
+
+        def do_UNSUBSCRIBE(self):
+            speaker.counts["UNSUBSCRIBE " + self.path] += 1
+
+            with speaker.lock:
+                found = speaker.subscriptions.pop(self.headers.get("SID"), None)
+
+            self.reply(200 if found else 412)
+
+    return Handler
+
+
+def serve_ssdp(household, interface):
+    listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("", SSDP_PORT))
+    listener.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+                        struct.pack("4s4s", socket.inet_aton(SSDP_ADDR), socket.inet_aton(interface)))
+
+    # Replies come from each speaker's own address, which is
+    # what the music box takes as the speaker's IP
+    senders = {}
+    for speaker in household.speakers:
+        sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sender.bind((speaker.ip, 0))
+        senders[speaker.ip] = sender
+
+    while True:
+        data, address = listener.recvfrom(2048)
+        text = data.decode("utf-8", "replace")
+
+        if not text.startswith("M-SEARCH") or (ZONE_PLAYER not in text and "ssdp:all" not in text):
+            continue
+
+        mx = re.search(r"^MX:\s*(\d+)", text, re.M | re.I)
+        window = min(int(mx.group(1)), 5) if mx else 1
+
+        for speaker in household.speakers:
+            if household.faults.drop():
+                continue
+
+            speaker.counts["M-SEARCH"] += 1
+
+            # Real speakers spread their replies across MX seconds
+            delay = random.uniform(0, window) + household.faults.latency
+            threading.Timer(delay, senders[speaker.ip].sendto, (speaker.ssdp_response(), address)).start()
+
+
+def main():
+    default_recording = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "html", "resp.txt")
+
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--speakers", type=int, default=3, help="number of speakers, 1 to 100")
+    parser.add_argument("--base-address", default="127.0.1.1", help="address of the first speaker, the rest follow on")
+    parser.add_argument("--interface", default="0.0.0.0", help="address of the interface to listen for SSDP on")
+    parser.add_argument("--latency", type=float, default=0, help="ms added to every response")
+    parser.add_argument("--jitter", type=float, default=0, help="ms either side of the latency")
+    parser.add_argument("--loss", type=float, default=0, help="fraction of SSDP replies and SOAP requests dropped")
+    parser.add_argument("--error-rate", type=float, default=0, help="fraction of SOAP requests answered with a fault")
+    parser.add_argument("--recording", default=default_recording, help="recorded ListAvailableServices response")
+    parser.add_argument("--replay", help="capture to answer with, from /capture")
+    parser.add_argument("--replay-timing", action="store_true", help="answer as slowly as the captured speakers did")
+    args = parser.parse_args()
+
+    if not 1 <= args.speakers <= 100:
+        parser.error("--speakers must be between 1 and 100")
+
+    base = ipaddress.IPv4Address(args.base_address)
+
+    if args.replay:
+        speakers = load_replay(args.replay, base)
+        if not speakers:
+            sys.exit("No speakers in %s" % args.replay)
+    else:
+        speakers = [Speaker(i, str(base + i)) for i in range(args.speakers)]
+    faults = Faults(args.latency, args.jitter, args.loss, args.error_rate)
+    household = Household(speakers, faults, load_services_response(args.recording))
+
+    if not household.services_response:
+        print("No recorded services response in %s, MusicServices will fault" % args.recording, file=sys.stderr)
+
+    for speaker in speakers:
+        try:
+            server = ThreadingHTTPServer((speaker.ip, SOAP_PORT), make_handler(household, speaker, args.replay_timing))
+        except OSError as error:
+            sys.exit("Can't listen on %s:%d (%s), is the address on an interface?" % (speaker.ip, SOAP_PORT, error))
+
+        server.daemon_threads = True
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        print("%-15s %-14s %s" % (speaker.ip, speaker.room, speaker.serial))
+
+    threading.Thread(target=serve_ssdp, args=(household, args.interface), daemon=True).start()
+
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+
+    for speaker in speakers:
+        for request, count in sorted(speaker.counts.items()):
+            print("%-15s %-40s %d" % (speaker.ip, request, count))
+
+
+if __name__ == "__main__":
+    main()